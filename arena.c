@@ -0,0 +1,180 @@
+#include "vcs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16U
+#define ARENA_DEFAULT_BLOCK (64U * 1024U)
+#define ARENA_MAX_BLOCK (4U * 1024U * 1024U)
+
+/*
+ * Blocks are chained newest first and only ever bumped. Each new block doubles the size of
+ * the previous one (up to ARENA_MAX_BLOCK), so a load of N records touches O(log N) blocks.
+ */
+struct ArenaBlock
+{
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+    size_t last;
+};
+
+static size_t align_up(size_t n)
+{
+    return (n + (ARENA_ALIGN - 1U)) & ~(size_t)(ARENA_ALIGN - 1U);
+}
+
+static char *block_data(ArenaBlock *block)
+{
+    return (char *)block + align_up(sizeof(ArenaBlock));
+}
+
+void arena_init(Arena *arena, size_t block_size)
+{
+    arena->head = NULL;
+    arena->block_size = block_size == 0U ? ARENA_DEFAULT_BLOCK : align_up(block_size);
+    arena->used = 0U;
+}
+
+static ArenaBlock *arena_new_block(Arena *arena, size_t min_size)
+{
+    size_t size = arena->block_size;
+    ArenaBlock *block;
+
+    while (size < min_size)
+    {
+        size *= 2U;
+    }
+
+    block = (ArenaBlock *)malloc(align_up(sizeof(ArenaBlock)) + size);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    block->next = arena->head;
+    block->size = size;
+    block->used = 0U;
+    block->last = 0U;
+    arena->head = block;
+
+    if (arena->block_size < ARENA_MAX_BLOCK)
+    {
+        arena->block_size *= 2U;
+    }
+
+    return block;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    ArenaBlock *block = arena->head;
+    size_t need = align_up(size == 0U ? 1U : size);
+    void *ptr;
+
+    if (block == NULL || block->size - block->used < need)
+    {
+        block = arena_new_block(arena, need);
+        if (block == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    ptr = block_data(block) + block->used;
+    block->last = block->used;
+    block->used += need;
+    arena->used += need;
+    return ptr;
+}
+
+/*
+ * Resizes the most recent allocation in place when it still sits at the top of the current
+ * block; anything else is copied to a fresh allocation and the old bytes are simply left
+ * behind until the arena is reset.
+ */
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    ArenaBlock *block = arena->head;
+    void *next;
+
+    if (ptr == NULL)
+    {
+        return arena_alloc(arena, new_size);
+    }
+
+    if (new_size <= old_size)
+    {
+        return ptr;
+    }
+
+    if (block != NULL && (char *)ptr == block_data(block) + block->last &&
+        block->size - block->last >= align_up(new_size))
+    {
+        size_t need = align_up(new_size);
+
+        arena->used += need - (block->used - block->last);
+        block->used = block->last + need;
+        return ptr;
+    }
+
+    next = arena_alloc(arena, new_size);
+    if (next != NULL)
+    {
+        memcpy(next, ptr, old_size);
+    }
+    return next;
+}
+
+char *arena_strndup(Arena *arena, const char *text, size_t len)
+{
+    char *copy = (char *)arena_alloc(arena, len + 1U);
+
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+/* Keeps the newest (largest) block for the next operation and releases the rest. */
+void arena_reset(Arena *arena)
+{
+    ArenaBlock *block;
+
+    if (arena->head == NULL)
+    {
+        return;
+    }
+
+    block = arena->head->next;
+    while (block != NULL)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->head->next = NULL;
+    arena->head->used = 0U;
+    arena->head->last = 0U;
+    arena->used = 0U;
+}
+
+void arena_free(Arena *arena)
+{
+    ArenaBlock *block = arena->head;
+
+    while (block != NULL)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->head = NULL;
+    arena->used = 0U;
+}
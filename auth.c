@@ -5,92 +5,12 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int split_fields(char *line, char *fields[], size_t expected)
-{
-    size_t count = 0U;
-    char *start = line;
-    char *p;
-
-    for (p = line; ; p++)
-    {
-        if (*p == '|' || *p == '\0')
-        {
-            if (count >= expected)
-            {
-                return 0;
-            }
-            fields[count++] = start;
-            if (*p == '\0')
-            {
-                break;
-            }
-            *p = '\0';
-            start = p + 1;
-        }
-    }
-
-    return count == expected;
-}
-
 static int users_db_path(char path[VELOCE_PATH_LEN + 1])
 {
     return path_join(path, VELOCE_PATH_LEN + 1U, storage_root(), VELOCE_USERS_DB);
 }
 
-static int parse_user_line(const char *line, UserRecord *user)
-{
-    char scratch[2048];
-    char *fields[9];
-
-    if (line == NULL || user == NULL)
-    {
-        return 0;
-    }
-
-    if (snprintf(scratch, sizeof(scratch), "%s", line) >= (int)sizeof(scratch))
-    {
-        return 0;
-    }
-
-    if (!split_fields(scratch, fields, 9U))
-    {
-        return 0;
-    }
-
-    (void)snprintf(user->uid, sizeof(user->uid), "%s", fields[0]);
-    (void)snprintf(user->username, sizeof(user->username), "%s", fields[1]);
-    (void)snprintf(user->name, sizeof(user->name), "%s", fields[2]);
-    (void)snprintf(user->password_salt, sizeof(user->password_salt), "%s", fields[3]);
-    (void)snprintf(user->password_hash, sizeof(user->password_hash), "%s", fields[4]);
-    (void)snprintf(user->security_question, sizeof(user->security_question), "%s", fields[5]);
-    (void)snprintf(user->answer_salt, sizeof(user->answer_salt), "%s", fields[6]);
-    (void)snprintf(user->answer_hash, sizeof(user->answer_hash), "%s", fields[7]);
-    (void)snprintf(user->created_at, sizeof(user->created_at), "%s", fields[8]);
-
-    return 1;
-}
-
-static int write_user_line(FILE *fp, const UserRecord *user)
-{
-    if (fp == NULL || user == NULL)
-    {
-        return 0;
-    }
-
-    return fprintf(fp,
-                   "%s|%s|%s|%s|%s|%s|%s|%s|%s\n",
-                   user->uid,
-                   user->username,
-                   user->name,
-                   user->password_salt,
-                   user->password_hash,
-                   user->security_question,
-                   user->answer_salt,
-                   user->answer_hash,
-                   user->created_at) > 0;
-}
-
-static int is_valid_username(const char *username)
+int username_is_valid(const char *username)
 {
     size_t i;
 
@@ -115,49 +35,50 @@ static int is_valid_username(const char *username)
     return 1;
 }
 
-static int is_valid_password(const char *password)
+int password_is_valid(const char *password)
 {
     return password != NULL && strlen(password) >= 8U;
 }
 
-static int find_user_by_username(const char *username, UserRecord *result)
+int find_user_by_username(const char *username, UserRecord *result)
 {
-    FILE *fp;
+    DbScan scan;
     char path[VELOCE_PATH_LEN + 1];
-    char line[2048];
-    UserRecord current;
+    FieldSpan fields[VELOCE_USER_FIELDS];
+    UserRecord user;
+    uint64_t span;
 
     if (users_db_path(path) != 0)
     {
         return 0;
     }
 
-    fp = fopen(path, "rb");
-    if (fp == NULL)
+    span = trace_begin();
+    if (!db_scan_open(&scan, path))
     {
         return 0;
     }
 
-    while (fgets(line, sizeof(line), fp) != NULL)
+    while (db_scan_next(&scan, fields, VELOCE_USER_FIELDS))
     {
-        line[strcspn(line, "\r\n")] = '\0';
-        if (!parse_user_line(line, &current))
+        if (!span_equals(&fields[1], username))
         {
             continue;
         }
 
-        if (strcmp(current.username, username) == 0)
+        /* The fields may point into a mapping that closing the scan unmaps, so copy them first. */
+        (void)user_from_fields(fields, &user);
+        db_scan_close(&scan);
+        trace_end("scan users.db", span, 0U);
+        if (result != NULL)
         {
-            fclose(fp);
-            if (result != NULL)
-            {
-                *result = current;
-            }
-            return 1;
+            *result = user;
         }
+        return 1;
     }
 
-    fclose(fp);
+    db_scan_close(&scan);
+    trace_end("scan users.db", span, 0U);
     return 0;
 }
 
@@ -166,24 +87,33 @@ static int append_user(const UserRecord *user)
     FILE *fp;
     char path[VELOCE_PATH_LEN + 1];
     int ok;
+    uint64_t start;
 
     if (users_db_path(path) != 0)
     {
         return 0;
     }
 
+    start = stats_op_begin();
     fp = fopen(path, "ab");
     if (fp == NULL)
     {
         return 0;
     }
 
+    if (!change_log_append(fp, VELOCE_USERS_DB))
+    {
+        fclose(fp);
+        return 0;
+    }
+
     ok = write_user_line(fp, user);
     fclose(fp);
+    stats_op_end(STAT_OP_DB_APPEND, start);
     return ok;
 }
 
-static int update_user_password(const char *uid, const char *new_salt, const char *new_hash)
+static int update_user_password(const IdKey *uid, const char *new_salt, const char *new_hash)
 {
     char path[VELOCE_PATH_LEN + 1];
     char tmp_path[VELOCE_PATH_LEN + 1];
@@ -191,6 +121,7 @@ static int update_user_password(const char *uid, const char *new_salt, const cha
     FILE *out;
     char line[2048];
     int changed = 0;
+    uint64_t span;
 
     if (users_db_path(path) != 0)
     {
@@ -202,6 +133,7 @@ static int update_user_password(const char *uid, const char *new_salt, const cha
         return 0;
     }
 
+    span = trace_begin();
     in = fopen(path, "rb");
     out = fopen(tmp_path, "wb");
     if (in == NULL || out == NULL)
@@ -224,6 +156,8 @@ static int update_user_password(const char *uid, const char *new_salt, const cha
         char raw[2048];
 
         (void)snprintf(raw, sizeof(raw), "%s", line);
+        stats_add(STAT_RECORDS_SCANNED, 1U);
+        stats_add(STAT_BYTES_READ, strlen(raw));
 
         line[strcspn(line, "\r\n")] = '\0';
         if (!parse_user_line(line, &user))
@@ -238,7 +172,7 @@ static int update_user_password(const char *uid, const char *new_salt, const cha
             continue;
         }
 
-        if (strcmp(user.uid, uid) == 0)
+        if (id_key_equals(&user.uid, uid))
         {
             (void)snprintf(user.password_salt, sizeof(user.password_salt), "%s", new_salt);
             (void)snprintf(user.password_hash, sizeof(user.password_hash), "%s", new_hash);
@@ -255,9 +189,16 @@ static int update_user_password(const char *uid, const char *new_salt, const cha
     }
 
     fclose(in);
+    trace_end("rewrite users.db", span, 0U);
+    if (file_sync(out) != 0)
+    {
+        fclose(out);
+        remove(tmp_path);
+        return 0;
+    }
     fclose(out);
 
-    if (!changed)
+    if (!changed || !change_log_record(CHANGE_WRITE, VELOCE_USERS_DB, 0U))
     {
         remove(tmp_path);
         return 0;
@@ -273,292 +214,77 @@ static int update_user_password(const char *uid, const char *new_salt, const cha
     return 1;
 }
 
-static void set_session_from_user(Session *session, const UserRecord *user)
-{
-    (void)snprintf(session->uid, sizeof(session->uid), "%s", user->uid);
-    (void)snprintf(session->username, sizeof(session->username), "%s", user->username);
-    (void)snprintf(session->name, sizeof(session->name), "%s", user->name);
-}
-
-static int reset_password_flow(void)
+/*
+ * Adds an account. `user` supplies the username, name and security question; the id, salts,
+ * hashes and creation time are filled in here. Fails on an invalid or taken username or a
+ * password that is too short.
+ */
+int user_create(UserRecord *user, const char *password, const char *answer)
 {
-    char username[VELOCE_USERNAME_LEN + 1];
-    char answer[VELOCE_ANSWER_LEN + 1];
-    char answer_hash[VELOCE_HASH_HEX_LEN];
-    char new_password[VELOCE_PASSWORD_LEN + 1];
-    char confirm_password[VELOCE_PASSWORD_LEN + 1];
-    char password_salt[VELOCE_ID_LEN];
-    char password_hash[VELOCE_HASH_HEX_LEN];
-    UserRecord user;
-
-    app_clear_screen();
-    (void)printf("Reset password\n\n");
-
-    if (!read_line("Username: ", username, sizeof(username)))
-    {
-        return 0;
-    }
-    sanitize_field(username);
+    char clean_answer[VELOCE_ANSWER_LEN + 1];
 
-    if (!find_user_by_username(username, &user))
+    sanitize_field(user->name);
+    sanitize_field(user->security_question);
+    if (!username_is_valid(user->username) || !password_is_valid(password) ||
+        find_user_by_username(user->username, NULL))
     {
-        (void)printf("No account found for that username.\n");
-        app_pause(NULL);
         return 0;
     }
 
-    (void)printf("Security question: %s\n", user.security_question);
-    if (!read_line("Answer: ", answer, sizeof(answer)))
-    {
-        return 0;
-    }
-    sanitize_field(answer);
-    hash_secret(answer, user.answer_salt, answer_hash);
+    (void)snprintf(clean_answer, sizeof(clean_answer), "%s", answer);
+    sanitize_field(clean_answer);
+    generate_id(user->answer_salt);
+    hash_secret(clean_answer, user->answer_salt, user->answer_hash);
 
-    if (strcmp(answer_hash, user.answer_hash) != 0)
-    {
-        (void)printf("Verification failed.\n");
-        app_pause(NULL);
-        return 0;
-    }
+    generate_key(&user->uid);
+    generate_id(user->password_salt);
+    hash_secret(password, user->password_salt, user->password_hash);
+    user->created_at = now_timestamp();
 
-    if (!read_password("New password (min 8 chars): ", new_password, sizeof(new_password)))
-    {
-        return 0;
-    }
-    if (!read_password("Confirm password: ", confirm_password, sizeof(confirm_password)))
-    {
-        return 0;
-    }
-
-    if (strcmp(new_password, confirm_password) != 0)
-    {
-        (void)printf("Passwords do not match.\n");
-        app_pause(NULL);
-        return 0;
-    }
-
-    if (!is_valid_password(new_password))
-    {
-        (void)printf("Password must be at least 8 characters.\n");
-        app_pause(NULL);
-        return 0;
-    }
-
-    generate_id(password_salt);
-    hash_secret(new_password, password_salt, password_hash);
-
-    if (!update_user_password(user.uid, password_salt, password_hash))
-    {
-        (void)printf("Failed to update password.\n");
-        app_pause(NULL);
-        return 0;
-    }
-
-    (void)printf("Password updated successfully.\n");
-    app_pause(NULL);
-    return 1;
+    return append_user(user);
 }
 
-static int login_flow(Session *session)
+/* Checks `password` for `username`; on success `user` receives the account. */
+int user_authenticate(const char *username, const char *password, UserRecord *user)
 {
-    char username[VELOCE_USERNAME_LEN + 1];
-    char password[VELOCE_PASSWORD_LEN + 1];
     char password_hash[VELOCE_HASH_HEX_LEN];
-    UserRecord user;
-    int choice;
+    uint64_t start;
+    int ok;
 
-    while (1)
+    start = stats_op_begin();
+    ok = find_user_by_username(username, user);
+    if (ok)
     {
-        app_clear_screen();
-        (void)printf("Login\n\n");
-
-        if (!read_line("Username: ", username, sizeof(username)))
-        {
-            return 0;
-        }
-        sanitize_field(username);
-
-        if (!read_password("Password: ", password, sizeof(password)))
-        {
-            return 0;
-        }
-
-        if (find_user_by_username(username, &user))
-        {
-            hash_secret(password, user.password_salt, password_hash);
-            if (strcmp(password_hash, user.password_hash) == 0)
-            {
-                set_session_from_user(session, &user);
-                (void)printf("Login successful.\n");
-                app_pause(NULL);
-                return 1;
-            }
-        }
-
-        (void)printf("\nCredentials did not match.\n");
-        (void)printf("1) Try again\n");
-        (void)printf("2) Reset password\n");
-        (void)printf("3) Back\n");
-
-        if (!read_int("Choice: ", &choice))
-        {
-            choice = 1;
-        }
-
-        if (choice == 2)
-        {
-            (void)reset_password_flow();
-        }
-        else if (choice == 3)
-        {
-            return 0;
-        }
+        hash_secret(password, user->password_salt, password_hash);
+        ok = strcmp(password_hash, user->password_hash) == 0;
     }
+    stats_op_end(STAT_OP_LOGIN, start);
+
+    return ok;
 }
 
-static int signup_flow(Session *session)
+int user_check_answer(const UserRecord *user, const char *answer)
 {
-    UserRecord user;
-    char password[VELOCE_PASSWORD_LEN + 1];
-    char confirm_password[VELOCE_PASSWORD_LEN + 1];
-
-    app_clear_screen();
-    (void)printf("Create account\n\n");
-
-    while (1)
-    {
-        if (!read_line("Username (letters/numbers/_/-): ", user.username, sizeof(user.username)))
-        {
-            return 0;
-        }
-        sanitize_field(user.username);
-
-        if (!is_valid_username(user.username))
-        {
-            (void)printf("Username must be at least 3 characters and only use letters, numbers, '_' or '-'.\n");
-            continue;
-        }
-
-        if (find_user_by_username(user.username, NULL))
-        {
-            (void)printf("That username is already in use.\n");
-            continue;
-        }
-
-        break;
-    }
-
-    while (1)
-    {
-        if (!read_password("Password (min 8 chars): ", password, sizeof(password)))
-        {
-            return 0;
-        }
-        if (!read_password("Confirm password: ", confirm_password, sizeof(confirm_password)))
-        {
-            return 0;
-        }
-
-        if (strcmp(password, confirm_password) != 0)
-        {
-            (void)printf("Passwords do not match. Try again.\n");
-            continue;
-        }
-
-        if (!is_valid_password(password))
-        {
-            (void)printf("Password must be at least 8 characters.\n");
-            continue;
-        }
-
-        break;
-    }
-
-    if (!read_line("Full name: ", user.name, sizeof(user.name)))
-    {
-        return 0;
-    }
-    sanitize_field(user.name);
-
-    if (!read_line("Security question: ", user.security_question, sizeof(user.security_question)))
-    {
-        return 0;
-    }
-    sanitize_field(user.security_question);
-
-    {
-        char answer[VELOCE_ANSWER_LEN + 1];
-
-        if (!read_line("Security answer: ", answer, sizeof(answer)))
-        {
-            return 0;
-        }
-        sanitize_field(answer);
-
-        generate_id(user.answer_salt);
-        hash_secret(answer, user.answer_salt, user.answer_hash);
-    }
-
-    generate_id(user.uid);
-    generate_id(user.password_salt);
-    hash_secret(password, user.password_salt, user.password_hash);
-    now_timestamp(user.created_at);
-
-    if (!append_user(&user))
-    {
-        (void)printf("Failed to create account.\n");
-        app_pause(NULL);
-        return 0;
-    }
+    char clean_answer[VELOCE_ANSWER_LEN + 1];
+    char answer_hash[VELOCE_HASH_HEX_LEN];
 
-    set_session_from_user(session, &user);
-    (void)printf("Account created successfully.\n");
-    app_pause(NULL);
-    return 1;
+    (void)snprintf(clean_answer, sizeof(clean_answer), "%s", answer);
+    sanitize_field(clean_answer);
+    hash_secret(clean_answer, user->answer_salt, answer_hash);
+    return strcmp(answer_hash, user->answer_hash) == 0;
 }
 
-int verify_auth(Session *session)
+int user_set_password(const IdKey *uid, const char *password)
 {
-    int choice;
+    char password_salt[VELOCE_ID_LEN];
+    char password_hash[VELOCE_HASH_HEX_LEN];
 
-    while (1)
+    if (!password_is_valid(password))
     {
-        app_clear_screen();
-        (void)printf("Veloce\n");
-        (void)printf("1) Login\n");
-        (void)printf("2) Signup\n");
-        (void)printf("3) Exit\n");
-
-        if (!read_int("Choice: ", &choice))
-        {
-            (void)printf("Please enter a valid number.\n");
-            app_pause(NULL);
-            continue;
-        }
-
-        if (choice == 1)
-        {
-            if (login_flow(session))
-            {
-                return 1;
-            }
-        }
-        else if (choice == 2)
-        {
-            if (signup_flow(session))
-            {
-                return 1;
-            }
-        }
-        else if (choice == 3)
-        {
-            return 0;
-        }
-        else
-        {
-            (void)printf("Please choose 1, 2, or 3.\n");
-            app_pause(NULL);
-        }
+        return 0;
     }
+
+    generate_id(password_salt);
+    hash_secret(password, password_salt, password_hash);
+    return update_user_password(uid, password_salt, password_hash);
 }
@@ -0,0 +1,1041 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_MAX_RESULTS 64
+#define BENCH_NAME_LEN 63
+#define BENCH_MIN_RUN_NS 200000000ULL
+#define BENCH_REPEATS 3
+
+typedef struct
+{
+    char name[BENCH_NAME_LEN + 1];
+    const char *unit;
+    double ns_per_op;
+} BenchResult;
+
+typedef void (*BenchFn)(void *ctx, size_t iterations);
+
+static BenchResult g_results[BENCH_MAX_RESULTS];
+static size_t g_result_count = 0U;
+static volatile size_t g_sink = 0U;
+
+static const char *k_sample_commit_line =
+    "Qm3kXv9TzL0aPbN2|R7yHc2WqE5uJd8Fk|1710166927000000000|Fix off-by-one in snapshot rotation||"
+    "9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d08c1c1fc7f3a";
+
+static void record_result(const char *name, const char *unit, double ns_per_op)
+{
+    BenchResult *r;
+
+    if (g_result_count >= BENCH_MAX_RESULTS)
+    {
+        return;
+    }
+
+    r = &g_results[g_result_count++];
+    (void)snprintf(r->name, sizeof(r->name), "%s", name);
+    r->unit = unit;
+    r->ns_per_op = ns_per_op;
+    (void)fprintf(stderr, "%-36s %14.1f ns/%s\n", name, ns_per_op, unit);
+}
+
+/* Grows the iteration count until a run lasts long enough to time, then keeps the best of a few runs. */
+static double measure(BenchFn fn, void *ctx, size_t min_iterations)
+{
+    size_t iterations = min_iterations > 0U ? min_iterations : 1U;
+    uint64_t elapsed;
+    double best = -1.0;
+    int rep;
+
+    while (1)
+    {
+        uint64_t start = monotonic_ns();
+        fn(ctx, iterations);
+        elapsed = monotonic_ns() - start;
+        if (elapsed >= BENCH_MIN_RUN_NS || iterations >= ((size_t)1 << 30))
+        {
+            break;
+        }
+        iterations *= 2U;
+    }
+
+    best = (double)elapsed / (double)iterations;
+    for (rep = 1; rep < BENCH_REPEATS; rep++)
+    {
+        uint64_t start = monotonic_ns();
+        double per_op;
+
+        fn(ctx, iterations);
+        per_op = (double)(monotonic_ns() - start) / (double)iterations;
+        if (per_op < best)
+        {
+            best = per_op;
+        }
+    }
+
+    return best;
+}
+
+static void bench_split_fields(void *ctx, size_t iterations)
+{
+    FieldSpan fields[VELOCE_COMMIT_FIELDS];
+    size_t len = strlen(k_sample_commit_line);
+    size_t i;
+
+    (void)ctx;
+    for (i = 0U; i < iterations; i++)
+    {
+        g_sink += (size_t)split_field_spans(k_sample_commit_line, len, fields, VELOCE_COMMIT_FIELDS);
+        g_sink += fields[4].len;
+    }
+}
+
+static void bench_parse_commit_line(void *ctx, size_t iterations)
+{
+    CommitRecord commit;
+    size_t i;
+
+    (void)ctx;
+    for (i = 0U; i < iterations; i++)
+    {
+        g_sink += (size_t)parse_commit_line(k_sample_commit_line, &commit);
+    }
+}
+
+static void bench_hash_secret(void *ctx, size_t iterations)
+{
+    char out[VELOCE_HASH_HEX_LEN];
+    size_t i;
+
+    (void)ctx;
+    for (i = 0U; i < iterations; i++)
+    {
+        hash_secret("correct horse battery staple", "Qm3kXv9TzL0aPbN2", out);
+        g_sink += (size_t)out[0];
+    }
+}
+
+typedef struct
+{
+    uint8_t *data;
+    size_t len;
+} BufferCtx;
+
+static void bench_sha256_update(void *ctx, size_t iterations)
+{
+    BufferCtx *buf = (BufferCtx *)ctx;
+    Sha256Ctx sha;
+    uint8_t digest[32];
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        sha256_init(&sha);
+        sha256_update(&sha, buf->data, buf->len);
+        sha256_final(&sha, digest);
+        g_sink += digest[0];
+    }
+}
+
+static void bench_blake3_update(void *ctx, size_t iterations)
+{
+    BufferCtx *buf = (BufferCtx *)ctx;
+    Blake3Ctx blake3;
+    uint8_t digest[32];
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        blake3_init(&blake3);
+        blake3_update(&blake3, buf->data, buf->len);
+        blake3_final(&blake3, digest);
+        g_sink += digest[0];
+    }
+}
+
+static void bench_blake3_parallel(void *ctx, size_t iterations)
+{
+    BufferCtx *buf = (BufferCtx *)ctx;
+    uint8_t digest[32];
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        blake3_hash_parallel(buf->data, buf->len, digest);
+        g_sink += digest[0];
+    }
+}
+
+static void bench_find_substring(void *ctx, size_t iterations)
+{
+    BufferCtx *buf = (BufferCtx *)ctx;
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        g_sink += find_substring((const char *)buf->data, buf->len, "veloce", 6U) == NULL;
+    }
+}
+
+typedef struct
+{
+    BufferCtx raw;
+    uint8_t *packed;
+    size_t packed_len;
+} LzCtx;
+
+static void bench_lz_compress(void *ctx, size_t iterations)
+{
+    LzCtx *lz = (LzCtx *)ctx;
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        g_sink += lz_compress(lz->raw.data, lz->raw.len, lz->packed, lz->raw.len);
+    }
+}
+
+static void bench_lz_decompress(void *ctx, size_t iterations)
+{
+    LzCtx *lz = (LzCtx *)ctx;
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        g_sink += (size_t)lz_decompress(lz->packed, lz->packed_len, lz->raw.data, lz->raw.len);
+    }
+}
+
+/* Snapshot-like text: lines of words drawn from a small vocabulary, as bundles mostly carry. */
+static int run_lz_benchmarks(void)
+{
+    static const char *const words[] = {"static", "int", "return", "commit", "snapshot", "repo", "const",
+                                        "char", "size_t", "if", "while", "(void)printf", "{", "}", ";"};
+    LzCtx lz;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    size_t pos = 0U;
+
+    lz.raw.len = 64U * 1024U;
+    lz.raw.data = (uint8_t *)malloc(lz.raw.len);
+    lz.packed = (uint8_t *)malloc(lz.raw.len);
+    if (lz.raw.data == NULL || lz.packed == NULL)
+    {
+        free(lz.raw.data);
+        free(lz.packed);
+        return 0;
+    }
+
+    while (pos < lz.raw.len)
+    {
+        const char *word;
+        size_t len;
+
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        word = words[(seed >> 33) % (sizeof(words) / sizeof(words[0]))];
+        len = strlen(word);
+        if (len + 1U > lz.raw.len - pos)
+        {
+            len = lz.raw.len - pos - 1U;
+        }
+        memcpy(lz.raw.data + pos, word, len);
+        pos += len;
+        lz.raw.data[pos++] = (seed >> 60) == 0U ? '\n' : ' ';
+    }
+
+    lz.packed_len = lz_compress(lz.raw.data, lz.raw.len, lz.packed, lz.raw.len);
+    record_result("lz_compress_64KiB", "op", measure(bench_lz_compress, &lz, 16U));
+    record_result("lz_decompress_64KiB", "op", measure(bench_lz_decompress, &lz, 16U));
+    free(lz.raw.data);
+    free(lz.packed);
+    return lz.packed_len > 0U;
+}
+
+#define BENCH_BULK_FILES 1000U
+#define BENCH_BULK_SIZE 4096U
+
+typedef struct
+{
+    const char **paths;
+    BulkWrite *writes;
+    size_t count;
+} BulkCtx;
+
+static void bulk_sink(void *arg, size_t index, const char *data, size_t len)
+{
+    (void)arg;
+    (void)index;
+    g_sink += data != NULL ? len : 0U;
+}
+
+static void bench_bulk_read(void *ctx, size_t iterations)
+{
+    BulkCtx *bulk = (BulkCtx *)ctx;
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        g_sink += bulk_read_files(bulk->paths, bulk->count, bulk_sink, NULL) == 0;
+    }
+}
+
+static void bench_bulk_write(void *ctx, size_t iterations)
+{
+    BulkCtx *bulk = (BulkCtx *)ctx;
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        g_sink += bulk_write_files(bulk->writes, bulk->count) == 0;
+    }
+}
+
+static void bench_find_user(void *ctx, size_t iterations)
+{
+    const char *username = (const char *)ctx;
+    UserRecord user;
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        g_sink += (size_t)find_user_by_username(username, &user);
+    }
+}
+
+static void bench_next_repo_id(void *ctx, size_t iterations)
+{
+    const IdKey *owner = (const IdKey *)ctx;
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        g_sink += (size_t)next_repo_id_for_owner(owner);
+    }
+}
+
+static void bench_load_commits(void *ctx, size_t iterations)
+{
+    const RepoRecord *repo = (const RepoRecord *)ctx;
+    Arena arena;
+    CommitHistory history;
+    size_t i;
+
+    arena_init(&arena, 0U);
+    for (i = 0U; i < iterations; i++)
+    {
+        if (load_commits_for_repo(repo, &arena, &history))
+        {
+            g_sink += history.count;
+        }
+        arena_reset(&arena);
+    }
+    arena_free(&arena);
+}
+
+static void bench_table_load(void *ctx, size_t iterations)
+{
+    Arena arena;
+    CommitTable table;
+    size_t i;
+
+    (void)ctx;
+    arena_init(&arena, 0U);
+    for (i = 0U; i < iterations; i++)
+    {
+        if (commit_table_load(&arena, &table))
+        {
+            g_sink += table.count;
+        }
+        arena_reset(&arena);
+    }
+    arena_free(&arena);
+}
+
+typedef struct
+{
+    Arena *arena;
+    CommitTable table;
+    uint64_t *counts;
+} TableCtx;
+
+static int bench_table_prepare(TableCtx *ctx)
+{
+    ctx->arena = (Arena *)malloc(sizeof(Arena));
+    if (ctx->arena == NULL)
+    {
+        return 0;
+    }
+
+    arena_init(ctx->arena, 0U);
+    if (!commit_table_load(ctx->arena, &ctx->table))
+    {
+        arena_free(ctx->arena);
+        free(ctx->arena);
+        return 0;
+    }
+
+    ctx->counts = (uint64_t *)arena_alloc(ctx->arena, (ctx->table.repo_count + 1U) * sizeof(uint64_t));
+    if (ctx->counts == NULL)
+    {
+        arena_free(ctx->arena);
+        free(ctx->arena);
+        return 0;
+    }
+
+    return 1;
+}
+
+static void bench_table_count(void *ctx, size_t iterations)
+{
+    TableCtx *table = (TableCtx *)ctx;
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        commit_table_count_by_repo(&table->table, NULL, table->counts);
+        g_sink += table->counts[0];
+    }
+}
+
+static void bench_search_messages(void *ctx, size_t iterations)
+{
+    Arena arena;
+    MessageHit *hits;
+    size_t count;
+    size_t i;
+
+    (void)ctx;
+    arena_init(&arena, 0U);
+    for (i = 0U; i < iterations; i++)
+    {
+        if (message_index_search("synthetic change 777", NULL, 0U, &arena, &hits, &count))
+        {
+            g_sink += count;
+        }
+        arena_reset(&arena);
+    }
+    arena_free(&arena);
+}
+
+static void bench_snapshot_cache(void *ctx, size_t iterations)
+{
+    const IdKey *snapshot = (const IdKey *)ctx;
+    const char *content;
+    size_t len;
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        content = snapshot_cache_acquire(snapshot, &len);
+        g_sink += len;
+        snapshot_cache_release(content);
+    }
+}
+
+static void bench_create_commit(void *ctx, size_t iterations)
+{
+    RepoRecord *repo = (RepoRecord *)ctx;
+    size_t i;
+
+    for (i = 0U; i < iterations; i++)
+    {
+        g_sink += (size_t)create_commit_with_message(repo, "bench commit", NULL);
+    }
+}
+
+static int db_path(const char *name, char out[VELOCE_PATH_LEN + 1])
+{
+    return path_join(out, VELOCE_PATH_LEN + 1U, storage_root(), name);
+}
+
+static int write_users_db(size_t count, char last_username[VELOCE_USERNAME_LEN + 1])
+{
+    char path[VELOCE_PATH_LEN + 1];
+    FILE *fp;
+    UserRecord user;
+    size_t i;
+
+    if (db_path(VELOCE_USERS_DB, path) != 0)
+    {
+        return 0;
+    }
+
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    memset(&user, 0, sizeof(user));
+    (void)snprintf(user.name, sizeof(user.name), "Bench User");
+    (void)snprintf(user.security_question, sizeof(user.security_question), "Favourite colour?");
+    user.created_at = now_timestamp();
+
+    for (i = 0U; i < count; i++)
+    {
+        generate_key(&user.uid);
+        generate_id(user.password_salt);
+        generate_id(user.answer_salt);
+        (void)snprintf(user.username, sizeof(user.username), "user%zu", i);
+        hash_secret("password", user.password_salt, user.password_hash);
+        (void)snprintf(user.answer_hash, sizeof(user.answer_hash), "%s", user.password_hash);
+        if (!write_user_line(fp, &user))
+        {
+            fclose(fp);
+            return 0;
+        }
+    }
+
+    fclose(fp);
+    (void)snprintf(last_username, VELOCE_USERNAME_LEN + 1U, "%s", user.username);
+    return 1;
+}
+
+#define BENCH_REPOS 16U
+
+/* The synthetic repositories; picked once so every scale rewrites the same commit logs. */
+static IdKey g_bench_repos[BENCH_REPOS];
+static int g_bench_repos_ready;
+
+static int write_bench_repos(void)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    RepoRecord repo;
+    FILE *fp;
+    size_t i;
+
+    if (db_path(VELOCE_REPOS_DB, path) != 0)
+    {
+        return 0;
+    }
+
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    memset(&repo, 0, sizeof(repo));
+    generate_key(&repo.owner_uid);
+    repo.created_at = now_timestamp();
+    for (i = 0U; i < BENCH_REPOS; i++)
+    {
+        repo.id = g_bench_repos[i];
+        repo.rid = (int)i + 1;
+        (void)snprintf(repo.name, sizeof(repo.name), "bench-%zu", i + 1U);
+        if (!write_repo_line(fp, &repo))
+        {
+            fclose(fp);
+            return 0;
+        }
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+/* Writes `count` commits spread over the bench repositories; the first repository id is returned. */
+static int write_commit_logs(size_t count, IdKey *target_repo)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    FILE *shards[BENCH_REPOS];
+    CommitRecord commit;
+    size_t i;
+    int ok = 1;
+
+    /* The message index would describe the previous commit logs; searches rebuild it. */
+    if (db_path(VELOCE_MESSAGE_INDEX, path) != 0)
+    {
+        return 0;
+    }
+    (void)remove(path);
+
+    if (!g_bench_repos_ready)
+    {
+        for (i = 0U; i < BENCH_REPOS; i++)
+        {
+            generate_key(&g_bench_repos[i]);
+        }
+        g_bench_repos_ready = 1;
+    }
+
+    if (!write_bench_repos())
+    {
+        return 0;
+    }
+
+    for (i = 0U; i < BENCH_REPOS; i++)
+    {
+        shards[i] = commit_shard_path(&g_bench_repos[i], path) == 0 ? fopen(path, "wb") : NULL;
+        ok = ok && shards[i] != NULL;
+    }
+
+    memset(&commit, 0, sizeof(commit));
+    commit.timestamp = now_timestamp();
+    for (i = 0U; ok && i < count; i++)
+    {
+        generate_key(&commit.id);
+        commit.repo_id = g_bench_repos[i % BENCH_REPOS];
+        (void)snprintf(commit.message, sizeof(commit.message), "Synthetic change number %zu", i);
+        commit.snapshot_id = commit.id;
+        ok = write_commit_line(shards[i % BENCH_REPOS], &commit);
+    }
+
+    for (i = 0U; i < BENCH_REPOS; i++)
+    {
+        if (shards[i] != NULL)
+        {
+            fclose(shards[i]);
+        }
+    }
+
+    *target_repo = g_bench_repos[0];
+    return ok;
+}
+
+/* Drops the bench repositories' commit logs once the last measurement is done. */
+static void remove_bench_shards(void)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    size_t i;
+
+    for (i = 0U; g_bench_repos_ready && i < BENCH_REPOS; i++)
+    {
+        if (commit_shard_path(&g_bench_repos[i], path) == 0)
+        {
+            (void)remove(path);
+        }
+    }
+}
+
+static void remove_repo_snapshots(const RepoRecord *repo)
+{
+    Arena arena;
+    CommitHistory history;
+    char path[VELOCE_PATH_LEN + 1];
+    size_t i;
+
+    arena_init(&arena, 0U);
+    if (!load_commits_for_repo(repo, &arena, &history))
+    {
+        arena_free(&arena);
+        return;
+    }
+
+    for (i = 0U; i < history.count; i++)
+    {
+        if (commit_entry_snapshot_path(&history.items[i], path) == 0)
+        {
+            (void)remove(path);
+        }
+    }
+
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_TRIGRAMS_DIR) == 0)
+    {
+        char id[VELOCE_ID_LEN];
+        char tri[VELOCE_PATH_LEN + 1];
+        char name[VELOCE_ID_LEN + 4];
+
+        id_key_to_text(&repo->id, id);
+        (void)snprintf(name, sizeof(name), "%s.tri", id);
+        if (path_join(tri, sizeof(tri), path, name) == 0)
+        {
+            (void)remove(tri);
+        }
+    }
+
+    arena_free(&arena);
+}
+
+static int measure_bulk_io(BulkCtx *bulk, char (*names)[VELOCE_PATH_LEN + 1], char *content, const char *dir)
+{
+    size_t i;
+
+    for (i = 0U; i < BENCH_BULK_SIZE; i++)
+    {
+        content[i] = (i % 64U == 63U) ? '\n' : (char)('a' + (int)(i % 26U));
+    }
+
+    for (i = 0U; i < bulk->count; i++)
+    {
+        char file[32];
+
+        (void)snprintf(file, sizeof(file), "%zu.txt", i);
+        if (path_join(names[i], VELOCE_PATH_LEN + 1U, dir, file) != 0)
+        {
+            return 0;
+        }
+        bulk->paths[i] = names[i];
+        bulk->writes[i].path = names[i];
+        bulk->writes[i].data = content;
+        bulk->writes[i].len = BENCH_BULK_SIZE;
+    }
+
+    bulk_io_uring_set(0);
+    record_result("bulk_write_1000x4KiB", "op", measure(bench_bulk_write, bulk, 1U));
+    record_result("bulk_read_1000x4KiB", "op", measure(bench_bulk_read, bulk, 1U));
+
+    bulk_io_uring_set(1);
+    if (bulk_io_uring_enabled())
+    {
+        record_result("bulk_write_1000x4KiB_io_uring", "op", measure(bench_bulk_write, bulk, 1U));
+        record_result("bulk_read_1000x4KiB_io_uring", "op", measure(bench_bulk_read, bulk, 1U));
+    }
+
+    for (i = 0U; i < bulk->count; i++)
+    {
+        (void)remove(names[i]);
+    }
+    (void)remove(dir);
+    return 1;
+}
+
+/* Writes and reads back BENCH_BULK_FILES snapshot-sized files, blocking and through io_uring. */
+static int run_bulk_benchmarks(void)
+{
+    char dir[VELOCE_PATH_LEN + 1];
+    char (*names)[VELOCE_PATH_LEN + 1];
+    BulkCtx bulk;
+    char *content;
+    int ok;
+
+    if (db_path("bench_bulk", dir) != 0 || ensure_dir(dir) != 0)
+    {
+        return 0;
+    }
+
+    names = (char (*)[VELOCE_PATH_LEN + 1])malloc(BENCH_BULK_FILES * sizeof(*names));
+    bulk.paths = (const char **)malloc(BENCH_BULK_FILES * sizeof(const char *));
+    bulk.writes = (BulkWrite *)malloc(BENCH_BULK_FILES * sizeof(BulkWrite));
+    bulk.count = BENCH_BULK_FILES;
+    content = (char *)malloc(BENCH_BULK_SIZE);
+
+    ok = names != NULL && bulk.paths != NULL && bulk.writes != NULL && content != NULL &&
+         measure_bulk_io(&bulk, names, content, dir);
+
+    free(names);
+    free(bulk.paths);
+    free(bulk.writes);
+    free(content);
+    return ok;
+}
+
+static int run_benchmarks(size_t max_commits)
+{
+    char username[VELOCE_USERNAME_LEN + 1];
+    char name[BENCH_NAME_LEN + 1];
+    BufferCtx buf;
+    RepoRecord repo;
+    TableCtx table;
+    size_t scale;
+    size_t i;
+
+    record_result("split_fields", "op", measure(bench_split_fields, NULL, 1024U));
+    record_result("parse_commit_line", "op", measure(bench_parse_commit_line, NULL, 1024U));
+    record_result("hash_secret", "op", measure(bench_hash_secret, NULL, 1024U));
+
+    buf.len = 1024U * 1024U;
+    buf.data = (uint8_t *)malloc(buf.len);
+    if (buf.data == NULL)
+    {
+        return 0;
+    }
+    for (i = 0U; i < buf.len; i++)
+    {
+        buf.data[i] = (uint8_t)(i * 131U);
+    }
+    record_result("sha256_update_1MiB", "MiB", measure(bench_sha256_update, &buf, 1U));
+    record_result("blake3_update_1MiB", "MiB", measure(bench_blake3_update, &buf, 1U));
+    record_result("find_substring_1MiB", "MiB", measure(bench_find_substring, &buf, 1U));
+    free(buf.data);
+
+    /* Large enough that blake3_hash_parallel splits it across workers. */
+    buf.len = 64U * 1024U * 1024U;
+    buf.data = (uint8_t *)malloc(buf.len);
+    if (buf.data == NULL)
+    {
+        return 0;
+    }
+    for (i = 0U; i < buf.len; i++)
+    {
+        buf.data[i] = (uint8_t)(i * 131U);
+    }
+    record_result("blake3_parallel_64MiB", "op", measure(bench_blake3_parallel, &buf, 1U));
+    free(buf.data);
+
+    if (!run_lz_benchmarks() || !run_bulk_benchmarks())
+    {
+        return 0;
+    }
+
+    if (!write_users_db(10000U, username))
+    {
+        return 0;
+    }
+    db_mmap_set(0);
+    record_result("find_user_by_username_10k", "op", measure(bench_find_user, username, 1U));
+    db_mmap_set(1);
+    record_result("find_user_by_username_10k_mmap", "op", measure(bench_find_user, username, 1U));
+
+    {
+        char counter_name[VELOCE_PATH_LEN + 1];
+        char counter[VELOCE_PATH_LEN + 1];
+        IdKey owner;
+
+        generate_key(&owner);
+        record_result("next_repo_id_for_owner", "op", measure(bench_next_repo_id, &owner, 1U));
+        if (repo_counter_name(&owner, counter_name) == 0 && db_path(counter_name, counter) == 0)
+        {
+            (void)remove(counter);
+        }
+    }
+
+    memset(&repo, 0, sizeof(repo));
+    for (scale = 1000U; scale <= max_commits; scale *= 10U)
+    {
+        if (!write_commit_logs(scale, &repo.id))
+        {
+            return 0;
+        }
+        db_mmap_set(0);
+        (void)snprintf(name, sizeof(name), "load_commits_for_repo_%zu", scale);
+        record_result(name, "op", measure(bench_load_commits, &repo, 1U));
+        db_mmap_set(1);
+        (void)snprintf(name, sizeof(name), "load_commits_for_repo_%zu_mmap", scale);
+        record_result(name, "op", measure(bench_load_commits, &repo, 1U));
+    }
+
+    /* The commit logs still hold the largest scale; the mapping mode is left on from the loop. */
+    if (scale > 1000U)
+    {
+        (void)snprintf(name, sizeof(name), "commit_table_load_%zu_mmap", scale / 10U);
+        record_result(name, "op", measure(bench_table_load, NULL, 1U));
+        if (!bench_table_prepare(&table))
+        {
+            return 0;
+        }
+        (void)snprintf(name, sizeof(name), "commit_table_count_by_repo_%zu", scale / 10U);
+        record_result(name, "op", measure(bench_table_count, &table, 1U));
+        arena_free(table.arena);
+        free(table.arena);
+
+        /* The first search rebuilds messages.idx; the measured ones hit the in-memory index. */
+        bench_search_messages(NULL, 1U);
+        (void)snprintf(name, sizeof(name), "message_index_search_%zu", scale / 10U);
+        record_result(name, "op", measure(bench_search_messages, NULL, 1U));
+    }
+    db_mmap_set(0);
+
+    if (!write_commit_logs(1000U, &repo.id))
+    {
+        return 0;
+    }
+
+    {
+        char tracked[VELOCE_PATH_LEN + 1];
+        char *content;
+        size_t len = 64U * 1024U;
+
+        if (db_path("bench_tracked.txt", tracked) != 0)
+        {
+            return 0;
+        }
+
+        content = (char *)malloc(len);
+        if (content == NULL)
+        {
+            return 0;
+        }
+        for (i = 0U; i < len; i++)
+        {
+            content[i] = (i % 64U == 63U) ? '\n' : (char)('a' + (int)(i % 26U));
+        }
+        if (write_text_file(tracked, content, len) != 0)
+        {
+            free(content);
+            return 0;
+        }
+        free(content);
+
+        (void)snprintf(repo.tracked_file, sizeof(repo.tracked_file), "%s", tracked);
+        repo.initialized = 1;
+
+        record_result("create_commit_with_message_64KiB", "op", measure(bench_create_commit, &repo, 1U));
+
+        {
+            Arena arena;
+            CommitHistory history;
+
+            arena_init(&arena, 0U);
+            if (load_commits_for_repo(&repo, &arena, &history) && history.count > 0U)
+            {
+                IdKey head = history.items[history.count - 1U].id;
+
+                snapshot_cache_set_budget(0U);
+                record_result("snapshot_read_64KiB", "op", measure(bench_snapshot_cache, &head, 1U));
+                snapshot_cache_set_budget(64U * 1024U * 1024U);
+                record_result("snapshot_cache_hit_64KiB", "op", measure(bench_snapshot_cache, &head, 1U));
+            }
+            arena_free(&arena);
+        }
+        remove_repo_snapshots(&repo);
+        (void)remove(tracked);
+    }
+
+    remove_bench_shards();
+    return 1;
+}
+
+static int write_results(const char *path)
+{
+    FILE *fp;
+    size_t i;
+
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    (void)fprintf(fp, "# veloce-bench v1\n");
+    (void)fprintf(fp, "# name\tunit\tns_per_unit\n");
+    for (i = 0U; i < g_result_count; i++)
+    {
+        (void)fprintf(fp, "%s\t%s\t%.1f\n", g_results[i].name, g_results[i].unit, g_results[i].ns_per_op);
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+/* Returns the number of regressions beyond `threshold_pct`, or -1 if the baseline cannot be read. */
+static int compare_baseline(const char *path, double threshold_pct)
+{
+    FILE *fp;
+    char line[256];
+    int regressions = 0;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    (void)fprintf(stderr, "\nBaseline comparison (%s, threshold %.0f%%)\n", path, threshold_pct);
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        char name[BENCH_NAME_LEN + 1];
+        char unit[16];
+        double baseline;
+        size_t i;
+
+        if (line[0] == '#' || sscanf(line, "%63s %15s %lf", name, unit, &baseline) != 3 || baseline <= 0.0)
+        {
+            continue;
+        }
+
+        for (i = 0U; i < g_result_count; i++)
+        {
+            double delta_pct;
+
+            if (strcmp(g_results[i].name, name) != 0)
+            {
+                continue;
+            }
+
+            delta_pct = (g_results[i].ns_per_op - baseline) * 100.0 / baseline;
+            (void)fprintf(stderr, "%-36s %+7.1f%%%s\n", name, delta_pct,
+                          delta_pct > threshold_pct ? "  REGRESSION" : "");
+            if (delta_pct > threshold_pct)
+            {
+                regressions++;
+            }
+            break;
+        }
+    }
+
+    fclose(fp);
+    return regressions;
+}
+
+static void usage(void)
+{
+    (void)fprintf(stderr,
+                  "usage: vcs-bench [--home DIR] [--out FILE] [--baseline FILE]\n"
+                  "                 [--threshold PCT] [--max-commits N]\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *home = "bench_home";
+    const char *out = "bench_results.tsv";
+    const char *baseline = NULL;
+    double threshold_pct = 15.0;
+    size_t max_commits = 100000U;
+    int regressions;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--home") == 0 && i + 1 < argc)
+        {
+            home = argv[++i];
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            out = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+        {
+            baseline = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+        {
+            threshold_pct = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-commits") == 0 && i + 1 < argc)
+        {
+            max_commits = (size_t)strtoull(argv[++i], NULL, 10);
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    storage_set_root(home);
+    if (ensure_storage_ready() != 0)
+    {
+        (void)fprintf(stderr, "Failed to prepare bench storage at %s.\n", home);
+        return 1;
+    }
+
+    if (!run_benchmarks(max_commits))
+    {
+        (void)fprintf(stderr, "Benchmark setup failed.\n");
+        return 1;
+    }
+
+    if (!write_results(out))
+    {
+        (void)fprintf(stderr, "Failed to write results to %s.\n", out);
+        return 1;
+    }
+
+    if (baseline == NULL)
+    {
+        return 0;
+    }
+
+    regressions = compare_baseline(baseline, threshold_pct);
+    if (regressions < 0)
+    {
+        (void)fprintf(stderr, "Baseline %s not found; results written to %s.\n", baseline, out);
+        return 0;
+    }
+
+    return regressions > 0 ? 2 : 0;
+}
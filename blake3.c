@@ -0,0 +1,399 @@
+#include "vcs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLAKE3_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define BLAKE3_BLOCK_LEN 64U
+#define BLAKE3_CHUNK_LEN 1024U
+#define BLAKE3_CHUNK_START 1U
+#define BLAKE3_CHUNK_END 2U
+#define BLAKE3_PARENT 4U
+#define BLAKE3_ROOT 8U
+/* Inputs below this are hashed on the calling thread; spawning would cost more than it saves. */
+#define BLAKE3_PARALLEL_MIN (4U * 1024U * 1024U)
+/* Smallest subtree a worker takes, in chunks; must be a power of two. */
+#define BLAKE3_PIECE_CHUNKS 1024U
+#define BLAKE3_PIECES_PER_WORKER 8U
+
+/*
+ * BLAKE3 (unkeyed, 32-byte output). Input is split into 1 KiB chunks, each chunk is hashed
+ * with a 7-round BLAKE2s-style compression into a chaining value, and chaining values are
+ * paired up the left-balanced binary tree the specification fixes. The tree is what makes
+ * large inputs parallel: blake3_hash_parallel gives each worker whole power-of-two subtrees
+ * and only the few subtree roots are merged on the calling thread. With SSE2 the four
+ * column (then diagonal) G functions of a round run as one vector operation.
+ */
+static const uint32_t g_blake3_iv[8] = {0x6A09E667U, 0xBB67AE85U, 0x3C6EF372U, 0xA54FF53AU,
+                                        0x510E527FU, 0x9B05688CU, 0x1F83D9ABU, 0x5BE0CD19U};
+
+static const uint8_t g_blake3_schedule[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+static uint32_t load_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+#ifdef BLAKE3_SSE2
+static __m128i rotr_vec(__m128i x, int n)
+{
+    return _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n));
+}
+
+static void g_vec(__m128i *a, __m128i *b, __m128i *c, __m128i *d, __m128i mx, __m128i my)
+{
+    *a = _mm_add_epi32(_mm_add_epi32(*a, *b), mx);
+    *d = rotr_vec(_mm_xor_si128(*d, *a), 16);
+    *c = _mm_add_epi32(*c, *d);
+    *b = rotr_vec(_mm_xor_si128(*b, *c), 12);
+    *a = _mm_add_epi32(_mm_add_epi32(*a, *b), my);
+    *d = rotr_vec(_mm_xor_si128(*d, *a), 8);
+    *c = _mm_add_epi32(*c, *d);
+    *b = rotr_vec(_mm_xor_si128(*b, *c), 7);
+}
+
+/* The first eight output words of the compression function: a chaining value or root hash. */
+static void compress(const uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN], uint64_t counter,
+                     uint32_t block_len, uint32_t flags, uint32_t out[8])
+{
+    uint32_t m[16];
+    __m128i a = _mm_loadu_si128((const __m128i *)(const void *)&cv[0]);
+    __m128i b = _mm_loadu_si128((const __m128i *)(const void *)&cv[4]);
+    __m128i c = _mm_loadu_si128((const __m128i *)(const void *)&g_blake3_iv[0]);
+    __m128i d = _mm_setr_epi32((int)(uint32_t)counter, (int)(uint32_t)(counter >> 32), (int)block_len, (int)flags);
+    size_t r;
+    size_t i;
+
+    for (i = 0U; i < 16U; i++)
+    {
+        m[i] = load_le32(block + i * 4U);
+    }
+
+    for (r = 0U; r < 7U; r++)
+    {
+        const uint8_t *s = g_blake3_schedule[r];
+
+        g_vec(&a, &b, &c, &d, _mm_setr_epi32((int)m[s[0]], (int)m[s[2]], (int)m[s[4]], (int)m[s[6]]),
+              _mm_setr_epi32((int)m[s[1]], (int)m[s[3]], (int)m[s[5]], (int)m[s[7]]));
+
+        /* Rotate rows b, c and d so each lane holds one diagonal. */
+        b = _mm_shuffle_epi32(b, 0x39);
+        c = _mm_shuffle_epi32(c, 0x4E);
+        d = _mm_shuffle_epi32(d, 0x93);
+        g_vec(&a, &b, &c, &d, _mm_setr_epi32((int)m[s[8]], (int)m[s[10]], (int)m[s[12]], (int)m[s[14]]),
+              _mm_setr_epi32((int)m[s[9]], (int)m[s[11]], (int)m[s[13]], (int)m[s[15]]));
+        b = _mm_shuffle_epi32(b, 0x93);
+        c = _mm_shuffle_epi32(c, 0x4E);
+        d = _mm_shuffle_epi32(d, 0x39);
+    }
+
+    _mm_storeu_si128((__m128i *)(void *)&out[0], _mm_xor_si128(a, c));
+    _mm_storeu_si128((__m128i *)(void *)&out[4], _mm_xor_si128(b, d));
+}
+#else
+static uint32_t rotr32(uint32_t x, unsigned int n)
+{
+    return (x >> n) | (x << (32U - n));
+}
+
+static void g(uint32_t *v, size_t a, size_t b, size_t c, size_t d, uint32_t mx, uint32_t my)
+{
+    v[a] = v[a] + v[b] + mx;
+    v[d] = rotr32(v[d] ^ v[a], 16U);
+    v[c] = v[c] + v[d];
+    v[b] = rotr32(v[b] ^ v[c], 12U);
+    v[a] = v[a] + v[b] + my;
+    v[d] = rotr32(v[d] ^ v[a], 8U);
+    v[c] = v[c] + v[d];
+    v[b] = rotr32(v[b] ^ v[c], 7U);
+}
+
+/* The first eight output words of the compression function: a chaining value or root hash. */
+static void compress(const uint32_t cv[8], const uint8_t block[BLAKE3_BLOCK_LEN], uint64_t counter,
+                     uint32_t block_len, uint32_t flags, uint32_t out[8])
+{
+    uint32_t m[16];
+    uint32_t v[16];
+    size_t r;
+    size_t i;
+
+    for (i = 0U; i < 16U; i++)
+    {
+        m[i] = load_le32(block + i * 4U);
+    }
+
+    memcpy(v, cv, 8U * sizeof(uint32_t));
+    memcpy(v + 8, g_blake3_iv, 4U * sizeof(uint32_t));
+    v[12] = (uint32_t)counter;
+    v[13] = (uint32_t)(counter >> 32);
+    v[14] = block_len;
+    v[15] = flags;
+
+    for (r = 0U; r < 7U; r++)
+    {
+        const uint8_t *s = g_blake3_schedule[r];
+
+        g(v, 0U, 4U, 8U, 12U, m[s[0]], m[s[1]]);
+        g(v, 1U, 5U, 9U, 13U, m[s[2]], m[s[3]]);
+        g(v, 2U, 6U, 10U, 14U, m[s[4]], m[s[5]]);
+        g(v, 3U, 7U, 11U, 15U, m[s[6]], m[s[7]]);
+        g(v, 0U, 5U, 10U, 15U, m[s[8]], m[s[9]]);
+        g(v, 1U, 6U, 11U, 12U, m[s[10]], m[s[11]]);
+        g(v, 2U, 7U, 8U, 13U, m[s[12]], m[s[13]]);
+        g(v, 3U, 4U, 9U, 14U, m[s[14]], m[s[15]]);
+    }
+
+    for (i = 0U; i < 8U; i++)
+    {
+        out[i] = v[i] ^ v[i + 8U];
+    }
+}
+#endif
+
+static void parent_cv(const uint32_t left[8], const uint32_t right[8], uint32_t flags, uint32_t out[8])
+{
+    uint8_t block[BLAKE3_BLOCK_LEN];
+    size_t i;
+
+    for (i = 0U; i < 8U; i++)
+    {
+        block[i * 4U] = (uint8_t)left[i];
+        block[i * 4U + 1U] = (uint8_t)(left[i] >> 8);
+        block[i * 4U + 2U] = (uint8_t)(left[i] >> 16);
+        block[i * 4U + 3U] = (uint8_t)(left[i] >> 24);
+        block[32U + i * 4U] = (uint8_t)right[i];
+        block[32U + i * 4U + 1U] = (uint8_t)(right[i] >> 8);
+        block[32U + i * 4U + 2U] = (uint8_t)(right[i] >> 16);
+        block[32U + i * 4U + 3U] = (uint8_t)(right[i] >> 24);
+    }
+
+    compress(g_blake3_iv, block, 0U, BLAKE3_BLOCK_LEN, BLAKE3_PARENT | flags, out);
+}
+
+static void digest_from_words(const uint32_t words[8], uint8_t digest[32])
+{
+    size_t i;
+
+    for (i = 0U; i < 8U; i++)
+    {
+        digest[i * 4U] = (uint8_t)words[i];
+        digest[i * 4U + 1U] = (uint8_t)(words[i] >> 8);
+        digest[i * 4U + 2U] = (uint8_t)(words[i] >> 16);
+        digest[i * 4U + 3U] = (uint8_t)(words[i] >> 24);
+    }
+}
+
+static void chunk_reset(Blake3Ctx *ctx)
+{
+    memcpy(ctx->cv, g_blake3_iv, sizeof(ctx->cv));
+    ctx->block_len = 0U;
+    ctx->blocks = 0U;
+}
+
+/* The flags for the chunk's next block; CHUNK_START only on its first. */
+static uint32_t chunk_flags(const Blake3Ctx *ctx)
+{
+    return ctx->blocks == 0U ? BLAKE3_CHUNK_START : 0U;
+}
+
+/* Chaining value of the finished current chunk, or the root hash when `root` is set. */
+static void chunk_output(const Blake3Ctx *ctx, int root, uint32_t out[8])
+{
+    uint8_t block[BLAKE3_BLOCK_LEN];
+
+    memcpy(block, ctx->block, ctx->block_len);
+    memset(block + ctx->block_len, 0, BLAKE3_BLOCK_LEN - ctx->block_len);
+    compress(ctx->cv, block, ctx->chunk_base + ctx->chunks, ctx->block_len,
+             chunk_flags(ctx) | BLAKE3_CHUNK_END | (root ? BLAKE3_ROOT : 0U), out);
+}
+
+/* Pushes a finished subtree's chaining value, merging every pair the tree has completed. */
+static void push_cv(uint32_t stack[][8], uint8_t *depth, uint32_t cv[8], uint64_t total)
+{
+    while ((total & 1U) == 0U)
+    {
+        (*depth)--;
+        parent_cv(stack[*depth], cv, 0U, cv);
+        total >>= 1;
+    }
+
+    memcpy(stack[*depth], cv, 8U * sizeof(uint32_t));
+    (*depth)++;
+}
+
+/* Starts a hasher whose first chunk is chunk `chunk_base` of a larger input. */
+static void blake3_init_at(Blake3Ctx *ctx, uint64_t chunk_base)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->chunk_base = chunk_base;
+    chunk_reset(ctx);
+}
+
+void blake3_init(Blake3Ctx *ctx)
+{
+    blake3_init_at(ctx, 0U);
+}
+
+void blake3_update(Blake3Ctx *ctx, const uint8_t data[], size_t len)
+{
+    while (len > 0U)
+    {
+        size_t take;
+
+        /* A full chunk is only closed once more input arrives: the last one may be the root. */
+        if (ctx->blocks * BLAKE3_BLOCK_LEN + ctx->block_len == BLAKE3_CHUNK_LEN)
+        {
+            uint32_t cv[8];
+
+            chunk_output(ctx, 0, cv);
+            ctx->chunks++;
+            push_cv(ctx->stack, &ctx->depth, cv, ctx->chunks);
+            chunk_reset(ctx);
+        }
+
+        /* Likewise a full block is only compressed once it is known not to be the chunk's last. */
+        if (ctx->block_len == BLAKE3_BLOCK_LEN)
+        {
+            compress(ctx->cv, ctx->block, ctx->chunk_base + ctx->chunks, BLAKE3_BLOCK_LEN, chunk_flags(ctx), ctx->cv);
+            ctx->blocks++;
+            ctx->block_len = 0U;
+        }
+
+        take = BLAKE3_BLOCK_LEN - ctx->block_len;
+        if (take > len)
+        {
+            take = len;
+        }
+
+        memcpy(ctx->block + ctx->block_len, data, take);
+        ctx->block_len += (uint32_t)take;
+        data += take;
+        len -= take;
+    }
+}
+
+/*
+ * Folds the open chunk into the stack of finished subtrees. With `root` set the result is
+ * the digest of the whole input; without it, the chaining value of this subtree.
+ */
+static void blake3_finish(const Blake3Ctx *ctx, int root, uint32_t out[8])
+{
+    uint32_t cv[8];
+    size_t n = ctx->depth;
+
+    if (n == 0U)
+    {
+        chunk_output(ctx, root, out);
+        return;
+    }
+
+    chunk_output(ctx, 0, cv);
+    while (n > 1U)
+    {
+        n--;
+        parent_cv(ctx->stack[n], cv, 0U, cv);
+    }
+    parent_cv(ctx->stack[0], cv, root ? BLAKE3_ROOT : 0U, out);
+}
+
+void blake3_final(Blake3Ctx *ctx, uint8_t digest[32])
+{
+    uint32_t words[8];
+
+    blake3_finish(ctx, 1, words);
+    digest_from_words(words, digest);
+}
+
+typedef struct
+{
+    const uint8_t *data;
+    size_t len;
+    size_t piece_len;
+    size_t pieces;
+    unsigned int workers;
+    uint32_t (*cvs)[8];
+} Blake3Job;
+
+/* Each worker hashes every workers-th piece; pieces are equal, so the split stays even. */
+static void blake3_worker(void *arg, unsigned int index)
+{
+    Blake3Job *job = (Blake3Job *)arg;
+    size_t i;
+
+    for (i = index; i < job->pieces; i += job->workers)
+    {
+        size_t offset = i * job->piece_len;
+        size_t len = job->len - offset < job->piece_len ? job->len - offset : job->piece_len;
+        Blake3Ctx ctx;
+
+        blake3_init_at(&ctx, (uint64_t)(offset / BLAKE3_CHUNK_LEN));
+        blake3_update(&ctx, job->data + offset, len);
+        blake3_finish(&ctx, 0, job->cvs[i]);
+    }
+}
+
+/*
+ * The same digest as blake3_init/update/final, with large inputs spread over the machine's
+ * cores. Pieces are a power-of-two number of chunks, so each is a whole subtree of the
+ * input's tree and their chaining values merge exactly as chunks do.
+ */
+void blake3_hash_parallel(const uint8_t data[], size_t len, uint8_t digest[32])
+{
+    Blake3Job job;
+    uint32_t stack[54][8];
+    uint32_t root[8];
+    uint8_t depth = 0U;
+    unsigned int workers = len >= BLAKE3_PARALLEL_MIN ? worker_default_count() : 1U;
+    size_t i;
+
+    job.piece_len = (size_t)BLAKE3_PIECE_CHUNKS * BLAKE3_CHUNK_LEN;
+    while (len / job.piece_len > (size_t)workers * BLAKE3_PIECES_PER_WORKER)
+    {
+        job.piece_len *= 2U;
+    }
+    job.pieces = (len + job.piece_len - 1U) / job.piece_len;
+    job.cvs = workers > 1U && job.pieces > 1U ? (uint32_t(*)[8])malloc(job.pieces * sizeof(*job.cvs)) : NULL;
+
+    if (job.cvs == NULL)
+    {
+        Blake3Ctx ctx;
+
+        blake3_init(&ctx);
+        blake3_update(&ctx, data, len);
+        blake3_final(&ctx, digest);
+        return;
+    }
+
+    job.data = data;
+    job.len = len;
+    job.workers = workers < job.pieces ? workers : (unsigned int)job.pieces;
+    (void)run_workers(job.workers, blake3_worker, &job);
+
+    for (i = 0U; i + 1U < job.pieces; i++)
+    {
+        push_cv(stack, &depth, job.cvs[i], (uint64_t)(i + 1U));
+    }
+
+    memcpy(root, job.cvs[job.pieces - 1U], sizeof(root));
+    while (depth > 1U)
+    {
+        depth--;
+        parent_cv(stack[depth], root, 0U, root);
+    }
+    parent_cv(stack[0], root, BLAKE3_ROOT, root);
+    free(job.cvs);
+
+    digest_from_words(root, digest);
+}
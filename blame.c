@@ -0,0 +1,537 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLAME_MAP_RECORD VELOCE_ID_LEN
+#define BLAME_MAX_EDITS 2048
+
+/*
+ * blame/<commit_id>.map holds the line-origin map of one commit: one 16-character commit id
+ * per line of that commit's snapshot, naming the commit that last changed the line. Snapshots
+ * never change once written, so neither do their maps; annotating HEAD only has to diff the
+ * commits added since the newest cached map.
+ */
+typedef struct
+{
+    const char *ptr;
+    uint32_t len;
+    uint64_t hash;
+} LineRef;
+
+static uint64_t line_hash(const char *ptr, size_t len)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    size_t i;
+
+    for (i = 0U; i < len; i++)
+    {
+        hash ^= (unsigned char)ptr[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static int lines_equal(const LineRef *a, const LineRef *b)
+{
+    return a->hash == b->hash && a->len == b->len && memcmp(a->ptr, b->ptr, a->len) == 0;
+}
+
+static int split_lines(Arena *arena, const char *text, size_t len, LineRef **out, size_t *count)
+{
+    size_t cap = 0U;
+    size_t n = 0U;
+    size_t start = 0U;
+    size_t i;
+    LineRef *lines;
+
+    for (i = 0U; i < len; i++)
+    {
+        cap += text[i] == '\n';
+    }
+    cap++;
+
+    lines = (LineRef *)arena_alloc(arena, cap * sizeof(LineRef));
+    if (lines == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 0U; i <= len; i++)
+    {
+        if (i == len ? i > start : text[i] == '\n')
+        {
+            lines[n].ptr = text + start;
+            lines[n].len = (uint32_t)(i - start);
+            lines[n].hash = line_hash(lines[n].ptr, lines[n].len);
+            n++;
+            start = i + 1U;
+        }
+    }
+
+    *out = lines;
+    *count = n;
+    return 1;
+}
+
+/*
+ * Forward pass of Myers' O(ND) diff. trace[d] holds the furthest x reached on each diagonal
+ * k in [-d, d] after d edits. Returns the edit distance, or -1 once it exceeds `limit`.
+ */
+static int32_t myers_forward(Arena *arena, const LineRef *a, int32_t n, const LineRef *b, int32_t m, int32_t limit,
+                             int32_t **trace)
+{
+    const int32_t *prev = NULL;
+    int32_t d;
+    int32_t k;
+
+    for (d = 0; d <= limit; d++)
+    {
+        int32_t *v = (int32_t *)arena_alloc(arena, (2U * (size_t)d + 1U) * sizeof(int32_t));
+
+        if (v == NULL)
+        {
+            return -1;
+        }
+        trace[d] = v;
+
+        for (k = -d; k <= d; k += 2)
+        {
+            int32_t x;
+            int32_t y;
+
+            if (d == 0)
+            {
+                x = 0;
+            }
+            else if (k == -d || (k != d && prev[k - 1 + d - 1] < prev[k + 1 + d - 1]))
+            {
+                x = prev[k + 1 + d - 1];
+            }
+            else
+            {
+                x = prev[k - 1 + d - 1] + 1;
+            }
+
+            y = x - k;
+            while (x < n && y < m && lines_equal(&a[x], &b[y]))
+            {
+                x++;
+                y++;
+            }
+            v[k + d] = x;
+
+            if (x >= n && y >= m)
+            {
+                return d;
+            }
+        }
+
+        prev = v;
+    }
+
+    return -1;
+}
+
+/*
+ * Fills match[j] with the line of `a` that b[j] was carried over from, or -1 for inserted
+ * lines. The trace costs O(D^2) memory, so past BLAME_MAX_EDITS the section is treated as
+ * rewritten: every line of `b` is attributed to the new commit.
+ */
+static int myers_match(Arena *arena, const LineRef *a, int32_t n, const LineRef *b, int32_t m, int32_t *match)
+{
+    int32_t limit = n + m < BLAME_MAX_EDITS ? n + m : BLAME_MAX_EDITS;
+    int32_t **trace;
+    int32_t d;
+    int32_t x = n;
+    int32_t y = m;
+
+    for (y = 0; y < m; y++)
+    {
+        match[y] = -1;
+    }
+
+    if (n == 0 || m == 0)
+    {
+        return 1;
+    }
+
+    trace = (int32_t **)arena_alloc(arena, ((size_t)limit + 1U) * sizeof(int32_t *));
+    if (trace == NULL)
+    {
+        return 0;
+    }
+
+    d = myers_forward(arena, a, n, b, m, limit, trace);
+    if (d < 0)
+    {
+        return 1;
+    }
+
+    /* Walk back from (n, m), recording the diagonal runs between edits. */
+    y = m;
+    for (; d > 0; d--)
+    {
+        const int32_t *pv = trace[d - 1];
+        int32_t k = x - y;
+        int32_t pk;
+        int32_t px;
+
+        if (k == -d || (k != d && pv[k - 1 + d - 1] < pv[k + 1 + d - 1]))
+        {
+            pk = k + 1;
+        }
+        else
+        {
+            pk = k - 1;
+        }
+
+        px = pv[pk + d - 1];
+        while (x > px && y > px - pk)
+        {
+            x--;
+            y--;
+            match[y] = x;
+        }
+        x = px;
+        y = px - pk;
+    }
+
+    while (x > 0 && y > 0)
+    {
+        x--;
+        y--;
+        match[y] = x;
+    }
+
+    return 1;
+}
+
+/* Trims the common prefix and suffix before running the diff on what is left. */
+static int match_lines(Arena *arena, const LineRef *a, size_t n, const LineRef *b, size_t m, int32_t **out)
+{
+    int32_t *match = (int32_t *)arena_alloc(arena, (m + 1U) * sizeof(int32_t));
+    size_t prefix = 0U;
+    size_t suffix = 0U;
+    size_t i;
+
+    if (match == NULL || n > (size_t)INT32_MAX || m > (size_t)INT32_MAX)
+    {
+        return 0;
+    }
+
+    while (prefix < n && prefix < m && lines_equal(&a[prefix], &b[prefix]))
+    {
+        match[prefix] = (int32_t)prefix;
+        prefix++;
+    }
+
+    while (suffix < n - prefix && suffix < m - prefix && lines_equal(&a[n - 1U - suffix], &b[m - 1U - suffix]))
+    {
+        match[m - 1U - suffix] = (int32_t)(n - 1U - suffix);
+        suffix++;
+    }
+
+    if (!myers_match(arena, a + prefix, (int32_t)(n - prefix - suffix), b + prefix, (int32_t)(m - prefix - suffix),
+                     match + prefix))
+    {
+        return 0;
+    }
+
+    for (i = prefix; i < m - suffix; i++)
+    {
+        if (match[i] >= 0)
+        {
+            match[i] += (int32_t)prefix;
+        }
+    }
+
+    *out = match;
+    return 1;
+}
+
+static int blame_map_path(const IdKey *commit, char out[VELOCE_PATH_LEN + 1])
+{
+    char dir[VELOCE_PATH_LEN + 1];
+    char name[VELOCE_ID_LEN + 4];
+    char id[VELOCE_ID_LEN];
+
+    id_key_to_text(commit, id);
+    if (snprintf(name, sizeof(name), "%s.map", id) >= (int)sizeof(name))
+    {
+        return -1;
+    }
+
+    if (path_join(dir, sizeof(dir), storage_root(), VELOCE_BLAME_DIR) != 0)
+    {
+        return -1;
+    }
+
+    return path_join(out, VELOCE_PATH_LEN + 1U, dir, name);
+}
+
+static int load_blame_map(Arena *arena, const IdKey *commit, IdKey **origins, size_t *count)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char *data;
+    size_t len;
+    size_t i;
+    IdKey *map;
+
+    if (blame_map_path(commit, path) != 0 || !file_exists(path) ||
+        read_text_file_arena(arena, path, &data, &len) != 0 || len % BLAME_MAP_RECORD != 0U)
+    {
+        return 0;
+    }
+
+    *count = len / BLAME_MAP_RECORD;
+    map = (IdKey *)arena_alloc(arena, (*count + 1U) * sizeof(IdKey));
+    if (map == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 0U; i < *count; i++)
+    {
+        FieldSpan span;
+
+        span.ptr = data + i * BLAME_MAP_RECORD;
+        span.len = VELOCE_ID_LEN - 1U;
+        if (span.ptr[span.len] != '\n' || !id_key_from_span(&span, &map[i]))
+        {
+            return 0;
+        }
+    }
+
+    *origins = map;
+    return 1;
+}
+
+/* Writes beside the map and renames it into place, so a map is never seen half written. */
+static void save_blame_map(Arena *arena, const IdKey *commit, const IdKey *origins, size_t count)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char tmp_path[VELOCE_PATH_LEN + 1];
+    char *data;
+    size_t i;
+
+    data = (char *)arena_alloc(arena, count * BLAME_MAP_RECORD + 1U);
+    if (data == NULL || blame_map_path(commit, path) != 0 ||
+        snprintf(tmp_path, sizeof(tmp_path), "%s.part", path) >= (int)sizeof(tmp_path))
+    {
+        return;
+    }
+
+    for (i = 0U; i < count; i++)
+    {
+        id_key_to_text(&origins[i], data + i * BLAME_MAP_RECORD);
+        data[i * BLAME_MAP_RECORD + VELOCE_ID_LEN - 1U] = '\n';
+    }
+
+    /* A missing map only costs a re-diff next time, so write failures are not reported. */
+    if (write_text_file(tmp_path, data, count * BLAME_MAP_RECORD) != 0)
+    {
+        (void)remove(tmp_path);
+        return;
+    }
+
+    (void)remove(path);
+    if (rename(tmp_path, path) != 0)
+    {
+        (void)remove(tmp_path);
+    }
+}
+
+/* Splits a snapshot served by the snapshot cache; the caller releases the returned content. */
+static const char *acquire_entry_lines(Arena *arena, const CommitEntry *entry, LineRef **lines, size_t *count)
+{
+    size_t len;
+    const char *content = snapshot_cache_acquire(&entry->snapshot, &len);
+
+    if (content != NULL && !split_lines(arena, content, len, lines, count))
+    {
+        snapshot_cache_release(content);
+        return NULL;
+    }
+
+    return content;
+}
+
+/*
+ * Computes the line-origin map of history->items[target]. Starts from the newest commit at or
+ * before `target` that already has a cached map and diffs forward one commit at a time, caching
+ * each map on the way. A map whose length differs from its snapshot's line count is treated as
+ * missing and rewritten. Two scratch arenas alternate so only adjacent commits are held in memory.
+ */
+int blame_commit(const CommitHistory *history, size_t target, Arena *arena, IdKey **origins, size_t *count)
+{
+    Arena scratch[2];
+    const char *held[2] = {NULL, NULL};
+    LineRef *prev_lines = NULL;
+    IdKey *prev_origins = NULL;
+    size_t prev_count = 0U;
+    size_t base = target + 1U;
+    size_t i;
+    int ok = 1;
+
+    if (target >= history->count)
+    {
+        return 0;
+    }
+
+    arena_init(&scratch[0], 0U);
+    arena_init(&scratch[1], 0U);
+
+    while (base > 0U)
+    {
+        Arena *found = &scratch[(base - 1U) & 1U];
+        const char **snapshot = &held[(base - 1U) & 1U];
+        size_t lines;
+
+        if (load_blame_map(found, &history->items[base - 1U].id, &prev_origins, &prev_count))
+        {
+            *snapshot = acquire_entry_lines(found, &history->items[base - 1U], &prev_lines, &lines);
+            if (*snapshot == NULL)
+            {
+                ok = 0;
+                break;
+            }
+            if (lines == prev_count)
+            {
+                break;
+            }
+            snapshot_cache_release(*snapshot);
+            *snapshot = NULL;
+        }
+        arena_reset(found);
+        base--;
+    }
+
+    if (base == 0U)
+    {
+        prev_lines = NULL;
+        prev_origins = NULL;
+        prev_count = 0U;
+    }
+
+    for (i = base; ok && i <= target; i++)
+    {
+        Arena *cur = &scratch[i & 1U];
+        LineRef *lines;
+        IdKey *map;
+        int32_t *match;
+        size_t n;
+        size_t j;
+
+        arena_reset(cur);
+        snapshot_cache_release(held[i & 1U]);
+        held[i & 1U] = acquire_entry_lines(cur, &history->items[i], &lines, &n);
+        if (held[i & 1U] == NULL || !match_lines(cur, prev_lines, prev_count, lines, n, &match))
+        {
+            ok = 0;
+            break;
+        }
+
+        map = (IdKey *)arena_alloc(cur, (n + 1U) * sizeof(IdKey));
+        if (map == NULL)
+        {
+            ok = 0;
+            break;
+        }
+
+        for (j = 0U; j < n; j++)
+        {
+            map[j] = match[j] >= 0 ? prev_origins[match[j]] : history->items[i].id;
+        }
+
+        save_blame_map(cur, &history->items[i].id, map, n);
+        prev_lines = lines;
+        prev_origins = map;
+        prev_count = n;
+    }
+
+    if (ok)
+    {
+        *origins = (IdKey *)arena_alloc(arena, (prev_count + 1U) * sizeof(IdKey));
+        ok = *origins != NULL;
+        if (ok)
+        {
+            memcpy(*origins, prev_origins, prev_count * sizeof(IdKey));
+            *count = prev_count;
+        }
+    }
+
+    snapshot_cache_release(held[0]);
+    snapshot_cache_release(held[1]);
+    arena_free(&scratch[0]);
+    arena_free(&scratch[1]);
+    return ok;
+}
+
+static const CommitEntry *find_entry(const CommitHistory *history, const IdKey *id)
+{
+    size_t i = history->count;
+
+    /* Most lines come from recent commits, so search from the newest end. */
+    while (i > 0U)
+    {
+        i--;
+        if (id_key_equals(&history->items[i].id, id))
+        {
+            return &history->items[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Attributes each line of the repository's tracked file: lines it shares with the latest
+ * commit inherit that commit's origins, and the rest have no origin. `history` must hold
+ * the repository's commits; `lines` points into `arena`.
+ */
+int blame_tracked_file(const RepoRecord *repo, const CommitHistory *history, Arena *arena, BlameLine **lines,
+                       size_t *count)
+{
+    IdKey *origins;
+    size_t origin_count;
+    LineRef *head_lines;
+    LineRef *work_lines;
+    size_t head_count;
+    size_t work_count;
+    int32_t *match;
+    const char *head = NULL;
+    char *content;
+    size_t len;
+    size_t i;
+    int ok;
+
+    if (history->count == 0U)
+    {
+        return 0;
+    }
+
+    ok = blame_commit(history, history->count - 1U, arena, &origins, &origin_count) &&
+         (head = acquire_entry_lines(arena, &history->items[history->count - 1U], &head_lines, &head_count)) != NULL &&
+         head_count == origin_count && read_text_file_arena(arena, repo->tracked_file, &content, &len) == 0 &&
+         split_lines(arena, content, len, &work_lines, &work_count) &&
+         match_lines(arena, head_lines, head_count, work_lines, work_count, &match) &&
+         (*lines = (BlameLine *)arena_alloc(arena, (work_count + 1U) * sizeof(BlameLine))) != NULL;
+    snapshot_cache_release(head);
+    if (!ok)
+    {
+        return 0;
+    }
+
+    for (i = 0U; i < work_count; i++)
+    {
+        (*lines)[i].text = work_lines[i].ptr;
+        (*lines)[i].len = work_lines[i].len;
+        (*lines)[i].origin = match[i] >= 0 ? find_entry(history, &origins[match[i]]) : NULL;
+    }
+
+    *count = work_count;
+    return 1;
+}
@@ -0,0 +1,865 @@
+#define _GNU_SOURCE
+
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define VELOCE_IO_URING 1
+#endif
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef VELOCE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+
+#define BULK_QUEUE_DEPTH 32U
+#define BULK_SLOT_SIZE (128U * 1024U)
+#define BULK_SLOT_STRIDE (BULK_SLOT_SIZE + 4096U)
+/* Largest single copy_file_range or sendfile request; both stop short of 2 GiB anyway. */
+#define BULK_COPY_CHUNK (1U << 30)
+#define BULK_COPY_BUFFER (64U * 1024U)
+
+/*
+ * Bulk reads and writes of many small files (snapshots, mostly). On Linux they go through an
+ * io_uring: up to BULK_QUEUE_DEPTH files are in flight at once, reads land in a pool of
+ * registered buffers and one io_uring_enter both submits new requests and reaps finished
+ * ones. Elsewhere, when the kernel refuses a ring, or with VELOCE_IO_URING=0, every file
+ * takes the blocking read_text_file/write_text_file path instead.
+ */
+static int g_uring_mode = -1;
+
+int bulk_io_uring_enabled(void)
+{
+#ifdef VELOCE_IO_URING
+    if (g_uring_mode < 0)
+    {
+        const char *env = getenv("VELOCE_IO_URING");
+        g_uring_mode = env == NULL || env[0] == '\0' || strcmp(env, "0") != 0;
+    }
+
+    return g_uring_mode;
+#else
+    return 0;
+#endif
+}
+
+void bulk_io_uring_set(int enabled)
+{
+    g_uring_mode = enabled != 0;
+}
+
+/* Reads paths[first..count) one at a time, reporting each under its index in `paths`. */
+static int blocking_read_files(const char *const *paths, size_t first, size_t count, BulkReadFn fn, void *arg)
+{
+    size_t i;
+    int rc = 0;
+
+    for (i = first; i < count; i++)
+    {
+        char *content;
+        size_t len;
+
+        if (read_text_file(paths[i], &content, &len) != 0)
+        {
+            fn(arg, i, NULL, 0U);
+            rc = -1;
+            continue;
+        }
+
+        fn(arg, i, content, len);
+        free(content);
+    }
+
+    return rc;
+}
+
+static int blocking_write_files(const BulkWrite *files, size_t count)
+{
+    size_t i;
+    int rc = 0;
+
+    for (i = 0U; i < count; i++)
+    {
+        if (write_text_file(files[i].path, files[i].data, files[i].len) != 0)
+        {
+            rc = -1;
+        }
+    }
+
+    return rc;
+}
+
+#ifdef VELOCE_IO_URING
+
+typedef struct
+{
+    int fd;
+    unsigned int entries;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned int queued;
+} Ring;
+
+/* One file in flight: which request it is, its descriptor and how far it has got. */
+typedef struct
+{
+    size_t index;
+    int fd;
+    size_t size;
+    size_t done;
+    const char *data;
+} BulkSlot;
+
+static void ring_close(Ring *ring)
+{
+    if (ring->sqes != NULL)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+}
+
+static int ring_open(Ring *ring, unsigned int entries)
+{
+    struct io_uring_params params;
+    char *sq;
+    char *cq;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+    {
+        return 0;
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0U && ring->cq_ring_size > ring->sq_ring_size)
+    {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        ring->sq_ring = NULL;
+        ring_close(ring);
+        return 0;
+    }
+
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0U)
+    {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                             IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+        {
+            ring->cq_ring = NULL;
+            ring_close(ring);
+            return 0;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                             ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        ring_close(ring);
+        return 0;
+    }
+
+    sq = (char *)ring->sq_ring;
+    cq = (char *)ring->cq_ring;
+    ring->sq_head = (unsigned int *)(void *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(void *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(void *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(void *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned int *)(void *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(void *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(void *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(void *)(cq + params.cq_off.cqes);
+    return 1;
+}
+
+/* The slot count never exceeds the ring size, so a free SQE always exists. */
+static struct io_uring_sqe *ring_next_sqe(Ring *ring)
+{
+    unsigned int index = *ring->sq_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    return sqe;
+}
+
+/* Publishes the SQE handed out by ring_next_sqe once it is filled in. */
+static void ring_push(Ring *ring)
+{
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1U, __ATOMIC_RELEASE);
+    ring->queued++;
+}
+
+/* Submits everything queued and, if asked, blocks until at least one completion is ready. */
+static int ring_enter(Ring *ring, unsigned int wait)
+{
+    long res;
+
+    do
+    {
+        res = syscall(__NR_io_uring_enter, ring->fd, ring->queued, wait, wait > 0U ? IORING_ENTER_GETEVENTS : 0U,
+                      NULL, 0);
+    } while (res < 0 && errno == EINTR);
+
+    if (res < 0)
+    {
+        return 0;
+    }
+
+    ring->queued -= (unsigned int)res < ring->queued ? (unsigned int)res : ring->queued;
+    return 1;
+}
+
+static int ring_peek(Ring *ring, struct io_uring_cqe *out)
+{
+    unsigned int head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+
+    *out = ring->cqes[head & *ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1U, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void queue_read(Ring *ring, BulkSlot *slot, unsigned int id, char *buffer, int fixed)
+{
+    struct io_uring_sqe *sqe = ring_next_sqe(ring);
+
+    sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(buffer + slot->done);
+    sqe->len = (unsigned int)(slot->size - slot->done);
+    sqe->off = (uint64_t)slot->done;
+    sqe->buf_index = (uint16_t)id;
+    sqe->user_data = id;
+    ring_push(ring);
+}
+
+static void queue_write(Ring *ring, BulkSlot *slot, unsigned int id)
+{
+    struct io_uring_sqe *sqe = ring_next_sqe(ring);
+
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = slot->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(slot->data + slot->done);
+    sqe->len = (unsigned int)(slot->size - slot->done);
+    sqe->off = (uint64_t)slot->done;
+    sqe->user_data = id;
+    ring_push(ring);
+}
+
+/*
+ * Opens the next file that fits a slot buffer. Files that cannot be opened are reported
+ * straight away; files larger than a slot are read on the blocking path. Returns 1 once a
+ * file needs the ring, 0 when none is left.
+ */
+static int open_next_read(const char *const *paths, size_t count, size_t *next, BulkSlot *slot, BulkReadFn fn,
+                          void *arg, int *rc)
+{
+    while (*next < count)
+    {
+        size_t i = (*next)++;
+        struct stat st;
+        int fd = open(paths[i], O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0 || fstat(fd, &st) != 0)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            fn(arg, i, NULL, 0U);
+            *rc = -1;
+            continue;
+        }
+
+        if ((size_t)st.st_size > BULK_SLOT_SIZE)
+        {
+            close(fd);
+            if (blocking_read_files(paths, i, i + 1U, fn, arg) != 0)
+            {
+                *rc = -1;
+            }
+            continue;
+        }
+
+        if (st.st_size == 0)
+        {
+            close(fd);
+            fn(arg, i, "", 0U);
+            continue;
+        }
+
+        slot->index = i;
+        slot->fd = fd;
+        slot->size = (size_t)st.st_size;
+        slot->done = 0U;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* A ring plus its registered buffer pool, set up once and reused for every batch. */
+struct BulkReader
+{
+    int uring;
+    Ring ring;
+    char *pool;
+    struct iovec iov[BULK_QUEUE_DEPTH];
+    unsigned int depth;
+    int fixed;
+};
+
+static void reader_uring_open(BulkReader *reader)
+{
+    unsigned int i;
+
+    if (!bulk_io_uring_enabled() || !ring_open(&reader->ring, BULK_QUEUE_DEPTH))
+    {
+        return;
+    }
+
+    reader->depth = reader->ring.entries < BULK_QUEUE_DEPTH ? reader->ring.entries : BULK_QUEUE_DEPTH;
+    reader->pool = (char *)aligned_alloc(4096U, (size_t)reader->depth * BULK_SLOT_STRIDE);
+    if (reader->pool == NULL)
+    {
+        ring_close(&reader->ring);
+        return;
+    }
+
+    for (i = 0U; i < reader->depth; i++)
+    {
+        reader->iov[i].iov_base = reader->pool + (size_t)i * BULK_SLOT_STRIDE;
+        reader->iov[i].iov_len = BULK_SLOT_STRIDE;
+    }
+
+    /* Registration pins the pool once instead of per read; without it plain reads still batch. */
+    reader->fixed =
+        syscall(__NR_io_uring_register, reader->ring.fd, IORING_REGISTER_BUFFERS, reader->iov, reader->depth) == 0;
+    reader->uring = 1;
+}
+
+static void reader_uring_close(BulkReader *reader)
+{
+    if (reader->uring)
+    {
+        ring_close(&reader->ring);
+        free(reader->pool);
+        reader->uring = 0;
+    }
+}
+
+static int uring_read_files(BulkReader *reader, const char *const *paths, size_t count, BulkReadFn fn, void *arg)
+{
+    Ring *ring = &reader->ring;
+    BulkSlot slots[BULK_QUEUE_DEPTH];
+    unsigned int free_ids[BULK_QUEUE_DEPTH];
+    unsigned int free_count = 0U;
+    unsigned int inflight = 0U;
+    size_t next = 0U;
+    int rc = 0;
+    unsigned int i;
+
+    for (i = 0U; i < reader->depth; i++)
+    {
+        free_ids[free_count++] = reader->depth - 1U - i;
+    }
+
+    while (1)
+    {
+        struct io_uring_cqe cqe;
+
+        while (free_count > 0U)
+        {
+            unsigned int id = free_ids[free_count - 1U];
+
+            if (!open_next_read(paths, count, &next, &slots[id], fn, arg, &rc))
+            {
+                break;
+            }
+            free_count--;
+            queue_read(ring, &slots[id], id, (char *)reader->iov[id].iov_base, reader->fixed);
+            inflight++;
+        }
+
+        if (inflight == 0U)
+        {
+            break;
+        }
+
+        if (!ring_enter(ring, 1U))
+        {
+            /* The ring itself failed; finish whatever is left the slow way and stop using it. */
+            for (i = 0U; i < reader->depth; i++)
+            {
+                unsigned int k;
+                int idle = 0;
+
+                for (k = 0U; k < free_count; k++)
+                {
+                    idle |= free_ids[k] == i;
+                }
+                if (!idle)
+                {
+                    close(slots[i].fd);
+                    if (blocking_read_files(paths, slots[i].index, slots[i].index + 1U, fn, arg) != 0)
+                    {
+                        rc = -1;
+                    }
+                }
+            }
+            if (blocking_read_files(paths, next, count, fn, arg) != 0)
+            {
+                rc = -1;
+            }
+            reader_uring_close(reader);
+            break;
+        }
+
+        while (ring_peek(ring, &cqe))
+        {
+            unsigned int id = (unsigned int)cqe.user_data;
+            BulkSlot *slot = &slots[id];
+            char *buffer = (char *)reader->iov[id].iov_base;
+
+            if (cqe.res > 0)
+            {
+                slot->done += (size_t)cqe.res;
+                if (slot->done < slot->size)
+                {
+                    queue_read(ring, slot, id, buffer, reader->fixed);
+                    continue;
+                }
+            }
+
+            close(slot->fd);
+            inflight--;
+            free_ids[free_count++] = id;
+            if (slot->done < slot->size)
+            {
+                fn(arg, slot->index, NULL, 0U);
+                rc = -1;
+                continue;
+            }
+
+            buffer[slot->size] = '\0';
+            stats_add(STAT_BYTES_READ, (uint64_t)slot->size);
+            fn(arg, slot->index, buffer, slot->size);
+        }
+    }
+
+    return rc;
+}
+
+static int uring_write_files(const BulkWrite *files, size_t count)
+{
+    Ring ring;
+    BulkSlot slots[BULK_QUEUE_DEPTH];
+    unsigned int free_ids[BULK_QUEUE_DEPTH];
+    unsigned int free_count = 0U;
+    unsigned int depth;
+    unsigned int inflight = 0U;
+    size_t next = 0U;
+    int rc = 0;
+    unsigned int i;
+
+    if (!ring_open(&ring, BULK_QUEUE_DEPTH))
+    {
+        return blocking_write_files(files, count);
+    }
+
+    depth = ring.entries < BULK_QUEUE_DEPTH ? ring.entries : BULK_QUEUE_DEPTH;
+    for (i = 0U; i < depth; i++)
+    {
+        free_ids[free_count++] = depth - 1U - i;
+    }
+
+    while (1)
+    {
+        struct io_uring_cqe cqe;
+
+        while (free_count > 0U && next < count)
+        {
+            const BulkWrite *file = &files[next];
+            unsigned int id = free_ids[free_count - 1U];
+            int fd = open(file->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+            next++;
+            if (fd < 0)
+            {
+                rc = -1;
+                continue;
+            }
+
+            if (file->len == 0U)
+            {
+                close(fd);
+                continue;
+            }
+
+            slots[id].index = next - 1U;
+            slots[id].fd = fd;
+            slots[id].size = file->len;
+            slots[id].done = 0U;
+            slots[id].data = file->data;
+            free_count--;
+            queue_write(&ring, &slots[id], id);
+            inflight++;
+        }
+
+        if (inflight == 0U)
+        {
+            break;
+        }
+
+        if (!ring_enter(&ring, 1U))
+        {
+            for (i = 0U; i < depth; i++)
+            {
+                unsigned int k;
+                int idle = 0;
+
+                for (k = 0U; k < free_count; k++)
+                {
+                    idle |= free_ids[k] == i;
+                }
+                if (!idle)
+                {
+                    close(slots[i].fd);
+                    if (blocking_write_files(&files[slots[i].index], 1U) != 0)
+                    {
+                        rc = -1;
+                    }
+                }
+            }
+            if (next < count && blocking_write_files(files + next, count - next) != 0)
+            {
+                rc = -1;
+            }
+            break;
+        }
+
+        while (ring_peek(&ring, &cqe))
+        {
+            unsigned int id = (unsigned int)cqe.user_data;
+            BulkSlot *slot = &slots[id];
+
+            if (cqe.res > 0)
+            {
+                slot->done += (size_t)cqe.res;
+                if (slot->done < slot->size)
+                {
+                    queue_write(&ring, slot, id);
+                    continue;
+                }
+            }
+
+            close(slot->fd);
+            inflight--;
+            free_ids[free_count++] = id;
+            if (slot->done < slot->size)
+            {
+                rc = -1;
+                continue;
+            }
+            stats_add(STAT_BYTES_WRITTEN, (uint64_t)slot->size);
+        }
+    }
+
+    ring_close(&ring);
+    return rc;
+}
+
+#endif
+
+#ifndef VELOCE_IO_URING
+struct BulkReader
+{
+    int uring;
+};
+#endif
+
+BulkReader *bulk_reader_open(void)
+{
+    BulkReader *reader = (BulkReader *)calloc(1U, sizeof(BulkReader));
+
+#ifdef VELOCE_IO_URING
+    if (reader != NULL)
+    {
+        reader_uring_open(reader);
+    }
+#endif
+
+    return reader;
+}
+
+void bulk_reader_close(BulkReader *reader)
+{
+    if (reader == NULL)
+    {
+        return;
+    }
+
+#ifdef VELOCE_IO_URING
+    reader_uring_close(reader);
+#endif
+    free(reader);
+}
+
+/*
+ * Reads every file in `paths` and hands its NUL-terminated contents to `fn`, or NULL if it
+ * could not be read. Calls arrive in completion order on the calling thread, and the bytes
+ * are only valid for the duration of the call. Returns 0 if every file was read, -1 if not.
+ */
+int bulk_reader_read(BulkReader *reader, const char *const *paths, size_t count, BulkReadFn fn, void *arg)
+{
+#ifdef VELOCE_IO_URING
+    if (reader != NULL && reader->uring && count > 1U)
+    {
+        return uring_read_files(reader, paths, count, fn, arg);
+    }
+#else
+    (void)reader;
+#endif
+
+    return blocking_read_files(paths, 0U, count, fn, arg);
+}
+
+/* One-shot bulk_reader_read for callers that only have a single batch. */
+int bulk_read_files(const char *const *paths, size_t count, BulkReadFn fn, void *arg)
+{
+    BulkReader *reader;
+    int rc;
+
+    if (count <= 1U || !bulk_io_uring_enabled())
+    {
+        return blocking_read_files(paths, 0U, count, fn, arg);
+    }
+
+    reader = bulk_reader_open();
+    rc = bulk_reader_read(reader, paths, count, fn, arg);
+    bulk_reader_close(reader);
+    return rc;
+}
+
+/* Creates or truncates each file and writes its contents. Returns 0 if all writes succeeded. */
+int bulk_write_files(const BulkWrite *files, size_t count)
+{
+#ifdef VELOCE_IO_URING
+    if (bulk_io_uring_enabled() && count > 1U)
+    {
+        return uring_write_files(files, count);
+    }
+#endif
+
+    return blocking_write_files(files, count);
+}
+
+#ifndef _WIN32
+/* Copies the rest of `in` to `out` through a buffer; the fallback for what the kernel would not copy. */
+static int copy_by_buffer(int in, int out, uint64_t *copied)
+{
+    char buffer[BULK_COPY_BUFFER];
+
+    while (1)
+    {
+        ssize_t got = read(in, buffer, sizeof(buffer));
+        ssize_t put = 0;
+
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            return got == 0;
+        }
+
+        while (put < got)
+        {
+            ssize_t n = write(out, buffer + put, (size_t)(got - put));
+
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return 0;
+            }
+            put += n;
+        }
+        *copied += (uint64_t)got;
+    }
+}
+
+/*
+ * Copies `size` bytes from `in` to `out`. On Linux copy_file_range keeps the data in the
+ * kernel, and filesystems that can share extents (Btrfs, XFS) do not copy it at all;
+ * sendfile covers kernels and filesystem pairs that refuse it. Both move the file offsets,
+ * so whatever they leave is finished through a buffer.
+ */
+static int copy_descriptor(int in, int out, uint64_t size, uint64_t *copied)
+{
+#ifdef __linux__
+#ifdef SYS_copy_file_range
+    while (*copied < size)
+    {
+        uint64_t left = size - *copied;
+        long n = syscall(SYS_copy_file_range, in, NULL, out, NULL,
+                         (size_t)(left > BULK_COPY_CHUNK ? BULK_COPY_CHUNK : left), 0U);
+
+        if (n <= 0)
+        {
+            break;
+        }
+        *copied += (uint64_t)n;
+    }
+#endif
+
+    while (*copied < size)
+    {
+        uint64_t left = size - *copied;
+        ssize_t n = sendfile(out, in, NULL, (size_t)(left > BULK_COPY_CHUNK ? BULK_COPY_CHUNK : left));
+
+        if (n <= 0)
+        {
+            break;
+        }
+        *copied += (uint64_t)n;
+    }
+#else
+    (void)size;
+#endif
+
+    return copy_by_buffer(in, out, copied);
+}
+#endif
+
+/*
+ * Creates or truncates `dst` and fills it with the contents of `src` without staging the
+ * file in memory: CopyFile on Windows, copy_descriptor elsewhere. Returns 0 on success.
+ */
+int bulk_copy_file(const char *src, const char *dst)
+{
+    uint64_t copied = 0U;
+    uint64_t start;
+
+    if (src == NULL || dst == NULL)
+    {
+        return -1;
+    }
+
+    start = stats_op_begin();
+#ifdef _WIN32
+    {
+        WIN32_FILE_ATTRIBUTE_DATA info;
+
+        if (!CopyFileA(src, dst, FALSE) || !GetFileAttributesExA(dst, GetFileExInfoStandard, &info))
+        {
+            return -1;
+        }
+        copied = ((uint64_t)info.nFileSizeHigh << 32) | (uint64_t)info.nFileSizeLow;
+    }
+#else
+    {
+        struct stat st;
+        int in;
+        int out;
+        int ok;
+
+        in = open(src, O_RDONLY);
+        if (in < 0)
+        {
+            return -1;
+        }
+
+        out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (out < 0 || fstat(in, &st) != 0)
+        {
+            if (out >= 0)
+            {
+                close(out);
+            }
+            close(in);
+            return -1;
+        }
+
+        ok = copy_descriptor(in, out, (uint64_t)st.st_size, &copied);
+        ok = close(out) == 0 && ok;
+        close(in);
+        if (!ok)
+        {
+            return -1;
+        }
+    }
+#endif
+
+    stats_add(STAT_BYTES_WRITTEN, copied);
+    stats_op_end(STAT_OP_FILE_WRITE, start);
+    return 0;
+}
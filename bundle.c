@@ -0,0 +1,781 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A bundle is one repository in a single file, written and read front to back:
+ *
+ *   "VELOCEB1"
+ *   'R' <repos.db line>
+ *   'C' <commit log line>      for each commit, oldest first, followed by
+ *   'D' <u32 raw> <u32 stored> <stored bytes>   zero or more snapshot blocks
+ *   'E' <commit count> '\n'
+ *
+ * Record frames reuse the .db line format. Snapshot blocks hold at most BUNDLE_BLOCK raw
+ * bytes; a block whose stored size differs from its raw size is LZ compressed. Neither side
+ * holds more than one block in memory, whatever the size of the repository.
+ */
+#define BUNDLE_MAGIC "VELOCEB1"
+#define BUNDLE_MAGIC_LEN 8U
+#define BUNDLE_BLOCK 65536U
+#define BUNDLE_LINE_LEN 4096U
+#define BUNDLE_HOME_PREFIX "$VELOCE_HOME/"
+
+#define LZ_MIN_MATCH 4U
+#define LZ_HASH_BITS 13U
+#define LZ_MAX_OFFSET 65535U
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void write_u32(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static uint32_t load_u32(const uint8_t *p)
+{
+    uint32_t value;
+
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/* Writes a 4-bit length nibble's overflow as a run of 255s and a remainder. */
+static uint8_t *put_length(uint8_t *op, const uint8_t *end, size_t len)
+{
+    while (len >= 255U)
+    {
+        if (op >= end)
+        {
+            return NULL;
+        }
+        *op++ = 255U;
+        len -= 255U;
+    }
+
+    if (op >= end)
+    {
+        return NULL;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *end, const uint8_t *literals, size_t literal_len,
+                             size_t offset, size_t match_len)
+{
+    size_t match_code = match_len > 0U ? match_len - LZ_MIN_MATCH : 0U;
+
+    if (op >= end)
+    {
+        return NULL;
+    }
+
+    *op++ = (uint8_t)(((literal_len < 15U ? literal_len : 15U) << 4) | (match_code < 15U ? match_code : 15U));
+    if (literal_len >= 15U && (op = put_length(op, end, literal_len - 15U)) == NULL)
+    {
+        return NULL;
+    }
+
+    if ((size_t)(end - op) < literal_len)
+    {
+        return NULL;
+    }
+    memcpy(op, literals, literal_len);
+    op += literal_len;
+
+    if (match_len == 0U)
+    {
+        return op;
+    }
+
+    if (end - op < 2)
+    {
+        return NULL;
+    }
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    if (match_code >= 15U && (op = put_length(op, end, match_code - 15U)) == NULL)
+    {
+        return NULL;
+    }
+
+    return op;
+}
+
+/*
+ * Greedy LZ77 in the LZ4 block layout: a token of literal and match length nibbles, the
+ * literals, then a 16-bit match offset. Returns the compressed size, or 0 if the output
+ * would not fit in `cap` bytes (callers then store the block raw).
+ */
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+    uint32_t table[1U << LZ_HASH_BITS];
+    const uint8_t *end = dst + cap;
+    uint8_t *op = dst;
+    size_t anchor = 0U;
+    size_t pos = 0U;
+
+    memset(table, 0, sizeof(table));
+
+    while (pos + LZ_MIN_MATCH <= len)
+    {
+        uint32_t seq = load_u32(src + pos);
+        uint32_t slot = (seq * 2654435761U) >> (32U - LZ_HASH_BITS);
+        size_t candidate = table[slot];
+
+        table[slot] = (uint32_t)pos;
+        if (candidate < pos && pos - candidate <= LZ_MAX_OFFSET && load_u32(src + candidate) == seq)
+        {
+            size_t match_len = LZ_MIN_MATCH;
+
+            while (pos + match_len < len && src[candidate + match_len] == src[pos + match_len])
+            {
+                match_len++;
+            }
+
+            op = put_sequence(op, end, src + anchor, pos - anchor, pos - candidate, match_len);
+            if (op == NULL)
+            {
+                return 0U;
+            }
+
+            pos += match_len;
+            anchor = pos;
+            continue;
+        }
+        pos++;
+    }
+
+    op = put_sequence(op, end, src + anchor, len - anchor, 0U, 0U);
+    return op == NULL ? 0U : (size_t)(op - dst);
+}
+
+static int get_length(const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+    uint8_t byte;
+
+    do
+    {
+        if (*ip >= end)
+        {
+            return 0;
+        }
+        byte = *(*ip)++;
+        *len += byte;
+    } while (byte == 255U);
+
+    return 1;
+}
+
+/* Expands an lz_compress block; returns 1 only if it decodes to exactly `raw_len` bytes. */
+int lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t raw_len)
+{
+    const uint8_t *ip = src;
+    const uint8_t *end = src + len;
+    size_t out = 0U;
+
+    while (ip < end)
+    {
+        uint8_t token = *ip++;
+        size_t literal_len = token >> 4;
+        size_t match_len = token & 15U;
+        size_t offset;
+        size_t i;
+
+        if (literal_len == 15U && !get_length(&ip, end, &literal_len))
+        {
+            return 0;
+        }
+
+        if ((size_t)(end - ip) < literal_len || raw_len - out < literal_len)
+        {
+            return 0;
+        }
+        memcpy(dst + out, ip, literal_len);
+        ip += literal_len;
+        out += literal_len;
+
+        if (ip == end)
+        {
+            break;
+        }
+
+        if (end - ip < 2)
+        {
+            return 0;
+        }
+        offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+
+        if (match_len == 15U && !get_length(&ip, end, &match_len))
+        {
+            return 0;
+        }
+        match_len += LZ_MIN_MATCH;
+
+        if (offset == 0U || offset > out || raw_len - out < match_len)
+        {
+            return 0;
+        }
+
+        if (offset >= match_len)
+        {
+            memcpy(dst + out, dst + out - offset, match_len);
+        }
+        else
+        {
+            /* Byte at a time: an overlapping match repeats the bytes it is producing. */
+            for (i = 0U; i < match_len; i++)
+            {
+                dst[out + i] = dst[out - offset + i];
+            }
+        }
+        out += match_len;
+    }
+
+    return out == raw_len;
+}
+
+static int db_path(const char *name, char path[VELOCE_PATH_LEN + 1])
+{
+    return path_join(path, VELOCE_PATH_LEN + 1U, storage_root(), name);
+}
+
+/* Returns 1 if `key` appears as the first field of some record in `name`. */
+static int db_has_key(const char *name, size_t expected, const IdKey *key)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    DbScan scan;
+    FieldSpan fields[VELOCE_USER_FIELDS];
+    int found = 0;
+
+    if (db_path(name, path) != 0 || !db_scan_open(&scan, path))
+    {
+        return 0;
+    }
+
+    while (!found && db_scan_next(&scan, fields, expected))
+    {
+        found = span_key_equals(&fields[0], key);
+    }
+
+    db_scan_close(&scan);
+    return found;
+}
+
+/*
+ * A tracked file inside this root's workspace is written to the bundle relative to the root,
+ * so the importing side can recreate it under its own workspace.
+ */
+static void home_relative_tracked_file(const char *tracked, char out[VELOCE_PATH_LEN + 1])
+{
+    char workspace[VELOCE_PATH_LEN + 1];
+    size_t len;
+
+    (void)snprintf(out, VELOCE_PATH_LEN + 1U, "%s", tracked);
+    if (path_join(workspace, sizeof(workspace), storage_root(), VELOCE_WORKSPACE_DIR) != 0)
+    {
+        return;
+    }
+
+    len = strlen(workspace);
+    if (strncmp(tracked, workspace, len) == 0 && tracked[len] == VELOCE_PATH_SEP)
+    {
+        (void)snprintf(out, VELOCE_PATH_LEN + 1U, "%s%s", BUNDLE_HOME_PREFIX,
+                       tracked + len - strlen(VELOCE_WORKSPACE_DIR));
+    }
+}
+
+static int write_block(FILE *out, const uint8_t *raw, size_t len, uint8_t *packed, int compress)
+{
+    uint8_t header[9];
+    size_t stored = compress ? lz_compress(raw, len, packed, len - 1U) : 0U;
+    const uint8_t *data = stored > 0U ? packed : raw;
+
+    if (stored == 0U)
+    {
+        stored = len;
+    }
+
+    header[0] = (uint8_t)'D';
+    write_u32(header + 1, (uint32_t)len);
+    write_u32(header + 5, (uint32_t)stored);
+    if (fwrite(header, 1U, sizeof(header), out) != sizeof(header) || fwrite(data, 1U, stored, out) != stored)
+    {
+        return 0;
+    }
+
+    stats_add(STAT_BYTES_WRITTEN, (uint64_t)(sizeof(header) + stored));
+    return 1;
+}
+
+static int export_snapshot(FILE *out, const IdKey *snapshot, uint8_t *raw, uint8_t *packed, int compress)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    FILE *fp;
+    size_t got;
+    int ok = 1;
+
+    if (build_snapshot_path(snapshot, path) != 0 || (fp = fopen(path, "rb")) == NULL)
+    {
+        return 0;
+    }
+
+    while (ok && (got = fread(raw, 1U, BUNDLE_BLOCK, fp)) > 0U)
+    {
+        stats_add(STAT_BYTES_READ, (uint64_t)got);
+        ok = write_block(out, raw, got, packed, compress);
+    }
+
+    ok = ok && !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+/*
+ * Streams `repo`, its commits and their snapshots to a bundle at `path`. With `compress`,
+ * each snapshot block is LZ compressed when that makes it smaller. `result` says how it
+ * went and how many commits were written.
+ */
+int bundle_export(const RepoRecord *repo, const char *path, int compress, BundleResult *result)
+{
+    char commits[VELOCE_PATH_LEN + 1];
+    RepoRecord header;
+    DbScan scan;
+    FieldSpan fields[VELOCE_COMMIT_FIELDS];
+    uint8_t *raw = (uint8_t *)malloc(BUNDLE_BLOCK * 2U);
+    uint64_t span = trace_begin();
+    size_t count = 0U;
+    FILE *out;
+    int ok;
+
+    memset(result, 0, sizeof(*result));
+    result->repo = *repo;
+    result->status = BUNDLE_CANNOT_WRITE;
+    if (raw == NULL)
+    {
+        return 0;
+    }
+
+    out = fopen(path, "wb");
+    if (out == NULL || commit_shard_path(&repo->id, commits) != 0)
+    {
+        if (out != NULL)
+        {
+            fclose(out);
+        }
+        free(raw);
+        return 0;
+    }
+
+    header = *repo;
+    home_relative_tracked_file(repo->tracked_file, header.tracked_file);
+    ok = fwrite(BUNDLE_MAGIC, 1U, BUNDLE_MAGIC_LEN, out) == BUNDLE_MAGIC_LEN && fputc('R', out) != EOF &&
+         write_repo_line(out, &header);
+
+    if (ok && file_exists(commits) && db_scan_open(&scan, commits))
+    {
+        while (ok && db_scan_next_optional(&scan, fields, VELOCE_COMMIT_REQUIRED_FIELDS, VELOCE_COMMIT_FIELDS))
+        {
+            CommitRecord commit;
+
+            if (!commit_from_fields(fields, &commit))
+            {
+                continue;
+            }
+
+            ok = fputc('C', out) != EOF && write_commit_line(out, &commit);
+            if (ok && !export_snapshot(out, &commit.snapshot_id, raw, raw + BUNDLE_BLOCK, compress))
+            {
+                result->status = BUNDLE_SNAPSHOT_UNREADABLE;
+                result->commit = commit.id;
+                ok = 0;
+            }
+            count++;
+        }
+        db_scan_close(&scan);
+    }
+
+    ok = ok && fprintf(out, "E%zu\n", count) > 0;
+    ok = fclose(out) == 0 && ok;
+    free(raw);
+    trace_end("bundle export", span, 0U);
+
+    if (!ok)
+    {
+        (void)remove(path);
+        return 0;
+    }
+
+    result->status = BUNDLE_OK;
+    result->commits = count;
+    return 1;
+}
+
+typedef struct
+{
+    FILE *in;
+    FILE *staged;
+    FILE *snapshot;
+    char snapshot_path[VELOCE_PATH_LEN + 1];
+    char partial_path[VELOCE_PATH_LEN + 1];
+    CommitRecord commit;
+    ContentHasher hasher;
+    size_t count;
+    int open;
+    /* Set when the import stopped on a snapshot that did not match its commit's hash. */
+    int mismatch;
+} ImportState;
+
+static int read_line_frame(FILE *in, char *line, size_t size)
+{
+    size_t len;
+
+    if (!db_next_line(in, line, size, &len))
+    {
+        return 0;
+    }
+
+    /* db_next_line stops at the first newline, so a line that filled the buffer was cut short. */
+    return len + 1U < size;
+}
+
+/*
+ * Closes the snapshot being written, checks it against the commit's hash, moves it into place
+ * and stages the commit. Snapshots are written beside their final name so that a bad block
+ * never replaces a snapshot that is already there.
+ */
+static int finish_commit(ImportState *state)
+{
+    char hash[VELOCE_CONTENT_HASH_LEN];
+    int ok;
+
+    if (!state->open)
+    {
+        return 1;
+    }
+
+    state->open = 0;
+    ok = fclose(state->snapshot) == 0;
+    content_hasher_final(&state->hasher, hash);
+
+    if (ok && state->commit.content_hash[0] != '\0' && strcmp(hash, state->commit.content_hash) != 0)
+    {
+        state->mismatch = 1;
+        ok = 0;
+    }
+
+    if (ok && change_log_snapshot(&state->commit.snapshot_id))
+    {
+        remove(state->snapshot_path);
+        ok = rename(state->partial_path, state->snapshot_path) == 0;
+    }
+    else
+    {
+        ok = 0;
+    }
+
+    if (!ok)
+    {
+        (void)remove(state->partial_path);
+        return 0;
+    }
+
+    if (!write_commit_line(state->staged, &state->commit))
+    {
+        return 0;
+    }
+
+    state->count++;
+    return 1;
+}
+
+/*
+ * Commit lines are staged until every snapshot has arrived, so a truncated bundle never
+ * leaves a commit log behind. This writes the repository's log beside its final name and
+ * renames it into place (replacing any left by an earlier import that failed later on), so
+ * a shard is never truncated under a reader, and indexes the messages.
+ */
+static int write_staged_commits(FILE *staged, const IdKey *repo_id, char *line, size_t size)
+{
+    char name[VELOCE_PATH_LEN + 1];
+    char path[VELOCE_PATH_LEN + 1];
+    char tmp_path[VELOCE_PATH_LEN + 1];
+    CommitRecord commit;
+    FILE *fp;
+    int ok = 1;
+
+    if (commit_shard_name(repo_id, name) != 0 || commit_shard_path(repo_id, path) != 0 ||
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path) ||
+        fseek(staged, 0, SEEK_SET) != 0)
+    {
+        return 0;
+    }
+
+    fp = fopen(tmp_path, "wb");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    while (ok && db_next_line(staged, line, size, NULL))
+    {
+        long offset = ftell(fp);
+
+        ok = parse_commit_line(line, &commit) && write_commit_line(fp, &commit);
+        if (ok && offset >= 0L)
+        {
+            (void)message_index_append(&commit, (uint64_t)offset);
+        }
+    }
+
+    ok = ok && file_sync(fp) == 0;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || !change_log_record(CHANGE_WRITE, name, 0U))
+    {
+        (void)remove(tmp_path);
+        return 0;
+    }
+
+    remove(path);
+    if (rename(tmp_path, path) != 0)
+    {
+        (void)remove(tmp_path);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int import_block(ImportState *state, uint8_t *raw, uint8_t *packed)
+{
+    uint8_t header[8];
+    size_t raw_len;
+    size_t stored;
+
+    if (fread(header, 1U, sizeof(header), state->in) != sizeof(header))
+    {
+        return 0;
+    }
+
+    raw_len = read_u32(header);
+    stored = read_u32(header + 4);
+    if (!state->open || raw_len > BUNDLE_BLOCK || stored > raw_len)
+    {
+        return 0;
+    }
+
+    if (fread(stored < raw_len ? packed : raw, 1U, stored, state->in) != stored)
+    {
+        return 0;
+    }
+    stats_add(STAT_BYTES_READ, (uint64_t)(sizeof(header) + stored));
+
+    if (stored < raw_len && !lz_decompress(packed, stored, raw, raw_len))
+    {
+        return 0;
+    }
+
+    content_hasher_update(&state->hasher, raw, raw_len);
+    if (fwrite(raw, 1U, raw_len, state->snapshot) != raw_len)
+    {
+        return 0;
+    }
+
+    stats_add(STAT_BYTES_WRITTEN, (uint64_t)raw_len);
+    return 1;
+}
+
+static int import_commit(ImportState *state, const RepoRecord *repo, char *line, size_t size)
+{
+    if (!finish_commit(state) || !read_line_frame(state->in, line, size) ||
+        !parse_commit_line(line, &state->commit) || !id_key_equals(&state->commit.repo_id, &repo->id))
+    {
+        return 0;
+    }
+
+    if (snapshot_path_create(storage_root(), &state->commit.snapshot_id, state->snapshot_path) != 0 ||
+        snprintf(state->partial_path, sizeof(state->partial_path), "%s.part", state->snapshot_path) >=
+            (int)sizeof(state->partial_path))
+    {
+        return 0;
+    }
+
+    state->snapshot = fopen(state->partial_path, "wb");
+    if (state->snapshot == NULL)
+    {
+        return 0;
+    }
+
+    content_hasher_init(&state->hasher, content_hash_of(state->commit.content_hash));
+    state->open = 1;
+    return 1;
+}
+
+/* Points a workspace-relative tracked file at this root and fills it from the newest snapshot. */
+static void restore_tracked_file(RepoRecord *repo, const IdKey *head)
+{
+    char snapshot[VELOCE_PATH_LEN + 1];
+    char path[VELOCE_PATH_LEN + 1];
+    char *slash;
+
+    if (strncmp(repo->tracked_file, BUNDLE_HOME_PREFIX, strlen(BUNDLE_HOME_PREFIX)) != 0 ||
+        path_join(path, sizeof(path), storage_root(), repo->tracked_file + strlen(BUNDLE_HOME_PREFIX)) != 0)
+    {
+        return;
+    }
+
+    (void)snprintf(repo->tracked_file, sizeof(repo->tracked_file), "%s", path);
+    slash = strrchr(path, VELOCE_PATH_SEP);
+    if (slash != NULL)
+    {
+        *slash = '\0';
+        (void)ensure_dir(path);
+    }
+
+    if (head != NULL && build_snapshot_path(head, snapshot) == 0)
+    {
+        (void)bulk_copy_file(snapshot, repo->tracked_file);
+    }
+    else
+    {
+        (void)write_text_file(repo->tracked_file, "", 0U);
+    }
+}
+
+/*
+ * Adds the repository in the bundle at `path` to this storage root, keeping its repository
+ * and commit ids. With `owner`, the repository is given to that user instead of the one it
+ * was exported from. It gets the next repository number for its owner here. `result` says
+ * how it went; on success its `repo` is the repository as added here.
+ */
+int bundle_import(const char *path, const IdKey *owner, BundleResult *result)
+{
+    char line[BUNDLE_LINE_LEN];
+    char magic[BUNDLE_MAGIC_LEN];
+    ImportState state;
+    RepoRecord repo;
+    IdKey head;
+    uint8_t *raw;
+    uint64_t span;
+    int ok = 0;
+    int done = 0;
+    int frame;
+
+    memset(&state, 0, sizeof(state));
+    memset(&head, 0, sizeof(head));
+    memset(result, 0, sizeof(*result));
+    result->status = BUNDLE_CANNOT_OPEN;
+    state.in = fopen(path, "rb");
+    if (state.in == NULL)
+    {
+        return 0;
+    }
+
+    if (fread(magic, 1U, sizeof(magic), state.in) != sizeof(magic) ||
+        memcmp(magic, BUNDLE_MAGIC, BUNDLE_MAGIC_LEN) != 0 || fgetc(state.in) != 'R' ||
+        !read_line_frame(state.in, line, sizeof(line)) || !parse_repo_line(line, &repo))
+    {
+        result->status = BUNDLE_NOT_A_BUNDLE;
+        fclose(state.in);
+        return 0;
+    }
+
+    if (owner != NULL)
+    {
+        repo.owner_uid = *owner;
+    }
+
+    result->repo = repo;
+    if (db_has_key(VELOCE_REPOS_DB, VELOCE_REPO_FIELDS, &repo.id))
+    {
+        result->status = BUNDLE_REPO_EXISTS;
+        fclose(state.in);
+        return 0;
+    }
+
+    if (!db_has_key(VELOCE_USERS_DB, VELOCE_USER_FIELDS, &repo.owner_uid))
+    {
+        result->status = BUNDLE_NO_OWNER;
+        fclose(state.in);
+        return 0;
+    }
+
+    raw = (uint8_t *)malloc(BUNDLE_BLOCK * 2U);
+    state.staged = tmpfile();
+    if (raw == NULL || state.staged == NULL)
+    {
+        result->status = BUNDLE_CANNOT_STAGE;
+        if (state.staged != NULL)
+        {
+            fclose(state.staged);
+        }
+        free(raw);
+        fclose(state.in);
+        return 0;
+    }
+
+    span = trace_begin();
+    ok = 1;
+    while (ok && !done && (frame = fgetc(state.in)) != EOF)
+    {
+        if (frame == 'C')
+        {
+            ok = import_commit(&state, &repo, line, sizeof(line));
+            head = state.commit.snapshot_id;
+        }
+        else if (frame == 'D')
+        {
+            ok = import_block(&state, raw, raw + BUNDLE_BLOCK);
+        }
+        else if (frame == 'E')
+        {
+            ok = finish_commit(&state) && read_line_frame(state.in, line, sizeof(line)) &&
+                 strtoul(line, NULL, 10) == (unsigned long)state.count;
+            done = 1;
+        }
+        else
+        {
+            ok = 0;
+        }
+    }
+
+    if (state.open)
+    {
+        fclose(state.snapshot);
+        (void)remove(state.partial_path);
+    }
+    ok = ok && done && write_staged_commits(state.staged, &repo.id, line, sizeof(line));
+    fclose(state.staged);
+    fclose(state.in);
+    free(raw);
+
+    if (ok)
+    {
+        repo.rid = next_repo_id_for_owner(&repo.owner_uid);
+        restore_tracked_file(&repo, state.count > 0U ? &head : NULL);
+        ok = repo.rid != 0 && append_repo(&repo);
+    }
+    trace_end("bundle import", span, 0U);
+
+    result->commits = state.count;
+    if (!ok)
+    {
+        result->status = state.mismatch ? BUNDLE_HASH_MISMATCH : BUNDLE_CORRUPT;
+        result->commit = state.commit.id;
+        return 0;
+    }
+
+    result->status = BUNDLE_OK;
+    result->repo = repo;
+    return 1;
+}
@@ -0,0 +1,804 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+/*
+ * changes.log records, ahead of the write itself, every change to the files a standby needs:
+ *
+ *   a|<name>|<offset>   bytes are being appended to <name> starting at <offset>
+ *   w|<name>|0          <name> is being replaced (or removed) as a whole
+ *   s|<commit id>|0     the snapshot for that id is being written
+ *
+ * Names are relative to the storage root. The first line carries an id for the log so a
+ * replica can tell whether its saved position still refers to this log. An entry whose
+ * write then fails is harmless: replaying it copies whatever the source holds. Once the log
+ * passes CHANGE_LOG_ROTATE_BYTES it is removed and started over under a new id, which sends
+ * every replica back to a full seed instead of letting the log grow without bound.
+ */
+#define CHANGE_LOG_LINE_LEN (VELOCE_PATH_LEN + 64U)
+#define CHANGE_LOG_HEADER "# veloce changes "
+#define CHANGE_LOG_ROTATE_BYTES (64L * 1024L * 1024L)
+#define REPLICATE_BATCH 1024U
+#define REPLICATE_COPY_BUFFER (256U * 1024U)
+
+static FILE *g_log;
+static char g_log_root[VELOCE_PATH_LEN + 1];
+static int g_log_lock;
+
+/* The holder writes and flushes a line, which is too slow to spin through. */
+static void log_lock(void)
+{
+    while (!worker_spin_trylock(&g_log_lock))
+    {
+        worker_yield();
+    }
+}
+
+static void log_unlock(void)
+{
+    worker_spin_unlock(&g_log_lock);
+}
+
+/* Whether `fp` is still the file at `path`, which another process may have rotated away. */
+static int log_is_current(FILE *fp, const char *path)
+{
+#ifdef _WIN32
+    /* An open file cannot be removed here, so a log this process holds is never rotated away. */
+    (void)fp;
+    (void)path;
+    return 1;
+#else
+    struct stat open_st;
+    struct stat path_st;
+
+    return fstat(fileno(fp), &open_st) == 0 && stat(path, &path_st) == 0 && open_st.st_dev == path_st.st_dev &&
+           open_st.st_ino == path_st.st_ino;
+#endif
+}
+
+/* Opens (creating with a fresh id if needed) the log of the current storage root. */
+static FILE *open_log(void)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char id[VELOCE_ID_LEN];
+    FILE *fp;
+
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_CHANGE_LOG) != 0)
+    {
+        return NULL;
+    }
+
+    if (g_log != NULL && strcmp(g_log_root, storage_root()) == 0 && log_is_current(g_log, path))
+    {
+        if (ftell(g_log) < CHANGE_LOG_ROTATE_BYTES)
+        {
+            return g_log;
+        }
+        fclose(g_log);
+        g_log = NULL;
+        (void)remove(path);
+    }
+
+    if (g_log != NULL)
+    {
+        fclose(g_log);
+        g_log = NULL;
+    }
+
+    fp = fopen(path, "ab");
+    if (fp == NULL || fseek(fp, 0, SEEK_END) != 0)
+    {
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        return NULL;
+    }
+
+    if (ftell(fp) == 0L)
+    {
+        generate_id(id);
+        if (fprintf(fp, "%s%s\n", CHANGE_LOG_HEADER, id) <= 0 || fflush(fp) != 0)
+        {
+            fclose(fp);
+            return NULL;
+        }
+    }
+
+    g_log = fp;
+    (void)snprintf(g_log_root, sizeof(g_log_root), "%s", storage_root());
+    return g_log;
+}
+
+int change_log_record(char kind, const char *name, uint64_t offset)
+{
+    FILE *fp;
+    int ok;
+
+    log_lock();
+    fp = open_log();
+    ok = fp != NULL && fprintf(fp, "%c|%s|%llu\n", kind, name, (unsigned long long)offset) > 0 &&
+         fflush(fp) == 0;
+    log_unlock();
+    return ok;
+}
+
+/* Records that `name` is about to grow by an append through `fp`, opened with "ab". */
+int change_log_append(FILE *fp, const char *name)
+{
+    long offset;
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (offset = ftell(fp)) < 0L)
+    {
+        return 0;
+    }
+
+    return change_log_record(CHANGE_APPEND, name, (uint64_t)offset);
+}
+
+int change_log_snapshot(const IdKey *commit_id)
+{
+    char id[VELOCE_ID_LEN];
+
+    id_key_to_text(commit_id, id);
+    return change_log_record(CHANGE_SNAPSHOT, id, 0U);
+}
+
+/* Reads the id line at the start of the log; returns 0 if it has none. */
+static int read_log_id(FILE *fp, char id[VELOCE_ID_LEN])
+{
+    char line[CHANGE_LOG_LINE_LEN];
+    size_t header = strlen(CHANGE_LOG_HEADER);
+
+    if (fgets(line, sizeof(line), fp) == NULL || strncmp(line, CHANGE_LOG_HEADER, header) != 0)
+    {
+        return 0;
+    }
+
+    line[strcspn(line, "\r\n")] = '\0';
+    if (strlen(line + header) != VELOCE_ID_LEN - 1U)
+    {
+        return 0;
+    }
+
+    memcpy(id, line + header, VELOCE_ID_LEN);
+    return 1;
+}
+
+typedef struct
+{
+    const char *dest;
+    char log_id[VELOCE_ID_LEN];
+    uint64_t changes;
+    uint64_t snapshots;
+    uint64_t bytes;
+    int failed;
+} Replica;
+
+static int copy_stream(Replica *replica, FILE *in, FILE *out, char *buf)
+{
+    size_t n;
+
+    while ((n = fread(buf, 1U, REPLICATE_COPY_BUFFER, in)) > 0U)
+    {
+        if (fwrite(buf, 1U, n, out) != n)
+        {
+            return 0;
+        }
+        stats_add(STAT_BYTES_READ, (uint64_t)n);
+        stats_add(STAT_BYTES_WRITTEN, (uint64_t)n);
+        replica->bytes += n;
+    }
+
+    return !ferror(in);
+}
+
+/* Copies `src` over `dst` through a temporary beside it; a missing source removes `dst`. */
+static int copy_whole(Replica *replica, const char *src, const char *dst, char *buf)
+{
+    char tmp_path[VELOCE_PATH_LEN + 1];
+    FILE *in;
+    FILE *out;
+    int ok;
+
+    in = fopen(src, "rb");
+    if (in == NULL)
+    {
+        (void)remove(dst);
+        return 1;
+    }
+
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.part", dst) >= (int)sizeof(tmp_path) ||
+        (out = fopen(tmp_path, "wb")) == NULL)
+    {
+        fclose(in);
+        return 0;
+    }
+
+    ok = copy_stream(replica, in, out, buf);
+    fclose(in);
+    ok = fclose(out) == 0 && ok;
+    if (ok)
+    {
+        remove(dst);
+        ok = rename(tmp_path, dst) == 0;
+    }
+
+    if (!ok)
+    {
+        (void)remove(tmp_path);
+    }
+    return ok;
+}
+
+static long file_size(FILE *fp)
+{
+    return fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1L;
+}
+
+/*
+ * Copies everything from `offset` to the end of `src` into `dst` at the same offset. The
+ * replica already holds the bytes before it, so only the appended tail crosses over; a
+ * replica that is somehow shorter than `offset` gets the whole file instead.
+ */
+static int copy_tail(Replica *replica, const char *src, const char *dst, uint64_t offset, char *buf)
+{
+    FILE *in;
+    FILE *out;
+    int ok;
+
+    out = fopen(dst, "r+b");
+    if (out == NULL || file_size(out) < (long)offset)
+    {
+        if (out != NULL)
+        {
+            fclose(out);
+        }
+        return copy_whole(replica, src, dst, buf);
+    }
+
+    in = fopen(src, "rb");
+    if (in == NULL)
+    {
+        fclose(out);
+        return 0;
+    }
+
+    ok = fseek(in, (long)offset, SEEK_SET) == 0 && fseek(out, (long)offset, SEEK_SET) == 0 &&
+         copy_stream(replica, in, out, buf);
+    fclose(in);
+    return fclose(out) == 0 && ok;
+}
+
+typedef struct
+{
+    Replica *replica;
+    const IdKey *ids;
+} SnapshotBatch;
+
+static void write_replica_snapshot(void *arg, size_t index, const char *data, size_t len)
+{
+    SnapshotBatch *batch = (SnapshotBatch *)arg;
+    char path[VELOCE_PATH_LEN + 1];
+    char tmp_path[VELOCE_PATH_LEN + 1];
+
+    if (data == NULL)
+    {
+        /* Logged ahead of a write that never happened; there is nothing to ship. */
+        return;
+    }
+
+    if (snapshot_path_create(batch->replica->dest, &batch->ids[index], path) != 0 ||
+        snprintf(tmp_path, sizeof(tmp_path), "%s.part", path) >= (int)sizeof(tmp_path) ||
+        write_text_file(tmp_path, data, len) != 0)
+    {
+        batch->replica->failed = 1;
+        return;
+    }
+
+    remove(path);
+    if (rename(tmp_path, path) != 0)
+    {
+        (void)remove(tmp_path);
+        batch->replica->failed = 1;
+        return;
+    }
+
+    batch->replica->snapshots++;
+    batch->replica->bytes += len;
+}
+
+static int copy_snapshots(Replica *replica, BulkReader *reader, const IdKey *ids, size_t count)
+{
+    char (*paths)[VELOCE_PATH_LEN + 1];
+    const char **names;
+    SnapshotBatch batch;
+    size_t i;
+    int ok = 1;
+
+    if (count == 0U)
+    {
+        return 1;
+    }
+
+    paths = (char (*)[VELOCE_PATH_LEN + 1])malloc(count * sizeof(*paths));
+    names = (const char **)malloc(count * sizeof(*names));
+    if (paths == NULL || names == NULL)
+    {
+        free(paths);
+        free(names);
+        return 0;
+    }
+
+    for (i = 0U; i < count && ok; i++)
+    {
+        ok = build_snapshot_path(&ids[i], paths[i]) == 0;
+        names[i] = paths[i];
+    }
+
+    batch.replica = replica;
+    batch.ids = ids;
+    if (ok)
+    {
+        /* Unreadable sources are skipped in the callback; only failed writes stop the sync. */
+        (void)bulk_reader_read(reader, names, count, write_replica_snapshot, &batch);
+        ok = !replica->failed;
+    }
+    free(paths);
+    free(names);
+    return ok;
+}
+
+static int replica_path(const Replica *replica, const char *name, char out[VELOCE_PATH_LEN + 1])
+{
+    return path_join(out, VELOCE_PATH_LEN + 1U, replica->dest, name);
+}
+
+static int source_path(const char *name, char out[VELOCE_PATH_LEN + 1])
+{
+    return path_join(out, VELOCE_PATH_LEN + 1U, storage_root(), name);
+}
+
+static int write_state(const Replica *replica, uint64_t offset)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char text[VELOCE_ID_LEN + 32];
+    int len;
+
+    if (replica_path(replica, VELOCE_REPLICA_STATE, path) != 0)
+    {
+        return 0;
+    }
+
+    len = snprintf(text, sizeof(text), "%s|%llu\n", replica->log_id, (unsigned long long)offset);
+    return len > 0 && write_text_file(path, text, (size_t)len) == 0;
+}
+
+/* Returns the saved log position, or -1 if the replica was never synced from this log. */
+static long read_state(const Replica *replica)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char line[CHANGE_LOG_LINE_LEN];
+    FieldSpan fields[2];
+    FILE *fp;
+    size_t len;
+    long offset = -1L;
+
+    if (replica_path(replica, VELOCE_REPLICA_STATE, path) != 0 || (fp = fopen(path, "rb")) == NULL)
+    {
+        return -1L;
+    }
+
+    if (db_next_line(fp, line, sizeof(line), &len) && split_field_spans(line, len, fields, 2U) &&
+        span_equals(&fields[0], replica->log_id))
+    {
+        offset = strtol(fields[1].ptr, NULL, 10);
+    }
+
+    fclose(fp);
+    return offset;
+}
+
+/*
+ * Database files in the order a replay applies them: referenced records land first. The
+ * commits entry stands for every per-repository log in that directory.
+ */
+static const char *const k_db_order[] = {VELOCE_USERS_DB, VELOCE_REPOS_DB, VELOCE_COMMITS_DIR, VELOCE_MESSAGE_INDEX};
+
+/* The single-file databases a seed copies as a whole. */
+static const char *const k_sync_dbs[] = {VELOCE_USERS_DB, VELOCE_REPOS_DB, VELOCE_MESSAGE_INDEX};
+
+static size_t db_rank(const char *name)
+{
+    size_t i;
+
+    for (i = 0U; i < sizeof(k_db_order) / sizeof(k_db_order[0]); i++)
+    {
+        size_t len = strlen(k_db_order[i]);
+
+        if (strncmp(name, k_db_order[i], len) == 0 && (name[len] == '\0' || name[len] == VELOCE_PATH_SEP))
+        {
+            return i + 1U;
+        }
+    }
+
+    return 0U;
+}
+
+/* Queues the snapshots named in the commit log at `path` that the replica still lacks. */
+static int sync_shard_snapshots(Replica *replica, BulkReader *reader, const char *path, IdKey *ids, size_t *count)
+{
+    char dst[VELOCE_PATH_LEN + 1];
+    FieldSpan fields[VELOCE_COMMIT_FIELDS];
+    DbScan scan;
+    int ok = 1;
+
+    if (!file_exists(path) || !db_scan_open(&scan, path))
+    {
+        return 1;
+    }
+
+    while (ok && db_scan_next_optional(&scan, fields, VELOCE_COMMIT_REQUIRED_FIELDS, VELOCE_COMMIT_FIELDS))
+    {
+        CommitRecord commit;
+
+        if (!commit_from_fields(fields, &commit) || snapshot_path_in(replica->dest, &commit.snapshot_id, dst) != 0)
+        {
+            continue;
+        }
+
+        /* Snapshots never change once written, so one the replica already has is skipped. */
+        if (file_exists(dst))
+        {
+            continue;
+        }
+
+        ids[(*count)++] = commit.snapshot_id;
+        if (*count == REPLICATE_BATCH)
+        {
+            ok = copy_snapshots(replica, reader, ids, *count);
+            *count = 0U;
+        }
+    }
+
+    db_scan_close(&scan);
+    return ok;
+}
+
+/*
+ * Seeds a replica that has never synced from this log. The databases and each repository's
+ * commit log are first copied to temporaries in the replica, the snapshots and trigram files
+ * they reference are copied next, and only then are the temporaries renamed in, so the
+ * replica never lists a commit whose snapshot it lacks.
+ */
+static int full_sync(Replica *replica, BulkReader *reader, char *buf)
+{
+    char src[VELOCE_PATH_LEN + 1];
+    char dst[VELOCE_PATH_LEN + 1];
+    char tmp[VELOCE_PATH_LEN + 1];
+    char repos[VELOCE_PATH_LEN + 1];
+    IdKey ids[REPLICATE_BATCH];
+    FieldSpan fields[VELOCE_REPO_FIELDS];
+    FieldSpan user_fields[VELOCE_USER_FIELDS];
+    DbScan scan;
+    size_t count = 0U;
+    size_t i;
+    int ok = 1;
+
+    for (i = 0U; i < sizeof(k_sync_dbs) / sizeof(k_sync_dbs[0]) && ok; i++)
+    {
+        ok = source_path(k_sync_dbs[i], src) == 0 && replica_path(replica, k_sync_dbs[i], dst) == 0 &&
+             snprintf(tmp, sizeof(tmp), "%s.sync", dst) < (int)sizeof(tmp) && copy_whole(replica, src, tmp, buf);
+    }
+
+    /* The root's content hash choice travels with it, so the replica keeps hashing the same way. */
+    ok = ok && source_path(VELOCE_HASH_CONFIG, src) == 0 && replica_path(replica, VELOCE_HASH_CONFIG, dst) == 0 &&
+         copy_whole(replica, src, dst, buf);
+
+    /* Repository counters belong to users; no record refers to them, so they go over directly. */
+    if (ok && replica_path(replica, VELOCE_USERS_DB ".sync", tmp) == 0 && db_scan_open(&scan, tmp))
+    {
+        while (ok && db_scan_next(&scan, user_fields, VELOCE_USER_FIELDS))
+        {
+            char name[VELOCE_PATH_LEN + 1];
+            IdKey uid;
+
+            if (id_key_from_span(&user_fields[0], &uid))
+            {
+                ok = repo_counter_name(&uid, name) == 0 && source_path(name, src) == 0 &&
+                     replica_path(replica, name, dst) == 0 && copy_whole(replica, src, dst, buf);
+            }
+        }
+        db_scan_close(&scan);
+    }
+
+    ok = ok && replica_path(replica, VELOCE_REPOS_DB ".sync", repos) == 0;
+    if (ok && db_scan_open(&scan, repos))
+    {
+        while (ok && db_scan_next(&scan, fields, VELOCE_REPO_FIELDS))
+        {
+            char id[VELOCE_ID_LEN];
+            char name[VELOCE_PATH_LEN + 1];
+            char file[VELOCE_ID_LEN + 4];
+            IdKey repo;
+
+            if (!id_key_from_span(&fields[0], &repo))
+            {
+                continue;
+            }
+
+            ok = commit_shard_name(&repo, name) == 0 && source_path(name, src) == 0 &&
+                 replica_path(replica, name, dst) == 0 &&
+                 snprintf(tmp, sizeof(tmp), "%s.sync", dst) < (int)sizeof(tmp) && copy_whole(replica, src, tmp, buf) &&
+                 sync_shard_snapshots(replica, reader, tmp, ids, &count);
+
+            span_copy(id, sizeof(id), &fields[0]);
+            (void)snprintf(file, sizeof(file), "%s.tri", id);
+            ok = ok && path_join(name, sizeof(name), VELOCE_TRIGRAMS_DIR, file) == 0 && source_path(name, src) == 0 &&
+                 replica_path(replica, name, dst) == 0 && copy_whole(replica, src, dst, buf);
+        }
+        db_scan_close(&scan);
+        ok = ok && copy_snapshots(replica, reader, ids, count);
+    }
+
+    /* Every snapshot is in place; the commit logs follow, then the databases. */
+    if (ok && db_scan_open(&scan, repos))
+    {
+        while (ok && db_scan_next(&scan, fields, VELOCE_REPO_FIELDS))
+        {
+            IdKey repo;
+
+            if (!id_key_from_span(&fields[0], &repo))
+            {
+                continue;
+            }
+
+            ok = commit_shard_path_in(replica->dest, &repo, dst) == 0 &&
+                 snprintf(tmp, sizeof(tmp), "%s.sync", dst) < (int)sizeof(tmp);
+            if (ok)
+            {
+                remove(dst);
+                ok = !file_exists(tmp) || rename(tmp, dst) == 0;
+            }
+        }
+        db_scan_close(&scan);
+    }
+
+    for (i = 0U; i < sizeof(k_sync_dbs) / sizeof(k_sync_dbs[0]) && ok; i++)
+    {
+        ok = replica_path(replica, k_sync_dbs[i], dst) == 0 &&
+             snprintf(tmp, sizeof(tmp), "%s.sync", dst) < (int)sizeof(tmp);
+        if (ok)
+        {
+            /* No temporary means the source had no such file (messages.idx is optional). */
+            remove(dst);
+            ok = !file_exists(tmp) || rename(tmp, dst) == 0;
+        }
+    }
+
+    return ok;
+}
+
+typedef struct
+{
+    char name[VELOCE_PATH_LEN + 1];
+    uint64_t offset;
+    int whole;
+} FileChange;
+
+static FileChange *find_change(FileChange *files, size_t *count, const char *name)
+{
+    size_t i;
+
+    for (i = 0U; i < *count; i++)
+    {
+        if (strcmp(files[i].name, name) == 0)
+        {
+            return &files[i];
+        }
+    }
+
+    (void)snprintf(files[*count].name, sizeof(files[*count].name), "%s", name);
+    files[*count].offset = UINT64_MAX;
+    files[*count].whole = 0;
+    return &files[(*count)++];
+}
+
+static int apply_file_changes(Replica *replica, FileChange *files, size_t count, char *buf)
+{
+    char src[VELOCE_PATH_LEN + 1];
+    char dst[VELOCE_PATH_LEN + 1];
+    size_t rank;
+    size_t i;
+
+    /* Other files (trigrams) first, then the databases in reference order. */
+    for (rank = 0U; rank <= sizeof(k_db_order) / sizeof(k_db_order[0]); rank++)
+    {
+        for (i = 0U; i < count; i++)
+        {
+            int ok;
+
+            if (db_rank(files[i].name) != rank)
+            {
+                continue;
+            }
+
+            if (source_path(files[i].name, src) != 0 || replica_path(replica, files[i].name, dst) != 0)
+            {
+                return 0;
+            }
+
+            ok = files[i].whole ? copy_whole(replica, src, dst, buf)
+                                : copy_tail(replica, src, dst, files[i].offset, buf);
+            if (!ok)
+            {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Replays the log from `offset` in batches. Each batch copies its snapshots, then the changed
+ * tails (or whole copies) of the other files, then saves the position, so an interrupted run
+ * resumes from the last finished batch and repeats at most one batch of work.
+ */
+static int replay(Replica *replica, FILE *log, long offset, BulkReader *reader, char *buf)
+{
+    char line[CHANGE_LOG_LINE_LEN];
+    IdKey *ids = (IdKey *)malloc(REPLICATE_BATCH * sizeof(IdKey));
+    FileChange *files = (FileChange *)malloc(REPLICATE_BATCH * sizeof(FileChange));
+    int ok = ids != NULL && files != NULL && fseek(log, offset, SEEK_SET) == 0;
+    int more = 1;
+
+    while (ok && more)
+    {
+        size_t id_count = 0U;
+        size_t file_count = 0U;
+        size_t entries = 0U;
+        long next = offset;
+
+        while (entries < REPLICATE_BATCH && fgets(line, sizeof(line), log) != NULL)
+        {
+            FieldSpan fields[3];
+            char name[VELOCE_PATH_LEN + 1];
+            size_t len = strlen(line);
+
+            /* A line still being written by another process is left for the next run. */
+            if (len == 0U || line[len - 1U] != '\n')
+            {
+                break;
+            }
+
+            next = ftell(log);
+            entries++;
+            line[--len] = '\0';
+            if (!split_field_spans(line, len, fields, 3U) || fields[0].len != 1U)
+            {
+                continue;
+            }
+
+            span_copy(name, sizeof(name), &fields[1]);
+            if (fields[0].ptr[0] == CHANGE_SNAPSHOT)
+            {
+                if (id_key_from_span(&fields[1], &ids[id_count]))
+                {
+                    id_count++;
+                }
+            }
+            else if (fields[0].ptr[0] == CHANGE_APPEND || fields[0].ptr[0] == CHANGE_WRITE)
+            {
+                FileChange *change = find_change(files, &file_count, name);
+                uint64_t at = strtoull(fields[2].ptr, NULL, 10);
+
+                change->whole = change->whole || fields[0].ptr[0] == CHANGE_WRITE;
+                change->offset = at < change->offset ? at : change->offset;
+            }
+        }
+
+        more = entries == REPLICATE_BATCH;
+        if (entries == 0U)
+        {
+            break;
+        }
+
+        ok = copy_snapshots(replica, reader, ids, id_count) && apply_file_changes(replica, files, file_count, buf) &&
+             write_state(replica, (uint64_t)next);
+        replica->changes += entries;
+        offset = next;
+    }
+
+    free(ids);
+    free(files);
+    return ok;
+}
+
+static int prepare_replica(const Replica *replica)
+{
+    char path[VELOCE_PATH_LEN + 1];
+
+    return ensure_dir(replica->dest) == 0 && replica_path(replica, VELOCE_SNAPSHOTS_DIR, path) == 0 &&
+           ensure_dir(path) == 0 && replica_path(replica, VELOCE_COMMITS_DIR, path) == 0 && ensure_dir(path) == 0 &&
+           replica_path(replica, VELOCE_COUNTERS_DIR, path) == 0 && ensure_dir(path) == 0 &&
+           replica_path(replica, VELOCE_TRIGRAMS_DIR, path) == 0 && ensure_dir(path) == 0;
+}
+
+/*
+ * Brings the storage root at `dest` up to date with this one, shipping only what changed
+ * since its last sync. A replica that has never synced from this root is seeded in full.
+ * `result` says how it went and what was copied.
+ */
+int replicate_storage(const char *dest, ReplicateResult *result)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    Replica replica;
+    BulkReader *reader;
+    FILE *log;
+    char *buf;
+    long offset;
+    long seed_offset = -1L;
+    uint64_t span = trace_begin();
+    int ok;
+
+    memset(&replica, 0, sizeof(replica));
+    memset(result, 0, sizeof(*result));
+    replica.dest = dest;
+    if (strcmp(dest, storage_root()) == 0 || !prepare_replica(&replica))
+    {
+        result->status = REPLICATE_BAD_DEST;
+        return 0;
+    }
+
+    /* Make sure the log exists, so the replica has an id to remember it by. */
+    log_lock();
+    ok = open_log() != NULL;
+    log_unlock();
+
+    log = ok && source_path(VELOCE_CHANGE_LOG, path) == 0 ? fopen(path, "rb") : NULL;
+    if (log == NULL || !read_log_id(log, replica.log_id))
+    {
+        result->status = REPLICATE_NO_LOG;
+        if (log != NULL)
+        {
+            fclose(log);
+        }
+        return 0;
+    }
+
+    buf = (char *)malloc(REPLICATE_COPY_BUFFER);
+    reader = bulk_reader_open();
+    offset = read_state(&replica);
+    ok = buf != NULL;
+
+    if (ok && offset < 0L)
+    {
+        /* Changes logged while the seed copy runs are replayed straight after it. */
+        seed_offset = file_size(log);
+        ok = seed_offset >= 0L && full_sync(&replica, reader, buf) && write_state(&replica, (uint64_t)seed_offset);
+        offset = seed_offset;
+    }
+
+    ok = ok && replay(&replica, log, offset, reader, buf);
+
+    fclose(log);
+    bulk_reader_close(reader);
+    free(buf);
+    trace_end("replicate", span, replica.bytes);
+
+    result->status = ok ? REPLICATE_OK : REPLICATE_STOPPED;
+    result->seeded = seed_offset >= 0L;
+    result->changes = replica.changes;
+    result->snapshots = replica.snapshots;
+    result->bytes = replica.bytes;
+    return ok;
+}
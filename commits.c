@@ -4,92 +4,18 @@
 #include <stdlib.h>
 #include <string.h>
 
-static int split_fields(char *line, char *fields[], size_t expected)
-{
-    size_t count = 0U;
-    char *start = line;
-    char *p;
+/* Shard files a legacy commits.db migration keeps open at once. */
+#define SHARD_MIGRATE_OPEN 64U
+#define SNAPSHOT_FANOUT_MARKER ".fanout"
 
-    for (p = line; ; p++)
-    {
-        if (*p == '|' || *p == '\0')
-        {
-            if (count >= expected)
-            {
-                return 0;
-            }
-            fields[count++] = start;
-            if (*p == '\0')
-            {
-                break;
-            }
-            *p = '\0';
-            start = p + 1;
-        }
-    }
-
-    return count == expected;
-}
+/* Set until snapshot_store_migrate finds no flat snapshots left in the storage root. */
+static int g_flat_snapshots = 1;
 
 static int repos_db_path(char path[VELOCE_PATH_LEN + 1])
 {
     return path_join(path, VELOCE_PATH_LEN + 1U, storage_root(), VELOCE_REPOS_DB);
 }
 
-static int commits_db_path(char path[VELOCE_PATH_LEN + 1])
-{
-    return path_join(path, VELOCE_PATH_LEN + 1U, storage_root(), VELOCE_COMMITS_DB);
-}
-
-static int parse_repo_line(const char *line, RepoRecord *repo)
-{
-    char scratch[2048];
-    char *fields[7];
-
-    if (line == NULL || repo == NULL)
-    {
-        return 0;
-    }
-
-    if (snprintf(scratch, sizeof(scratch), "%s", line) >= (int)sizeof(scratch))
-    {
-        return 0;
-    }
-
-    if (!split_fields(scratch, fields, 7U))
-    {
-        return 0;
-    }
-
-    (void)snprintf(repo->id, sizeof(repo->id), "%s", fields[0]);
-    (void)snprintf(repo->owner_uid, sizeof(repo->owner_uid), "%s", fields[1]);
-    repo->rid = atoi(fields[2]);
-    (void)snprintf(repo->name, sizeof(repo->name), "%s", fields[3]);
-    repo->initialized = atoi(fields[4]);
-    (void)snprintf(repo->tracked_file, sizeof(repo->tracked_file), "%s", fields[5]);
-    (void)snprintf(repo->created_at, sizeof(repo->created_at), "%s", fields[6]);
-
-    return 1;
-}
-
-static int write_repo_line(FILE *fp, const RepoRecord *repo)
-{
-    if (fp == NULL || repo == NULL)
-    {
-        return 0;
-    }
-
-    return fprintf(fp,
-                   "%s|%s|%d|%s|%d|%s|%s\n",
-                   repo->id,
-                   repo->owner_uid,
-                   repo->rid,
-                   repo->name,
-                   repo->initialized,
-                   repo->tracked_file,
-                   repo->created_at) > 0;
-}
-
 static int update_repo_record(const RepoRecord *updated)
 {
     char path[VELOCE_PATH_LEN + 1];
@@ -98,6 +24,7 @@ static int update_repo_record(const RepoRecord *updated)
     FILE *out;
     char line[2048];
     int changed = 0;
+    uint64_t span;
 
     if (repos_db_path(path) != 0)
     {
@@ -109,6 +36,7 @@ static int update_repo_record(const RepoRecord *updated)
         return 0;
     }
 
+    span = trace_begin();
     in = fopen(path, "rb");
     out = fopen(tmp_path, "wb");
     if (in == NULL || out == NULL)
@@ -131,6 +59,8 @@ static int update_repo_record(const RepoRecord *updated)
         char raw[2048];
 
         (void)snprintf(raw, sizeof(raw), "%s", line);
+        stats_add(STAT_RECORDS_SCANNED, 1U);
+        stats_add(STAT_BYTES_READ, strlen(raw));
 
         line[strcspn(line, "\r\n")] = '\0';
         if (!parse_repo_line(line, &repo))
@@ -145,7 +75,7 @@ static int update_repo_record(const RepoRecord *updated)
             continue;
         }
 
-        if (strcmp(repo.id, updated->id) == 0)
+        if (id_key_equals(&repo.id, &updated->id))
         {
             repo = *updated;
             changed = 1;
@@ -161,9 +91,16 @@ static int update_repo_record(const RepoRecord *updated)
     }
 
     fclose(in);
+    trace_end("rewrite repos.db", span, 0U);
+    if (file_sync(out) != 0)
+    {
+        fclose(out);
+        remove(tmp_path);
+        return 0;
+    }
     fclose(out);
 
-    if (!changed)
+    if (!changed || !change_log_record(CHANGE_WRITE, VELOCE_REPOS_DB, 0U))
     {
         remove(tmp_path);
         return 0;
@@ -179,499 +116,915 @@ static int update_repo_record(const RepoRecord *updated)
     return 1;
 }
 
-static int parse_commit_line(const char *line, CommitRecord *commit)
+static int append_commit(const CommitRecord *commit)
 {
-    char scratch[2048];
-    char *fields[5];
+    char name[VELOCE_PATH_LEN + 1];
+    char path[VELOCE_PATH_LEN + 1];
+    FILE *fp;
+    long offset;
+    int ok;
+    uint64_t start;
 
-    if (line == NULL || commit == NULL)
+    if (commit_shard_name(&commit->repo_id, name) != 0 || commit_shard_path(&commit->repo_id, path) != 0)
     {
         return 0;
     }
 
-    if (snprintf(scratch, sizeof(scratch), "%s", line) >= (int)sizeof(scratch))
+    start = stats_op_begin();
+    fp = fopen(path, "ab");
+    if (fp == NULL)
     {
         return 0;
     }
 
-    if (!split_fields(scratch, fields, 5U))
+    /* Where this line lands; the message index points search hits straight at it. */
+    offset = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1L;
+    ok = change_log_append(fp, name) && write_commit_line(fp, commit);
+    fclose(fp);
+    stats_op_end(STAT_OP_DB_APPEND, start);
+
+    if (ok && offset >= 0L)
     {
-        return 0;
+        (void)message_index_append(commit, (uint64_t)offset);
     }
+    return ok;
+}
 
-    (void)snprintf(commit->id, sizeof(commit->id), "%s", fields[0]);
-    (void)snprintf(commit->repo_id, sizeof(commit->repo_id), "%s", fields[1]);
-    (void)snprintf(commit->timestamp, sizeof(commit->timestamp), "%s", fields[2]);
-    (void)snprintf(commit->message, sizeof(commit->message), "%s", fields[3]);
-    (void)snprintf(commit->snapshot_path, sizeof(commit->snapshot_path), "%s", fields[4]);
+/*
+ * Snapshots fan out over two levels of 256 directories, picked by the top two bytes of the
+ * commit id's hash: snapshots/3f/a0/<id>.txt. Every directory stays small (about fifteen
+ * files per million snapshots), so creating and opening one costs the same at any count.
+ */
+static int snapshot_dirs_in(const char *root, const IdKey *commit_id, char mid[VELOCE_PATH_LEN + 1],
+                            char leaf[VELOCE_PATH_LEN + 1])
+{
+    char snapshots_dir[VELOCE_PATH_LEN + 1];
+    char name[3];
+    uint64_t hash = id_key_hash(commit_id);
 
-    return 1;
+    if (path_join(snapshots_dir, sizeof(snapshots_dir), root, VELOCE_SNAPSHOTS_DIR) != 0)
+    {
+        return -1;
+    }
+
+    (void)snprintf(name, sizeof(name), "%02x", (unsigned int)(hash >> 56));
+    if (path_join(mid, VELOCE_PATH_LEN + 1U, snapshots_dir, name) != 0)
+    {
+        return -1;
+    }
+
+    (void)snprintf(name, sizeof(name), "%02x", (unsigned int)((hash >> 48) & 0xFFU));
+    return path_join(leaf, VELOCE_PATH_LEN + 1U, mid, name);
+}
+
+static int snapshot_file_name(const IdKey *commit_id, char out[VELOCE_ID_LEN + 4])
+{
+    char id[VELOCE_ID_LEN];
+
+    id_key_to_text(commit_id, id);
+    return snprintf(out, VELOCE_ID_LEN + 4U, "%s.txt", id) >= (int)(VELOCE_ID_LEN + 4U) ? -1 : 0;
 }
 
-static int write_commit_line(FILE *fp, const CommitRecord *commit)
+/* Where the snapshot for `commit_id` lives under the storage root `root`. */
+int snapshot_path_in(const char *root, const IdKey *commit_id, char out[VELOCE_PATH_LEN + 1])
 {
-    if (fp == NULL || commit == NULL)
+    char mid[VELOCE_PATH_LEN + 1];
+    char leaf[VELOCE_PATH_LEN + 1];
+    char file_name[VELOCE_ID_LEN + 4];
+
+    if (snapshot_dirs_in(root, commit_id, mid, leaf) != 0 || snapshot_file_name(commit_id, file_name) != 0)
     {
-        return 0;
+        return -1;
     }
 
-    return fprintf(fp,
-                   "%s|%s|%s|%s|%s\n",
-                   commit->id,
-                   commit->repo_id,
-                   commit->timestamp,
-                   commit->message,
-                   commit->snapshot_path) > 0;
+    return path_join(out, VELOCE_PATH_LEN + 1U, leaf, file_name);
 }
 
-static int append_commit(const CommitRecord *commit)
+/* Like snapshot_path_in, and creates the snapshot's fan-out directories for a write. */
+int snapshot_path_create(const char *root, const IdKey *commit_id, char out[VELOCE_PATH_LEN + 1])
 {
-    char path[VELOCE_PATH_LEN + 1];
-    FILE *fp;
-    int ok;
+    char mid[VELOCE_PATH_LEN + 1];
+    char leaf[VELOCE_PATH_LEN + 1];
+    char file_name[VELOCE_ID_LEN + 4];
 
-    if (commits_db_path(path) != 0)
+    if (snapshot_dirs_in(root, commit_id, mid, leaf) != 0 || snapshot_file_name(commit_id, file_name) != 0)
     {
-        return 0;
+        return -1;
     }
 
-    fp = fopen(path, "ab");
-    if (fp == NULL)
+    /* The leaf nearly always exists already; its parent is only made when it does not. */
+    if (ensure_dir(leaf) != 0 && (ensure_dir(mid) != 0 || ensure_dir(leaf) != 0))
     {
-        return 0;
+        return -1;
     }
 
-    ok = write_commit_line(fp, commit);
-    fclose(fp);
-    return ok;
+    return path_join(out, VELOCE_PATH_LEN + 1U, leaf, file_name);
 }
 
-static int build_snapshot_path(const char *commit_id, char out[VELOCE_PATH_LEN + 1])
+/* Where builds before the fan-out kept the snapshot: directly in snapshots/. */
+static int flat_snapshot_path(const IdKey *commit_id, char out[VELOCE_PATH_LEN + 1])
 {
     char snapshots_dir[VELOCE_PATH_LEN + 1];
-    char file_name[VELOCE_ID_LEN + 5];
+    char file_name[VELOCE_ID_LEN + 4];
 
-    if (path_join(snapshots_dir, sizeof(snapshots_dir), storage_root(), VELOCE_SNAPSHOTS_DIR) != 0)
+    if (path_join(snapshots_dir, sizeof(snapshots_dir), storage_root(), VELOCE_SNAPSHOTS_DIR) != 0 ||
+        snapshot_file_name(commit_id, file_name) != 0)
     {
         return -1;
     }
 
-    if (snprintf(file_name, sizeof(file_name), "%s.txt", commit_id) >= (int)sizeof(file_name))
+    return path_join(out, VELOCE_PATH_LEN + 1U, snapshots_dir, file_name);
+}
+
+/* Where to read the snapshot for `commit_id` in the storage root. */
+int build_snapshot_path(const IdKey *commit_id, char out[VELOCE_PATH_LEN + 1])
+{
+    char flat[VELOCE_PATH_LEN + 1];
+
+    if (snapshot_path_in(storage_root(), commit_id, out) != 0)
     {
         return -1;
     }
 
-    if (path_join(out, VELOCE_PATH_LEN + 1U, snapshots_dir, file_name) != 0)
+    /* Until snapshot_store_migrate has finished, a snapshot may still have its flat name. */
+    if (g_flat_snapshots && !file_exists(out) && flat_snapshot_path(commit_id, flat) == 0 && file_exists(flat))
     {
-        return -1;
+        (void)snprintf(out, VELOCE_PATH_LEN + 1U, "%s", flat);
     }
 
     return 0;
 }
 
-static int create_commit_with_message(RepoRecord *repo, const char *message)
+/* Moves one flat snapshot into the fan-out; one that is not there is already done. */
+static int fan_out_snapshot(const IdKey *commit_id)
 {
-    char *content;
-    size_t len;
-    CommitRecord commit;
+    char flat[VELOCE_PATH_LEN + 1];
+    char path[VELOCE_PATH_LEN + 1];
 
-    if (read_text_file(repo->tracked_file, &content, &len) != 0)
+    if (flat_snapshot_path(commit_id, flat) != 0)
     {
-        (void)printf("Failed to read tracked file: %s\n", repo->tracked_file);
         return 0;
     }
 
-    generate_id(commit.id);
-    (void)snprintf(commit.repo_id, sizeof(commit.repo_id), "%s", repo->id);
-    now_timestamp(commit.timestamp);
-    (void)snprintf(commit.message, sizeof(commit.message), "%s", message);
-    sanitize_field(commit.message);
+    if (!file_exists(flat))
+    {
+        return 1;
+    }
 
-    if (build_snapshot_path(commit.id, commit.snapshot_path) != 0)
+    if (snapshot_path_create(storage_root(), commit_id, path) != 0)
     {
-        free(content);
         return 0;
     }
 
-    if (write_text_file(commit.snapshot_path, content, len) != 0)
+    /* Snapshots never change, so a copy already in place (from a replica sync) wins. */
+    return file_exists(path) ? remove(flat) == 0 : rename(flat, path) == 0;
+}
+
+/*
+ * Builds before the fan-out kept every snapshot directly in snapshots/. On the first start
+ * of such a root, each snapshot a commit log names is moved to its fan-out directory, and
+ * the .fanout marker is written once none is left. Until then build_snapshot_path falls
+ * back to the flat name, so a migration cut short only resumes on the next start. Commit
+ * lines name snapshots by id rather than path, so no log needs rewriting.
+ */
+int snapshot_store_migrate(void)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char marker[VELOCE_PATH_LEN + 1];
+    char shard[VELOCE_PATH_LEN + 1];
+    DbScan repos;
+    FieldSpan repo_fields[VELOCE_REPO_FIELDS];
+    FieldSpan fields[VELOCE_COMMIT_FIELDS];
+    uint64_t span;
+    int ok = 1;
+
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_SNAPSHOTS_DIR) != 0 ||
+        path_join(marker, sizeof(marker), path, SNAPSHOT_FANOUT_MARKER) != 0)
     {
-        free(content);
         return 0;
     }
 
-    free(content);
+    if (file_exists(marker))
+    {
+        g_flat_snapshots = 0;
+        return 1;
+    }
 
-    if (!append_commit(&commit))
+    span = trace_begin();
+    if (repos_db_path(path) == 0 && db_scan_open(&repos, path))
+    {
+        while (ok && db_scan_next(&repos, repo_fields, VELOCE_REPO_FIELDS))
+        {
+            DbScan scan;
+            IdKey repo;
+
+            if (!id_key_from_span(&repo_fields[0], &repo) || commit_shard_path(&repo, shard) != 0 ||
+                !file_exists(shard) || !db_scan_open(&scan, shard))
+            {
+                continue;
+            }
+
+            while (ok && db_scan_next_optional(&scan, fields, VELOCE_COMMIT_REQUIRED_FIELDS, VELOCE_COMMIT_FIELDS))
+            {
+                CommitRecord commit;
+
+                if (commit_from_fields(fields, &commit))
+                {
+                    ok = fan_out_snapshot(&commit.snapshot_id);
+                }
+            }
+            db_scan_close(&scan);
+        }
+        db_scan_close(&repos);
+    }
+
+    if (!ok || write_text_file(marker, "", 0U) != 0)
     {
         return 0;
     }
 
-    (void)printf("Commit created: %s\n", commit.id);
+    g_flat_snapshots = 0;
+    trace_end("fan out snapshots", span, 0U);
     return 1;
 }
 
-static int init_repo(RepoRecord *repo)
+/* The repository's commit log relative to the storage root, as changes.log names it. */
+int commit_shard_name(const IdKey *repo_id, char out[VELOCE_PATH_LEN + 1])
 {
-    int choice;
-    char path[VELOCE_PATH_LEN + 1];
+    char name[VELOCE_ID_LEN + 3];
+    char id[VELOCE_ID_LEN];
 
-    while (1)
+    id_key_to_text(repo_id, id);
+    if (snprintf(name, sizeof(name), "%s.db", id) >= (int)sizeof(name))
     {
-        app_clear_screen();
-        (void)printf("Repository: %s\n", repo->name);
-        (void)printf("This repository is not initialized yet.\n\n");
-        (void)printf("1) Track an existing file\n");
-        (void)printf("2) Create a new tracked file\n");
-        (void)printf("3) Back\n");
+        return -1;
+    }
 
-        if (!read_int("Choice: ", &choice))
-        {
-            (void)printf("Please enter a valid number.\n");
-            app_pause(NULL);
-            continue;
-        }
+    return path_join(out, VELOCE_PATH_LEN + 1U, VELOCE_COMMITS_DIR, name);
+}
 
-        if (choice == 1)
-        {
-            if (!read_line("Path to file: ", path, sizeof(path)))
-            {
-                return 0;
-            }
-            sanitize_field(path);
-            if (!file_exists(path))
-            {
-                (void)printf("File not found.\n");
-                app_pause(NULL);
-                continue;
-            }
+/* Where the commit log for `repo_id` lives under the storage root `root`. */
+int commit_shard_path_in(const char *root, const IdKey *repo_id, char out[VELOCE_PATH_LEN + 1])
+{
+    char name[VELOCE_PATH_LEN + 1];
 
-            (void)snprintf(repo->tracked_file, sizeof(repo->tracked_file), "%s", path);
-            break;
-        }
+    if (commit_shard_name(repo_id, name) != 0)
+    {
+        return -1;
+    }
 
-        if (choice == 2)
-        {
-            char workspace_root[VELOCE_PATH_LEN + 1];
-            char repo_workspace[VELOCE_PATH_LEN + 1];
+    return path_join(out, VELOCE_PATH_LEN + 1U, root, name);
+}
 
-            if (path_join(workspace_root, sizeof(workspace_root), storage_root(), VELOCE_WORKSPACE_DIR) != 0 ||
-                path_join(repo_workspace, sizeof(repo_workspace), workspace_root, repo->id) != 0)
-            {
-                (void)printf("Failed to build workspace path.\n");
-                app_pause(NULL);
-                return 0;
-            }
+int commit_shard_path(const IdKey *repo_id, char out[VELOCE_PATH_LEN + 1])
+{
+    return commit_shard_path_in(storage_root(), repo_id, out);
+}
 
-            if (ensure_dir(repo_workspace) != 0)
-            {
-                (void)printf("Failed to create repository workspace.\n");
-                app_pause(NULL);
-                return 0;
-            }
+typedef struct
+{
+    IdKey repo;
+    FILE *fp;
+} ShardOut;
 
-            if (path_join(path, sizeof(path), repo_workspace, "tracked.txt") != 0)
-            {
-                (void)printf("Failed to build tracked file path.\n");
-                app_pause(NULL);
-                return 0;
-            }
+static void close_shards(ShardOut *open, size_t *count)
+{
+    size_t i;
 
-            if (write_text_file(path, "", 0U) != 0)
-            {
-                (void)printf("Failed to create tracked file.\n");
-                app_pause(NULL);
-                return 0;
-            }
+    for (i = 0U; i < *count; i++)
+    {
+        fclose(open[i].fp);
+    }
+    *count = 0U;
+}
 
-            (void)snprintf(repo->tracked_file, sizeof(repo->tracked_file), "%s", path);
-            break;
-        }
+/* The append handle for `repo`'s shard; every handle is closed once too many are open. */
+static FILE *migration_shard(ShardOut *open, size_t *count, const IdKey *repo)
+{
+    char name[VELOCE_PATH_LEN + 1];
+    char path[VELOCE_PATH_LEN + 1];
+    FILE *fp;
+    size_t i;
 
-        if (choice == 3)
+    for (i = 0U; i < *count; i++)
+    {
+        if (id_key_equals(&open[i].repo, repo))
         {
-            return 0;
+            return open[i].fp;
         }
+    }
 
-        (void)printf("Please choose 1, 2, or 3.\n");
-        app_pause(NULL);
+    if (*count == SHARD_MIGRATE_OPEN)
+    {
+        close_shards(open, count);
     }
 
-    repo->initialized = 1;
+    if (commit_shard_name(repo, name) != 0 || commit_shard_path(repo, path) != 0)
+    {
+        return NULL;
+    }
 
-    if (!update_repo_record(repo))
+    fp = fopen(path, "ab");
+    if (fp == NULL)
     {
-        (void)printf("Failed to save repository state.\n");
-        app_pause(NULL);
-        return 0;
+        return NULL;
     }
 
-    if (!create_commit_with_message(repo, "Initial commit"))
+    if (!change_log_append(fp, name))
     {
-        (void)printf("Repository initialized, but initial commit failed.\n");
-        app_pause(NULL);
-        return 0;
+        fclose(fp);
+        return NULL;
     }
 
-    (void)printf("Repository initialized successfully.\n");
-    app_pause(NULL);
-    return 1;
+    open[*count].repo = *repo;
+    open[*count].fp = fp;
+    (*count)++;
+    return fp;
 }
 
-static int create_commit(RepoRecord *repo)
+static int compare_repo_id(const void *a, const void *b)
 {
-    char message[VELOCE_MSG_LEN + 1];
+    const IdKey *x = (const IdKey *)a;
+    const IdKey *y = (const IdKey *)b;
 
-    app_clear_screen();
-    (void)printf("Create commit\n\n");
+    if (x->hi != y->hi)
+    {
+        return x->hi < y->hi ? -1 : 1;
+    }
+    if (x->lo != y->lo)
+    {
+        return x->lo < y->lo ? -1 : 1;
+    }
+    return 0;
+}
 
-    if (!read_line("Commit message: ", message, sizeof(message)))
+/* Reads the id of every repository in repos.db into a sorted heap array the caller frees. */
+static int load_repo_ids(IdKey **ids, size_t *count)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    DbScan scan;
+    FieldSpan fields[VELOCE_REPO_FIELDS];
+    size_t cap = 0U;
+    int ok = 1;
+
+    *ids = NULL;
+    *count = 0U;
+    if (repos_db_path(path) != 0)
     {
         return 0;
     }
-    sanitize_field(message);
 
-    if (message[0] == '\0')
+    if (!db_scan_open(&scan, path))
     {
-        (void)printf("Commit message cannot be empty.\n");
-        app_pause(NULL);
-        return 0;
+        return 1;
     }
 
-    if (!create_commit_with_message(repo, message))
+    while (ok && db_scan_next(&scan, fields, VELOCE_REPO_FIELDS))
     {
-        (void)printf("Commit failed.\n");
-        app_pause(NULL);
+        IdKey repo;
+
+        if (!id_key_from_span(&fields[0], &repo))
+        {
+            continue;
+        }
+
+        if (*count == cap)
+        {
+            size_t next = cap == 0U ? 64U : cap * 2U;
+            IdKey *grown = (IdKey *)realloc(*ids, next * sizeof(IdKey));
+
+            if (grown == NULL)
+            {
+                ok = 0;
+                break;
+            }
+            *ids = grown;
+            cap = next;
+        }
+        (*ids)[(*count)++] = repo;
+    }
+
+    db_scan_close(&scan);
+    if (!ok)
+    {
+        free(*ids);
+        *ids = NULL;
+        *count = 0U;
         return 0;
     }
 
-    app_pause(NULL);
+    if (*count > 1U)
+    {
+        qsort(*ids, *count, sizeof(IdKey), compare_repo_id);
+    }
     return 1;
 }
 
-static int load_commits_for_repo(const RepoRecord *repo, CommitRecord **items, size_t *count)
+/* Removes the shard of every repository in `repos`, so a migration cut short starts over. */
+static int clear_repo_shards(const IdKey *repos, size_t count)
 {
-    char path[VELOCE_PATH_LEN + 1];
-    FILE *fp;
+    char shard[VELOCE_PATH_LEN + 1];
+    char name[VELOCE_PATH_LEN + 1];
+    size_t i;
+
+    for (i = 0U; i < count; i++)
+    {
+        if (commit_shard_path(&repos[i], shard) != 0)
+        {
+            return 0;
+        }
+        if (!file_exists(shard))
+        {
+            continue;
+        }
+        if (commit_shard_name(&repos[i], name) != 0 || !change_log_record(CHANGE_WRITE, name, 0U) ||
+            remove(shard) != 0)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+ * Storage roots written before commits were sharded keep every repository's history in one
+ * commits.db. This splits that file into the per-repository logs and then sets it aside as
+ * commits.db.migrated; a line naming no repository is only kept in that copy. messages.idx
+ * is dropped since its offsets pointed into the old file, and the next search rebuilds it.
+ */
+int commit_shards_migrate(void)
+{
+    char legacy[VELOCE_PATH_LEN + 1];
+    char aside[VELOCE_PATH_LEN + 1];
+    char index[VELOCE_PATH_LEN + 1];
     char line[2048];
-    CommitRecord *list = NULL;
-    size_t len = 0U;
-    size_t cap = 0U;
+    ShardOut open[SHARD_MIGRATE_OPEN];
+    size_t open_count = 0U;
+    IdKey *repos;
+    size_t repo_count;
+    size_t len;
+    FILE *in;
+    int ok;
 
-    if (items == NULL || count == NULL)
+    if (path_join(legacy, sizeof(legacy), storage_root(), VELOCE_COMMITS_DB) != 0 ||
+        path_join(index, sizeof(index), storage_root(), VELOCE_MESSAGE_INDEX) != 0 ||
+        snprintf(aside, sizeof(aside), "%s.migrated", legacy) >= (int)sizeof(aside))
     {
         return 0;
     }
 
-    *items = NULL;
-    *count = 0U;
+    if (!file_exists(legacy))
+    {
+        return 1;
+    }
 
-    if (commits_db_path(path) != 0)
+    if (!load_repo_ids(&repos, &repo_count))
     {
         return 0;
     }
 
-    fp = fopen(path, "rb");
-    if (fp == NULL)
+    in = fopen(legacy, "rb");
+    if (in == NULL)
     {
+        free(repos);
         return 0;
     }
 
-    while (fgets(line, sizeof(line), fp) != NULL)
+    ok = clear_repo_shards(repos, repo_count);
+    while (ok && db_next_line(in, line, sizeof(line), &len))
     {
-        CommitRecord commit;
-        CommitRecord *next;
+        FieldSpan fields[VELOCE_COMMIT_FIELDS];
+        IdKey repo;
+        FILE *fp;
 
-        line[strcspn(line, "\r\n")] = '\0';
-        if (!parse_commit_line(line, &commit))
+        if (!split_field_spans_optional(line, len, fields, VELOCE_COMMIT_REQUIRED_FIELDS, VELOCE_COMMIT_FIELDS) ||
+            !id_key_from_span(&fields[1], &repo) ||
+            repo_count == 0U || bsearch(&repo, repos, repo_count, sizeof(IdKey), compare_repo_id) == NULL)
         {
             continue;
         }
 
-        if (strcmp(commit.repo_id, repo->id) != 0)
-        {
-            continue;
-        }
+        fp = migration_shard(open, &open_count, &repo);
+        ok = fp != NULL && fwrite(line, 1U, len, fp) == len && fputc('\n', fp) != EOF;
+    }
 
-        if (len == cap)
-        {
-            cap = (cap == 0U) ? 8U : cap * 2U;
-            next = (CommitRecord *)realloc(list, cap * sizeof(CommitRecord));
-            if (next == NULL)
-            {
-                free(list);
-                fclose(fp);
-                return 0;
-            }
-            list = next;
-        }
+    fclose(in);
+    close_shards(open, &open_count);
+    free(repos);
+    if (!ok || !change_log_record(CHANGE_WRITE, VELOCE_MESSAGE_INDEX, 0U) ||
+        !change_log_record(CHANGE_WRITE, VELOCE_COMMITS_DB, 0U))
+    {
+        return 0;
+    }
+
+    (void)remove(index);
+    (void)remove(aside);
+    return rename(legacy, aside) == 0;
+}
 
-        list[len++] = commit;
+static int write_commit_snapshot(const RepoRecord *repo, const char *message, IdKey *commit_id)
+{
+    Arena arena;
+    char *content;
+    size_t len;
+    CommitRecord commit;
+    char snapshot_path[VELOCE_PATH_LEN + 1];
+    int ok;
+
+    arena_init(&arena, 0U);
+    if (read_text_file_arena(&arena, repo->tracked_file, &content, &len) != 0)
+    {
+        arena_free(&arena);
+        return 0;
     }
 
-    fclose(fp);
+    generate_key(&commit.id);
+    commit.repo_id = repo->id;
+    commit.timestamp = now_timestamp();
+    (void)snprintf(commit.message, sizeof(commit.message), "%s", message);
+    sanitize_field(commit.message);
+
+    commit.snapshot_id = commit.id;
+    hash_content(content, len, commit.content_hash);
+
+    ok = snapshot_path_create(storage_root(), &commit.id, snapshot_path) == 0 && change_log_snapshot(&commit.id) &&
+         write_text_file(snapshot_path, content, len) == 0;
+    if (ok)
+    {
+        /* Best effort: a snapshot without trigrams is simply always read by history search. */
+        (void)snapshot_trigrams_append(&repo->id, &commit.id, content, len);
+    }
+    arena_free(&arena);
+
+    if (!ok || !append_commit(&commit))
+    {
+        return 0;
+    }
 
-    *items = list;
-    *count = len;
+    if (commit_id != NULL)
+    {
+        *commit_id = commit.id;
+    }
     return 1;
 }
 
-static void view_commits(const RepoRecord *repo)
+/* Snapshots the tracked file as a new commit; `commit_id`, when not NULL, receives its id. */
+int create_commit_with_message(const RepoRecord *repo, const char *message, IdKey *commit_id)
 {
-    CommitRecord *commits;
-    size_t count;
-    size_t i;
+    uint64_t start = stats_op_begin();
+    int ok = write_commit_snapshot(repo, message, commit_id);
 
-    app_clear_screen();
-    (void)printf("Commits for %s\n\n", repo->name);
+    stats_op_end(STAT_OP_COMMIT, start);
+    return ok;
+}
+
+/*
+ * Starts tracking `path`, or a new empty tracked.txt in the repository's workspace when
+ * `path` is NULL, and saves the repository as initialized. No commit is made.
+ */
+int repo_track_file(RepoRecord *repo, const char *path)
+{
+    RepoRecord updated = *repo;
 
-    if (!load_commits_for_repo(repo, &commits, &count))
+    if (path != NULL)
     {
-        (void)printf("Failed to load commits.\n");
-        app_pause(NULL);
-        return;
+        if (!file_exists(path))
+        {
+            return 0;
+        }
+        (void)snprintf(updated.tracked_file, sizeof(updated.tracked_file), "%s", path);
+        sanitize_field(updated.tracked_file);
     }
-
-    if (count == 0U)
+    else
     {
-        (void)printf("No commits yet.\n");
-        free(commits);
-        app_pause(NULL);
-        return;
+        char workspace_root[VELOCE_PATH_LEN + 1];
+        char repo_workspace[VELOCE_PATH_LEN + 1];
+        char id[VELOCE_ID_LEN];
+
+        id_key_to_text(&repo->id, id);
+        if (path_join(workspace_root, sizeof(workspace_root), storage_root(), VELOCE_WORKSPACE_DIR) != 0 ||
+            path_join(repo_workspace, sizeof(repo_workspace), workspace_root, id) != 0 ||
+            ensure_dir(repo_workspace) != 0 ||
+            path_join(updated.tracked_file, sizeof(updated.tracked_file), repo_workspace, "tracked.txt") != 0 ||
+            write_text_file(updated.tracked_file, "", 0U) != 0)
+        {
+            return 0;
+        }
     }
 
-    for (i = 0U; i < count; i++)
+    updated.initialized = 1;
+    if (!update_repo_record(&updated))
     {
-        (void)printf("%zu) %s  %s\n", i + 1U, commits[i].id, commits[i].timestamp);
-        (void)printf("    %s\n", commits[i].message);
+        return 0;
     }
 
-    free(commits);
-    app_pause(NULL);
+    *repo = updated;
+    return 1;
 }
 
-static int revert_commit(RepoRecord *repo)
+static uint32_t intern_repo(CommitHistory *history, const IdKey *key)
 {
-    CommitRecord *commits;
-    size_t count;
     size_t i;
-    int choice;
-    char revert_msg[VELOCE_MSG_LEN + 1];
 
-    app_clear_screen();
-    (void)printf("Revert commit\n\n");
+    for (i = 0U; i < history->repo_count; i++)
+    {
+        if (id_key_equals(&history->repos[i], key))
+        {
+            return (uint32_t)i;
+        }
+    }
 
-    if (!load_commits_for_repo(repo, &commits, &count))
+    if (history->repo_count == history->repo_cap)
     {
-        (void)printf("Failed to load commits.\n");
-        app_pause(NULL);
-        return 0;
+        size_t cap = history->repo_cap == 0U ? 4U : history->repo_cap * 2U;
+        IdKey *next = (IdKey *)arena_grow(history->arena, history->repos,
+                                          history->repo_cap * sizeof(IdKey), cap * sizeof(IdKey));
+
+        if (next == NULL)
+        {
+            return UINT32_MAX;
+        }
+        history->repos = next;
+        history->repo_cap = cap;
     }
 
-    if (count == 0U)
+    history->repos[history->repo_count] = *key;
+    return (uint32_t)history->repo_count++;
+}
+
+/*
+ * Entries grow on the heap while a shard is read: the messages are interleaved in the arena,
+ * so an arena-grown array would be copied on every doubling and leave each old copy behind.
+ * history_finish moves them into the arena once, at their final size.
+ */
+static int history_append(CommitHistory *history, const FieldSpan fields[VELOCE_COMMIT_FIELDS], uint32_t repo)
+{
+    CommitEntry *entry;
+
+    if (history->count == history->cap)
     {
-        (void)printf("No commits available.\n");
-        free(commits);
-        app_pause(NULL);
-        return 0;
+        size_t cap = history->cap == 0U ? 64U : history->cap * 2U;
+        CommitEntry *next = (CommitEntry *)realloc(history->items, cap * sizeof(CommitEntry));
+
+        if (next == NULL)
+        {
+            return 0;
+        }
+        history->items = next;
+        history->cap = cap;
     }
 
-    for (i = 0U; i < count; i++)
+    entry = &history->items[history->count];
+    if (!id_key_from_span(&fields[0], &entry->id) || !snapshot_id_from_span(&fields[4], &entry->id, &entry->snapshot))
     {
-        (void)printf("%zu) %s  %s\n", i + 1U, commits[i].id, commits[i].message);
+        /* Not an id this build could have written; skip the line rather than fail the load. */
+        return 1;
     }
 
-    if (!read_int("Select commit number: ", &choice))
+    entry->timestamp = parse_timestamp(fields[2].ptr, fields[2].len);
+    entry->repo = repo;
+    entry->message = arena_strndup(history->arena, fields[3].ptr, fields[3].len);
+    entry->message_len = (uint32_t)fields[3].len;
+    if (entry->message == NULL)
     {
-        free(commits);
-        (void)printf("Invalid selection.\n");
-        app_pause(NULL);
         return 0;
     }
 
-    if (choice < 1 || (size_t)choice > count)
+    history->count++;
+    return 1;
+}
+
+/* Hands the loaded entries over to the arena; on failure the history is left empty. */
+static int history_finish(CommitHistory *history, int ok)
+{
+    CommitEntry *items = NULL;
+
+    if (ok && history->count > 0U)
     {
-        free(commits);
-        (void)printf("Invalid selection.\n");
-        app_pause(NULL);
-        return 0;
+        items = (CommitEntry *)arena_alloc(history->arena, history->count * sizeof(CommitEntry));
+        ok = items != NULL;
+        if (ok)
+        {
+            memcpy(items, history->items, history->count * sizeof(CommitEntry));
+        }
     }
 
-    if (copy_text_file(commits[(size_t)choice - 1U].snapshot_path, repo->tracked_file) != 0)
+    free(history->items);
+    history->items = items;
+    history->count = ok ? history->count : 0U;
+    history->cap = history->count;
+    return ok;
+}
+
+/* Readies an empty history of `repo`; `path` is left empty when the repository has no commits yet. */
+static int history_start(const RepoRecord *repo, Arena *arena, CommitHistory *history, char path[VELOCE_PATH_LEN + 1],
+                         uint32_t *repo_ref)
+{
+    if (arena == NULL || history == NULL)
     {
-        free(commits);
-        (void)printf("Failed to restore file from snapshot.\n");
-        app_pause(NULL);
         return 0;
     }
 
-    (void)snprintf(revert_msg,
-                   sizeof(revert_msg),
-                   "Revert to %s",
-                   commits[(size_t)choice - 1U].id);
+    memset(history, 0, sizeof(*history));
+    history->arena = arena;
 
-    if (!create_commit_with_message(repo, revert_msg))
+    if (commit_shard_path(&repo->id, path) != 0)
     {
-        free(commits);
-        (void)printf("File reverted, but failed to record revert commit.\n");
-        app_pause(NULL);
         return 0;
     }
 
-    free(commits);
-    (void)printf("Repository reverted successfully.\n");
-    app_pause(NULL);
+    *repo_ref = intern_repo(history, &repo->id);
+    if (*repo_ref == UINT32_MAX)
+    {
+        return 0;
+    }
+
+    /* A repository without commits has no shard yet. */
+    if (!file_exists(path))
+    {
+        path[0] = '\0';
+    }
+
     return 1;
 }
 
-void comm(RepoRecord *repo)
+/* Everything the history points at is allocated from `arena` and released with it. */
+int load_commits_for_repo(const RepoRecord *repo, Arena *arena, CommitHistory *history)
 {
-    int choice;
+    char path[VELOCE_PATH_LEN + 1];
+    DbScan scan;
+    FieldSpan fields[VELOCE_COMMIT_FIELDS];
+    uint32_t repo_ref;
+    uint64_t span;
 
-    if (!repo->initialized)
+    if (!history_start(repo, arena, history, path, &repo_ref))
     {
-        if (!init_repo(repo))
-        {
-            return;
-        }
+        return 0;
     }
 
-    while (1)
+    if (path[0] == '\0')
     {
-        app_clear_screen();
-        (void)printf("Repository #%d: %s\n", repo->rid, repo->name);
-        (void)printf("Tracked file: %s\n\n", repo->tracked_file);
-        (void)printf("1) Create commit\n");
-        (void)printf("2) View commits\n");
-        (void)printf("3) Revert to commit\n");
-        (void)printf("4) Back\n");
+        return 1;
+    }
 
-        if (!read_int("Choice: ", &choice))
-        {
-            (void)printf("Please enter a valid number.\n");
-            app_pause(NULL);
-            continue;
-        }
+    span = trace_begin();
+    if (!db_scan_open(&scan, path))
+    {
+        return 0;
+    }
 
-        if (choice == 1)
+    /* The shard holds this repository's commits only, so every line is copied out. */
+    while (db_scan_next_optional(&scan, fields, VELOCE_COMMIT_REQUIRED_FIELDS, VELOCE_COMMIT_FIELDS))
+    {
+        if (!history_append(history, fields, repo_ref))
         {
-            (void)create_commit(repo);
+            db_scan_close(&scan);
+            trace_end("scan commit shard", span, 0U);
+            return history_finish(history, 0);
         }
-        else if (choice == 2)
+    }
+
+    db_scan_close(&scan);
+    trace_end("scan commit shard", span, 0U);
+    return history_finish(history, 1);
+}
+
+/*
+ * Loads the commits stamped in [since, until). Commits are appended as they are made, so a
+ * shard is in time order: the first commit in range is found by bisecting the file by byte
+ * offset, and reading stops at the first commit past the range. A commit stamped earlier
+ * than the one before it, as after the clock was stepped back, can be missed at the edges.
+ */
+int load_commits_between(const RepoRecord *repo, int64_t since, int64_t until, Arena *arena, CommitHistory *history)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    DbScan scan;
+    FieldSpan fields[VELOCE_COMMIT_FIELDS];
+    uint32_t repo_ref;
+    uint64_t span;
+    int64_t lo = 0;
+    int64_t hi;
+    int ok;
+
+    if (!history_start(repo, arena, history, path, &repo_ref))
+    {
+        return 0;
+    }
+
+    if (path[0] == '\0' || since >= until)
+    {
+        return 1;
+    }
+
+    span = trace_begin();
+    if (!db_scan_open(&scan, path))
+    {
+        return 0;
+    }
+
+    /* Smallest offset whose next line is at or after `since`, or the end of the file. */
+    hi = db_scan_size(&scan);
+    ok = hi >= 0;
+    while (ok && lo < hi)
+    {
+        int64_t mid = lo + (hi - lo) / 2;
+
+        ok = db_scan_seek(&scan, mid);
+        if (!db_scan_next_optional(&scan, fields, VELOCE_COMMIT_REQUIRED_FIELDS, VELOCE_COMMIT_FIELDS) ||
+            parse_timestamp(fields[2].ptr, fields[2].len) >= since)
         {
-            view_commits(repo);
+            hi = mid;
         }
-        else if (choice == 3)
+        else
         {
-            (void)revert_commit(repo);
+            lo = mid + 1;
         }
-        else if (choice == 4)
+    }
+
+    ok = ok && db_scan_seek(&scan, lo);
+    while (ok && db_scan_next_optional(&scan, fields, VELOCE_COMMIT_REQUIRED_FIELDS, VELOCE_COMMIT_FIELDS))
+    {
+        int64_t stamp = parse_timestamp(fields[2].ptr, fields[2].len);
+
+        if (stamp >= until)
         {
-            return;
+            break;
         }
-        else
+        if (stamp >= since)
         {
-            (void)printf("Please choose 1 to 4.\n");
-            app_pause(NULL);
+            ok = history_append(history, fields, repo_ref);
         }
     }
+
+    db_scan_close(&scan);
+    trace_end("bisect commit shard", span, 0U);
+    return history_finish(history, ok);
+}
+
+int commit_entry_snapshot_path(const CommitEntry *entry, char out[VELOCE_PATH_LEN + 1])
+{
+    return build_snapshot_path(&entry->snapshot, out);
+}
+
+/* Reads the commit `commit_id` from the repository's log; 0 if the repository has no such commit. */
+int find_commit(const RepoRecord *repo, const IdKey *commit_id, CommitRecord *commit)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    DbScan scan;
+    FieldSpan fields[VELOCE_COMMIT_FIELDS];
+    int found = 0;
+
+    if (commit_shard_path(&repo->id, path) != 0 || !file_exists(path) || !db_scan_open(&scan, path))
+    {
+        return 0;
+    }
+
+    while (!found && db_scan_next_optional(&scan, fields, VELOCE_COMMIT_REQUIRED_FIELDS, VELOCE_COMMIT_FIELDS))
+    {
+        found = span_key_equals(&fields[0], commit_id) && commit_from_fields(fields, commit);
+    }
+
+    db_scan_close(&scan);
+    return found;
+}
+
+/*
+ * Restores the tracked file to the snapshot of `target` and records that as a new commit,
+ * whose id goes to `commit_id` when it is not NULL. The new commit points at the target's
+ * snapshot and reuses its hash, so the only data written is the one copy onto the tracked
+ * file; the snapshot is neither re-read nor stored again.
+ */
+int revert_to_commit(const RepoRecord *repo, const IdKey *target, IdKey *commit_id)
+{
+    CommitRecord commit;
+    char snapshot_path[VELOCE_PATH_LEN + 1];
+    char id[VELOCE_ID_LEN];
+    int ok;
+    uint64_t start;
+
+    if (!find_commit(repo, target, &commit))
+    {
+        return 0;
+    }
+
+    start = stats_op_begin();
+    ok = build_snapshot_path(&commit.snapshot_id, snapshot_path) == 0 &&
+         bulk_copy_file(snapshot_path, repo->tracked_file) == 0;
+
+    if (ok)
+    {
+        id_key_to_text(target, id);
+        generate_key(&commit.id);
+        commit.timestamp = now_timestamp();
+        (void)snprintf(commit.message, sizeof(commit.message), "Revert to %s", id);
+        ok = append_commit(&commit);
+    }
+    stats_op_end(STAT_OP_REVERT, start);
+
+    if (ok && commit_id != NULL)
+    {
+        *commit_id = commit.id;
+    }
+    return ok;
 }
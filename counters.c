@@ -0,0 +1,318 @@
+#define _DEFAULT_SOURCE
+
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#define COUNTER_TEXT_LEN 24U
+#define COUNTERS_SEEDED ".seeded"
+
+/*
+ * Repository numbers are handed out from one small file per owner, counters/<uid>.rid,
+ * holding the last number issued. Each allocation locks the file (flock, or LockFileEx on
+ * Windows), bumps the number and writes it back, so creating a repository costs the same
+ * however many exist, and two creators for the same owner never get the same number. The
+ * lock belongs to the open file, so threads of one process exclude each other too.
+ *
+ * Storage roots from before the counters existed are seeded once from repos.db; the
+ * .seeded marker is written only after every owner's counter has been raised.
+ */
+typedef struct
+{
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    int fd;
+#endif
+} CounterFile;
+
+#ifdef _WIN32
+static int counter_lock(const char *path, CounterFile *file)
+{
+    OVERLAPPED whole;
+
+    file->handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                               OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file->handle == INVALID_HANDLE_VALUE)
+    {
+        return 0;
+    }
+
+    memset(&whole, 0, sizeof(whole));
+    if (!LockFileEx(file->handle, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &whole))
+    {
+        CloseHandle(file->handle);
+        return 0;
+    }
+
+    return 1;
+}
+
+static size_t counter_read_text(CounterFile *file, char *text, size_t size)
+{
+    DWORD got = 0;
+
+    if (SetFilePointer(file->handle, 0, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER ||
+        !ReadFile(file->handle, text, (DWORD)(size - 1U), &got, NULL))
+    {
+        got = 0;
+    }
+
+    return (size_t)got;
+}
+
+static int counter_write_text(CounterFile *file, const char *text, size_t len)
+{
+    DWORD put = 0;
+
+    return SetFilePointer(file->handle, 0, NULL, FILE_BEGIN) != INVALID_SET_FILE_POINTER &&
+           WriteFile(file->handle, text, (DWORD)len, &put, NULL) && put == (DWORD)len &&
+           SetEndOfFile(file->handle);
+}
+
+static void counter_unlock(CounterFile *file)
+{
+    OVERLAPPED whole;
+
+    memset(&whole, 0, sizeof(whole));
+    (void)UnlockFileEx(file->handle, 0, MAXDWORD, MAXDWORD, &whole);
+    CloseHandle(file->handle);
+}
+#else
+static int counter_lock(const char *path, CounterFile *file)
+{
+    int rc;
+
+    file->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (file->fd < 0)
+    {
+        return 0;
+    }
+
+    do
+    {
+        rc = flock(file->fd, LOCK_EX);
+    } while (rc != 0 && errno == EINTR);
+
+    if (rc != 0)
+    {
+        close(file->fd);
+        return 0;
+    }
+
+    return 1;
+}
+
+static size_t counter_read_text(CounterFile *file, char *text, size_t size)
+{
+    ssize_t got = pread(file->fd, text, size - 1U, 0);
+
+    return got > 0 ? (size_t)got : 0U;
+}
+
+static int counter_write_text(CounterFile *file, const char *text, size_t len)
+{
+    return pwrite(file->fd, text, len, 0) == (ssize_t)len && ftruncate(file->fd, (off_t)len) == 0;
+}
+
+static void counter_unlock(CounterFile *file)
+{
+    /* Closing the descriptor drops the lock. */
+    close(file->fd);
+}
+#endif
+
+/* The owner's counter file relative to the storage root, as changes.log names it. */
+int repo_counter_name(const IdKey *owner_uid, char out[VELOCE_PATH_LEN + 1])
+{
+    char name[VELOCE_ID_LEN + 4];
+    char id[VELOCE_ID_LEN];
+
+    id_key_to_text(owner_uid, id);
+    if (snprintf(name, sizeof(name), "%s.rid", id) >= (int)sizeof(name))
+    {
+        return -1;
+    }
+
+    return path_join(out, VELOCE_PATH_LEN + 1U, VELOCE_COUNTERS_DIR, name);
+}
+
+/*
+ * Under the owner's lock, moves the counter up to `at_least`, or one past its current value
+ * when `at_least` is 0. Returns the stored value, or 0 on failure.
+ */
+static int counter_update(const IdKey *owner_uid, int at_least)
+{
+    char name[VELOCE_PATH_LEN + 1];
+    char path[VELOCE_PATH_LEN + 1];
+    char text[COUNTER_TEXT_LEN];
+    CounterFile file;
+    size_t len;
+    int value;
+    int next;
+
+    if (repo_counter_name(owner_uid, name) != 0 || path_join(path, sizeof(path), storage_root(), name) != 0 ||
+        !counter_lock(path, &file))
+    {
+        return 0;
+    }
+
+    /* A file created just now is empty: the owner has no repositories yet. */
+    len = counter_read_text(&file, text, sizeof(text));
+    text[len] = '\0';
+    value = atoi(text);
+
+    next = at_least == 0 ? value + 1 : (at_least > value ? at_least : value);
+    if (next != value)
+    {
+        len = (size_t)snprintf(text, sizeof(text), "%d\n", next);
+        if (!change_log_record(CHANGE_WRITE, name, 0U) || !counter_write_text(&file, text, len))
+        {
+            next = 0;
+        }
+    }
+
+    counter_unlock(&file);
+    return next;
+}
+
+/* Allocates the owner's next repository number; returns 0 if it could not be allocated. */
+int next_repo_id_for_owner(const IdKey *owner_uid)
+{
+    return counter_update(owner_uid, 0);
+}
+
+int repo_counter_raise(const IdKey *owner_uid, int rid)
+{
+    return rid <= 0 || counter_update(owner_uid, rid) != 0;
+}
+
+typedef struct
+{
+    IdKey owner;
+    int rid;
+} OwnerRid;
+
+static int compare_owner_rid(const void *a, const void *b)
+{
+    const OwnerRid *x = (const OwnerRid *)a;
+    const OwnerRid *y = (const OwnerRid *)b;
+
+    if (x->owner.hi != y->owner.hi)
+    {
+        return x->owner.hi < y->owner.hi ? -1 : 1;
+    }
+    if (x->owner.lo != y->owner.lo)
+    {
+        return x->owner.lo < y->owner.lo ? -1 : 1;
+    }
+    return 0;
+}
+
+/* Raises every owner's counter to the highest number that owner has in repos.db. */
+static int seed_counters(void)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    DbScan scan;
+    FieldSpan fields[VELOCE_REPO_FIELDS];
+    OwnerRid *pairs = NULL;
+    size_t count = 0U;
+    size_t cap = 0U;
+    size_t i;
+    int ok = 1;
+
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_REPOS_DB) != 0)
+    {
+        return 0;
+    }
+
+    if (db_scan_open(&scan, path))
+    {
+        while (ok && db_scan_next(&scan, fields, VELOCE_REPO_FIELDS))
+        {
+            if (count == cap)
+            {
+                size_t next_cap = cap == 0U ? 1024U : cap * 2U;
+                OwnerRid *next = (OwnerRid *)realloc(pairs, next_cap * sizeof(OwnerRid));
+
+                if (next == NULL)
+                {
+                    ok = 0;
+                    break;
+                }
+                pairs = next;
+                cap = next_cap;
+            }
+
+            if (id_key_from_span(&fields[1], &pairs[count].owner))
+            {
+                pairs[count].rid = span_to_int(&fields[2]);
+                count++;
+            }
+        }
+        db_scan_close(&scan);
+    }
+
+    if (ok && count > 0U)
+    {
+        qsort(pairs, count, sizeof(OwnerRid), compare_owner_rid);
+    }
+
+    for (i = 0U; ok && i < count;)
+    {
+        const IdKey *owner = &pairs[i].owner;
+        int max_rid = 0;
+
+        for (; i < count && id_key_equals(&pairs[i].owner, owner); i++)
+        {
+            if (pairs[i].rid > max_rid)
+            {
+                max_rid = pairs[i].rid;
+            }
+        }
+
+        ok = repo_counter_raise(owner, max_rid);
+    }
+
+    free(pairs);
+    return ok;
+}
+
+/* Seeds the counters on first use of a storage root; afterwards it only checks the marker. */
+int repo_counters_prepare(void)
+{
+    char dir[VELOCE_PATH_LEN + 1];
+    char marker[VELOCE_PATH_LEN + 1];
+    uint64_t span;
+
+    if (path_join(dir, sizeof(dir), storage_root(), VELOCE_COUNTERS_DIR) != 0 ||
+        path_join(marker, sizeof(marker), dir, COUNTERS_SEEDED) != 0 || ensure_dir(dir) != 0)
+    {
+        return 0;
+    }
+
+    if (file_exists(marker))
+    {
+        return 1;
+    }
+
+    span = trace_begin();
+    if (!seed_counters() || write_text_file(marker, "", 0U) != 0)
+    {
+        return 0;
+    }
+
+    trace_end("seed repo counters", span, 0U);
+    return 1;
+}
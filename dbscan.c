@@ -0,0 +1,479 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define DB_MAP_SLOTS 8U
+
+/*
+ * One mapping of a database file. Scans hold a reference while they walk it, so a remap
+ * triggered by growth in another thread never unmaps memory that is still being read.
+ * The databases are only appended to or replaced by rename, never truncated in place,
+ * so an old mapping stays valid until its last reader lets go.
+ */
+struct DbMap
+{
+    char path[VELOCE_PATH_LEN + 1];
+    const char *data;
+    size_t size;
+    uint64_t identity;
+    /* g_map_clock when a scan last took this mapping; the oldest idle slot is reused first. */
+    uint64_t last_used;
+    int refs;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+static DbMap *g_maps[DB_MAP_SLOTS];
+static uint64_t g_map_clock;
+static int g_map_lock;
+static int g_mmap_mode = -1;
+
+static void map_lock(void)
+{
+    while (!worker_spin_trylock(&g_map_lock))
+    {
+    }
+}
+
+static void map_unlock(void)
+{
+    worker_spin_unlock(&g_map_lock);
+}
+
+int db_mmap_enabled(void)
+{
+    if (g_mmap_mode < 0)
+    {
+        const char *env = getenv("VELOCE_MMAP");
+        g_mmap_mode = env != NULL && env[0] != '\0' && strcmp(env, "0") != 0;
+    }
+
+    return g_mmap_mode;
+}
+
+void db_mmap_set(int enabled)
+{
+    g_mmap_mode = enabled != 0;
+}
+
+/*
+ * Size plus modification time and inode, so both appends and rename-replacements are noticed.
+ * The time keeps its nanoseconds where the platform has them: a file replaced within the same
+ * second, reusing the inode and size, must not keep serving the old mapping.
+ */
+static int file_identity(const char *path, size_t *size, uint64_t *identity)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info))
+    {
+        return 0;
+    }
+
+    *size = (size_t)(((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow);
+    *identity = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+    return 1;
+#else
+    struct stat st;
+    uint64_t mtime;
+
+    if (stat(path, &st) != 0)
+    {
+        return 0;
+    }
+
+#ifdef __APPLE__
+    /* Darwin names the nanosecond field differently under each feature macro; whole seconds there. */
+    mtime = (uint64_t)st.st_mtime * (uint64_t)VELOCE_NS_PER_SEC;
+#else
+    mtime = (uint64_t)st.st_mtim.tv_sec * (uint64_t)VELOCE_NS_PER_SEC + (uint64_t)st.st_mtim.tv_nsec;
+#endif
+    *size = (size_t)st.st_size;
+    *identity = mtime ^ ((uint64_t)st.st_ino * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)st.st_dev << 48);
+    return 1;
+#endif
+}
+
+static void map_destroy(DbMap *map)
+{
+    if (map == NULL)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    if (map->data != NULL)
+    {
+        UnmapViewOfFile(map->data);
+    }
+    if (map->mapping != NULL)
+    {
+        CloseHandle(map->mapping);
+    }
+    if (map->file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(map->file);
+    }
+#else
+    if (map->data != NULL)
+    {
+        (void)munmap((void *)map->data, map->size);
+    }
+#endif
+
+    free(map);
+}
+
+static DbMap *map_create(const char *path, size_t size, uint64_t identity)
+{
+    DbMap *map = (DbMap *)calloc(1U, sizeof(DbMap));
+
+    if (map == NULL)
+    {
+        return NULL;
+    }
+
+    (void)snprintf(map->path, sizeof(map->path), "%s", path);
+    map->size = size;
+    map->identity = identity;
+    map->refs = 1;
+#ifdef _WIN32
+    map->file = INVALID_HANDLE_VALUE;
+#endif
+
+    if (size == 0U)
+    {
+        return map;
+    }
+
+#ifdef _WIN32
+    map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE)
+    {
+        map_destroy(map);
+        return NULL;
+    }
+
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (map->mapping == NULL)
+    {
+        map_destroy(map);
+        return NULL;
+    }
+
+    map->data = (const char *)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, size);
+#else
+    {
+        int fd = open(path, O_RDONLY);
+        void *addr;
+
+        if (fd < 0)
+        {
+            map_destroy(map);
+            return NULL;
+        }
+
+        addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        (void)close(fd);
+        map->data = addr == MAP_FAILED ? NULL : (const char *)addr;
+    }
+#endif
+
+    if (map->data == NULL)
+    {
+        map_destroy(map);
+        return NULL;
+    }
+
+    return map;
+}
+
+static void map_release(DbMap *map)
+{
+    int destroy;
+
+    if (map == NULL)
+    {
+        return;
+    }
+
+    map_lock();
+    destroy = --map->refs == 0;
+    map_unlock();
+
+    if (destroy)
+    {
+        map_destroy(map);
+    }
+}
+
+/*
+ * Returns a referenced mapping of `path`, reusing the cached one unless the file changed.
+ * A file not yet cached takes an empty slot or evicts the least recently used mapping no
+ * scan is reading; only when all of them are in use is the mapping handed out uncached.
+ */
+static DbMap *map_acquire(const char *path)
+{
+    DbMap *fresh;
+    DbMap *expected = NULL;
+    DbMap *stale = NULL;
+    size_t size;
+    uint64_t identity;
+    unsigned int slot = DB_MAP_SLOTS;
+    unsigned int empty = DB_MAP_SLOTS;
+    unsigned int idle = DB_MAP_SLOTS;
+    unsigned int i;
+
+    if (!file_identity(path, &size, &identity))
+    {
+        return NULL;
+    }
+
+    map_lock();
+    for (i = 0U; i < DB_MAP_SLOTS; i++)
+    {
+        DbMap *map = g_maps[i];
+
+        if (map == NULL)
+        {
+            empty = empty == DB_MAP_SLOTS ? i : empty;
+            continue;
+        }
+
+        if (strcmp(map->path, path) == 0)
+        {
+            if (map->size == size && map->identity == identity)
+            {
+                map->refs++;
+                map->last_used = ++g_map_clock;
+                map_unlock();
+                return map;
+            }
+            slot = i;
+            break;
+        }
+
+        /* The cache's own reference is the only one on a mapping no scan is reading. */
+        if (map->refs == 1 && (idle == DB_MAP_SLOTS || map->last_used < g_maps[idle]->last_used))
+        {
+            idle = i;
+        }
+    }
+    if (slot == DB_MAP_SLOTS)
+    {
+        slot = empty != DB_MAP_SLOTS ? empty : idle;
+    }
+    if (slot != DB_MAP_SLOTS)
+    {
+        expected = g_maps[slot];
+    }
+    map_unlock();
+
+    fresh = map_create(path, size, identity);
+    if (fresh == NULL)
+    {
+        return NULL;
+    }
+
+    if (slot == DB_MAP_SLOTS)
+    {
+        /* Every slot is being read; hand out an uncached mapping. */
+        return fresh;
+    }
+
+    map_lock();
+    if (g_maps[slot] == expected || (g_maps[slot] != NULL && strcmp(g_maps[slot]->path, path) == 0))
+    {
+        stale = g_maps[slot];
+        g_maps[slot] = fresh;
+        fresh->refs++;
+        fresh->last_used = ++g_map_clock;
+        if (stale != NULL)
+        {
+            stale->refs--;
+            if (stale->refs != 0)
+            {
+                stale = NULL;
+            }
+        }
+    }
+    map_unlock();
+
+    map_destroy(stale);
+    return fresh;
+}
+
+int db_scan_open(DbScan *scan, const char *path)
+{
+    if (scan == NULL || path == NULL)
+    {
+        return 0;
+    }
+
+    memset(scan, 0, sizeof(*scan));
+
+    if (db_mmap_enabled())
+    {
+        scan->map = map_acquire(path);
+        if (scan->map != NULL)
+        {
+            scan->cursor = scan->map->data;
+            scan->end = scan->map->data + scan->map->size;
+            return 1;
+        }
+    }
+
+    scan->fp = fopen(path, "rb");
+    return scan->fp != NULL;
+}
+
+static int next_mapped_line(DbScan *scan, const char **line, size_t *len)
+{
+    const char *start = scan->cursor;
+    const char *nl;
+    size_t avail;
+
+    if (start == NULL || start >= scan->end)
+    {
+        return 0;
+    }
+
+    avail = (size_t)(scan->end - start);
+    nl = (const char *)memchr(start, '\n', avail);
+    scan->cursor = nl != NULL ? nl + 1 : scan->end;
+
+    *line = start;
+    *len = nl != NULL ? (size_t)(nl - start) : avail;
+    if (*len > 0U && start[*len - 1U] == '\r')
+    {
+        (*len)--;
+    }
+
+    stats_add(STAT_RECORDS_SCANNED, 1U);
+    stats_add(STAT_BYTES_READ, (uint64_t)(scan->cursor - start));
+    return 1;
+}
+
+int db_scan_next(DbScan *scan, FieldSpan fields[], size_t expected)
+{
+    return db_scan_next_optional(scan, fields, expected, expected);
+}
+
+int db_scan_next_optional(DbScan *scan, FieldSpan fields[], size_t required, size_t expected)
+{
+    const char *line;
+    size_t len;
+
+    while (1)
+    {
+        if (scan->map != NULL)
+        {
+            if (!next_mapped_line(scan, &line, &len))
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            if (scan->fp == NULL || !db_next_line(scan->fp, scan->line, sizeof(scan->line), &len))
+            {
+                return 0;
+            }
+            line = scan->line;
+        }
+
+        if (split_field_spans_optional(line, len, fields, required, expected))
+        {
+            return 1;
+        }
+    }
+}
+
+/* Size in bytes of the file being scanned, or -1 when it cannot be told. */
+int64_t db_scan_size(DbScan *scan)
+{
+    long size;
+
+    if (scan->map != NULL)
+    {
+        return (int64_t)scan->map->size;
+    }
+
+    if (scan->fp == NULL || fseek(scan->fp, 0L, SEEK_END) != 0 || (size = ftell(scan->fp)) < 0L)
+    {
+        return -1;
+    }
+
+    return (int64_t)size;
+}
+
+/*
+ * Moves the scan to the first line that starts at or after byte `offset`, so a sorted file
+ * can be bisected by offset. Returns 0 if the file could not be repositioned.
+ */
+int db_scan_seek(DbScan *scan, int64_t offset)
+{
+    int c;
+
+    if (scan->map != NULL)
+    {
+        const char *at = scan->map->data + offset;
+
+        if (offset > 0 && at[-1] != '\n')
+        {
+            at = (const char *)memchr(at, '\n', (size_t)(scan->end - at));
+            at = at != NULL ? at + 1 : scan->end;
+        }
+        scan->cursor = at;
+        return 1;
+    }
+
+    if (scan->fp == NULL || fseek(scan->fp, offset > 0 ? (long)offset - 1L : 0L, SEEK_SET) != 0)
+    {
+        return 0;
+    }
+
+    if (offset > 0)
+    {
+        do
+        {
+            c = fgetc(scan->fp);
+        } while (c != EOF && c != '\n');
+    }
+
+    return 1;
+}
+
+void db_scan_close(DbScan *scan)
+{
+    if (scan == NULL)
+    {
+        return;
+    }
+
+    if (scan->fp != NULL)
+    {
+        fclose(scan->fp);
+        scan->fp = NULL;
+    }
+
+    map_release(scan->map);
+    scan->map = NULL;
+}
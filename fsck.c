@@ -0,0 +1,642 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FSCK_LINE_LEN 8192U
+#define FSCK_CHUNK 64U
+#define FSCK_PROGRESS_NS 500000000ULL
+
+#ifdef _MSC_VER
+#include <windows.h>
+#define FSCK_ATOMIC_ADD(p, n) (void)InterlockedExchangeAdd64((volatile LONG64 *)(p), (LONG64)(n))
+#define FSCK_ATOMIC_LOAD(p) (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)(p), 0, 0)
+#else
+#define FSCK_ATOMIC_ADD(p, n) (void)__atomic_fetch_add((p), (uint64_t)(n), __ATOMIC_RELAXED)
+#define FSCK_ATOMIC_LOAD(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#endif
+
+/* Open-addressed set of ids, sized once up front; slots hold index + 1 so zero means empty. */
+typedef struct
+{
+    const IdKey *keys;
+    uint32_t *slots;
+    size_t mask;
+    size_t count;
+} KeySet;
+
+typedef struct
+{
+    IdKey id;
+    IdKey snapshot;
+    char hash[VELOCE_CONTENT_HASH_LEN];
+} FsckCommit;
+
+/* A worker's share of the commit list; others steal from the back when theirs runs dry. */
+typedef struct
+{
+    size_t next;
+    size_t end;
+    int lock;
+} FsckQueue;
+
+typedef struct
+{
+    const FsckReporter *reporter;
+    const FsckCommit *commits;
+    size_t count;
+    FsckQueue *queues;
+    unsigned int workers;
+    uint64_t checked;
+    uint64_t unhashed;
+    uint64_t problems;
+    uint64_t last_report_ns;
+    int report_lock;
+    int problem_lock;
+} FsckJob;
+
+typedef struct
+{
+    FsckJob *job;
+    size_t base;
+} FsckBatch;
+
+static void queue_lock(int *lock)
+{
+    while (!worker_spin_trylock(lock))
+    {
+    }
+}
+
+static const FsckReporter k_silent_reporter = {NULL, NULL, NULL};
+
+static void report(FsckJob *job, const char *where, const char *what)
+{
+    if (job->reporter->problem != NULL)
+    {
+        queue_lock(&job->problem_lock);
+        job->reporter->problem(job->reporter->ctx, where, what);
+        worker_spin_unlock(&job->problem_lock);
+    }
+    FSCK_ATOMIC_ADD(&job->problems, 1U);
+}
+
+static void report_line(FsckJob *job, const char *db, size_t line, const char *what)
+{
+    char where[VELOCE_PATH_LEN + 24];
+
+    (void)snprintf(where, sizeof(where), "%s:%zu", db, line);
+    report(job, where, what);
+}
+
+static int key_set_init(Arena *arena, KeySet *set, const IdKey *keys, size_t count)
+{
+    size_t slots = 16U;
+
+    while (slots < count * 2U)
+    {
+        slots *= 2U;
+    }
+
+    set->keys = keys;
+    set->mask = slots - 1U;
+    set->count = 0U;
+    set->slots = (uint32_t *)arena_alloc(arena, slots * sizeof(uint32_t));
+    if (set->slots == NULL)
+    {
+        return 0;
+    }
+
+    memset(set->slots, 0, slots * sizeof(uint32_t));
+    return 1;
+}
+
+/* Inserts keys[index]; returns 0 if an equal key is already present. */
+static int key_set_insert(KeySet *set, size_t index)
+{
+    size_t s = (size_t)id_key_hash(&set->keys[index]) & set->mask;
+
+    while (set->slots[s] != 0U)
+    {
+        if (id_key_equals(&set->keys[set->slots[s] - 1U], &set->keys[index]))
+        {
+            return 0;
+        }
+        s = (s + 1U) & set->mask;
+    }
+
+    set->slots[s] = (uint32_t)index + 1U;
+    set->count++;
+    return 1;
+}
+
+static int key_set_contains(const KeySet *set, const IdKey *key)
+{
+    size_t s = (size_t)id_key_hash(key) & set->mask;
+
+    while (set->slots[s] != 0U)
+    {
+        if (id_key_equals(&set->keys[set->slots[s] - 1U], key))
+        {
+            return 1;
+        }
+        s = (s + 1U) & set->mask;
+    }
+
+    return 0;
+}
+
+static FILE *open_db(const char *name)
+{
+    char path[VELOCE_PATH_LEN + 1];
+
+    if (path_join(path, sizeof(path), storage_root(), name) != 0)
+    {
+        return NULL;
+    }
+
+    return fopen(path, "rb");
+}
+
+/* Counts lines so the id arrays can be sized before the records are parsed. */
+static size_t count_lines(const char *name)
+{
+    char line[FSCK_LINE_LEN];
+    size_t count = 0U;
+    FILE *fp = open_db(name);
+
+    if (fp == NULL)
+    {
+        return 0U;
+    }
+
+    while (db_next_line(fp, line, sizeof(line), NULL))
+    {
+        count++;
+    }
+
+    fclose(fp);
+    return count;
+}
+
+static int check_users(FsckJob *job, Arena *arena, KeySet *users)
+{
+    char line[FSCK_LINE_LEN];
+    size_t capacity = count_lines(VELOCE_USERS_DB);
+    IdKey *keys = (IdKey *)arena_alloc(arena, (capacity + 1U) * sizeof(IdKey));
+    size_t count = 0U;
+    size_t number = 0U;
+    size_t len;
+    FILE *fp;
+
+    if (keys == NULL || !key_set_init(arena, users, keys, capacity))
+    {
+        return 0;
+    }
+
+    fp = open_db(VELOCE_USERS_DB);
+    while (fp != NULL && count < capacity && db_next_line(fp, line, sizeof(line), &len))
+    {
+        FieldSpan fields[VELOCE_USER_FIELDS];
+        UserRecord user;
+
+        number++;
+        if (len == 0U)
+        {
+            continue;
+        }
+
+        if (!split_field_spans(line, len, fields, VELOCE_USER_FIELDS) || !user_from_fields(fields, &user))
+        {
+            report_line(job, VELOCE_USERS_DB, number, "malformed user record");
+            continue;
+        }
+
+        keys[count] = user.uid;
+        if (!key_set_insert(users, count))
+        {
+            report_line(job, VELOCE_USERS_DB, number, "duplicate user id");
+            continue;
+        }
+        count++;
+    }
+
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    return 1;
+}
+
+static int check_repos(FsckJob *job, Arena *arena, const KeySet *users, KeySet *repos)
+{
+    char line[FSCK_LINE_LEN];
+    size_t capacity = count_lines(VELOCE_REPOS_DB);
+    IdKey *keys = (IdKey *)arena_alloc(arena, (capacity + 1U) * sizeof(IdKey));
+    size_t count = 0U;
+    size_t number = 0U;
+    size_t len;
+    FILE *fp;
+
+    if (keys == NULL || !key_set_init(arena, repos, keys, capacity))
+    {
+        return 0;
+    }
+
+    fp = open_db(VELOCE_REPOS_DB);
+    while (fp != NULL && count < capacity && db_next_line(fp, line, sizeof(line), &len))
+    {
+        FieldSpan fields[VELOCE_REPO_FIELDS];
+        RepoRecord repo;
+
+        number++;
+        if (len == 0U)
+        {
+            continue;
+        }
+
+        if (!split_field_spans(line, len, fields, VELOCE_REPO_FIELDS) || !repo_from_fields(fields, &repo))
+        {
+            report_line(job, VELOCE_REPOS_DB, number, "malformed repository record");
+            continue;
+        }
+
+        if (!key_set_contains(users, &repo.owner_uid))
+        {
+            report_line(job, VELOCE_REPOS_DB, number, "owner does not exist in users.db");
+        }
+
+        keys[count] = repo.id;
+        if (!key_set_insert(repos, count))
+        {
+            report_line(job, VELOCE_REPOS_DB, number, "duplicate repository id");
+            continue;
+        }
+        count++;
+    }
+
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+    return 1;
+}
+
+typedef struct
+{
+    FsckJob *job;
+    const KeySet *repos;
+} ShardCheck;
+
+/* Reports a commit log in VELOCE_COMMITS_DIR whose repository is not in repos.db. */
+static int check_shard_owner(const char *file, void *ctx)
+{
+    ShardCheck *check = (ShardCheck *)ctx;
+    char name[VELOCE_PATH_LEN + 1];
+    size_t len = strlen(file);
+    FieldSpan stem;
+    IdKey repo;
+
+    if (len < 3U || strcmp(file + len - 3U, ".db") != 0 ||
+        path_join(name, sizeof(name), VELOCE_COMMITS_DIR, file) != 0)
+    {
+        return 1;
+    }
+
+    stem.ptr = file;
+    stem.len = len - 3U;
+    if (stem.len != VELOCE_ID_LEN - 1U || !id_key_from_span(&stem, &repo) || !key_set_contains(check->repos, &repo))
+    {
+        report(check->job, name, "commit log belongs to no repository");
+    }
+    return 1;
+}
+
+/* Parses the commit log of every repository into `out`, checking each record belongs there. */
+static int check_commits(FsckJob *job, Arena *arena, const KeySet *repos, FsckCommit **out, size_t *out_count)
+{
+    char line[FSCK_LINE_LEN];
+    char name[VELOCE_PATH_LEN + 1];
+    ShardCheck check;
+    size_t capacity = 0U;
+    FsckCommit *commits;
+    IdKey *keys;
+    KeySet ids;
+    size_t count = 0U;
+    size_t len;
+    size_t r;
+    size_t i;
+
+    for (r = 0U; r < repos->count; r++)
+    {
+        if (commit_shard_name(&repos->keys[r], name) == 0)
+        {
+            capacity += count_lines(name);
+        }
+    }
+
+    commits = (FsckCommit *)arena_alloc(arena, (capacity + 1U) * sizeof(FsckCommit));
+    keys = (IdKey *)arena_alloc(arena, (capacity + 1U) * sizeof(IdKey));
+    if (commits == NULL || keys == NULL || !key_set_init(arena, &ids, keys, capacity))
+    {
+        return 0;
+    }
+
+    for (r = 0U; r < repos->count; r++)
+    {
+        size_t number = 0U;
+        FILE *fp = commit_shard_name(&repos->keys[r], name) == 0 ? open_db(name) : NULL;
+
+        while (fp != NULL && count < capacity && db_next_line(fp, line, sizeof(line), &len))
+        {
+            FieldSpan fields[VELOCE_COMMIT_FIELDS];
+            CommitRecord commit;
+
+            number++;
+            if (len == 0U)
+            {
+                continue;
+            }
+
+            if (!split_field_spans_optional(line, len, fields, VELOCE_COMMIT_REQUIRED_FIELDS, VELOCE_COMMIT_FIELDS) ||
+                !commit_from_fields(fields, &commit))
+            {
+                report_line(job, name, number, "malformed commit record");
+                continue;
+            }
+
+            if (!id_key_equals(&commit.repo_id, &repos->keys[r]))
+            {
+                report_line(job, name, number, "commit belongs to another repository");
+            }
+
+            if (commit.content_hash[0] != '\0' && !content_hash_is_valid(commit.content_hash))
+            {
+                report_line(job, name, number, "malformed content hash");
+                commit.content_hash[0] = '\0';
+            }
+
+            keys[count] = commit.id;
+            if (!key_set_insert(&ids, count))
+            {
+                report_line(job, name, number, "duplicate commit id");
+                continue;
+            }
+
+            commits[count].id = commit.id;
+            commits[count].snapshot = commit.snapshot_id;
+            memcpy(commits[count].hash, commit.content_hash, sizeof(commits[count].hash));
+            count++;
+        }
+
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+    }
+
+    /* Only listed repositories were read above; a log left behind by any other is an orphan. */
+    check.job = job;
+    check.repos = repos;
+    if (path_join(name, sizeof(name), storage_root(), VELOCE_COMMITS_DIR) != 0 ||
+        dir_for_each(name, check_shard_owner, &check) != 0)
+    {
+        return 0;
+    }
+
+    /* A commit may point at another commit's snapshot; that commit has to exist too. */
+    for (i = 0U; i < count; i++)
+    {
+        if (!id_key_equals(&commits[i].snapshot, &commits[i].id) && !key_set_contains(&ids, &commits[i].snapshot))
+        {
+            char where[VELOCE_ID_LEN + 8];
+            char id[VELOCE_ID_LEN];
+
+            id_key_to_text(&commits[i].id, id);
+            (void)snprintf(where, sizeof(where), "commit %s", id);
+            report(job, where, "snapshot refers to an unknown commit");
+        }
+    }
+
+    *out = commits;
+    *out_count = count;
+    return 1;
+}
+
+static void report_progress(FsckJob *job, int final)
+{
+    uint64_t now = monotonic_ns();
+    uint64_t checked;
+
+    if (job->reporter->progress == NULL)
+    {
+        return;
+    }
+
+    if (!final && (now - job->last_report_ns < FSCK_PROGRESS_NS || !worker_spin_trylock(&job->report_lock)))
+    {
+        return;
+    }
+
+    if (final)
+    {
+        queue_lock(&job->report_lock);
+    }
+
+    checked = FSCK_ATOMIC_LOAD(&job->checked);
+    if (final || now - job->last_report_ns >= FSCK_PROGRESS_NS)
+    {
+        job->reporter->progress(job->reporter->ctx, checked, (uint64_t)job->count, final);
+        job->last_report_ns = now;
+    }
+    worker_spin_unlock(&job->report_lock);
+}
+
+static void verify_snapshot(void *arg, size_t index, const char *data, size_t len)
+{
+    FsckBatch *batch = (FsckBatch *)arg;
+    const FsckCommit *commit = &batch->job->commits[batch->base + index];
+    char where[VELOCE_ID_LEN + 8];
+    char id[VELOCE_ID_LEN];
+
+    id_key_to_text(&commit->id, id);
+    (void)snprintf(where, sizeof(where), "commit %s", id);
+
+    if (data == NULL)
+    {
+        report(batch->job, where, "snapshot is missing or unreadable");
+        return;
+    }
+
+    if (commit->hash[0] == '\0')
+    {
+        FSCK_ATOMIC_ADD(&batch->job->unhashed, 1U);
+        return;
+    }
+
+    if (!content_hash_matches(data, len, commit->hash))
+    {
+        report(batch->job, where, "snapshot content does not match its recorded hash");
+    }
+}
+
+/*
+ * Takes the next chunk from this worker's queue, or steals the back half of another
+ * worker's remaining range when its own is empty.
+ */
+static int take_chunk(FsckJob *job, unsigned int index, size_t *begin, size_t *end)
+{
+    FsckQueue *own = &job->queues[index];
+    unsigned int step;
+
+    while (1)
+    {
+        int stolen = 0;
+
+        queue_lock(&own->lock);
+        if (own->next < own->end)
+        {
+            *begin = own->next;
+            *end = own->end - own->next > FSCK_CHUNK ? own->next + FSCK_CHUNK : own->end;
+            own->next = *end;
+            worker_spin_unlock(&own->lock);
+            return 1;
+        }
+        worker_spin_unlock(&own->lock);
+
+        for (step = 1U; step < job->workers && !stolen; step++)
+        {
+            FsckQueue *victim = &job->queues[(index + step) % job->workers];
+            size_t take;
+
+            queue_lock(&victim->lock);
+            take = (victim->end - victim->next + 1U) / 2U;
+            if (take > 0U)
+            {
+                victim->end -= take;
+                *begin = victim->end;
+                stolen = 1;
+            }
+            worker_spin_unlock(&victim->lock);
+
+            if (stolen)
+            {
+                queue_lock(&own->lock);
+                own->next = *begin;
+                own->end = *begin + take;
+                worker_spin_unlock(&own->lock);
+            }
+        }
+
+        if (!stolen)
+        {
+            return 0;
+        }
+    }
+}
+
+static void fsck_worker(void *arg, unsigned int index)
+{
+    FsckJob *job = (FsckJob *)arg;
+    BulkReader *reader = bulk_reader_open();
+    char (*paths)[VELOCE_PATH_LEN + 1] = (char (*)[VELOCE_PATH_LEN + 1])malloc(FSCK_CHUNK * sizeof(*paths));
+    const char *names[FSCK_CHUNK];
+    size_t begin;
+    size_t end;
+    size_t i;
+
+    if (paths == NULL)
+    {
+        bulk_reader_close(reader);
+        return;
+    }
+
+    while (take_chunk(job, index, &begin, &end))
+    {
+        FsckBatch batch;
+
+        batch.job = job;
+        batch.base = begin;
+        for (i = begin; i < end; i++)
+        {
+            if (build_snapshot_path(&job->commits[i].snapshot, paths[i - begin]) != 0)
+            {
+                paths[i - begin][0] = '\0';
+            }
+            names[i - begin] = paths[i - begin];
+        }
+
+        (void)bulk_reader_read(reader, names, end - begin, verify_snapshot, &batch);
+        FSCK_ATOMIC_ADD(&job->checked, end - begin);
+        report_progress(job, 0);
+    }
+
+    free(paths);
+    bulk_reader_close(reader);
+}
+
+/*
+ * Checks the whole storage root: every record in users.db, repos.db and the commit logs
+ * parses, ids are unique, owners exist, each commit sits in its repository's log, and every
+ * snapshot can be read and matches the hash recorded with its commit. Problems and progress go
+ * to `reporter`, which may be NULL; `summary`, when not NULL, receives what was checked.
+ * Returns the number of problems found, or -1 if the check itself could not run.
+ */
+long fsck_storage(unsigned int threads, const FsckReporter *reporter, FsckSummary *summary)
+{
+    Arena arena;
+    KeySet users;
+    KeySet repos;
+    FsckJob job;
+    FsckCommit *commits = NULL;
+    size_t count = 0U;
+    unsigned int i;
+
+    memset(&job, 0, sizeof(job));
+    job.reporter = reporter != NULL ? reporter : &k_silent_reporter;
+    arena_init(&arena, 0U);
+
+    if (!check_users(&job, &arena, &users) || !check_repos(&job, &arena, &users, &repos) ||
+        !check_commits(&job, &arena, &repos, &commits, &count))
+    {
+        arena_free(&arena);
+        return -1;
+    }
+
+    job.workers = threads > 0U ? threads : worker_default_count();
+    if ((size_t)job.workers > count / FSCK_CHUNK + 1U)
+    {
+        job.workers = (unsigned int)(count / FSCK_CHUNK + 1U);
+    }
+
+    job.commits = commits;
+    job.count = count;
+    job.queues = (FsckQueue *)arena_alloc(&arena, job.workers * sizeof(FsckQueue));
+    if (job.queues == NULL)
+    {
+        arena_free(&arena);
+        return -1;
+    }
+
+    for (i = 0U; i < job.workers; i++)
+    {
+        job.queues[i].next = count * i / job.workers;
+        job.queues[i].end = count * (i + 1U) / job.workers;
+        job.queues[i].lock = 0;
+    }
+
+    job.last_report_ns = monotonic_ns();
+    (void)run_workers(job.workers, fsck_worker, &job);
+    report_progress(&job, 1);
+
+    if (summary != NULL)
+    {
+        summary->commits = count;
+        summary->threads = job.workers;
+        summary->unhashed = job.unhashed;
+    }
+
+    arena_free(&arena);
+    return (long)job.problems;
+}
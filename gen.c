@@ -0,0 +1,614 @@
+#include "vcs.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEN_IO_BUFFER (1U << 20)
+/* Generated accounts date back this far; each repository's commits spread evenly up to now. */
+#define GEN_HISTORY_DAYS 365
+
+typedef struct
+{
+    size_t users;
+    size_t repos_per_user;
+    size_t commits_per_repo;
+    size_t snapshot_min;
+    size_t snapshot_max;
+    int log_sizes;
+    int write_snapshots;
+    unsigned int threads;
+    uint64_t seed;
+    int64_t now;
+    const char *prefix;
+    int failed;
+} GenConfig;
+
+typedef struct
+{
+    uint64_t state;
+} GenRng;
+
+static uint64_t rng_next(GenRng *rng)
+{
+    uint64_t x = rng->state;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double rng_unit(GenRng *rng)
+{
+    return (double)(rng_next(rng) >> 11) / 9007199254740992.0;
+}
+
+/* Same alphabet and length as generate_id, but thread-local and reproducible from --seed. */
+static void gen_id(GenRng *rng, char out[VELOCE_ID_LEN])
+{
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    size_t i;
+
+    for (i = 0U; i < VELOCE_ID_LEN - 1U; i++)
+    {
+        out[i] = chars[rng_next(rng) % (sizeof(chars) - 1U)];
+    }
+
+    out[VELOCE_ID_LEN - 1U] = '\0';
+}
+
+static void gen_key(GenRng *rng, IdKey *key)
+{
+    char text[VELOCE_ID_LEN];
+
+    gen_id(rng, text);
+    (void)id_key_from_text(text, key);
+}
+
+static size_t pick_snapshot_size(const GenConfig *cfg, GenRng *rng)
+{
+    double lo;
+    double hi;
+
+    if (cfg->snapshot_max <= cfg->snapshot_min)
+    {
+        return cfg->snapshot_min;
+    }
+
+    if (!cfg->log_sizes)
+    {
+        return cfg->snapshot_min + (size_t)(rng_next(rng) % (cfg->snapshot_max - cfg->snapshot_min + 1U));
+    }
+
+    /* Log-uniform: most snapshots are small, a long tail is large, like real source files. */
+    lo = log((double)(cfg->snapshot_min > 0U ? cfg->snapshot_min : 1U));
+    hi = log((double)cfg->snapshot_max);
+    return (size_t)exp(lo + (hi - lo) * rng_unit(rng));
+}
+
+static void fill_text(GenRng *rng, char *buf, size_t len)
+{
+    static const char *words[] = {"alpha", "beta", "commit", "delta", "snapshot", "tracked",
+                                  "veloce", "value", "return", "index", "buffer", "record"};
+    size_t pos = 0U;
+    size_t col = 0U;
+
+    while (pos < len)
+    {
+        const char *word = words[rng_next(rng) % (sizeof(words) / sizeof(words[0]))];
+        size_t wlen = strlen(word);
+        size_t i;
+
+        for (i = 0U; i < wlen && pos < len; i++)
+        {
+            buf[pos++] = word[i];
+        }
+
+        col += wlen + 1U;
+        if (pos < len)
+        {
+            buf[pos++] = (col > 72U) ? '\n' : ' ';
+        }
+        if (col > 72U)
+        {
+            col = 0U;
+        }
+    }
+}
+
+static int part_path(const char *db_name, unsigned int index, char out[VELOCE_PATH_LEN + 1])
+{
+    char name[64];
+
+    if (snprintf(name, sizeof(name), "%s.gen%u", db_name, index) >= (int)sizeof(name))
+    {
+        return -1;
+    }
+
+    return path_join(out, VELOCE_PATH_LEN + 1U, storage_root(), name);
+}
+
+static FILE *open_part(const char *db_name, unsigned int index)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    FILE *fp;
+
+    if (part_path(db_name, index, path) != 0)
+    {
+        return NULL;
+    }
+
+    fp = fopen(path, "wb");
+    if (fp != NULL)
+    {
+        (void)setvbuf(fp, NULL, _IOFBF, GEN_IO_BUFFER);
+    }
+
+    return fp;
+}
+
+/* A fresh repository's commit log; only its generating worker ever writes to it. */
+static FILE *open_shard(const IdKey *repo_id)
+{
+    char name[VELOCE_PATH_LEN + 1];
+    char path[VELOCE_PATH_LEN + 1];
+    FILE *fp;
+
+    if (commit_shard_name(repo_id, name) != 0 || commit_shard_path(repo_id, path) != 0 ||
+        !change_log_record(CHANGE_WRITE, name, 0U))
+    {
+        return NULL;
+    }
+
+    fp = fopen(path, "wb");
+    if (fp != NULL)
+    {
+        (void)setvbuf(fp, NULL, _IOFBF, GEN_IO_BUFFER);
+    }
+
+    return fp;
+}
+
+static int write_workspace_file(const RepoRecord *repo, const char *content, size_t len)
+{
+    char workspace_root[VELOCE_PATH_LEN + 1];
+    char repo_workspace[VELOCE_PATH_LEN + 1];
+    char id[VELOCE_ID_LEN];
+
+    id_key_to_text(&repo->id, id);
+    if (path_join(workspace_root, sizeof(workspace_root), storage_root(), VELOCE_WORKSPACE_DIR) != 0 ||
+        path_join(repo_workspace, sizeof(repo_workspace), workspace_root, id) != 0 ||
+        ensure_dir(repo_workspace) != 0)
+    {
+        return 0;
+    }
+
+    return write_text_file(repo->tracked_file, content, len) == 0;
+}
+
+static int generate_user(GenConfig *cfg, GenRng *rng, size_t user_index, FILE *users, FILE *repos, char *content)
+{
+    UserRecord user;
+    int64_t history = (int64_t)GEN_HISTORY_DAYS * 86400 * VELOCE_NS_PER_SEC;
+    int64_t slot = cfg->commits_per_repo > 0U ? history / (int64_t)cfg->commits_per_repo : history;
+    size_t r;
+
+    memset(&user, 0, sizeof(user));
+    gen_key(rng, &user.uid);
+    gen_id(rng, user.password_salt);
+    gen_id(rng, user.answer_salt);
+    (void)snprintf(user.username, sizeof(user.username), "%s%zu", cfg->prefix, user_index);
+    (void)snprintf(user.name, sizeof(user.name), "Generated User %zu", user_index);
+    (void)snprintf(user.security_question, sizeof(user.security_question), "Favourite colour?");
+    hash_secret("password", user.password_salt, user.password_hash);
+    hash_secret("blue", user.answer_salt, user.answer_hash);
+    user.created_at = cfg->now - history;
+
+    if (!write_user_line(users, &user))
+    {
+        return 0;
+    }
+
+    for (r = 0U; r < cfg->repos_per_user; r++)
+    {
+        RepoRecord repo;
+        CommitRecord commit;
+        FILE *commits = NULL;
+        size_t last_len = 0U;
+        size_t c;
+        int ok = 1;
+
+        memset(&repo, 0, sizeof(repo));
+        gen_key(rng, &repo.id);
+        repo.owner_uid = user.uid;
+        repo.rid = (int)r + 1;
+        (void)snprintf(repo.name, sizeof(repo.name), "repo-%zu", r + 1U);
+        repo.initialized = cfg->commits_per_repo > 0U;
+        if (repo.initialized)
+        {
+            char workspace_root[VELOCE_PATH_LEN + 1];
+            char repo_workspace[VELOCE_PATH_LEN + 1];
+            char id[VELOCE_ID_LEN];
+
+            id_key_to_text(&repo.id, id);
+            if (path_join(workspace_root, sizeof(workspace_root), storage_root(), VELOCE_WORKSPACE_DIR) != 0 ||
+                path_join(repo_workspace, sizeof(repo_workspace), workspace_root, id) != 0 ||
+                path_join(repo.tracked_file, sizeof(repo.tracked_file), repo_workspace, "tracked.txt") != 0)
+            {
+                return 0;
+            }
+        }
+        repo.created_at = user.created_at;
+
+        if (!write_repo_line(repos, &repo))
+        {
+            return 0;
+        }
+
+        if (repo.initialized && (commits = open_shard(&repo.id)) == NULL)
+        {
+            return 0;
+        }
+
+        memset(&commit, 0, sizeof(commit));
+        commit.repo_id = repo.id;
+        for (c = 0U; ok && c < cfg->commits_per_repo; c++)
+        {
+            gen_key(rng, &commit.id);
+            /* One commit somewhere in each slot keeps the shard in time order. */
+            commit.timestamp = user.created_at + slot * (int64_t)c + (int64_t)(rng_next(rng) % (uint64_t)slot);
+            (void)snprintf(commit.message, sizeof(commit.message),
+                           c == 0U ? "Initial commit" : "Generated change %zu", c);
+            commit.snapshot_id = commit.id;
+            commit.content_hash[0] = '\0';
+
+            if (cfg->write_snapshots)
+            {
+                char snapshot_path[VELOCE_PATH_LEN + 1];
+
+                last_len = pick_snapshot_size(cfg, rng);
+                fill_text(rng, content, last_len);
+                hash_content(content, last_len, commit.content_hash);
+                if (snapshot_path_create(storage_root(), &commit.id, snapshot_path) != 0 ||
+                    !change_log_snapshot(&commit.id) || write_text_file(snapshot_path, content, last_len) != 0 ||
+                    !snapshot_trigrams_append(&repo.id, &commit.id, content, last_len))
+                {
+                    ok = 0;
+                    break;
+                }
+            }
+
+            ok = write_commit_line(commits, &commit);
+        }
+
+        if (commits != NULL && fclose(commits) != 0)
+        {
+            ok = 0;
+        }
+
+        if (!ok)
+        {
+            return 0;
+        }
+
+        if (cfg->write_snapshots && repo.initialized && !write_workspace_file(&repo, content, last_len))
+        {
+            return 0;
+        }
+    }
+
+    /* Repositories created later for this user continue after the generated ones. */
+    return repo_counter_raise(&user.uid, (int)cfg->repos_per_user);
+}
+
+static void generate_partition(void *arg, unsigned int index)
+{
+    GenConfig *cfg = (GenConfig *)arg;
+    size_t first = cfg->users * index / cfg->threads;
+    size_t last = cfg->users * (index + 1U) / cfg->threads;
+    FILE *users = open_part(VELOCE_USERS_DB, index);
+    FILE *repos = open_part(VELOCE_REPOS_DB, index);
+    char *content = (char *)malloc(cfg->snapshot_max + 1U);
+    GenRng rng;
+    size_t u;
+    int ok = users != NULL && repos != NULL && content != NULL;
+
+    rng.state = (cfg->seed ^ (0x9E3779B97F4A7C15ULL * (uint64_t)(index + 1U))) | 1U;
+
+    for (u = first; ok && u < last; u++)
+    {
+        ok = generate_user(cfg, &rng, u, users, repos, content);
+    }
+
+    if (users != NULL && fclose(users) != 0)
+    {
+        ok = 0;
+    }
+    if (repos != NULL && fclose(repos) != 0)
+    {
+        ok = 0;
+    }
+    free(content);
+
+    if (!ok)
+    {
+        cfg->failed = 1;
+    }
+}
+
+/* Appends every worker's part file to the real database in worker order, then removes the parts. */
+static int merge_parts(const char *db_name, unsigned int threads)
+{
+    char db_path[VELOCE_PATH_LEN + 1];
+    char path[VELOCE_PATH_LEN + 1];
+    char *buf;
+    FILE *out;
+    unsigned int i;
+    int ok = 1;
+
+    if (path_join(db_path, sizeof(db_path), storage_root(), db_name) != 0)
+    {
+        return 0;
+    }
+
+    buf = (char *)malloc(GEN_IO_BUFFER);
+    out = fopen(db_path, "ab");
+    if (buf == NULL || out == NULL || !change_log_append(out, db_name))
+    {
+        free(buf);
+        if (out != NULL)
+        {
+            fclose(out);
+        }
+        return 0;
+    }
+
+    for (i = 0U; i < threads; i++)
+    {
+        FILE *in;
+        size_t n;
+
+        if (part_path(db_name, i, path) != 0)
+        {
+            ok = 0;
+            break;
+        }
+
+        in = fopen(path, "rb");
+        if (in == NULL)
+        {
+            ok = 0;
+            break;
+        }
+
+        while ((n = fread(buf, 1U, GEN_IO_BUFFER, in)) > 0U)
+        {
+            if (fwrite(buf, 1U, n, out) != n)
+            {
+                ok = 0;
+                break;
+            }
+        }
+
+        fclose(in);
+        (void)remove(path);
+    }
+
+    if (fclose(out) != 0)
+    {
+        ok = 0;
+    }
+    free(buf);
+    return ok;
+}
+
+static void usage(void)
+{
+    (void)fprintf(stderr,
+                  "usage: vcs-gen [--home DIR] [--users N] [--repos-per-user N] [--commits-per-repo N]\n"
+                  "               [--snapshot-min BYTES] [--snapshot-max BYTES] [--uniform-sizes]\n"
+                  "               [--no-snapshots] [--threads N] [--seed N] [--prefix NAME]\n"
+                  "\n"
+                  "Appends synthetic users, repositories, commits and snapshots to VELOCE_HOME\n"
+                  "(or --home). Every generated account uses the password \"password\". Ids come\n"
+                  "from a random seed unless --seed N repeats an earlier run.\n");
+}
+
+static int parse_size(const char *text, size_t *out)
+{
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    if (end == text)
+    {
+        return 0;
+    }
+
+    if (*end == 'k' || *end == 'K')
+    {
+        value *= 1024ULL;
+        end++;
+    }
+    else if (*end == 'm' || *end == 'M')
+    {
+        value *= 1024ULL * 1024ULL;
+        end++;
+    }
+
+    if (*end != '\0')
+    {
+        return 0;
+    }
+
+    *out = (size_t)value;
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    GenConfig cfg;
+    const char *home = NULL;
+    char path[VELOCE_PATH_LEN + 1];
+    uint64_t start;
+    double seconds;
+    size_t threads = 0U;
+    size_t seed = 0U;
+    int seeded = 0;
+    int i;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.users = 100U;
+    cfg.repos_per_user = 4U;
+    cfg.commits_per_repo = 100U;
+    cfg.snapshot_min = 256U;
+    cfg.snapshot_max = 16U * 1024U;
+    cfg.log_sizes = 1;
+    cfg.write_snapshots = 1;
+    cfg.prefix = "gen";
+
+    for (i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int ok = 1;
+
+        if (strcmp(arg, "--uniform-sizes") == 0)
+        {
+            cfg.log_sizes = 0;
+            continue;
+        }
+        if (strcmp(arg, "--no-snapshots") == 0)
+        {
+            cfg.write_snapshots = 0;
+            continue;
+        }
+        if (value == NULL)
+        {
+            usage();
+            return 1;
+        }
+
+        if (strcmp(arg, "--home") == 0)
+        {
+            home = value;
+        }
+        else if (strcmp(arg, "--prefix") == 0)
+        {
+            cfg.prefix = value;
+        }
+        else if (strcmp(arg, "--users") == 0)
+        {
+            ok = parse_size(value, &cfg.users);
+        }
+        else if (strcmp(arg, "--repos-per-user") == 0)
+        {
+            ok = parse_size(value, &cfg.repos_per_user);
+        }
+        else if (strcmp(arg, "--commits-per-repo") == 0)
+        {
+            ok = parse_size(value, &cfg.commits_per_repo);
+        }
+        else if (strcmp(arg, "--snapshot-min") == 0)
+        {
+            ok = parse_size(value, &cfg.snapshot_min);
+        }
+        else if (strcmp(arg, "--snapshot-max") == 0)
+        {
+            ok = parse_size(value, &cfg.snapshot_max);
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            ok = parse_size(value, &threads);
+        }
+        else if (strcmp(arg, "--seed") == 0)
+        {
+            ok = parse_size(value, &seed);
+            seeded = 1;
+        }
+        else
+        {
+            ok = 0;
+        }
+
+        if (!ok)
+        {
+            usage();
+            return 1;
+        }
+        i++;
+    }
+
+    /* A fixed seed would hand a second run into the same home the first run's ids. */
+    if (seeded)
+    {
+        cfg.seed = (uint64_t)seed;
+    }
+    else
+    {
+        IdKey key;
+
+        generate_key(&key);
+        cfg.seed = key.hi ^ key.lo;
+    }
+    cfg.now = now_timestamp();
+
+    if (cfg.snapshot_max < cfg.snapshot_min)
+    {
+        cfg.snapshot_max = cfg.snapshot_min;
+    }
+
+    cfg.threads = threads > 0U ? (unsigned int)threads : worker_default_count();
+    if (cfg.users > 0U && cfg.threads > cfg.users)
+    {
+        cfg.threads = (unsigned int)cfg.users;
+    }
+    if (cfg.threads == 0U)
+    {
+        cfg.threads = 1U;
+    }
+
+    if (home != NULL)
+    {
+        storage_set_root(home);
+    }
+
+    if (ensure_storage_ready() != 0)
+    {
+        (void)fprintf(stderr, "Failed to prepare storage at %s.\n", storage_root());
+        return 1;
+    }
+
+    (void)fprintf(stderr, "Generating %zu users x %zu repos x %zu commits into %s using %u threads (seed %llu)...\n",
+                  cfg.users, cfg.repos_per_user, cfg.commits_per_repo, storage_root(), cfg.threads,
+                  (unsigned long long)cfg.seed);
+
+    start = monotonic_ns();
+    (void)run_workers(cfg.threads, generate_partition, &cfg);
+
+    if (cfg.failed)
+    {
+        (void)fprintf(stderr, "Generation failed; partial *.gen* files may remain in %s.\n", storage_root());
+        return 1;
+    }
+
+    if (!merge_parts(VELOCE_USERS_DB, cfg.threads) || !merge_parts(VELOCE_REPOS_DB, cfg.threads))
+    {
+        (void)fprintf(stderr, "Failed to merge generated records into %s.\n", storage_root());
+        return 1;
+    }
+
+    /* The generated commits bypass append_commit; drop the message index so it is rebuilt. */
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_MESSAGE_INDEX) == 0)
+    {
+        (void)change_log_record(CHANGE_WRITE, VELOCE_MESSAGE_INDEX, 0U);
+        (void)remove(path);
+    }
+
+    seconds = (double)(monotonic_ns() - start) / 1e9;
+    (void)fprintf(stderr, "Wrote %zu commits in %.2fs.\n",
+                  cfg.users * cfg.repos_per_user * cfg.commits_per_repo, seconds);
+    return 0;
+}
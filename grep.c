@@ -0,0 +1,434 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VELOCE_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VELOCE_SIMD_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define TRIGRAM_MIN_BITS 512U
+#define TRIGRAM_MAX_BITS (1U << 19)
+#define TRIGRAM_HEADER_LEN (VELOCE_ID_LEN - 1U + 4U)
+
+/*
+ * trigrams/<repo_id>.tri holds one record per snapshot: the 16-character commit id, a
+ * little-endian 32-bit bit count and a bitmap with one bit set per hashed trigram of the
+ * content. A pattern can only occur in a snapshot whose bitmap has every one of the
+ * pattern's trigram bits set, so most snapshots are ruled out without being read.
+ */
+static uint32_t trigram_hash(uint32_t trigram, uint32_t bits)
+{
+    return (trigram * 0x9E3779B1U) >> 7 & (bits - 1U);
+}
+
+static void trigram_set_bits(const char *text, size_t len, unsigned char *bitmap, uint32_t bits)
+{
+    const unsigned char *p = (const unsigned char *)text;
+    uint32_t trigram;
+    size_t i;
+
+    if (len < 3U)
+    {
+        return;
+    }
+
+    /* Roll the 24-bit window along instead of reloading three bytes per position. */
+    trigram = ((uint32_t)p[0] << 8) | (uint32_t)p[1];
+    for (i = 2U; i < len; i++)
+    {
+        uint32_t bit;
+
+        trigram = ((trigram << 8) | (uint32_t)p[i]) & 0xFFFFFFU;
+        bit = trigram_hash(trigram, bits);
+        bitmap[bit >> 3] |= (unsigned char)(1U << (bit & 7U));
+    }
+}
+
+/* Roughly two bits per byte of content keeps false positives low for multi-trigram patterns. */
+static uint32_t trigram_bits_for(size_t len)
+{
+    uint32_t bits = TRIGRAM_MIN_BITS;
+
+    while (bits < TRIGRAM_MAX_BITS && (size_t)bits < len * 2U)
+    {
+        bits *= 2U;
+    }
+
+    return bits;
+}
+
+/* The repository's bitmap file relative to the storage root, as changes.log names it. */
+static int trigram_name(const IdKey *repo, char out[VELOCE_PATH_LEN + 1])
+{
+    char name[VELOCE_ID_LEN + 4];
+    char id[VELOCE_ID_LEN];
+
+    id_key_to_text(repo, id);
+    if (snprintf(name, sizeof(name), "%s.tri", id) >= (int)sizeof(name))
+    {
+        return -1;
+    }
+
+    return path_join(out, VELOCE_PATH_LEN + 1U, VELOCE_TRIGRAMS_DIR, name);
+}
+
+static int trigram_path(const IdKey *repo, char out[VELOCE_PATH_LEN + 1])
+{
+    char name[VELOCE_PATH_LEN + 1];
+
+    if (trigram_name(repo, name) != 0)
+    {
+        return -1;
+    }
+
+    return path_join(out, VELOCE_PATH_LEN + 1U, storage_root(), name);
+}
+
+int snapshot_trigrams_append(const IdKey *repo, const IdKey *commit, const char *content, size_t len)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char name[VELOCE_PATH_LEN + 1];
+    unsigned char header[TRIGRAM_HEADER_LEN];
+    unsigned char *bitmap;
+    uint32_t bits = trigram_bits_for(len);
+    FILE *fp;
+    int ok;
+
+    if (trigram_name(repo, name) != 0 || trigram_path(repo, path) != 0)
+    {
+        return 0;
+    }
+
+    bitmap = (unsigned char *)calloc(bits / 8U, 1U);
+    if (bitmap == NULL)
+    {
+        return 0;
+    }
+
+    trigram_set_bits(content, len, bitmap, bits);
+
+    id_key_to_text(commit, (char *)header);
+    header[VELOCE_ID_LEN - 1U] = (unsigned char)(bits & 0xFFU);
+    header[VELOCE_ID_LEN] = (unsigned char)((bits >> 8) & 0xFFU);
+    header[VELOCE_ID_LEN + 1U] = (unsigned char)((bits >> 16) & 0xFFU);
+    header[VELOCE_ID_LEN + 2U] = (unsigned char)((bits >> 24) & 0xFFU);
+
+    fp = fopen(path, "ab");
+    if (fp == NULL || !change_log_append(fp, name))
+    {
+        if (fp != NULL)
+        {
+            fclose(fp);
+        }
+        free(bitmap);
+        return 0;
+    }
+
+    ok = fwrite(header, 1U, sizeof(header), fp) == sizeof(header) &&
+         fwrite(bitmap, 1U, bits / 8U, fp) == bits / 8U;
+    fclose(fp);
+    free(bitmap);
+
+    if (ok)
+    {
+        stats_add(STAT_BYTES_WRITTEN, sizeof(header) + bits / 8U);
+    }
+    return ok;
+}
+
+#if defined(VELOCE_SIMD_AVX2) || defined(VELOCE_SIMD_SSE2)
+static unsigned int lowest_bit(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+
+    _BitScanForward(&index, mask);
+    return (unsigned int)index;
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+#endif
+
+/*
+ * memmem with a vector prefilter: compare the first and last byte of the needle against a
+ * block of candidate positions at once and only memcmp where both match.
+ */
+const char *find_substring(const char *hay, size_t hay_len, const char *needle, size_t needle_len)
+{
+    size_t i = 0U;
+
+    if (needle_len == 0U)
+    {
+        return hay;
+    }
+
+    if (needle_len > hay_len)
+    {
+        return NULL;
+    }
+
+#if defined(VELOCE_SIMD_AVX2)
+    {
+        const __m256i first = _mm256_set1_epi8(needle[0]);
+        const __m256i last = _mm256_set1_epi8(needle[needle_len - 1U]);
+
+        for (; i + needle_len + 31U <= hay_len; i += 32U)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(const void *)(hay + i));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(const void *)(hay + i + needle_len - 1U));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+
+            while (mask != 0U)
+            {
+                size_t pos = i + lowest_bit(mask);
+
+                if (memcmp(hay + pos + 1U, needle + 1U, needle_len - 1U) == 0)
+                {
+                    return hay + pos;
+                }
+                mask &= mask - 1U;
+            }
+        }
+    }
+#elif defined(VELOCE_SIMD_SSE2)
+    {
+        const __m128i first = _mm_set1_epi8(needle[0]);
+        const __m128i last = _mm_set1_epi8(needle[needle_len - 1U]);
+
+        for (; i + needle_len + 15U <= hay_len; i += 16U)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(const void *)(hay + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(const void *)(hay + i + needle_len - 1U));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+
+            while (mask != 0U)
+            {
+                size_t pos = i + lowest_bit(mask);
+
+                if (memcmp(hay + pos + 1U, needle + 1U, needle_len - 1U) == 0)
+                {
+                    return hay + pos;
+                }
+                mask &= mask - 1U;
+            }
+        }
+    }
+#endif
+
+    for (; i + needle_len <= hay_len; i++)
+    {
+        if (hay[i] == needle[0] && memcmp(hay + i, needle, needle_len) == 0)
+        {
+            return hay + i;
+        }
+    }
+
+    return NULL;
+}
+
+typedef struct
+{
+    const unsigned char *bitmap;
+    uint32_t bits;
+} TrigramSet;
+
+/*
+ * Looks up each history entry's bitmap in the repo's .tri file by the snapshot it reads, so
+ * a revert shares the bitmap of the commit it restored; entries without one get NULL.
+ */
+static int load_trigram_sets(const IdKey *repo, const CommitHistory *history, Arena *arena, TrigramSet *sets)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char *data;
+    size_t len;
+    size_t pos = 0U;
+    size_t slot_count = 16U;
+    uint32_t *slots;
+    size_t i;
+
+    memset(sets, 0, history->count * sizeof(TrigramSet));
+    if (trigram_path(repo, path) != 0 || !file_exists(path))
+    {
+        return 1;
+    }
+
+    if (read_text_file_arena(arena, path, &data, &len) != 0)
+    {
+        return 0;
+    }
+
+    while (slot_count < history->count * 2U)
+    {
+        slot_count *= 2U;
+    }
+    slots = (uint32_t *)arena_alloc(arena, slot_count * sizeof(uint32_t));
+    if (slots == NULL)
+    {
+        return 0;
+    }
+    memset(slots, 0xFF, slot_count * sizeof(uint32_t));
+
+    for (i = 0U; i < history->count; i++)
+    {
+        size_t s = (size_t)id_key_hash(&history->items[i].snapshot) & (slot_count - 1U);
+
+        while (slots[s] != UINT32_MAX)
+        {
+            s = (s + 1U) & (slot_count - 1U);
+        }
+        slots[s] = (uint32_t)i;
+    }
+
+    while (pos + TRIGRAM_HEADER_LEN <= len)
+    {
+        const unsigned char *header = (const unsigned char *)data + pos;
+        uint32_t bits = (uint32_t)header[VELOCE_ID_LEN - 1U] | ((uint32_t)header[VELOCE_ID_LEN] << 8) |
+                        ((uint32_t)header[VELOCE_ID_LEN + 1U] << 16) | ((uint32_t)header[VELOCE_ID_LEN + 2U] << 24);
+        FieldSpan id_span;
+        IdKey id;
+        size_t s;
+
+        if (bits < TRIGRAM_MIN_BITS || bits > TRIGRAM_MAX_BITS || (bits & (bits - 1U)) != 0U ||
+            pos + TRIGRAM_HEADER_LEN + bits / 8U > len)
+        {
+            break;
+        }
+
+        id_span.ptr = (const char *)header;
+        id_span.len = VELOCE_ID_LEN - 1U;
+        if (id_key_from_span(&id_span, &id))
+        {
+            for (s = (size_t)id_key_hash(&id) & (slot_count - 1U); slots[s] != UINT32_MAX; s = (s + 1U) & (slot_count - 1U))
+            {
+                if (id_key_equals(&history->items[slots[s]].snapshot, &id))
+                {
+                    sets[slots[s]].bitmap = header + TRIGRAM_HEADER_LEN;
+                    sets[slots[s]].bits = bits;
+                }
+            }
+        }
+
+        pos += TRIGRAM_HEADER_LEN + bits / 8U;
+    }
+
+    return 1;
+}
+
+static int may_contain(const TrigramSet *set, const char *pattern, size_t len)
+{
+    size_t i;
+
+    if (set->bitmap == NULL)
+    {
+        return 1;
+    }
+
+    for (i = 0U; i + 3U <= len; i++)
+    {
+        const unsigned char *p = (const unsigned char *)pattern + i;
+        uint32_t bit = trigram_hash(((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | (uint32_t)p[2], set->bits);
+
+        if ((set->bitmap[bit >> 3] & (1U << (bit & 7U))) == 0U)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+typedef struct
+{
+    const CommitHistory *history;
+    const size_t *candidates;
+    size_t candidate_count;
+    unsigned int workers;
+    const char *pattern;
+    size_t pattern_len;
+    signed char *present;
+} GrepJob;
+
+static void grep_worker(void *arg, unsigned int index)
+{
+    GrepJob *job = (GrepJob *)arg;
+    size_t i;
+
+    for (i = index; i < job->candidate_count; i += job->workers)
+    {
+        size_t row = job->candidates[i];
+        const char *content;
+        size_t len;
+
+        content = snapshot_cache_acquire(&job->history->items[row].snapshot, &len);
+        if (content == NULL)
+        {
+            job->present[row] = -1;
+            continue;
+        }
+
+        job->present[row] = find_substring(content, len, job->pattern, job->pattern_len) != NULL;
+        snapshot_cache_release(content);
+    }
+}
+
+/*
+ * Checks which snapshots of `history` contain `pattern`: present[i] becomes 1 or 0 for
+ * commit i, or -1 when its snapshot could not be read. `read` receives how many snapshots
+ * the trigram index could not rule out, which are the only ones opened.
+ */
+int history_grep_scan(const RepoRecord *repo, const CommitHistory *history, const char *pattern, Arena *arena,
+                      signed char **present, size_t *read)
+{
+    TrigramSet *sets;
+    size_t *candidates;
+    size_t candidate_count = 0U;
+    size_t pattern_len = strlen(pattern);
+    size_t i;
+    GrepJob job;
+
+    sets = (TrigramSet *)arena_alloc(arena, (history->count + 1U) * sizeof(TrigramSet));
+    candidates = (size_t *)arena_alloc(arena, (history->count + 1U) * sizeof(size_t));
+    job.present = (signed char *)arena_alloc(arena, history->count + 1U);
+    if (sets == NULL || candidates == NULL || job.present == NULL ||
+        !load_trigram_sets(&repo->id, history, arena, sets))
+    {
+        return 0;
+    }
+
+    for (i = 0U; i < history->count; i++)
+    {
+        job.present[i] = 0;
+        if (may_contain(&sets[i], pattern, pattern_len))
+        {
+            candidates[candidate_count++] = i;
+        }
+    }
+
+    job.history = history;
+    job.candidates = candidates;
+    job.candidate_count = candidate_count;
+    job.pattern = pattern;
+    job.pattern_len = pattern_len;
+    job.workers = worker_default_count();
+    if ((size_t)job.workers > candidate_count)
+    {
+        job.workers = candidate_count > 0U ? (unsigned int)candidate_count : 1U;
+    }
+    (void)run_workers(job.workers, grep_worker, &job);
+
+    *present = job.present;
+    *read = candidate_count;
+    return 1;
+}
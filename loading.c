@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "vcs.h"
 
 #include <ctype.h>
@@ -9,22 +11,16 @@
 #include <time.h>
 
 #ifdef _WIN32
-#include <conio.h>
 #include <direct.h>
+#include <io.h>
 #include <windows.h>
 #else
+#include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <termios.h>
 #include <unistd.h>
 #endif
 
-#ifdef _WIN32
-#define VELOCE_PATH_SEP '\\'
-#else
-#define VELOCE_PATH_SEP '/'
-#endif
-
 static char g_storage_root[VELOCE_PATH_LEN + 1];
 static int g_storage_ready = 0;
 
@@ -67,6 +63,20 @@ const char *storage_root(void)
     return g_storage_root;
 }
 
+void storage_set_root(const char *root)
+{
+    if (root == NULL || root[0] == '\0')
+    {
+        g_storage_root[0] = '\0';
+    }
+    else
+    {
+        (void)snprintf(g_storage_root, sizeof(g_storage_root), "%s", root);
+    }
+
+    g_storage_ready = 0;
+}
+
 int path_join(char *out, size_t out_size, const char *left, const char *right)
 {
     size_t left_len;
@@ -118,6 +128,60 @@ int ensure_dir(const char *path)
     return -1;
 }
 
+/*
+ * Calls `visit` with the name of every entry of directory `path` except "." and "..",
+ * stopping early when it returns 0. A missing directory has no entries.
+ */
+int dir_for_each(const char *path, int (*visit)(const char *name, void *ctx), void *ctx)
+{
+    int ok = 1;
+#ifdef _WIN32
+    char pattern[VELOCE_PATH_LEN + 1];
+    WIN32_FIND_DATAA entry;
+    HANDLE find;
+
+    if (path_join(pattern, sizeof(pattern), path, "*") != 0)
+    {
+        return -1;
+    }
+
+    find = FindFirstFileA(pattern, &entry);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        return GetLastError() == ERROR_FILE_NOT_FOUND || GetLastError() == ERROR_PATH_NOT_FOUND ? 0 : -1;
+    }
+
+    do
+    {
+        if (strcmp(entry.cFileName, ".") != 0 && strcmp(entry.cFileName, "..") != 0)
+        {
+            ok = visit(entry.cFileName, ctx);
+        }
+    } while (ok && FindNextFileA(find, &entry));
+
+    FindClose(find);
+#else
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+
+    if (dir == NULL)
+    {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    while (ok && (entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+        {
+            ok = visit(entry->d_name, ctx);
+        }
+    }
+
+    closedir(dir);
+#endif
+    return ok ? 0 : -1;
+}
+
 int file_exists(const char *path)
 {
     FILE *fp;
@@ -171,6 +235,24 @@ int ensure_storage_ready(void)
         return -1;
     }
 
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_COMMITS_DIR) != 0 ||
+        ensure_dir(path) != 0)
+    {
+        return -1;
+    }
+
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_TRIGRAMS_DIR) != 0 ||
+        ensure_dir(path) != 0)
+    {
+        return -1;
+    }
+
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_BLAME_DIR) != 0 ||
+        ensure_dir(path) != 0)
+    {
+        return -1;
+    }
+
     if (path_join(path, sizeof(path), storage_root(), VELOCE_WORKSPACE_DIR) != 0 ||
         ensure_dir(path) != 0)
     {
@@ -189,8 +271,15 @@ int ensure_storage_ready(void)
         return -1;
     }
 
-    if (path_join(path, sizeof(path), storage_root(), VELOCE_COMMITS_DB) != 0 ||
-        touch_file(path) != 0)
+    if (!commit_shards_migrate() || !repo_counters_prepare())
+    {
+        return -1;
+    }
+
+    /* A fan-out migration cut short keeps the flat fallback and resumes on the next start. */
+    (void)snapshot_store_migrate();
+
+    if (!content_hash_load())
     {
         return -1;
     }
@@ -199,299 +288,381 @@ int ensure_storage_ready(void)
     return 0;
 }
 
-void app_clear_screen(void)
+void trim_whitespace(char *value)
 {
-#ifdef _WIN32
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    COORD home = {0, 0};
-    DWORD written;
-    DWORD cells;
-    HANDLE hstdout = GetStdHandle(STD_OUTPUT_HANDLE);
+    size_t start;
+    size_t end;
+    size_t i;
 
-    if (hstdout == INVALID_HANDLE_VALUE)
+    if (value == NULL)
     {
         return;
     }
 
-    if (!GetConsoleScreenBufferInfo(hstdout, &csbi))
+    start = 0U;
+    while (value[start] != '\0' && isspace((unsigned char)value[start]))
+    {
+        start++;
+    }
+
+    end = strlen(value);
+    while (end > start && isspace((unsigned char)value[end - 1U]))
+    {
+        end--;
+    }
+
+    if (start > 0U)
+    {
+        for (i = start; i <= end; i++)
+        {
+            value[i - start] = value[i];
+        }
+    }
+    else
+    {
+        value[end] = '\0';
+    }
+
+    if (start > 0U)
+    {
+        value[end - start] = '\0';
+    }
+}
+
+void sanitize_field(char *value)
+{
+    size_t i;
+
+    if (value == NULL)
     {
         return;
     }
 
-    cells = (DWORD)csbi.dwSize.X * (DWORD)csbi.dwSize.Y;
-    FillConsoleOutputCharacterA(hstdout, ' ', cells, home, &written);
-    FillConsoleOutputAttribute(hstdout, csbi.wAttributes, cells, home, &written);
-    SetConsoleCursorPosition(hstdout, home);
-#else
-    (void)printf("\033[2J\033[H");
-    fflush(stdout);
-#endif
+    trim_whitespace(value);
+
+    for (i = 0U; value[i] != '\0'; i++)
+    {
+        if (value[i] == '|' || value[i] == '\n' || value[i] == '\r' || value[i] == '\t')
+        {
+            value[i] = ' ';
+        }
+    }
 }
 
-void app_sleep_ms(unsigned int ms)
+void generate_id(char out[VELOCE_ID_LEN])
 {
-#ifdef _WIN32
-    Sleep(ms);
-#else
-    struct timespec req;
-    req.tv_sec = (time_t)(ms / 1000U);
-    req.tv_nsec = (long)(ms % 1000U) * 1000000L;
-    nanosleep(&req, NULL);
-#endif
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    size_t i;
+
+    seed_rng_once();
+    for (i = 0U; i < VELOCE_ID_LEN - 1U; i++)
+    {
+        out[i] = chars[(size_t)(rand() % (int)(sizeof(chars) - 1U))];
+    }
+
+    out[VELOCE_ID_LEN - 1U] = '\0';
+}
+
+void generate_key(IdKey *key)
+{
+    char text[VELOCE_ID_LEN];
+
+    generate_id(text);
+    (void)id_key_from_text(text, key);
 }
 
-int app_getch(void)
+uint64_t monotonic_ns(void)
 {
 #ifdef _WIN32
-    return _getch();
-#else
-    int ch;
-    struct termios oldt;
-    struct termios newt;
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
 
-    if (tcgetattr(STDIN_FILENO, &oldt) != 0)
+    if (freq.QuadPart == 0)
     {
-        return getchar();
+        QueryPerformanceFrequency(&freq);
     }
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1000000000.0 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
 
-    newt = oldt;
-    newt.c_lflag &= (tcflag_t) ~(ICANON | ECHO);
-    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
-    ch = getchar();
-    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
-    return ch;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
 #endif
 }
 
-void app_pause(const char *prompt)
+/* Nanoseconds since 1970-01-01 UTC, the form every stored timestamp takes. */
+int64_t now_timestamp(void)
 {
-    const char *msg = prompt != NULL ? prompt : "Press any key to continue...";
-    (void)printf("%s", msg);
-    (void)fflush(stdout);
-    (void)app_getch();
-    (void)printf("\n");
+#ifdef _WIN32
+    FILETIME ft;
+    ULARGE_INTEGER ticks;
+
+    GetSystemTimePreciseAsFileTime(&ft);
+    ticks.LowPart = ft.dwLowDateTime;
+    ticks.HighPart = ft.dwHighDateTime;
+    /* FILETIME counts 100 ns ticks from 1601-01-01. */
+    return ((int64_t)ticks.QuadPart - 116444736000000000LL) * 100;
+#else
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * VELOCE_NS_PER_SEC + (int64_t)ts.tv_nsec;
+#endif
 }
 
-static void consume_stdin_until_newline(void)
+/* Days since 1970-01-01 in the proleptic Gregorian calendar. */
+static int64_t days_from_civil(int64_t y, int64_t m, int64_t d)
 {
-    int ch;
-
-    do
-    {
-        ch = getchar();
-    } while (ch != '\n' && ch != EOF);
+    int64_t era;
+    int64_t yoe;
+    int64_t doy;
+
+    y -= m <= 2 ? 1 : 0;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
 }
 
-int read_line(const char *prompt, char *buffer, size_t size)
+/* How many seconds local wall-clock time is ahead of UTC at `seconds` past the epoch. */
+static int64_t local_offset(int64_t seconds)
 {
-    size_t len;
+    time_t when = (time_t)seconds;
+    struct tm tm_info;
 
-    if (buffer == NULL || size < 2U)
+#ifdef _WIN32
+    if (localtime_s(&tm_info, &when) != 0)
     {
         return 0;
     }
-
-    if (prompt != NULL)
-    {
-        (void)printf("%s", prompt);
-    }
-
-    if (fgets(buffer, (int)size, stdin) == NULL)
+#else
+    if (localtime_r(&when, &tm_info) == NULL)
     {
         return 0;
     }
+#endif
 
-    len = strlen(buffer);
-    if (len > 0U && buffer[len - 1U] == '\n')
-    {
-        buffer[len - 1U] = '\0';
-    }
-    else
-    {
-        consume_stdin_until_newline();
-    }
+    return days_from_civil((int64_t)tm_info.tm_year + 1900, (int64_t)tm_info.tm_mon + 1, (int64_t)tm_info.tm_mday) *
+               86400 +
+           (int64_t)tm_info.tm_hour * 3600 + (int64_t)tm_info.tm_min * 60 + (int64_t)tm_info.tm_sec - seconds;
+}
 
-    return 1;
+static int64_t floor_div(int64_t value, int64_t by)
+{
+    return (value >= 0 ? value : value - (by - 1)) / by;
 }
 
-int read_password(const char *prompt, char *buffer, size_t size)
+static int read_digits(const char *text, size_t len, size_t *pos, size_t count, int64_t *value)
 {
-    size_t i = 0U;
-    int ch;
+    size_t i;
 
-    if (buffer == NULL || size < 2U)
+    *value = 0;
+    for (i = 0U; i < count; i++)
     {
-        return 0;
+        if (*pos >= len || text[*pos] < '0' || text[*pos] > '9')
+        {
+            return 0;
+        }
+        *value = *value * 10 + (text[*pos] - '0');
+        (*pos)++;
     }
 
-    if (prompt != NULL)
-    {
-        (void)printf("%s", prompt);
-    }
+    return 1;
+}
 
-    while (1)
-    {
-        ch = app_getch();
-        if (ch == '\r' || ch == '\n')
-        {
-            break;
-        }
+/*
+ * Reads a "YYYY-MM-DD HH:MM:SS" local wall-clock stamp, the form stamps took before they were
+ * stored as UTC nanoseconds, into UTC seconds. "YYYY-MM-DD" alone means local midnight.
+ */
+static int parse_wall_clock(const char *text, size_t len, int64_t *seconds)
+{
+    int64_t parts[6] = {0, 0, 0, 0, 0, 0};
+    static const size_t widths[6] = {4U, 2U, 2U, 2U, 2U, 2U};
+    size_t fields = len == 10U ? 3U : 6U;
+    size_t pos = 0U;
+    size_t i;
+    int64_t wall;
 
-        if (ch == 8 || ch == 127)
+    for (i = 0U; i < fields; i++)
+    {
+        if (i > 0U)
         {
-            if (i > 0U)
-            {
-                i--;
-                (void)printf("\b \b");
-            }
-            continue;
+            pos++;
         }
-
-        if (isprint((unsigned char)ch) && i < size - 1U)
+        if (!read_digits(text, len, &pos, widths[i], &parts[i]))
         {
-            buffer[i++] = (char)ch;
-            (void)printf("*");
+            return 0;
         }
     }
+    if (pos != len)
+    {
+        return 0;
+    }
 
-    buffer[i] = '\0';
-    (void)printf("\n");
+    /* The offset is looked up twice so a stamp next to a DST change lands on the right side. */
+    wall = days_from_civil(parts[0], parts[1], parts[2]) * 86400 + parts[3] * 3600 + parts[4] * 60 + parts[5];
+    *seconds = wall - local_offset(wall - local_offset(wall));
     return 1;
 }
 
-int read_int(const char *prompt, int *value)
+static int parse_nanoseconds(const char *text, size_t len, int64_t *value)
 {
-    char line[64];
-    char *endptr;
-    long parsed;
+    uint64_t magnitude = 0U;
+    size_t pos = len > 0U && text[0] == '-' ? 1U : 0U;
 
-    if (value == NULL)
+    if (pos == len || len - pos > 19U)
     {
         return 0;
     }
 
-    if (!read_line(prompt, line, sizeof(line)))
+    for (; pos < len; pos++)
     {
-        return 0;
-    }
-
-    errno = 0;
-    parsed = strtol(line, &endptr, 10);
-    if (errno != 0 || endptr == line || *endptr != '\0')
-    {
-        return 0;
+        if (text[pos] < '0' || text[pos] > '9')
+        {
+            return 0;
+        }
+        magnitude = magnitude * 10U + (uint64_t)(text[pos] - '0');
     }
 
-    if (parsed < -2147483647L - 1L || parsed > 2147483647L)
+    if (magnitude > (uint64_t)INT64_MAX)
     {
         return 0;
     }
 
-    *value = (int)parsed;
+    *value = text[0] == '-' ? -(int64_t)magnitude : (int64_t)magnitude;
     return 1;
 }
 
-void trim_whitespace(char *value)
+/*
+ * Converts a stored stamp into nanoseconds since 1970 UTC. Stamps are written as decimal
+ * nanoseconds; lines from before that carry local wall-clock text, which costs a timezone
+ * lookup to convert. Unparseable stamps become 0.
+ */
+int64_t parse_timestamp(const char *text, size_t len)
 {
-    size_t start;
-    size_t end;
-    size_t i;
+    int64_t value;
 
-    if (value == NULL)
+    if (parse_nanoseconds(text, len, &value))
     {
-        return;
+        return value;
     }
 
-    start = 0U;
-    while (value[start] != '\0' && isspace((unsigned char)value[start]))
-    {
-        start++;
-    }
+    return parse_wall_clock(text, len, &value) ? value * VELOCE_NS_PER_SEC : 0;
+}
 
-    end = strlen(value);
-    while (end > start && isspace((unsigned char)value[end - 1U]))
-    {
-        end--;
-    }
+/*
+ * Reads a time given on the command line: "YYYY-MM-DD[ HH:MM:SS]" in local time, or an age
+ * such as "90s", "15m", "1h" or "2d" counted back from `now`.
+ */
+int parse_time_arg(const char *text, int64_t now, int64_t *out)
+{
+    size_t len = strlen(text);
+    int64_t count = 0;
+    int64_t unit;
+    int64_t seconds;
+    size_t pos = 0U;
 
-    if (start > 0U)
+    if (len >= 2U && len <= 6U && read_digits(text, len - 1U, &pos, len - 1U, &count))
     {
-        for (i = start; i <= end; i++)
+        switch (text[len - 1U])
         {
-            value[i - start] = value[i];
+        case 's':
+            unit = 1;
+            break;
+        case 'm':
+            unit = 60;
+            break;
+        case 'h':
+            unit = 3600;
+            break;
+        case 'd':
+            unit = 86400;
+            break;
+        default:
+            return 0;
         }
-    }
-    else
-    {
-        value[end] = '\0';
+
+        *out = now - count * unit * VELOCE_NS_PER_SEC;
+        return 1;
     }
 
-    if (start > 0U)
+    if (!parse_wall_clock(text, len, &seconds))
     {
-        value[end - start] = '\0';
+        return 0;
     }
+
+    *out = seconds * VELOCE_NS_PER_SEC;
+    return 1;
 }
 
-void sanitize_field(char *value)
+/* Start of the local calendar day that contains `ns`, in nanoseconds since 1970 UTC. */
+int64_t local_day_start(int64_t ns)
 {
-    size_t i;
-
-    if (value == NULL)
-    {
-        return;
-    }
-
-    trim_whitespace(value);
+    int64_t seconds = floor_div(ns, VELOCE_NS_PER_SEC);
+    int64_t offset = local_offset(seconds);
+    int64_t midnight = floor_div(seconds + offset, 86400) * 86400;
 
-    for (i = 0U; value[i] != '\0'; i++)
-    {
-        if (value[i] == '|' || value[i] == '\n' || value[i] == '\r' || value[i] == '\t')
-        {
-            value[i] = ' ';
-        }
-    }
+    return (midnight - local_offset(midnight - offset)) * VELOCE_NS_PER_SEC;
 }
 
-void generate_id(char out[VELOCE_ID_LEN])
+static void put_digits(char *out, int64_t value, size_t width)
 {
-    static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
-    size_t i;
-
-    seed_rng_once();
-    for (i = 0U; i < VELOCE_ID_LEN - 1U; i++)
+    while (width > 0U)
     {
-        out[i] = chars[(size_t)(rand() % (int)(sizeof(chars) - 1U))];
+        width--;
+        out[width] = (char)('0' + value % 10);
+        value /= 10;
     }
-
-    out[VELOCE_ID_LEN - 1U] = '\0';
 }
 
-void now_timestamp(char out[VELOCE_TIMESTAMP_LEN])
+/* Formats a stored stamp for display, as "YYYY-MM-DD HH:MM:SS" in local time. */
+void format_timestamp(int64_t ns, char out[VELOCE_TIMESTAMP_LEN])
 {
-    time_t now;
-    struct tm tm_info;
+    int64_t utc = floor_div(ns, VELOCE_NS_PER_SEC);
+    int64_t seconds = utc + local_offset(utc);
+    int64_t days = floor_div(seconds, 86400);
+    int64_t rem = seconds - days * 86400;
+    int64_t z = days + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int64_t d = doy - (153 * mp + 2) / 5 + 1;
+    int64_t m = mp + (mp < 10 ? 3 : -9);
+    int64_t y = yoe + era * 400 + (m <= 2 ? 1 : 0);
+
+    if (y < 0 || y > 9999)
+    {
+        y = 0;
+    }
 
-    now = time(NULL);
-#ifdef _WIN32
-    localtime_s(&tm_info, &now);
-#else
-    localtime_r(&now, &tm_info);
-#endif
-    (void)strftime(out, VELOCE_TIMESTAMP_LEN, "%Y-%m-%d %H:%M:%S", &tm_info);
+    memcpy(out, "0000-00-00 00:00:00", VELOCE_TIMESTAMP_LEN);
+    put_digits(out, y, 4U);
+    put_digits(out + 5, m, 2U);
+    put_digits(out + 8, d, 2U);
+    put_digits(out + 11, rem / 3600, 2U);
+    put_digits(out + 14, rem / 60 % 60, 2U);
+    put_digits(out + 17, rem % 60, 2U);
 }
 
-int read_text_file(const char *path, char **content, size_t *len)
+/* Reads a whole file into a NUL-terminated buffer from `arena`, or from malloc when NULL. */
+/* `reserve` bytes are left free in front of the content for a caller-owned header. */
+static int read_file_into(Arena *arena, size_t reserve, const char *path, char **content, size_t *len)
 {
     FILE *fp;
     long size;
     size_t read_size;
     char *buf;
+    uint64_t start;
 
     if (path == NULL || content == NULL || len == NULL)
     {
         return -1;
     }
 
+    start = stats_op_begin();
     fp = fopen(path, "rb");
     if (fp == NULL)
     {
@@ -517,37 +688,60 @@ int read_text_file(const char *path, char **content, size_t *len)
         return -1;
     }
 
-    buf = (char *)malloc((size_t)size + 1U);
+    buf = arena != NULL ? (char *)arena_alloc(arena, reserve + (size_t)size + 1U)
+                        : (char *)malloc(reserve + (size_t)size + 1U);
     if (buf == NULL)
     {
         fclose(fp);
         return -1;
     }
 
-    read_size = fread(buf, 1U, (size_t)size, fp);
+    read_size = fread(buf + reserve, 1U, (size_t)size, fp);
     fclose(fp);
 
     if (read_size != (size_t)size)
     {
-        free(buf);
+        if (arena == NULL)
+        {
+            free(buf);
+        }
         return -1;
     }
 
-    buf[size] = '\0';
-    *content = buf;
+    buf[reserve + (size_t)size] = '\0';
+    *content = buf + reserve;
     *len = (size_t)size;
+    stats_add(STAT_BYTES_READ, (uint64_t)size);
+    stats_op_end(STAT_OP_FILE_READ, start);
     return 0;
 }
 
+int read_text_file(const char *path, char **content, size_t *len)
+{
+    return read_file_into(NULL, 0U, path, content, len);
+}
+
+int read_text_file_reserve(const char *path, size_t reserve, char **content, size_t *len)
+{
+    return read_file_into(NULL, reserve, path, content, len);
+}
+
+int read_text_file_arena(Arena *arena, const char *path, char **content, size_t *len)
+{
+    return read_file_into(arena, 0U, path, content, len);
+}
+
 int write_text_file(const char *path, const char *content, size_t len)
 {
     FILE *fp;
+    uint64_t start;
 
     if (path == NULL)
     {
         return -1;
     }
 
+    start = stats_op_begin();
     fp = fopen(path, "wb");
     if (fp == NULL)
     {
@@ -564,33 +758,27 @@ int write_text_file(const char *path, const char *content, size_t len)
     }
 
     fclose(fp);
+    stats_add(STAT_BYTES_WRITTEN, (uint64_t)len);
+    stats_op_end(STAT_OP_FILE_WRITE, start);
     return 0;
 }
 
-int copy_text_file(const char *src, const char *dst)
+int file_sync(FILE *fp)
 {
-    char *content;
-    size_t len;
-    int rc;
-
-    if (read_text_file(src, &content, &len) != 0)
+    if (fp == NULL || fflush(fp) != 0)
     {
         return -1;
     }
 
-    rc = write_text_file(dst, content, len);
-    free(content);
-    return rc;
+    stats_add(STAT_FSYNCS, 1U);
+#ifdef _WIN32
+    return _commit(_fileno(fp)) == 0 ? 0 : -1;
+#else
+    return fsync(fileno(fp)) == 0 ? 0 : -1;
+#endif
 }
 
 /* Minimal SHA-256 implementation for portable credential hashing. */
-typedef struct
-{
-    uint8_t data[64];
-    uint32_t datalen;
-    uint32_t state[8];
-    uint64_t bitlen;
-} SHA256_CTX;
 
 static const uint32_t k256[64] = {
     0x428a2f98U, 0x71374491U, 0xb5c0fbcfU, 0xe9b5dba5U, 0x3956c25bU, 0x59f111f1U, 0x923f82a4U,
@@ -612,7 +800,7 @@ static const uint32_t k256[64] = {
 #define SIG0(x) (ROTRIGHT(x, 7) ^ ROTRIGHT(x, 18) ^ ((x) >> 3))
 #define SIG1(x) (ROTRIGHT(x, 17) ^ ROTRIGHT(x, 19) ^ ((x) >> 10))
 
-static void sha256_transform(SHA256_CTX *ctx, const uint8_t data[])
+static void sha256_transform(Sha256Ctx *ctx, const uint8_t data[])
 {
     uint32_t m[64];
     uint32_t a;
@@ -672,7 +860,7 @@ static void sha256_transform(SHA256_CTX *ctx, const uint8_t data[])
     ctx->state[7] += h;
 }
 
-static void sha256_init(SHA256_CTX *ctx)
+void sha256_init(Sha256Ctx *ctx)
 {
     ctx->datalen = 0U;
     ctx->bitlen = 0U;
@@ -686,7 +874,7 @@ static void sha256_init(SHA256_CTX *ctx)
     ctx->state[7] = 0x5be0cd19U;
 }
 
-static void sha256_update(SHA256_CTX *ctx, const uint8_t data[], size_t len)
+void sha256_update(Sha256Ctx *ctx, const uint8_t data[], size_t len)
 {
     size_t i;
 
@@ -703,7 +891,7 @@ static void sha256_update(SHA256_CTX *ctx, const uint8_t data[], size_t len)
     }
 }
 
-static void sha256_final(SHA256_CTX *ctx, uint8_t hash[])
+void sha256_final(Sha256Ctx *ctx, uint8_t hash[])
 {
     uint32_t i;
 
@@ -752,45 +940,219 @@ static void sha256_final(SHA256_CTX *ctx, uint8_t hash[])
     }
 }
 
-void hash_secret(const char *secret, const char *salt, char out[VELOCE_HASH_HEX_LEN])
+void digest_to_hex(const uint8_t digest[32], char out[VELOCE_HASH_HEX_LEN])
 {
-    SHA256_CTX ctx;
-    uint8_t digest[32];
     static const char hex[] = "0123456789abcdef";
     size_t i;
 
+    for (i = 0U; i < 32U; i++)
+    {
+        out[i * 2U] = hex[digest[i] >> 4U];
+        out[i * 2U + 1U] = hex[digest[i] & 0x0FU];
+    }
+
+    out[64] = '\0';
+}
+
+void hash_secret(const char *secret, const char *salt, char out[VELOCE_HASH_HEX_LEN])
+{
+    Sha256Ctx ctx;
+    uint8_t digest[32];
+    uint64_t span;
+
+    span = trace_begin();
     sha256_init(&ctx);
     sha256_update(&ctx, (const uint8_t *)secret, strlen(secret));
     sha256_update(&ctx, (const uint8_t *)":", 1U);
     sha256_update(&ctx, (const uint8_t *)salt, strlen(salt));
     sha256_final(&ctx, digest);
+    digest_to_hex(digest, out);
+    trace_end("hash_secret", span, 0U);
+}
 
-    for (i = 0U; i < 32U; i++)
+/*
+ * Content hashes, recorded with each commit so fsck and import can tell a damaged snapshot
+ * apart. SHA-256 hashes are bare hex, as every build before the choice existed wrote them;
+ * BLAKE3 hashes carry a "blake3:" prefix, so each recorded hash names its own algorithm and
+ * a root can switch without touching old commits. The root's choice only decides how new
+ * commits are hashed.
+ */
+static ContentHash g_content_hash = CONTENT_HASH_SHA256;
+
+const char *content_hash_name(ContentHash algorithm)
+{
+    return algorithm == CONTENT_HASH_BLAKE3 ? "blake3" : "sha256";
+}
+
+int content_hash_from_name(const char *name, ContentHash *algorithm)
+{
+    if (strcmp(name, "sha256") == 0)
     {
-        out[i * 2U] = hex[digest[i] >> 4U];
-        out[i * 2U + 1U] = hex[digest[i] & 0x0FU];
+        *algorithm = CONTENT_HASH_SHA256;
+        return 1;
     }
+    if (strcmp(name, "blake3") == 0)
+    {
+        *algorithm = CONTENT_HASH_BLAKE3;
+        return 1;
+    }
+    return 0;
+}
 
-    out[64] = '\0';
+ContentHash content_hash_algorithm(void)
+{
+    return g_content_hash;
+}
+
+/* Reads the storage root's VELOCE_HASH_CONFIG; 0 if it names no known algorithm. */
+int content_hash_load(void)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char *text;
+    size_t len;
+    int ok;
+
+    g_content_hash = CONTENT_HASH_SHA256;
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_HASH_CONFIG) != 0)
+    {
+        return 0;
+    }
+
+    if (!file_exists(path))
+    {
+        return 1;
+    }
+
+    if (read_text_file(path, &text, &len) != 0)
+    {
+        return 0;
+    }
+
+    trim_whitespace(text);
+    ok = content_hash_from_name(text, &g_content_hash);
+    free(text);
+    return ok;
+}
+
+int content_hash_select(ContentHash algorithm)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char text[16];
+    int len;
+
+    len = snprintf(text, sizeof(text), "%s\n", content_hash_name(algorithm));
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_HASH_CONFIG) != 0 ||
+        !change_log_record(CHANGE_WRITE, VELOCE_HASH_CONFIG, 0U) || write_text_file(path, text, (size_t)len) != 0)
+    {
+        return 0;
+    }
+
+    g_content_hash = algorithm;
+    return 1;
 }
 
-void load(void)
+ContentHash content_hash_of(const char *recorded)
 {
-    app_clear_screen();
-    (void)printf("\n\n");
-    (void)printf(":::     ::: :::::::::: :::         ::::::::   ::::::::  :::::::::: \n");
-    app_sleep_ms(60U);
-    (void)printf(":+:     :+: :+:        :+:        :+:    :+: :+:    :+: :+:        \n");
-    app_sleep_ms(60U);
-    (void)printf("+:+     +:+ +:+        +:+        +:+    +:+ +:+        +:+        \n");
-    app_sleep_ms(60U);
-    (void)printf("+#+     +:+ +#++:++#   +#+        +#+    +:+ +#+        +#++:++#   \n");
-    app_sleep_ms(60U);
-    (void)printf(" +#+   +#+  +#+        +#+        +#+    +#+ +#+        +#+        \n");
-    app_sleep_ms(60U);
-    (void)printf("  #+#+#+#   #+#        #+#        #+#    #+# #+#    #+# #+#        \n");
-    app_sleep_ms(60U);
-    (void)printf("    ###     ########## ##########  ########   ########  ##########\n\n");
-    app_pause("Press any key to continue...");
+    return strncmp(recorded, "blake3:", 7U) == 0 ? CONTENT_HASH_BLAKE3 : CONTENT_HASH_SHA256;
 }
 
+int content_hash_is_valid(const char *recorded)
+{
+    const char *hex = content_hash_of(recorded) == CONTENT_HASH_BLAKE3 ? recorded + 7 : recorded;
+    size_t i;
+
+    for (i = 0U; hex[i] != '\0'; i++)
+    {
+        if (!((hex[i] >= '0' && hex[i] <= '9') || (hex[i] >= 'a' && hex[i] <= 'f')))
+        {
+            return 0;
+        }
+    }
+
+    return i == VELOCE_HASH_HEX_LEN - 1U;
+}
+
+static void content_hash_format(ContentHash algorithm, const uint8_t digest[32], char out[VELOCE_CONTENT_HASH_LEN])
+{
+    char hex[VELOCE_HASH_HEX_LEN];
+
+    digest_to_hex(digest, hex);
+    (void)snprintf(out, VELOCE_CONTENT_HASH_LEN, "%s%s", algorithm == CONTENT_HASH_BLAKE3 ? "blake3:" : "", hex);
+}
+
+void content_hasher_init(ContentHasher *hasher, ContentHash algorithm)
+{
+    hasher->algorithm = algorithm;
+    if (algorithm == CONTENT_HASH_BLAKE3)
+    {
+        blake3_init(&hasher->blake3);
+    }
+    else
+    {
+        sha256_init(&hasher->sha);
+    }
+}
+
+void content_hasher_update(ContentHasher *hasher, const void *data, size_t len)
+{
+    if (hasher->algorithm == CONTENT_HASH_BLAKE3)
+    {
+        blake3_update(&hasher->blake3, (const uint8_t *)data, len);
+    }
+    else
+    {
+        sha256_update(&hasher->sha, (const uint8_t *)data, len);
+    }
+}
+
+void content_hasher_final(ContentHasher *hasher, char out[VELOCE_CONTENT_HASH_LEN])
+{
+    uint8_t digest[32];
+
+    if (hasher->algorithm == CONTENT_HASH_BLAKE3)
+    {
+        blake3_final(&hasher->blake3, digest);
+    }
+    else
+    {
+        sha256_final(&hasher->sha, digest);
+    }
+    content_hash_format(hasher->algorithm, digest, out);
+}
+
+/* Hashes a new snapshot with the root's algorithm; BLAKE3 spreads a large one over all cores. */
+void hash_content(const char *content, size_t len, char out[VELOCE_CONTENT_HASH_LEN])
+{
+    ContentHasher hasher;
+    uint8_t digest[32];
+    uint64_t span;
+
+    span = trace_begin();
+    if (g_content_hash == CONTENT_HASH_BLAKE3)
+    {
+        blake3_hash_parallel((const uint8_t *)content, len, digest);
+        content_hash_format(CONTENT_HASH_BLAKE3, digest, out);
+    }
+    else
+    {
+        content_hasher_init(&hasher, CONTENT_HASH_SHA256);
+        content_hasher_update(&hasher, content, len);
+        content_hasher_final(&hasher, out);
+    }
+    trace_end("hash_content", span, (uint64_t)len);
+}
+
+/*
+ * Whether `content` hashes to `recorded` under the algorithm `recorded` names. This runs on
+ * one thread: its callers (fsck) already check many snapshots at once.
+ */
+int content_hash_matches(const char *content, size_t len, const char *recorded)
+{
+    ContentHasher hasher;
+    char hash[VELOCE_CONTENT_HASH_LEN];
+
+    content_hasher_init(&hasher, content_hash_of(recorded));
+    content_hasher_update(&hasher, content, len);
+    content_hasher_final(&hasher, hash);
+    return strcmp(hash, recorded) == 0;
+}
@@ -1,18 +1,379 @@
 #include "vcs.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-int main(void)
+static void usage(void)
+{
+    (void)fprintf(stderr, "usage: vcs\n"
+                          "       vcs fsck [--threads N]\n"
+                          "       vcs export USERNAME REPO_NUMBER FILE [--compress]\n"
+                          "       vcs import FILE [--owner USERNAME]\n"
+                          "       vcs replicate DEST\n"
+                          "       vcs log USERNAME REPO_NUMBER [--since WHEN] [--until WHEN]\n"
+                          "       vcs hash [sha256|blake3]\n"
+                          "\n"
+                          "With no command, starts the interactive client. \"fsck\" checks every record and\n"
+                          "snapshot under VELOCE_HOME and exits non-zero if anything is inconsistent.\n"
+                          "\"export\" writes one repository with its history to a bundle file and \"import\"\n"
+                          "adds a bundle's repository to this VELOCE_HOME. \"replicate\" copies what changed\n"
+                          "since the last run to the storage root DEST. \"log\" lists a repository's commits\n"
+                          "made from --since up to --until; WHEN is \"YYYY-MM-DD[ HH:MM:SS]\" in local time\n"
+                          "or an age such as 30m, 1h or 7d. \"hash\" shows or sets the content hash new\n"
+                          "commits record; existing commits keep the hash they were made with.\n");
+}
+
+static void print_fsck_problem(void *ctx, const char *where, const char *what)
+{
+    (void)ctx;
+    (void)printf("%s: %s\n", where, what);
+}
+
+static void print_fsck_progress(void *ctx, uint64_t checked, uint64_t total, int done)
+{
+    (void)ctx;
+    (void)fprintf(stderr, "\rfsck: %llu/%llu snapshots checked (%llu%%)%s", (unsigned long long)checked,
+                  (unsigned long long)total, (unsigned long long)(total > 0U ? checked * 100U / total : 100U),
+                  done ? "\n" : "");
+    (void)fflush(stderr);
+}
+
+static int run_fsck(int argc, char **argv)
+{
+    FsckReporter reporter = {print_fsck_problem, print_fsck_progress, NULL};
+    FsckSummary summary;
+    unsigned long threads = 0UL;
+    long problems;
+    int i;
+
+    for (i = 2; i < argc; i++)
+    {
+        char *end;
+
+        if (strcmp(argv[i], "--threads") != 0 || i + 1 >= argc)
+        {
+            usage();
+            return 2;
+        }
+
+        threads = strtoul(argv[i + 1], &end, 10);
+        if (end == argv[i + 1] || *end != '\0')
+        {
+            usage();
+            return 2;
+        }
+        i++;
+    }
+
+    problems = fsck_storage((unsigned int)threads, &reporter, &summary);
+    if (problems < 0)
+    {
+        (void)printf("fsck could not read the storage root.\n");
+        return 2;
+    }
+
+    (void)printf("Checked %zu commits on %u thread(s): %ld problem(s)", summary.commits, summary.threads, problems);
+    if (summary.unhashed > 0U)
+    {
+        (void)printf(", %llu snapshot(s) predate recorded hashes and were only checked for presence",
+                     (unsigned long long)summary.unhashed);
+    }
+    (void)printf(".\n");
+
+    return problems == 0 ? 0 : 1;
+}
+
+/* Explains why a bundle export or import of `path` stopped. */
+static void print_bundle_failure(const BundleResult *result, const char *path)
+{
+    char id[VELOCE_ID_LEN];
+
+    id_key_to_text(&result->commit, id);
+    switch (result->status)
+    {
+    case BUNDLE_CANNOT_WRITE:
+        (void)printf("Cannot write bundle: %s\n", path);
+        break;
+    case BUNDLE_SNAPSHOT_UNREADABLE:
+        (void)printf("Snapshot for commit %s is missing or unreadable; run `vcs fsck`.\n", id);
+        break;
+    case BUNDLE_CANNOT_OPEN:
+        (void)printf("Cannot open bundle: %s\n", path);
+        break;
+    case BUNDLE_NOT_A_BUNDLE:
+        (void)printf("%s is not a Veloce bundle.\n", path);
+        break;
+    case BUNDLE_REPO_EXISTS:
+        (void)printf("Repository %s already exists in this storage root.\n", result->repo.name);
+        break;
+    case BUNDLE_NO_OWNER:
+        (void)printf("The owner of %s does not exist here; import it with --owner USERNAME.\n", result->repo.name);
+        break;
+    case BUNDLE_CANNOT_STAGE:
+        (void)printf("Cannot stage the imported commits.\n");
+        break;
+    case BUNDLE_HASH_MISMATCH:
+        (void)printf("Snapshot for commit %s does not match its recorded hash.\n", id);
+        (void)printf("Import of %s failed after %zu commit(s); the bundle is truncated or corrupt.\n", path,
+                     result->commits);
+        break;
+    case BUNDLE_CORRUPT:
+        (void)printf("Import of %s failed after %zu commit(s); the bundle is truncated or corrupt.\n", path,
+                     result->commits);
+        break;
+    default:
+        break;
+    }
+}
+
+static int run_export(int argc, char **argv)
+{
+    UserRecord owner;
+    RepoRecord repo;
+    BundleResult result;
+    char *end;
+    long rid;
+
+    if (argc < 5 || argc > 6 || (argc == 6 && strcmp(argv[5], "--compress") != 0))
+    {
+        usage();
+        return 2;
+    }
+
+    rid = strtol(argv[3], &end, 10);
+    if (end == argv[3] || *end != '\0')
+    {
+        usage();
+        return 2;
+    }
+
+    if (!find_user_by_username(argv[2], &owner) || !load_repo_for_owner(&owner.uid, (int)rid, &repo))
+    {
+        (void)printf("No repository #%ld for user %s.\n", rid, argv[2]);
+        return 1;
+    }
+
+    if (!bundle_export(&repo, argv[4], argc == 6, &result))
+    {
+        print_bundle_failure(&result, argv[4]);
+        return 1;
+    }
+
+    (void)printf("Exported %s with %zu commit(s) to %s\n", repo.name, result.commits, argv[4]);
+    return 0;
+}
+
+static int run_log(int argc, char **argv)
+{
+    UserRecord owner;
+    RepoRecord repo;
+    Arena arena;
+    CommitHistory history;
+    int64_t now = now_timestamp();
+    int64_t since = INT64_MIN;
+    int64_t until = INT64_MAX;
+    uint64_t start;
+    char *end;
+    long rid;
+    size_t i;
+    int loaded;
+    int a;
+
+    if (argc < 4)
+    {
+        usage();
+        return 2;
+    }
+
+    rid = strtol(argv[3], &end, 10);
+    if (end == argv[3] || *end != '\0')
+    {
+        usage();
+        return 2;
+    }
+
+    for (a = 4; a < argc; a += 2)
+    {
+        int64_t *bound = strcmp(argv[a], "--since") == 0 ? &since : strcmp(argv[a], "--until") == 0 ? &until : NULL;
+
+        if (bound == NULL || a + 1 >= argc || !parse_time_arg(argv[a + 1], now, bound))
+        {
+            usage();
+            return 2;
+        }
+    }
+
+    if (!find_user_by_username(argv[2], &owner) || !load_repo_for_owner(&owner.uid, (int)rid, &repo))
+    {
+        (void)printf("No repository #%ld for user %s.\n", rid, argv[2]);
+        return 1;
+    }
+
+    arena_init(&arena, 0U);
+    start = stats_op_begin();
+    loaded = load_commits_between(&repo, since, until, &arena, &history);
+    stats_op_end(STAT_OP_LOG, start);
+
+    if (!loaded)
+    {
+        arena_free(&arena);
+        (void)printf("Failed to load commits.\n");
+        return 1;
+    }
+
+    for (i = 0U; i < history.count; i++)
+    {
+        const CommitEntry *entry = &history.items[i];
+        char id[VELOCE_ID_LEN];
+        char timestamp[VELOCE_TIMESTAMP_LEN];
+
+        id_key_to_text(&entry->id, id);
+        format_timestamp(entry->timestamp, timestamp);
+        (void)printf("%s  %s  %s\n", id, timestamp, entry->message);
+    }
+
+    arena_free(&arena);
+    return 0;
+}
+
+static int run_import(int argc, char **argv)
+{
+    UserRecord owner;
+    BundleResult result;
+
+    if (argc != 3 && !(argc == 5 && strcmp(argv[3], "--owner") == 0))
+    {
+        usage();
+        return 2;
+    }
+
+    if (argc == 5 && !find_user_by_username(argv[4], &owner))
+    {
+        (void)printf("No user named %s.\n", argv[4]);
+        return 1;
+    }
+
+    if (!bundle_import(argv[2], argc == 5 ? &owner.uid : NULL, &result))
+    {
+        print_bundle_failure(&result, argv[2]);
+        return 1;
+    }
+
+    (void)printf("Imported %s as repository #%d.\n", result.repo.name, result.repo.rid);
+    return 0;
+}
+
+static int run_replicate(int argc, char **argv)
+{
+    ReplicateResult result;
+
+    if (argc != 3)
+    {
+        usage();
+        return 2;
+    }
+
+    if (replicate_storage(argv[2], &result))
+    {
+        (void)printf("%s %s: %llu change(s), %llu snapshot(s), %.1f MiB copied.\n",
+                     result.seeded ? "Seeded" : "Updated", argv[2], (unsigned long long)result.changes,
+                     (unsigned long long)result.snapshots, (double)result.bytes / (1024.0 * 1024.0));
+        return 0;
+    }
+
+    if (result.status == REPLICATE_BAD_DEST)
+    {
+        (void)printf("Cannot replicate to %s.\n", argv[2]);
+    }
+    else if (result.status == REPLICATE_NO_LOG)
+    {
+        (void)printf("Cannot read %s.\n", VELOCE_CHANGE_LOG);
+    }
+    else
+    {
+        (void)printf("Replication to %s stopped after %llu change(s); run it again to resume.\n", argv[2],
+                     (unsigned long long)result.changes);
+    }
+    return 1;
+}
+
+static int run_hash(int argc, char **argv)
+{
+    ContentHash algorithm;
+
+    if (argc == 2)
+    {
+        (void)printf("%s\n", content_hash_name(content_hash_algorithm()));
+        return 0;
+    }
+
+    if (argc != 3 || !content_hash_from_name(argv[2], &algorithm))
+    {
+        usage();
+        return 2;
+    }
+
+    if (!content_hash_select(algorithm))
+    {
+        (void)printf("Failed to record the content hash.\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
 {
     Session session = {0};
     RepoRecord opened_repo = {0};
 
+    if (argc > 1 && strcmp(argv[1], "fsck") != 0 && strcmp(argv[1], "export") != 0 &&
+        strcmp(argv[1], "import") != 0 && strcmp(argv[1], "replicate") != 0 && strcmp(argv[1], "log") != 0 &&
+        strcmp(argv[1], "hash") != 0)
+    {
+        usage();
+        return 2;
+    }
+
     if (ensure_storage_ready() != 0)
     {
         (void)printf("Failed to initialize Veloce storage.\n");
         return 1;
     }
 
+    stats_init();
+    trace_init();
+
+    if (argc > 1 && strcmp(argv[1], "fsck") == 0)
+    {
+        return run_fsck(argc, argv);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "export") == 0)
+    {
+        return run_export(argc, argv);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "import") == 0)
+    {
+        return run_import(argc, argv);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "log") == 0)
+    {
+        return run_log(argc, argv);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "hash") == 0)
+    {
+        return run_hash(argc, argv);
+    }
+
+    if (argc > 1)
+    {
+        return run_replicate(argc, argv);
+    }
+
     load();
 
     while (verify_auth(&session))
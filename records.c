@@ -0,0 +1,559 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VELOCE_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VELOCE_SIMD_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VELOCE_SIMD_NEON 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* Reads the next database line with its line ending stripped, counting it for the stats surface. */
+int db_next_line(FILE *fp, char *line, size_t size, size_t *out_len)
+{
+    size_t len;
+
+    if (fgets(line, (int)size, fp) == NULL)
+    {
+        return 0;
+    }
+
+    len = strcspn(line, "\r\n");
+    stats_add(STAT_RECORDS_SCANNED, 1U);
+    stats_add(STAT_BYTES_READ, line[len] != '\0' ? len + 1U : len);
+    line[len] = '\0';
+    if (out_len != NULL)
+    {
+        *out_len = len;
+    }
+    return 1;
+}
+
+#if defined(VELOCE_SIMD_AVX2) || defined(VELOCE_SIMD_SSE2) || defined(VELOCE_SIMD_NEON)
+static unsigned int lowest_bit(uint64_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+
+    _BitScanForward64(&index, mask);
+    return (unsigned int)index;
+#else
+    return (unsigned int)__builtin_ctzll(mask);
+#endif
+}
+#endif
+
+/*
+ * Records the offset of every '|' in line[0, len) into `offsets`, stopping once more than
+ * `max` have been seen (the line then has too many fields and is rejected by the caller).
+ */
+static size_t scan_delimiters(const char *line, size_t len, size_t offsets[], size_t max)
+{
+    size_t found = 0U;
+    size_t i = 0U;
+
+#if defined(VELOCE_SIMD_AVX2)
+    const __m256i pipe = _mm256_set1_epi8('|');
+
+    for (; i + 32U <= len; i += 32U)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(const void *)(line + i));
+        uint64_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, pipe));
+
+        while (mask != 0U)
+        {
+            if (found == max)
+            {
+                return max + 1U;
+            }
+            offsets[found++] = i + lowest_bit(mask);
+            mask &= mask - 1U;
+        }
+    }
+#elif defined(VELOCE_SIMD_SSE2)
+    const __m128i pipe = _mm_set1_epi8('|');
+
+    for (; i + 16U <= len; i += 16U)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(const void *)(line + i));
+        uint64_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, pipe));
+
+        while (mask != 0U)
+        {
+            if (found == max)
+            {
+                return max + 1U;
+            }
+            offsets[found++] = i + lowest_bit(mask);
+            mask &= mask - 1U;
+        }
+    }
+#elif defined(VELOCE_SIMD_NEON)
+    const uint8x16_t pipe = vdupq_n_u8((uint8_t)'|');
+
+    for (; i + 16U <= len; i += 16U)
+    {
+        uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *)line + i), pipe);
+        /* Narrowing shift packs the 16 compare lanes into a 64-bit mask, four bits per byte. */
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+
+        mask &= 0x8888888888888888ULL;
+        while (mask != 0U)
+        {
+            if (found == max)
+            {
+                return max + 1U;
+            }
+            offsets[found++] = i + (lowest_bit(mask) >> 2);
+            mask &= mask - 1U;
+        }
+    }
+#endif
+
+    for (; i < len; i++)
+    {
+        if (line[i] == '|')
+        {
+            if (found == max)
+            {
+                return max + 1U;
+            }
+            offsets[found++] = i;
+        }
+    }
+
+    return found;
+}
+
+int split_field_spans(const char *line, size_t len, FieldSpan fields[], size_t expected)
+{
+    return split_field_spans_optional(line, len, fields, expected, expected);
+}
+
+/*
+ * Like split_field_spans, but accepts lines with anywhere from `required` to `expected`
+ * fields; the trailing fields a shorter line lacks come back as empty spans. This is how
+ * columns added later stay optional for lines written before they existed.
+ */
+int split_field_spans_optional(const char *line, size_t len, FieldSpan fields[], size_t required, size_t expected)
+{
+    size_t offsets[VELOCE_MAX_FIELDS];
+    size_t start = 0U;
+    size_t found;
+    size_t i;
+
+    if (line == NULL || required == 0U || required > expected || expected > VELOCE_MAX_FIELDS)
+    {
+        return 0;
+    }
+
+    found = scan_delimiters(line, len, offsets, expected - 1U);
+    if (found < required - 1U || found > expected - 1U)
+    {
+        return 0;
+    }
+
+    for (i = 0U; i < found; i++)
+    {
+        fields[i].ptr = line + start;
+        fields[i].len = offsets[i] - start;
+        start = offsets[i] + 1U;
+    }
+
+    fields[found].ptr = line + start;
+    fields[found].len = len - start;
+
+    for (i = found + 1U; i < expected; i++)
+    {
+        fields[i].ptr = line + len;
+        fields[i].len = 0U;
+    }
+    return 1;
+}
+
+int span_equals(const FieldSpan *field, const char *text)
+{
+    size_t len = strlen(text);
+
+    return field->len == len && memcmp(field->ptr, text, len) == 0;
+}
+
+void span_copy(char *dst, size_t dst_size, const FieldSpan *field)
+{
+    size_t n = field->len < dst_size - 1U ? field->len : dst_size - 1U;
+
+    memcpy(dst, field->ptr, n);
+    dst[n] = '\0';
+}
+
+int span_to_int(const FieldSpan *field)
+{
+    size_t i = 0U;
+    int negative = 0;
+    int value = 0;
+
+    while (i < field->len && (field->ptr[i] == ' ' || field->ptr[i] == '\t'))
+    {
+        i++;
+    }
+
+    if (i < field->len && (field->ptr[i] == '-' || field->ptr[i] == '+'))
+    {
+        negative = field->ptr[i] == '-';
+        i++;
+    }
+
+    for (; i < field->len && field->ptr[i] >= '0' && field->ptr[i] <= '9'; i++)
+    {
+        value = value * 10 + (field->ptr[i] - '0');
+    }
+
+    return negative ? -value : value;
+}
+
+static const char k_id_alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+/* Character codes 1..62; 0 marks the end of a short id and anything unlisted is invalid. */
+static const unsigned char k_id_codes[256] = {
+    ['a'] = 1, ['b'] = 2, ['c'] = 3, ['d'] = 4, ['e'] = 5, ['f'] = 6, ['g'] = 7, ['h'] = 8, ['i'] = 9,
+    ['j'] = 10, ['k'] = 11, ['l'] = 12, ['m'] = 13, ['n'] = 14, ['o'] = 15, ['p'] = 16, ['q'] = 17, ['r'] = 18,
+    ['s'] = 19, ['t'] = 20, ['u'] = 21, ['v'] = 22, ['w'] = 23, ['x'] = 24, ['y'] = 25, ['z'] = 26, ['A'] = 27,
+    ['B'] = 28, ['C'] = 29, ['D'] = 30, ['E'] = 31, ['F'] = 32, ['G'] = 33, ['H'] = 34, ['I'] = 35, ['J'] = 36,
+    ['K'] = 37, ['L'] = 38, ['M'] = 39, ['N'] = 40, ['O'] = 41, ['P'] = 42, ['Q'] = 43, ['R'] = 44, ['S'] = 45,
+    ['T'] = 46, ['U'] = 47, ['V'] = 48, ['W'] = 49, ['X'] = 50, ['Y'] = 51, ['Z'] = 52, ['0'] = 53, ['1'] = 54,
+    ['2'] = 55, ['3'] = 56, ['4'] = 57, ['5'] = 58, ['6'] = 59, ['7'] = 60, ['8'] = 61, ['9'] = 62,
+};
+
+int id_key_from_span(const FieldSpan *field, IdKey *key)
+{
+    size_t i;
+
+    key->hi = 0U;
+    key->lo = 0U;
+
+    if (field->len == 0U || field->len > VELOCE_ID_LEN - 1U)
+    {
+        return 0;
+    }
+
+    for (i = 0U; i < VELOCE_ID_LEN - 1U; i++)
+    {
+        unsigned int code = 0U;
+
+        if (i < field->len)
+        {
+            code = k_id_codes[(unsigned char)field->ptr[i]];
+            if (code == 0U)
+            {
+                return 0;
+            }
+        }
+
+        if (i < 8U)
+        {
+            key->hi = (key->hi << 6) | (uint64_t)code;
+        }
+        else
+        {
+            key->lo = (key->lo << 6) | (uint64_t)code;
+        }
+    }
+
+    return 1;
+}
+
+int id_key_from_text(const char *text, IdKey *key)
+{
+    FieldSpan field;
+
+    field.ptr = text;
+    field.len = strlen(text);
+    return id_key_from_span(&field, key);
+}
+
+void id_key_to_text(const IdKey *key, char out[VELOCE_ID_LEN])
+{
+    size_t len = 0U;
+    size_t i;
+
+    for (i = 0U; i < VELOCE_ID_LEN - 1U; i++)
+    {
+        uint64_t half = i < 8U ? key->hi : key->lo;
+        unsigned int code = (unsigned int)((half >> (6U * (7U - (i % 8U)))) & 0x3FU);
+
+        if (code == 0U || code > sizeof(k_id_alphabet) - 1U)
+        {
+            break;
+        }
+        out[len++] = k_id_alphabet[code - 1U];
+    }
+
+    out[len] = '\0';
+}
+
+int id_key_equals(const IdKey *a, const IdKey *b)
+{
+    return a->hi == b->hi && a->lo == b->lo;
+}
+
+/* splitmix64 finaliser over both halves; ids are random text, so this only needs to spread bits. */
+uint64_t id_key_hash(const IdKey *key)
+{
+    uint64_t x = key->hi ^ (key->lo * 0x9E3779B97F4A7C15ULL);
+
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/* Scans filter on this: the field is packed in registers and compared as two integers. */
+int span_key_equals(const FieldSpan *field, const IdKey *key)
+{
+    IdKey other;
+
+    return id_key_from_span(field, &other) && id_key_equals(&other, key);
+}
+
+int user_from_fields(const FieldSpan fields[VELOCE_USER_FIELDS], UserRecord *user)
+{
+    if (!id_key_from_span(&fields[0], &user->uid))
+    {
+        return 0;
+    }
+
+    span_copy(user->username, sizeof(user->username), &fields[1]);
+    span_copy(user->name, sizeof(user->name), &fields[2]);
+    span_copy(user->password_salt, sizeof(user->password_salt), &fields[3]);
+    span_copy(user->password_hash, sizeof(user->password_hash), &fields[4]);
+    span_copy(user->security_question, sizeof(user->security_question), &fields[5]);
+    span_copy(user->answer_salt, sizeof(user->answer_salt), &fields[6]);
+    span_copy(user->answer_hash, sizeof(user->answer_hash), &fields[7]);
+    user->created_at = parse_timestamp(fields[8].ptr, fields[8].len);
+    return 1;
+}
+
+int parse_user_line(const char *line, UserRecord *user)
+{
+    FieldSpan fields[VELOCE_USER_FIELDS];
+
+    if (line == NULL || user == NULL)
+    {
+        return 0;
+    }
+
+    if (!split_field_spans(line, strlen(line), fields, VELOCE_USER_FIELDS))
+    {
+        return 0;
+    }
+
+    return user_from_fields(fields, user);
+}
+
+int write_user_line(FILE *fp, const UserRecord *user)
+{
+    char uid[VELOCE_ID_LEN];
+    int written;
+
+    if (fp == NULL || user == NULL)
+    {
+        return 0;
+    }
+
+    id_key_to_text(&user->uid, uid);
+    written = fprintf(fp,
+                      "%s|%s|%s|%s|%s|%s|%s|%s|%lld\n",
+                      uid,
+                      user->username,
+                      user->name,
+                      user->password_salt,
+                      user->password_hash,
+                      user->security_question,
+                      user->answer_salt,
+                      user->answer_hash,
+                      (long long)user->created_at);
+    if (written <= 0)
+    {
+        return 0;
+    }
+
+    stats_add(STAT_BYTES_WRITTEN, (uint64_t)written);
+    return 1;
+}
+
+int repo_from_fields(const FieldSpan fields[VELOCE_REPO_FIELDS], RepoRecord *repo)
+{
+    if (!id_key_from_span(&fields[0], &repo->id) || !id_key_from_span(&fields[1], &repo->owner_uid))
+    {
+        return 0;
+    }
+
+    repo->rid = span_to_int(&fields[2]);
+    span_copy(repo->name, sizeof(repo->name), &fields[3]);
+    repo->initialized = span_to_int(&fields[4]);
+    span_copy(repo->tracked_file, sizeof(repo->tracked_file), &fields[5]);
+    repo->created_at = parse_timestamp(fields[6].ptr, fields[6].len);
+    return 1;
+}
+
+int parse_repo_line(const char *line, RepoRecord *repo)
+{
+    FieldSpan fields[VELOCE_REPO_FIELDS];
+
+    if (line == NULL || repo == NULL)
+    {
+        return 0;
+    }
+
+    if (!split_field_spans(line, strlen(line), fields, VELOCE_REPO_FIELDS))
+    {
+        return 0;
+    }
+
+    return repo_from_fields(fields, repo);
+}
+
+int write_repo_line(FILE *fp, const RepoRecord *repo)
+{
+    char id[VELOCE_ID_LEN];
+    char owner_uid[VELOCE_ID_LEN];
+    int written;
+
+    if (fp == NULL || repo == NULL)
+    {
+        return 0;
+    }
+
+    id_key_to_text(&repo->id, id);
+    id_key_to_text(&repo->owner_uid, owner_uid);
+    written = fprintf(fp,
+                      "%s|%s|%d|%s|%d|%s|%lld\n",
+                      id,
+                      owner_uid,
+                      repo->rid,
+                      repo->name,
+                      repo->initialized,
+                      repo->tracked_file,
+                      (long long)repo->created_at);
+    if (written <= 0)
+    {
+        return 0;
+    }
+
+    stats_add(STAT_BYTES_WRITTEN, (uint64_t)written);
+    return 1;
+}
+
+/*
+ * The fifth commit field names the commit whose snapshot holds the content, and is empty
+ * when that is the commit itself. Older databases stored an absolute snapshot path there;
+ * its file stem is the commit id, so those lines keep working after the storage root moves.
+ */
+int snapshot_id_from_span(const FieldSpan *field, const IdKey *commit_id, IdKey *snapshot_id)
+{
+    FieldSpan stem = *field;
+    size_t i;
+
+    for (i = stem.len; i > 0U; i--)
+    {
+        if (stem.ptr[i - 1U] == '/' || stem.ptr[i - 1U] == '\\')
+        {
+            stem.ptr += i;
+            stem.len -= i;
+            break;
+        }
+    }
+
+    if (stem.len > 4U && memcmp(stem.ptr + stem.len - 4U, ".txt", 4U) == 0)
+    {
+        stem.len -= 4U;
+    }
+
+    if (stem.len == 0U)
+    {
+        *snapshot_id = *commit_id;
+        return 1;
+    }
+
+    return id_key_from_span(&stem, snapshot_id);
+}
+
+int commit_from_fields(const FieldSpan fields[VELOCE_COMMIT_FIELDS], CommitRecord *commit)
+{
+    if (!id_key_from_span(&fields[0], &commit->id) || !id_key_from_span(&fields[1], &commit->repo_id))
+    {
+        return 0;
+    }
+
+    commit->timestamp = parse_timestamp(fields[2].ptr, fields[2].len);
+    span_copy(commit->message, sizeof(commit->message), &fields[3]);
+    span_copy(commit->content_hash, sizeof(commit->content_hash), &fields[5]);
+    return snapshot_id_from_span(&fields[4], &commit->id, &commit->snapshot_id);
+}
+
+int parse_commit_line(const char *line, CommitRecord *commit)
+{
+    FieldSpan fields[VELOCE_COMMIT_FIELDS];
+
+    if (line == NULL || commit == NULL)
+    {
+        return 0;
+    }
+
+    if (!split_field_spans_optional(line, strlen(line), fields, VELOCE_COMMIT_REQUIRED_FIELDS, VELOCE_COMMIT_FIELDS))
+    {
+        return 0;
+    }
+
+    return commit_from_fields(fields, commit);
+}
+
+int write_commit_line(FILE *fp, const CommitRecord *commit)
+{
+    char id[VELOCE_ID_LEN];
+    char repo_id[VELOCE_ID_LEN];
+    char snapshot_id[VELOCE_ID_LEN];
+    int written;
+
+    if (fp == NULL || commit == NULL)
+    {
+        return 0;
+    }
+
+    id_key_to_text(&commit->id, id);
+    id_key_to_text(&commit->repo_id, repo_id);
+    snapshot_id[0] = '\0';
+    if (!id_key_equals(&commit->snapshot_id, &commit->id))
+    {
+        id_key_to_text(&commit->snapshot_id, snapshot_id);
+    }
+
+    written = fprintf(fp,
+                      "%s|%s|%lld|%s|%s|%s\n",
+                      id,
+                      repo_id,
+                      (long long)commit->timestamp,
+                      commit->message,
+                      snapshot_id,
+                      commit->content_hash);
+    if (written <= 0)
+    {
+        return 0;
+    }
+
+    stats_add(STAT_BYTES_WRITTEN, (uint64_t)written);
+    return 1;
+}
@@ -0,0 +1,456 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int db_path(const char *name, char path[VELOCE_PATH_LEN + 1])
+{
+    return path_join(path, VELOCE_PATH_LEN + 1U, storage_root(), name);
+}
+
+/*
+ * Doubles a column on the heap; every row column of a table shares `cap`. Only the newest arena
+ * allocation can grow in place, so the columns are built here and table_finish moves them into
+ * the arena once, at their final size.
+ */
+static int grow_column(void **column, size_t elem, size_t new_cap)
+{
+    void *next = realloc(*column, new_cap * elem);
+
+    if (next == NULL)
+    {
+        return 0;
+    }
+
+    *column = next;
+    return 1;
+}
+
+/* Open-addressing index from repo key to its dictionary slot; the table is kept half empty. */
+static uint32_t repo_slot_find(const CommitTable *table, const IdKey *key, size_t *slot)
+{
+    size_t i = (size_t)id_key_hash(key) & table->repo_slot_mask;
+
+    while (table->repo_slots[i] != UINT32_MAX)
+    {
+        if (id_key_equals(&table->repo_keys[table->repo_slots[i]], key))
+        {
+            *slot = i;
+            return table->repo_slots[i];
+        }
+        i = (i + 1U) & table->repo_slot_mask;
+    }
+
+    *slot = i;
+    return UINT32_MAX;
+}
+
+static int repo_slots_rehash(CommitTable *table, size_t slot_count)
+{
+    uint32_t *slots = (uint32_t *)malloc(slot_count * sizeof(uint32_t));
+    size_t i;
+
+    if (slots == NULL)
+    {
+        return 0;
+    }
+
+    memset(slots, 0xFF, slot_count * sizeof(uint32_t));
+    free(table->repo_slots);
+    table->repo_slots = slots;
+    table->repo_slot_mask = slot_count - 1U;
+
+    for (i = 0U; i < table->repo_count; i++)
+    {
+        size_t slot;
+
+        (void)repo_slot_find(table, &table->repo_keys[i], &slot);
+        table->repo_slots[slot] = (uint32_t)i;
+    }
+
+    return 1;
+}
+
+static uint32_t intern_owner(CommitTable *table, const IdKey *owner)
+{
+    size_t i;
+
+    /* Owners are few next to repos and commits; a linear pass over them is cheap. */
+    for (i = 0U; i < table->owner_count; i++)
+    {
+        if (id_key_equals(&table->owner_keys[i], owner))
+        {
+            return (uint32_t)i;
+        }
+    }
+
+    if (table->owner_count == table->owner_cap)
+    {
+        size_t cap = table->owner_cap == 0U ? 16U : table->owner_cap * 2U;
+
+        if (!grow_column((void **)&table->owner_keys, sizeof(IdKey), cap))
+        {
+            return UINT32_MAX;
+        }
+        table->owner_cap = cap;
+    }
+
+    table->owner_keys[table->owner_count] = *owner;
+    return (uint32_t)table->owner_count++;
+}
+
+static uint32_t intern_repo(CommitTable *table, const IdKey *repo, uint32_t owner)
+{
+    size_t slot;
+    uint32_t index;
+
+    if (table->repo_slots == NULL && !repo_slots_rehash(table, 64U))
+    {
+        return UINT32_MAX;
+    }
+
+    index = repo_slot_find(table, repo, &slot);
+    if (index != UINT32_MAX)
+    {
+        if (owner != UINT32_MAX)
+        {
+            table->repo_owner[index] = owner;
+        }
+        return index;
+    }
+
+    if (table->repo_count == table->repo_cap)
+    {
+        size_t cap = table->repo_cap == 0U ? 16U : table->repo_cap * 2U;
+
+        if (!grow_column((void **)&table->repo_keys, sizeof(IdKey), cap) ||
+            !grow_column((void **)&table->repo_owner, sizeof(uint32_t), cap))
+        {
+            return UINT32_MAX;
+        }
+        table->repo_cap = cap;
+    }
+
+    index = (uint32_t)table->repo_count++;
+    table->repo_keys[index] = *repo;
+    table->repo_owner[index] = owner;
+
+    if (table->repo_count * 2U > table->repo_slot_mask + 1U)
+    {
+        if (!repo_slots_rehash(table, (table->repo_slot_mask + 1U) * 2U))
+        {
+            return UINT32_MAX;
+        }
+    }
+    else
+    {
+        table->repo_slots[slot] = index;
+    }
+
+    return index;
+}
+
+static uint32_t append_string(CommitTable *table, const FieldSpan *text)
+{
+    size_t need = table->strings_len + text->len + 1U;
+    uint32_t offset = (uint32_t)table->strings_len;
+
+    if (need > UINT32_MAX)
+    {
+        return UINT32_MAX;
+    }
+
+    if (need > table->strings_cap)
+    {
+        size_t cap = table->strings_cap == 0U ? 64U * 1024U : table->strings_cap;
+
+        while (cap < need)
+        {
+            cap *= 2U;
+        }
+        if (!grow_column((void **)&table->strings, 1U, cap))
+        {
+            return UINT32_MAX;
+        }
+        table->strings_cap = cap;
+    }
+
+    memcpy(table->strings + offset, text->ptr, text->len);
+    table->strings[offset + text->len] = '\0';
+    table->strings_len = need;
+    return offset;
+}
+
+static int append_row(CommitTable *table, const FieldSpan fields[VELOCE_COMMIT_FIELDS])
+{
+    IdKey repo_key;
+    uint32_t repo;
+    uint32_t message;
+
+    if (!id_key_from_span(&fields[1], &repo_key))
+    {
+        return 1;
+    }
+
+    if (table->count == table->cap)
+    {
+        size_t cap = table->cap == 0U ? 1024U : table->cap * 2U;
+
+        if (!grow_column((void **)&table->repo, sizeof(uint32_t), cap) ||
+            !grow_column((void **)&table->timestamp, sizeof(int64_t), cap) ||
+            !grow_column((void **)&table->message, sizeof(uint32_t), cap))
+        {
+            return 0;
+        }
+        table->cap = cap;
+    }
+
+    repo = intern_repo(table, &repo_key, UINT32_MAX);
+    message = append_string(table, &fields[3]);
+    if (repo == UINT32_MAX || message == UINT32_MAX)
+    {
+        return 0;
+    }
+
+    table->repo[table->count] = repo;
+    table->timestamp[table->count] = parse_timestamp(fields[2].ptr, fields[2].len);
+    table->message[table->count] = message;
+    table->count++;
+    return 1;
+}
+
+/* Copies the first `bytes` of a heap column into the arena and frees the heap copy. */
+static int move_column(Arena *arena, void **column, size_t bytes, int ok)
+{
+    void *moved = NULL;
+
+    if (ok && *column != NULL)
+    {
+        moved = arena_alloc(arena, bytes);
+        ok = moved != NULL;
+        if (ok)
+        {
+            memcpy(moved, *column, bytes);
+        }
+    }
+
+    free(*column);
+    *column = moved;
+    return ok;
+}
+
+/* Moves every column into the table's arena, trimmed to what was used; a failed load ends up empty. */
+static int table_finish(CommitTable *table, int ok)
+{
+    Arena *arena = table->arena;
+    size_t slot_count = table->repo_slots != NULL ? table->repo_slot_mask + 1U : 0U;
+
+    ok = move_column(arena, (void **)&table->repo, table->count * sizeof(uint32_t), ok);
+    ok = move_column(arena, (void **)&table->timestamp, table->count * sizeof(int64_t), ok);
+    ok = move_column(arena, (void **)&table->message, table->count * sizeof(uint32_t), ok);
+    ok = move_column(arena, (void **)&table->strings, table->strings_len, ok);
+    ok = move_column(arena, (void **)&table->repo_keys, table->repo_count * sizeof(IdKey), ok);
+    ok = move_column(arena, (void **)&table->repo_owner, table->repo_count * sizeof(uint32_t), ok);
+    ok = move_column(arena, (void **)&table->repo_slots, slot_count * sizeof(uint32_t), ok);
+    ok = move_column(arena, (void **)&table->owner_keys, table->owner_count * sizeof(IdKey), ok);
+
+    if (!ok)
+    {
+        memset(table, 0, sizeof(*table));
+        table->arena = arena;
+        return 0;
+    }
+
+    table->cap = table->count;
+    table->strings_cap = table->strings_len;
+    table->repo_cap = table->repo_count;
+    table->owner_cap = table->owner_count;
+    return 1;
+}
+
+/*
+ * Builds the table from repos.db (for the repo -> owner column) and then the commit log of
+ * each repository it lists. Everything lives in `arena` once it returns.
+ */
+int commit_table_load(Arena *arena, CommitTable *table)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    DbScan scan;
+    FieldSpan fields[VELOCE_MAX_FIELDS];
+    size_t repo_count;
+    size_t i;
+    uint64_t span;
+    int ok = 1;
+
+    if (arena == NULL || table == NULL)
+    {
+        return 0;
+    }
+
+    memset(table, 0, sizeof(*table));
+    table->arena = arena;
+
+    span = trace_begin();
+    if (db_path(VELOCE_REPOS_DB, path) == 0 && db_scan_open(&scan, path))
+    {
+        while (ok && db_scan_next(&scan, fields, VELOCE_REPO_FIELDS))
+        {
+            IdKey repo;
+            IdKey owner;
+
+            if (id_key_from_span(&fields[0], &repo) && id_key_from_span(&fields[1], &owner))
+            {
+                ok = intern_repo(table, &repo, intern_owner(table, &owner)) != UINT32_MAX;
+            }
+        }
+        db_scan_close(&scan);
+    }
+
+    repo_count = table->repo_count;
+    for (i = 0U; ok && i < repo_count; i++)
+    {
+        IdKey repo = table->repo_keys[i];
+
+        if (commit_shard_path(&repo, path) != 0 || !file_exists(path) || !db_scan_open(&scan, path))
+        {
+            continue;
+        }
+
+        while (ok && db_scan_next_optional(&scan, fields, VELOCE_COMMIT_REQUIRED_FIELDS, VELOCE_COMMIT_FIELDS))
+        {
+            ok = append_row(table, fields);
+        }
+        db_scan_close(&scan);
+    }
+    trace_end("build commit table", span, 0U);
+
+    return table_finish(table, ok);
+}
+
+uint32_t commit_table_find_repo(const CommitTable *table, const IdKey *repo)
+{
+    size_t slot;
+
+    if (table->repo_slots == NULL)
+    {
+        return UINT32_MAX;
+    }
+
+    return repo_slot_find(table, repo, &slot);
+}
+
+uint32_t commit_table_find_owner(const CommitTable *table, const IdKey *owner)
+{
+    size_t i;
+
+    for (i = 0U; i < table->owner_count; i++)
+    {
+        if (id_key_equals(&table->owner_keys[i], owner))
+        {
+            return (uint32_t)i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+const char *commit_table_message(const CommitTable *table, size_t row)
+{
+    return table->strings + table->message[row];
+}
+
+/*
+ * The filters and aggregates below are branch-free loops over one or two columns so the
+ * compiler can vectorise them. A selection is a byte per row (0 or 1); NULL selects all rows.
+ */
+size_t commit_table_select_range(const CommitTable *table, int64_t from, int64_t until, uint8_t *selected)
+{
+    const int64_t *ts = table->timestamp;
+    size_t hits = 0U;
+    size_t i;
+
+    for (i = 0U; i < table->count; i++)
+    {
+        uint8_t in = (uint8_t)((ts[i] >= from) & (ts[i] < until));
+
+        selected[i] = in;
+        hits += in;
+    }
+
+    return hits;
+}
+
+size_t commit_table_select_owner(const CommitTable *table, uint32_t owner, uint8_t *selected)
+{
+    const uint32_t *repo = table->repo;
+    const uint32_t *repo_owner = table->repo_owner;
+    size_t hits = 0U;
+    size_t i;
+
+    for (i = 0U; i < table->count; i++)
+    {
+        uint8_t in = (uint8_t)(repo_owner[repo[i]] == owner);
+
+        selected[i] &= in;
+        hits += selected[i];
+    }
+
+    return hits;
+}
+
+void commit_table_count_by_repo(const CommitTable *table, const uint8_t *selected, uint64_t *counts)
+{
+    size_t i;
+
+    memset(counts, 0, table->repo_count * sizeof(uint64_t));
+
+    /* Rows arrive one repository's log at a time; summing each run locally avoids a store per row. */
+    i = 0U;
+    while (i < table->count)
+    {
+        uint32_t repo = table->repo[i];
+        uint64_t n = 0U;
+
+        for (; i < table->count && table->repo[i] == repo; i++)
+        {
+            n += selected != NULL ? selected[i] : 1U;
+        }
+        counts[repo] += n;
+    }
+}
+
+/* `counts` has owner_count + 1 slots; the last one collects commits of ownerless repos. */
+void commit_table_count_by_owner(const CommitTable *table, const uint8_t *selected, uint64_t *counts)
+{
+    size_t i;
+
+    memset(counts, 0, (table->owner_count + 1U) * sizeof(uint64_t));
+    for (i = 0U; i < table->count; i++)
+    {
+        uint32_t owner = table->repo_owner[table->repo[i]];
+        size_t slot = owner == UINT32_MAX ? table->owner_count : owner;
+
+        counts[slot] += selected != NULL ? selected[i] : 1U;
+    }
+}
+
+/* Buckets rows into `days` spans of 24 hours starting at the stamp `first_day`; others are ignored. */
+void commit_table_count_by_day(const CommitTable *table, const uint8_t *selected, int64_t first_day, size_t days,
+                               uint64_t *counts)
+{
+    const int64_t day_ns = 86400 * VELOCE_NS_PER_SEC;
+    size_t i;
+
+    memset(counts, 0, days * sizeof(uint64_t));
+    for (i = 0U; i < table->count; i++)
+    {
+        int64_t since = table->timestamp[i] - first_day;
+        int64_t day = (since >= 0 ? since : since - (day_ns - 1)) / day_ns;
+
+        if (day >= 0 && (uint64_t)day < days)
+        {
+            counts[day] += selected != NULL ? selected[i] : 1U;
+        }
+    }
+}
@@ -0,0 +1,725 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INDEX_TOKEN_LEN 32U
+#define INDEX_MAX_TOKENS 32U
+#define INDEX_FIELDS 4U
+#define INDEX_HEADER "# veloce messages "
+
+/*
+ * messages.idx holds one posting per line, token|commit_id|repo_id|offset, where offset is
+ * the byte position of the commit's line in its repository's commit log. It is only ever
+ * appended to, so the in-memory copy below catches up by reading from where it last stopped.
+ * A commit's postings are written together; `seq` numbers those runs in file order.
+ *
+ * The first line names the file's generation, a fresh id each time the index is rebuilt. A
+ * file recreated by another process, even at the same or a larger size, then carries a
+ * different generation and the in-memory copy starts over instead of resuming mid-file.
+ */
+typedef struct
+{
+    IdKey commit;
+    IdKey repo;
+    uint64_t offset;
+    uint64_t seq;
+} Posting;
+
+typedef struct
+{
+    char token[INDEX_TOKEN_LEN + 1];
+    uint64_t hash;
+    Posting *postings;
+    size_t count;
+    size_t cap;
+} TokenList;
+
+typedef struct
+{
+    TokenList *slots;
+    size_t slot_count;
+    size_t used;
+    char generation[VELOCE_ID_LEN];
+    long loaded_bytes;
+    uint64_t seq;
+    IdKey last_commit;
+} MessageIndex;
+
+static MessageIndex g_index;
+
+static int index_path(char path[VELOCE_PATH_LEN + 1])
+{
+    return path_join(path, VELOCE_PATH_LEN + 1U, storage_root(), VELOCE_MESSAGE_INDEX);
+}
+
+/* FNV-1a; tokens are short lowercase words. */
+static uint64_t token_hash(const char *token, size_t len)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    size_t i;
+
+    for (i = 0U; i < len; i++)
+    {
+        h ^= (uint8_t)token[i];
+        h *= 0x100000001B3ULL;
+    }
+
+    return h;
+}
+
+/* Lowercased ASCII letter or digit, or 0 for a word separator. */
+static char word_char(char c)
+{
+    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+    {
+        return c;
+    }
+    if (c >= 'A' && c <= 'Z')
+    {
+        return (char)(c - 'A' + 'a');
+    }
+    return 0;
+}
+
+/*
+ * Splits text into lowercase ASCII alphanumeric words of two or more characters, dropping
+ * repeats. Longer words are cut at INDEX_TOKEN_LEN so indexing and queries agree.
+ */
+static size_t tokenize(const char *text, size_t len, char tokens[][INDEX_TOKEN_LEN + 1])
+{
+    size_t count = 0U;
+    size_t i = 0U;
+
+    while (i < len && count < INDEX_MAX_TOKENS)
+    {
+        char word[INDEX_TOKEN_LEN + 1];
+        size_t n = 0U;
+        size_t k;
+        int seen = 0;
+
+        for (; i < len && word_char(text[i]) == 0; i++)
+        {
+        }
+
+        for (; i < len && word_char(text[i]) != 0; i++)
+        {
+            if (n < INDEX_TOKEN_LEN)
+            {
+                word[n++] = word_char(text[i]);
+            }
+        }
+        word[n] = '\0';
+
+        if (n < 2U)
+        {
+            continue;
+        }
+
+        for (k = 0U; k < count && !seen; k++)
+        {
+            seen = strcmp(tokens[k], word) == 0;
+        }
+
+        if (!seen)
+        {
+            memcpy(tokens[count++], word, n + 1U);
+        }
+    }
+
+    return count;
+}
+
+static TokenList *index_find(const MessageIndex *index, const char *token, size_t len, uint64_t hash)
+{
+    size_t i;
+
+    if (index->slot_count == 0U)
+    {
+        return NULL;
+    }
+
+    for (i = (size_t)hash & (index->slot_count - 1U);; i = (i + 1U) & (index->slot_count - 1U))
+    {
+        TokenList *list = &index->slots[i];
+
+        if (list->token[0] == '\0')
+        {
+            return NULL;
+        }
+        if (list->hash == hash && strncmp(list->token, token, len) == 0 && list->token[len] == '\0')
+        {
+            return list;
+        }
+    }
+}
+
+static int index_grow(MessageIndex *index)
+{
+    size_t slot_count = index->slot_count == 0U ? 1024U : index->slot_count * 2U;
+    TokenList *slots = (TokenList *)calloc(slot_count, sizeof(TokenList));
+    size_t i;
+
+    if (slots == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 0U; i < index->slot_count; i++)
+    {
+        const TokenList *old = &index->slots[i];
+        size_t j;
+
+        if (old->token[0] == '\0')
+        {
+            continue;
+        }
+
+        for (j = (size_t)old->hash & (slot_count - 1U); slots[j].token[0] != '\0'; j = (j + 1U) & (slot_count - 1U))
+        {
+        }
+        slots[j] = *old;
+    }
+
+    free(index->slots);
+    index->slots = slots;
+    index->slot_count = slot_count;
+    return 1;
+}
+
+static TokenList *index_insert(MessageIndex *index, const char *token, size_t len)
+{
+    uint64_t hash = token_hash(token, len);
+    TokenList *list = index_find(index, token, len, hash);
+    size_t i;
+
+    if (list != NULL)
+    {
+        return list;
+    }
+
+    if ((index->used + 1U) * 2U > index->slot_count && !index_grow(index))
+    {
+        return NULL;
+    }
+
+    for (i = (size_t)hash & (index->slot_count - 1U); index->slots[i].token[0] != '\0';
+         i = (i + 1U) & (index->slot_count - 1U))
+    {
+    }
+
+    list = &index->slots[i];
+    memcpy(list->token, token, len);
+    list->token[len] = '\0';
+    list->hash = hash;
+    index->used++;
+    return list;
+}
+
+static int index_add(MessageIndex *index, const FieldSpan *token, const Posting *posting)
+{
+    TokenList *list;
+
+    if (token->len < 2U || token->len > INDEX_TOKEN_LEN)
+    {
+        return 1;
+    }
+
+    list = index_insert(index, token->ptr, token->len);
+    if (list == NULL)
+    {
+        return 0;
+    }
+
+    if (list->count == list->cap)
+    {
+        size_t cap = list->cap == 0U ? 4U : list->cap * 2U;
+        Posting *next = (Posting *)realloc(list->postings, cap * sizeof(Posting));
+
+        if (next == NULL)
+        {
+            return 0;
+        }
+        list->postings = next;
+        list->cap = cap;
+    }
+
+    list->postings[list->count++] = *posting;
+    return 1;
+}
+
+static void index_clear(MessageIndex *index)
+{
+    size_t i;
+
+    for (i = 0U; i < index->slot_count; i++)
+    {
+        free(index->slots[i].postings);
+    }
+
+    free(index->slots);
+    memset(index, 0, sizeof(*index));
+}
+
+static uint64_t span_to_u64(const FieldSpan *field)
+{
+    uint64_t value = 0U;
+    size_t i;
+
+    for (i = 0U; i < field->len && field->ptr[i] >= '0' && field->ptr[i] <= '9'; i++)
+    {
+        value = value * 10U + (uint64_t)(field->ptr[i] - '0');
+    }
+
+    return value;
+}
+
+static int write_postings(FILE *fp, const CommitRecord *commit, uint64_t offset)
+{
+    char tokens[INDEX_MAX_TOKENS][INDEX_TOKEN_LEN + 1];
+    char id[VELOCE_ID_LEN];
+    char repo_id[VELOCE_ID_LEN];
+    size_t count = tokenize(commit->message, strlen(commit->message), tokens);
+    size_t i;
+
+    id_key_to_text(&commit->id, id);
+    id_key_to_text(&commit->repo_id, repo_id);
+    for (i = 0U; i < count; i++)
+    {
+        int written = fprintf(fp, "%s|%s|%s|%llu\n", tokens[i], id, repo_id, (unsigned long long)offset);
+
+        if (written <= 0)
+        {
+            return 0;
+        }
+        stats_add(STAT_BYTES_WRITTEN, (uint64_t)written);
+    }
+
+    return 1;
+}
+
+/*
+ * Records the postings for a commit just appended at `db_offset` in its repository's commit
+ * log. When the index does not exist yet nothing is written: the next search rebuilds the
+ * whole index from the commit logs instead of trusting a partial one.
+ */
+int message_index_append(const CommitRecord *commit, uint64_t db_offset)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    FILE *fp;
+    int ok;
+
+    if (index_path(path) != 0)
+    {
+        return 0;
+    }
+
+    if (!file_exists(path))
+    {
+        return 1;
+    }
+
+    fp = fopen(path, "ab");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    ok = change_log_append(fp, VELOCE_MESSAGE_INDEX) && write_postings(fp, commit, db_offset);
+    fclose(fp);
+    return ok;
+}
+
+/* Appends postings for every commit in the shard at `path`; a missing shard has none. */
+static int index_shard(FILE *out, const char *path)
+{
+    char line[2048];
+    FILE *in;
+    size_t len;
+    long offset;
+
+    in = fopen(path, "rb");
+    if (in == NULL)
+    {
+        return 1;
+    }
+
+    for (offset = ftell(in); db_next_line(in, line, sizeof(line), &len); offset = ftell(in))
+    {
+        CommitRecord commit;
+
+        if (parse_commit_line(line, &commit) && !write_postings(out, &commit, (uint64_t)offset))
+        {
+            fclose(in);
+            return 0;
+        }
+    }
+
+    fclose(in);
+    return 1;
+}
+
+/* Regenerates messages.idx from the commit log of every repository in repos.db. */
+static int index_rebuild(void)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char tmp_path[VELOCE_PATH_LEN + 1];
+    char repos[VELOCE_PATH_LEN + 1];
+    char shard[VELOCE_PATH_LEN + 1];
+    char id[VELOCE_ID_LEN];
+    DbScan scan;
+    FieldSpan fields[VELOCE_REPO_FIELDS];
+    IdKey generation;
+    FILE *out;
+    int ok;
+    uint64_t span;
+
+    if (index_path(path) != 0 || path_join(repos, sizeof(repos), storage_root(), VELOCE_REPOS_DB) != 0 ||
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path))
+    {
+        return 0;
+    }
+
+    span = trace_begin();
+    out = fopen(tmp_path, "wb");
+    if (out == NULL)
+    {
+        return 0;
+    }
+
+    generate_key(&generation);
+    id_key_to_text(&generation, id);
+    ok = fprintf(out, "%s%s\n", INDEX_HEADER, id) > 0;
+
+    if (ok && db_scan_open(&scan, repos))
+    {
+        while (ok && db_scan_next(&scan, fields, VELOCE_REPO_FIELDS))
+        {
+            IdKey repo;
+
+            if (id_key_from_span(&fields[0], &repo) && commit_shard_path(&repo, shard) == 0)
+            {
+                ok = index_shard(out, shard);
+            }
+        }
+        db_scan_close(&scan);
+    }
+
+    ok = fclose(out) == 0 && ok;
+    if (!ok || !change_log_record(CHANGE_WRITE, VELOCE_MESSAGE_INDEX, 0U))
+    {
+        remove(tmp_path);
+        return 0;
+    }
+
+    remove(path);
+    if (rename(tmp_path, path) != 0)
+    {
+        remove(tmp_path);
+        return 0;
+    }
+
+    trace_end("rebuild messages.idx", span, 0U);
+    return 1;
+}
+
+/* Reads the generation line at the start of the index; returns 0 if it has none. */
+static int read_index_generation(FILE *fp, char generation[VELOCE_ID_LEN])
+{
+    char line[64];
+    size_t header = strlen(INDEX_HEADER);
+
+    if (fgets(line, sizeof(line), fp) == NULL || strncmp(line, INDEX_HEADER, header) != 0)
+    {
+        return 0;
+    }
+
+    line[strcspn(line, "\r\n")] = '\0';
+    if (strlen(line + header) != VELOCE_ID_LEN - 1U)
+    {
+        return 0;
+    }
+
+    memcpy(generation, line + header, VELOCE_ID_LEN);
+    return 1;
+}
+
+/*
+ * Opens the index positioned after its generation line. A missing index, or one written
+ * before indexes carried a generation, is rebuilt first.
+ */
+static FILE *index_open(const char *path, char generation[VELOCE_ID_LEN])
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (fp != NULL && read_index_generation(fp, generation))
+    {
+        return fp;
+    }
+
+    if (fp != NULL)
+    {
+        fclose(fp);
+    }
+
+    if (!index_rebuild())
+    {
+        return NULL;
+    }
+
+    fp = fopen(path, "rb");
+    if (fp != NULL && !read_index_generation(fp, generation))
+    {
+        fclose(fp);
+        fp = NULL;
+    }
+    return fp;
+}
+
+/* Reads postings appended since the last call; starts over when the file was rebuilt or replaced. */
+static int index_refresh(void)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char generation[VELOCE_ID_LEN];
+    char line[2048];
+    FILE *fp;
+    size_t len;
+    long size;
+    uint64_t span;
+
+    if (index_path(path) != 0)
+    {
+        return 0;
+    }
+
+    fp = index_open(path, generation);
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    if (strcmp(generation, g_index.generation) != 0)
+    {
+        index_clear(&g_index);
+        memcpy(g_index.generation, generation, VELOCE_ID_LEN);
+        g_index.loaded_bytes = ftell(fp);
+    }
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0)
+    {
+        fclose(fp);
+        return 0;
+    }
+
+    if (size == g_index.loaded_bytes || fseek(fp, g_index.loaded_bytes, SEEK_SET) != 0)
+    {
+        fclose(fp);
+        return size == g_index.loaded_bytes;
+    }
+
+    span = trace_begin();
+    while (db_next_line(fp, line, sizeof(line), &len))
+    {
+        FieldSpan fields[INDEX_FIELDS];
+        Posting posting;
+
+        if (!split_field_spans(line, len, fields, INDEX_FIELDS) ||
+            !id_key_from_span(&fields[1], &posting.commit) || !id_key_from_span(&fields[2], &posting.repo))
+        {
+            continue;
+        }
+
+        posting.offset = span_to_u64(&fields[3]);
+        if (g_index.seq == 0U || !id_key_equals(&g_index.last_commit, &posting.commit))
+        {
+            g_index.seq++;
+            g_index.last_commit = posting.commit;
+        }
+        posting.seq = g_index.seq;
+        if (!index_add(&g_index, &fields[0], &posting))
+        {
+            fclose(fp);
+            index_clear(&g_index);
+            return 0;
+        }
+    }
+
+    g_index.loaded_bytes = ftell(fp);
+    fclose(fp);
+    trace_end("load messages.idx", span, 0U);
+    return 1;
+}
+
+static int compare_key(const IdKey *a, const IdKey *b)
+{
+    if (a->hi != b->hi)
+    {
+        return a->hi < b->hi ? -1 : 1;
+    }
+    if (a->lo != b->lo)
+    {
+        return a->lo < b->lo ? -1 : 1;
+    }
+    return 0;
+}
+
+static int compare_id_key(const void *a, const void *b)
+{
+    return compare_key((const IdKey *)a, (const IdKey *)b);
+}
+
+/* Postings are ordered by `seq`, which is unique per commit. */
+static int list_contains(const TokenList *list, const Posting *needle)
+{
+    size_t lo = 0U;
+    size_t hi = list->count;
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2U;
+        const Posting *p = &list->postings[mid];
+
+        if (p->seq == needle->seq)
+        {
+            return id_key_equals(&p->commit, &needle->commit);
+        }
+        if (p->seq < needle->seq)
+        {
+            lo = mid + 1U;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return 0;
+}
+
+/* `sorted_repos` is NULL when any repository is allowed. */
+static int repo_allowed(const IdKey *sorted_repos, size_t repo_count, const IdKey *repo)
+{
+    return sorted_repos == NULL || bsearch(repo, sorted_repos, repo_count, sizeof(IdKey), compare_id_key) != NULL;
+}
+
+/*
+ * Finds commits whose message contains every word of `query`, restricted to `repos` unless it
+ * is NULL. Hits are returned in the order their commits were indexed and allocated from `arena`.
+ */
+int message_index_search(const char *query, const IdKey *repos, size_t repo_count, Arena *arena,
+                         MessageHit **hits, size_t *count)
+{
+    char tokens[INDEX_MAX_TOKENS][INDEX_TOKEN_LEN + 1];
+    const TokenList *lists[INDEX_MAX_TOKENS];
+    IdKey *allowed = NULL;
+    size_t token_count;
+    size_t smallest = 0U;
+    size_t found = 0U;
+    size_t i;
+    MessageHit *out;
+
+    *hits = NULL;
+    *count = 0U;
+
+    if (!index_refresh())
+    {
+        return 0;
+    }
+
+    token_count = tokenize(query, strlen(query), tokens);
+    if (token_count == 0U)
+    {
+        return 1;
+    }
+
+    for (i = 0U; i < token_count; i++)
+    {
+        size_t len = strlen(tokens[i]);
+
+        lists[i] = index_find(&g_index, tokens[i], len, token_hash(tokens[i], len));
+        if (lists[i] == NULL)
+        {
+            return 1;
+        }
+        if (lists[i]->count < lists[smallest]->count)
+        {
+            smallest = i;
+        }
+    }
+
+    if (repos != NULL)
+    {
+        allowed = (IdKey *)arena_alloc(arena, (repo_count + 1U) * sizeof(IdKey));
+        if (allowed == NULL)
+        {
+            return 0;
+        }
+        memcpy(allowed, repos, repo_count * sizeof(IdKey));
+        qsort(allowed, repo_count, sizeof(IdKey), compare_id_key);
+    }
+
+    out = (MessageHit *)arena_alloc(arena, lists[smallest]->count * sizeof(MessageHit));
+    if (out == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 0U; i < lists[smallest]->count; i++)
+    {
+        const Posting *posting = &lists[smallest]->postings[i];
+        size_t t;
+        int match = repo_allowed(allowed, repo_count, &posting->repo);
+
+        for (t = 0U; match && t < token_count; t++)
+        {
+            if (t != smallest)
+            {
+                match = list_contains(lists[t], posting);
+            }
+        }
+
+        if (match)
+        {
+            out[found].commit = posting->commit;
+            out[found].repo = posting->repo;
+            out[found].offset = posting->offset;
+            found++;
+        }
+    }
+
+    *hits = out;
+    *count = found;
+    return 1;
+}
+
+/*
+ * Reads the commit a search hit points at. A record that is no longer at the indexed offset
+ * means the index is stale: it is removed so the next search rebuilds it, and 0 is returned.
+ */
+int message_hit_commit(const MessageHit *hit, CommitRecord *commit)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char line[2048];
+    FILE *db = NULL;
+    int found;
+
+    if (commit_shard_path(&hit->repo, path) == 0)
+    {
+        db = fopen(path, "rb");
+    }
+
+    found = db != NULL && fseek(db, (long)hit->offset, SEEK_SET) == 0 && db_next_line(db, line, sizeof(line), NULL) &&
+            parse_commit_line(line, commit) && id_key_equals(&commit->id, &hit->commit);
+    if (db != NULL)
+    {
+        fclose(db);
+    }
+
+    if (!found && index_path(path) == 0)
+    {
+        (void)remove(path);
+    }
+
+    return found;
+}
@@ -0,0 +1,314 @@
+#include "vcs.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAPSHOT_CACHE_DEFAULT_MB 64U
+#define SNAPSHOT_CACHE_MIN_SLOTS 256U
+
+/*
+ * Process-wide LRU of snapshot contents keyed by snapshot id. Callers hold a reference while
+ * they read the bytes; eviction only frees entries nobody holds, so the cache may briefly run
+ * over budget while large snapshots are in use. A snapshot bigger than the whole budget is
+ * read into an uncached entry that is freed on release.
+ */
+typedef struct CachedSnapshot CachedSnapshot;
+
+struct CachedSnapshot
+{
+    IdKey id;
+    CachedSnapshot *chain;
+    CachedSnapshot *newer;
+    CachedSnapshot *older;
+    size_t len;
+    int refs;
+    int cached;
+};
+
+#define SNAPSHOT_HEADER ((sizeof(CachedSnapshot) + 15U) & ~(size_t)15U)
+
+static CachedSnapshot **g_slots;
+static size_t g_slot_count;
+static size_t g_entry_count;
+static CachedSnapshot *g_newest;
+static CachedSnapshot *g_oldest;
+static size_t g_bytes;
+static size_t g_budget = (size_t)-1;
+static int g_cache_lock;
+
+static void cache_lock(void)
+{
+    while (!worker_spin_trylock(&g_cache_lock))
+    {
+    }
+}
+
+static void cache_unlock(void)
+{
+    worker_spin_unlock(&g_cache_lock);
+}
+
+static size_t cache_budget(void)
+{
+    if (g_budget == (size_t)-1)
+    {
+        const char *env = getenv("VELOCE_SNAPSHOT_CACHE_MB");
+        unsigned long mb = SNAPSHOT_CACHE_DEFAULT_MB;
+
+        if (env != NULL && env[0] != '\0')
+        {
+            char *end;
+            unsigned long parsed = strtoul(env, &end, 10);
+
+            if (*end == '\0')
+            {
+                mb = parsed;
+            }
+        }
+
+        g_budget = (size_t)mb * 1024U * 1024U;
+    }
+
+    return g_budget;
+}
+
+static char *entry_data(CachedSnapshot *entry)
+{
+    return (char *)entry + SNAPSHOT_HEADER;
+}
+
+static CachedSnapshot **slot_for(const IdKey *id)
+{
+    return &g_slots[id_key_hash(id) & (g_slot_count - 1U)];
+}
+
+/* Doubles the chain table so chains stay around one entry long as the cache fills. */
+static void grow_slots(void)
+{
+    size_t count = g_slot_count == 0U ? SNAPSHOT_CACHE_MIN_SLOTS : g_slot_count * 2U;
+    CachedSnapshot **slots = (CachedSnapshot **)calloc(count, sizeof(CachedSnapshot *));
+    CachedSnapshot *entry;
+
+    if (slots == NULL)
+    {
+        return;
+    }
+
+    free(g_slots);
+    g_slots = slots;
+    g_slot_count = count;
+
+    for (entry = g_newest; entry != NULL; entry = entry->older)
+    {
+        CachedSnapshot **slot = slot_for(&entry->id);
+
+        entry->chain = *slot;
+        *slot = entry;
+    }
+}
+
+static void lru_unlink(CachedSnapshot *entry)
+{
+    if (entry->newer != NULL)
+    {
+        entry->newer->older = entry->older;
+    }
+    else
+    {
+        g_newest = entry->older;
+    }
+
+    if (entry->older != NULL)
+    {
+        entry->older->newer = entry->newer;
+    }
+    else
+    {
+        g_oldest = entry->newer;
+    }
+}
+
+static void lru_push(CachedSnapshot *entry)
+{
+    entry->newer = NULL;
+    entry->older = g_newest;
+    if (g_newest != NULL)
+    {
+        g_newest->newer = entry;
+    }
+    g_newest = entry;
+    if (g_oldest == NULL)
+    {
+        g_oldest = entry;
+    }
+}
+
+static void cache_remove(CachedSnapshot *entry)
+{
+    CachedSnapshot **slot = slot_for(&entry->id);
+
+    while (*slot != entry)
+    {
+        slot = &(*slot)->chain;
+    }
+    *slot = entry->chain;
+
+    lru_unlink(entry);
+    entry->cached = 0;
+    g_bytes -= entry->len;
+    g_entry_count--;
+}
+
+/* Frees unreferenced entries from the cold end until the cache fits its budget. */
+static void evict_to_budget(size_t budget)
+{
+    CachedSnapshot *entry = g_oldest;
+
+    while (entry != NULL && g_bytes > budget)
+    {
+        CachedSnapshot *newer = entry->newer;
+
+        if (entry->refs == 0)
+        {
+            cache_remove(entry);
+            free(entry);
+            stats_add(STAT_SNAPSHOT_CACHE_EVICTIONS, 1U);
+        }
+        entry = newer;
+    }
+}
+
+static CachedSnapshot *cache_find(const IdKey *id)
+{
+    CachedSnapshot *entry;
+
+    if (g_slot_count == 0U)
+    {
+        return NULL;
+    }
+
+    for (entry = *slot_for(id); entry != NULL; entry = entry->chain)
+    {
+        if (id_key_equals(&entry->id, id))
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns the NUL-terminated contents of a snapshot, served from memory when possible. The
+ * pointer stays valid until the matching snapshot_cache_release; NULL if it cannot be read.
+ */
+const char *snapshot_cache_acquire(const IdKey *snapshot, size_t *len)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    CachedSnapshot *entry;
+    CachedSnapshot *existing;
+    size_t budget = cache_budget();
+    char *content;
+
+    cache_lock();
+    entry = cache_find(snapshot);
+    if (entry != NULL)
+    {
+        entry->refs++;
+        lru_unlink(entry);
+        lru_push(entry);
+        cache_unlock();
+        stats_add(STAT_SNAPSHOT_CACHE_HITS, 1U);
+        *len = entry->len;
+        return entry_data(entry);
+    }
+    cache_unlock();
+
+    stats_add(STAT_SNAPSHOT_CACHE_MISSES, 1U);
+    if (build_snapshot_path(snapshot, path) != 0 || read_text_file_reserve(path, SNAPSHOT_HEADER, &content, len) != 0)
+    {
+        return NULL;
+    }
+
+    entry = (CachedSnapshot *)(void *)(content - SNAPSHOT_HEADER);
+    entry->id = *snapshot;
+    entry->chain = NULL;
+    entry->newer = NULL;
+    entry->older = NULL;
+    entry->len = *len;
+    entry->refs = 1;
+    entry->cached = 0;
+
+    if (budget == 0U || *len > budget)
+    {
+        return content;
+    }
+
+    cache_lock();
+    /* Another thread may have loaded the same snapshot while this one was reading it. */
+    existing = cache_find(snapshot);
+    if (existing != NULL)
+    {
+        existing->refs++;
+        cache_unlock();
+        free(entry);
+        return entry_data(existing);
+    }
+
+    if (g_entry_count >= g_slot_count)
+    {
+        grow_slots();
+    }
+
+    if (g_slot_count > 0U)
+    {
+        CachedSnapshot **slot = slot_for(snapshot);
+
+        entry->chain = *slot;
+        *slot = entry;
+        lru_push(entry);
+        entry->cached = 1;
+        g_bytes += entry->len;
+        g_entry_count++;
+        evict_to_budget(budget);
+    }
+    cache_unlock();
+
+    return content;
+}
+
+void snapshot_cache_release(const char *content)
+{
+    CachedSnapshot *entry;
+    int orphan;
+
+    if (content == NULL)
+    {
+        return;
+    }
+
+    entry = (CachedSnapshot *)(void *)(content - SNAPSHOT_HEADER);
+    cache_lock();
+    entry->refs--;
+    orphan = entry->refs == 0 && !entry->cached;
+    if (entry->refs == 0 && g_bytes > cache_budget())
+    {
+        evict_to_budget(cache_budget());
+    }
+    cache_unlock();
+
+    if (orphan)
+    {
+        free(entry);
+    }
+}
+
+/* Changes the memory budget; 0 disables caching and drops every unreferenced entry. */
+void snapshot_cache_set_budget(size_t bytes)
+{
+    cache_lock();
+    g_budget = bytes;
+    evict_to_budget(bytes);
+    cache_unlock();
+}
@@ -0,0 +1,226 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#define STAT_ATOMIC_ADD(p, n) (void)InterlockedExchangeAdd64((volatile LONG64 *)(p), (LONG64)(n))
+#else
+#define STAT_ATOMIC_ADD(p, n) (void)__atomic_fetch_add((p), (uint64_t)(n), __ATOMIC_RELAXED)
+#endif
+
+/*
+ * Log-linear histogram in the spirit of HdrHistogram: values below 16ns get their own
+ * bucket, above that every power of two is split into 16 sub-buckets (~6% precision).
+ */
+#define STAT_SUB_BUCKETS 16U
+#define STAT_BUCKETS (61U * STAT_SUB_BUCKETS)
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[STAT_BUCKETS];
+} StatHistogram;
+
+static const char *const k_op_names[STAT_OP_COUNT] = {
+    "login", "repo_open", "commit", "log", "revert", "file_read", "file_write", "db_append",
+};
+
+static const char *const k_counter_names[STAT_COUNTER_COUNT] = {
+    "records_scanned", "bytes_read", "bytes_written", "fsyncs",
+    "snapshot_cache_hits", "snapshot_cache_misses", "snapshot_cache_evictions",
+};
+
+static StatHistogram g_histograms[STAT_OP_COUNT];
+static uint64_t g_counters[STAT_COUNTER_COUNT];
+static char g_stats_path[VELOCE_PATH_LEN + 1];
+
+static unsigned int bucket_index(uint64_t ns)
+{
+    unsigned int shift = 0U;
+
+    if (ns < STAT_SUB_BUCKETS)
+    {
+        return (unsigned int)ns;
+    }
+
+    while ((ns >> shift) >= 2U * STAT_SUB_BUCKETS)
+    {
+        shift++;
+    }
+
+    return (shift + 1U) * STAT_SUB_BUCKETS + (unsigned int)((ns >> shift) - STAT_SUB_BUCKETS);
+}
+
+static uint64_t bucket_midpoint(unsigned int index)
+{
+    unsigned int shift;
+    uint64_t low;
+
+    if (index < STAT_SUB_BUCKETS)
+    {
+        return index;
+    }
+
+    shift = index / STAT_SUB_BUCKETS - 1U;
+    low = (uint64_t)(STAT_SUB_BUCKETS + index % STAT_SUB_BUCKETS) << shift;
+    return low + (((uint64_t)1 << shift) >> 1);
+}
+
+static uint64_t percentile(const StatHistogram *h, double pct)
+{
+    uint64_t target;
+    uint64_t seen = 0U;
+    unsigned int i;
+
+    if (h->count == 0U)
+    {
+        return 0U;
+    }
+
+    target = (uint64_t)((double)h->count * pct / 100.0);
+    if (target == 0U)
+    {
+        target = 1U;
+    }
+
+    for (i = 0U; i < STAT_BUCKETS; i++)
+    {
+        seen += h->buckets[i];
+        if (seen >= target)
+        {
+            uint64_t value = bucket_midpoint(i);
+            return value < h->max_ns ? value : h->max_ns;
+        }
+    }
+
+    return h->max_ns;
+}
+
+void stats_record(StatOp op, uint64_t ns)
+{
+    StatHistogram *h;
+    unsigned int index;
+
+    if ((unsigned int)op >= STAT_OP_COUNT)
+    {
+        return;
+    }
+
+    h = &g_histograms[op];
+    index = bucket_index(ns);
+    if (index >= STAT_BUCKETS)
+    {
+        index = STAT_BUCKETS - 1U;
+    }
+
+    STAT_ATOMIC_ADD(&h->count, 1U);
+    STAT_ATOMIC_ADD(&h->total_ns, ns);
+    STAT_ATOMIC_ADD(&h->buckets[index], 1U);
+
+    /* A lost race only under-reports the max by one sample; good enough for a diagnostic. */
+    if (ns > h->max_ns)
+    {
+        h->max_ns = ns;
+    }
+}
+
+uint64_t stats_op_begin(void)
+{
+    return monotonic_ns();
+}
+
+void stats_op_end(StatOp op, uint64_t start_ns)
+{
+    stats_record(op, monotonic_ns() - start_ns);
+    if ((unsigned int)op < STAT_OP_COUNT)
+    {
+        trace_end(k_op_names[op], start_ns, 0U);
+    }
+}
+
+void stats_add(StatCounter counter, uint64_t amount)
+{
+    if ((unsigned int)counter >= STAT_COUNTER_COUNT)
+    {
+        return;
+    }
+
+    STAT_ATOMIC_ADD(&g_counters[counter], amount);
+}
+
+uint64_t stats_counter(StatCounter counter)
+{
+    return (unsigned int)counter < STAT_COUNTER_COUNT ? g_counters[counter] : 0U;
+}
+
+void stats_write(FILE *fp)
+{
+    unsigned int i;
+
+    if (fp == NULL)
+    {
+        return;
+    }
+
+    (void)fprintf(fp, "%-12s %10s %12s %12s %12s %12s %12s %12s\n",
+                  "operation", "count", "mean_us", "p50_us", "p90_us", "p99_us", "p999_us", "max_us");
+    for (i = 0U; i < STAT_OP_COUNT; i++)
+    {
+        const StatHistogram *h = &g_histograms[i];
+        double mean = h->count > 0U ? (double)h->total_ns / (double)h->count : 0.0;
+
+        (void)fprintf(fp, "%-12s %10llu %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n",
+                      k_op_names[i],
+                      (unsigned long long)h->count,
+                      mean / 1000.0,
+                      (double)percentile(h, 50.0) / 1000.0,
+                      (double)percentile(h, 90.0) / 1000.0,
+                      (double)percentile(h, 99.0) / 1000.0,
+                      (double)percentile(h, 99.9) / 1000.0,
+                      (double)h->max_ns / 1000.0);
+    }
+
+    (void)fprintf(fp, "\n");
+    for (i = 0U; i < STAT_COUNTER_COUNT; i++)
+    {
+        (void)fprintf(fp, "%-16s %llu\n", k_counter_names[i], (unsigned long long)g_counters[i]);
+    }
+}
+
+static void stats_dump_at_exit(void)
+{
+    FILE *fp;
+
+    if (strcmp(g_stats_path, "-") == 0)
+    {
+        stats_write(stderr);
+        return;
+    }
+
+    fp = fopen(g_stats_path, "wb");
+    if (fp == NULL)
+    {
+        return;
+    }
+
+    stats_write(fp);
+    fclose(fp);
+}
+
+void stats_init(void)
+{
+    const char *path = getenv("VELOCE_STATS");
+
+    if (path == NULL || path[0] == '\0' || g_stats_path[0] != '\0')
+    {
+        return;
+    }
+
+    (void)snprintf(g_stats_path, sizeof(g_stats_path), "%s", path);
+    (void)atexit(stats_dump_at_exit);
+}
@@ -0,0 +1,154 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#define TRACE_NEXT_TID(p) (unsigned int)InterlockedIncrement((volatile LONG *)(p))
+#else
+#define TRACE_THREAD_LOCAL _Thread_local
+#define TRACE_NEXT_TID(p) __atomic_add_fetch((p), 1U, __ATOMIC_RELAXED)
+#endif
+
+typedef struct
+{
+    const char *name;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    uint64_t bytes;
+    unsigned int tid;
+} TraceEvent;
+
+/* Checked before any other work so disabled tracing costs a call and a branch per span. */
+static int g_trace_enabled = 0;
+
+static char g_trace_path[VELOCE_PATH_LEN + 1];
+static uint64_t g_trace_origin_ns;
+static TraceEvent *g_events;
+static size_t g_event_count;
+static size_t g_event_cap;
+static int g_trace_lock;
+static unsigned int g_next_tid;
+static TRACE_THREAD_LOCAL unsigned int t_tid;
+
+static void write_json_string(FILE *fp, const char *text)
+{
+    const char *p;
+
+    (void)fputc('"', fp);
+    for (p = text; *p != '\0'; p++)
+    {
+        if (*p == '"' || *p == '\\')
+        {
+            (void)fputc('\\', fp);
+        }
+        (void)fputc(*p, fp);
+    }
+    (void)fputc('"', fp);
+}
+
+static void trace_flush_at_exit(void)
+{
+    FILE *fp;
+    size_t i;
+
+    g_trace_enabled = 0;
+
+    fp = fopen(g_trace_path, "wb");
+    if (fp == NULL)
+    {
+        return;
+    }
+
+    (void)fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    (void)fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"vcs\"}}");
+    for (i = 0U; i < g_event_count; i++)
+    {
+        const TraceEvent *ev = &g_events[i];
+
+        (void)fprintf(fp, ",\n{\"name\":");
+        write_json_string(fp, ev->name);
+        (void)fprintf(fp, ",\"cat\":\"veloce\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                      ev->tid,
+                      (double)(ev->start_ns - g_trace_origin_ns) / 1000.0,
+                      (double)ev->dur_ns / 1000.0);
+        if (ev->bytes > 0U)
+        {
+            (void)fprintf(fp, ",\"args\":{\"bytes\":%llu}", (unsigned long long)ev->bytes);
+        }
+        (void)fprintf(fp, "}");
+    }
+    (void)fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    free(g_events);
+    g_events = NULL;
+    g_event_count = 0U;
+    g_event_cap = 0U;
+}
+
+void trace_init(void)
+{
+    const char *path = getenv("VELOCE_TRACE");
+
+    if (path == NULL || path[0] == '\0' || g_trace_enabled)
+    {
+        return;
+    }
+
+    (void)snprintf(g_trace_path, sizeof(g_trace_path), "%s", path);
+    g_trace_origin_ns = monotonic_ns();
+    g_trace_enabled = 1;
+    (void)atexit(trace_flush_at_exit);
+}
+
+uint64_t trace_begin(void)
+{
+    return g_trace_enabled ? monotonic_ns() : 0U;
+}
+
+void trace_end(const char *name, uint64_t start_ns, uint64_t bytes)
+{
+    uint64_t end_ns;
+
+    if (!g_trace_enabled || start_ns == 0U)
+    {
+        return;
+    }
+
+    end_ns = monotonic_ns();
+    if (t_tid == 0U)
+    {
+        t_tid = TRACE_NEXT_TID(&g_next_tid);
+    }
+
+    while (!worker_spin_trylock(&g_trace_lock))
+    {
+    }
+
+    if (g_event_count == g_event_cap)
+    {
+        size_t cap = g_event_cap == 0U ? 4096U : g_event_cap * 2U;
+        TraceEvent *next = (TraceEvent *)realloc(g_events, cap * sizeof(TraceEvent));
+
+        if (next == NULL)
+        {
+            worker_spin_unlock(&g_trace_lock);
+            return;
+        }
+        g_events = next;
+        g_event_cap = cap;
+    }
+
+    g_events[g_event_count].name = name;
+    g_events[g_event_count].start_ns = start_ns;
+    g_events[g_event_count].dur_ns = end_ns - start_ns;
+    g_events[g_event_count].bytes = bytes;
+    g_events[g_event_count].tid = t_tid;
+    g_event_count++;
+
+    worker_spin_unlock(&g_trace_lock);
+}
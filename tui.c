@@ -0,0 +1,235 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "vcs.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <conio.h>
+#include <windows.h>
+#else
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Terminal input and output for the interactive client. Nothing in the library calls these;
+ * they are linked into the vcs front-end only.
+ */
+void app_clear_screen(void)
+{
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    COORD home = {0, 0};
+    DWORD written;
+    DWORD cells;
+    HANDLE hstdout = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    if (hstdout == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    if (!GetConsoleScreenBufferInfo(hstdout, &csbi))
+    {
+        return;
+    }
+
+    cells = (DWORD)csbi.dwSize.X * (DWORD)csbi.dwSize.Y;
+    FillConsoleOutputCharacterA(hstdout, ' ', cells, home, &written);
+    FillConsoleOutputAttribute(hstdout, csbi.wAttributes, cells, home, &written);
+    SetConsoleCursorPosition(hstdout, home);
+#else
+    (void)printf("\033[2J\033[H");
+    fflush(stdout);
+#endif
+}
+
+void app_sleep_ms(unsigned int ms)
+{
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec req;
+    req.tv_sec = (time_t)(ms / 1000U);
+    req.tv_nsec = (long)(ms % 1000U) * 1000000L;
+    nanosleep(&req, NULL);
+#endif
+}
+
+int app_getch(void)
+{
+#ifdef _WIN32
+    return _getch();
+#else
+    int ch;
+    struct termios oldt;
+    struct termios newt;
+
+    if (tcgetattr(STDIN_FILENO, &oldt) != 0)
+    {
+        return getchar();
+    }
+
+    newt = oldt;
+    newt.c_lflag &= (tcflag_t) ~(ICANON | ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+    ch = getchar();
+    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+    return ch;
+#endif
+}
+
+void app_pause(const char *prompt)
+{
+    const char *msg = prompt != NULL ? prompt : "Press any key to continue...";
+    (void)printf("%s", msg);
+    (void)fflush(stdout);
+    (void)app_getch();
+    (void)printf("\n");
+}
+
+static void consume_stdin_until_newline(void)
+{
+    int ch;
+
+    do
+    {
+        ch = getchar();
+    } while (ch != '\n' && ch != EOF);
+}
+
+int read_line(const char *prompt, char *buffer, size_t size)
+{
+    size_t len;
+
+    if (buffer == NULL || size < 2U)
+    {
+        return 0;
+    }
+
+    if (prompt != NULL)
+    {
+        (void)printf("%s", prompt);
+    }
+
+    if (fgets(buffer, (int)size, stdin) == NULL)
+    {
+        return 0;
+    }
+
+    len = strlen(buffer);
+    if (len > 0U && buffer[len - 1U] == '\n')
+    {
+        buffer[len - 1U] = '\0';
+    }
+    else
+    {
+        consume_stdin_until_newline();
+    }
+
+    return 1;
+}
+
+int read_password(const char *prompt, char *buffer, size_t size)
+{
+    size_t i = 0U;
+    int ch;
+
+    if (buffer == NULL || size < 2U)
+    {
+        return 0;
+    }
+
+    if (prompt != NULL)
+    {
+        (void)printf("%s", prompt);
+    }
+
+    while (1)
+    {
+        ch = app_getch();
+        if (ch == '\r' || ch == '\n')
+        {
+            break;
+        }
+
+        if (ch == 8 || ch == 127)
+        {
+            if (i > 0U)
+            {
+                i--;
+                (void)printf("\b \b");
+            }
+            continue;
+        }
+
+        if (isprint((unsigned char)ch) && i < size - 1U)
+        {
+            buffer[i++] = (char)ch;
+            (void)printf("*");
+        }
+    }
+
+    buffer[i] = '\0';
+    (void)printf("\n");
+    return 1;
+}
+
+int read_int(const char *prompt, int *value)
+{
+    char line[64];
+    char *endptr;
+    long parsed;
+
+    if (value == NULL)
+    {
+        return 0;
+    }
+
+    if (!read_line(prompt, line, sizeof(line)))
+    {
+        return 0;
+    }
+
+    errno = 0;
+    parsed = strtol(line, &endptr, 10);
+    if (errno != 0 || endptr == line || *endptr != '\0')
+    {
+        return 0;
+    }
+
+    if (parsed < -2147483647L - 1L || parsed > 2147483647L)
+    {
+        return 0;
+    }
+
+    *value = (int)parsed;
+    return 1;
+}
+
+void load(void)
+{
+    app_clear_screen();
+    (void)printf("\n\n");
+    (void)printf(":::     ::: :::::::::: :::         ::::::::   ::::::::  :::::::::: \n");
+    app_sleep_ms(60U);
+    (void)printf(":+:     :+: :+:        :+:        :+:    :+: :+:    :+: :+:        \n");
+    app_sleep_ms(60U);
+    (void)printf("+:+     +:+ +:+        +:+        +:+    +:+ +:+        +:+        \n");
+    app_sleep_ms(60U);
+    (void)printf("+#+     +:+ +#++:++#   +#+        +#+    +:+ +#+        +#++:++#   \n");
+    app_sleep_ms(60U);
+    (void)printf(" +#+   +#+  +#+        +#+        +#+    +#+ +#+        +#+        \n");
+    app_sleep_ms(60U);
+    (void)printf("  #+#+#+#   #+#        #+#        #+#    #+# #+#    #+# #+#        \n");
+    app_sleep_ms(60U);
+    (void)printf("    ###     ########## ##########  ########   ########  ##########\n\n");
+    app_pause("Press any key to continue...");
+}
+
@@ -0,0 +1,259 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void set_session_from_user(Session *session, const UserRecord *user)
+{
+    session->uid = user->uid;
+    (void)snprintf(session->username, sizeof(session->username), "%s", user->username);
+    (void)snprintf(session->name, sizeof(session->name), "%s", user->name);
+}
+
+static int reset_password_flow(void)
+{
+    char username[VELOCE_USERNAME_LEN + 1];
+    char answer[VELOCE_ANSWER_LEN + 1];
+    char new_password[VELOCE_PASSWORD_LEN + 1];
+    char confirm_password[VELOCE_PASSWORD_LEN + 1];
+    UserRecord user;
+
+    app_clear_screen();
+    (void)printf("Reset password\n\n");
+
+    if (!read_line("Username: ", username, sizeof(username)))
+    {
+        return 0;
+    }
+    sanitize_field(username);
+
+    if (!find_user_by_username(username, &user))
+    {
+        (void)printf("No account found for that username.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    (void)printf("Security question: %s\n", user.security_question);
+    if (!read_line("Answer: ", answer, sizeof(answer)))
+    {
+        return 0;
+    }
+
+    if (!user_check_answer(&user, answer))
+    {
+        (void)printf("Verification failed.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    if (!read_password("New password (min 8 chars): ", new_password, sizeof(new_password)))
+    {
+        return 0;
+    }
+    if (!read_password("Confirm password: ", confirm_password, sizeof(confirm_password)))
+    {
+        return 0;
+    }
+
+    if (strcmp(new_password, confirm_password) != 0)
+    {
+        (void)printf("Passwords do not match.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    if (!password_is_valid(new_password))
+    {
+        (void)printf("Password must be at least 8 characters.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    if (!user_set_password(&user.uid, new_password))
+    {
+        (void)printf("Failed to update password.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    (void)printf("Password updated successfully.\n");
+    app_pause(NULL);
+    return 1;
+}
+
+static int login_flow(Session *session)
+{
+    char username[VELOCE_USERNAME_LEN + 1];
+    char password[VELOCE_PASSWORD_LEN + 1];
+    UserRecord user;
+    int choice;
+
+    while (1)
+    {
+        app_clear_screen();
+        (void)printf("Login\n\n");
+
+        if (!read_line("Username: ", username, sizeof(username)))
+        {
+            return 0;
+        }
+        sanitize_field(username);
+
+        if (!read_password("Password: ", password, sizeof(password)))
+        {
+            return 0;
+        }
+
+        if (user_authenticate(username, password, &user))
+        {
+            set_session_from_user(session, &user);
+            (void)printf("Login successful.\n");
+            app_pause(NULL);
+            return 1;
+        }
+
+        (void)printf("\nCredentials did not match.\n");
+        (void)printf("1) Try again\n");
+        (void)printf("2) Reset password\n");
+        (void)printf("3) Back\n");
+
+        if (!read_int("Choice: ", &choice))
+        {
+            choice = 1;
+        }
+
+        if (choice == 2)
+        {
+            (void)reset_password_flow();
+        }
+        else if (choice == 3)
+        {
+            return 0;
+        }
+    }
+}
+
+static int signup_flow(Session *session)
+{
+    UserRecord user;
+    char password[VELOCE_PASSWORD_LEN + 1];
+    char confirm_password[VELOCE_PASSWORD_LEN + 1];
+    char answer[VELOCE_ANSWER_LEN + 1];
+
+    app_clear_screen();
+    (void)printf("Create account\n\n");
+
+    while (1)
+    {
+        if (!read_line("Username (letters/numbers/_/-): ", user.username, sizeof(user.username)))
+        {
+            return 0;
+        }
+        sanitize_field(user.username);
+
+        if (!username_is_valid(user.username))
+        {
+            (void)printf("Username must be at least 3 characters and only use letters, numbers, '_' or '-'.\n");
+            continue;
+        }
+
+        if (find_user_by_username(user.username, NULL))
+        {
+            (void)printf("That username is already in use.\n");
+            continue;
+        }
+
+        break;
+    }
+
+    while (1)
+    {
+        if (!read_password("Password (min 8 chars): ", password, sizeof(password)))
+        {
+            return 0;
+        }
+        if (!read_password("Confirm password: ", confirm_password, sizeof(confirm_password)))
+        {
+            return 0;
+        }
+
+        if (strcmp(password, confirm_password) != 0)
+        {
+            (void)printf("Passwords do not match. Try again.\n");
+            continue;
+        }
+
+        if (!password_is_valid(password))
+        {
+            (void)printf("Password must be at least 8 characters.\n");
+            continue;
+        }
+
+        break;
+    }
+
+    if (!read_line("Full name: ", user.name, sizeof(user.name)) ||
+        !read_line("Security question: ", user.security_question, sizeof(user.security_question)) ||
+        !read_line("Security answer: ", answer, sizeof(answer)))
+    {
+        return 0;
+    }
+
+    if (!user_create(&user, password, answer))
+    {
+        (void)printf("Failed to create account.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    set_session_from_user(session, &user);
+    (void)printf("Account created successfully.\n");
+    app_pause(NULL);
+    return 1;
+}
+
+int verify_auth(Session *session)
+{
+    int choice;
+
+    while (1)
+    {
+        app_clear_screen();
+        (void)printf("Veloce\n");
+        (void)printf("1) Login\n");
+        (void)printf("2) Signup\n");
+        (void)printf("3) Exit\n");
+
+        if (!read_int("Choice: ", &choice))
+        {
+            (void)printf("Please enter a valid number.\n");
+            app_pause(NULL);
+            continue;
+        }
+
+        if (choice == 1)
+        {
+            if (login_flow(session))
+            {
+                return 1;
+            }
+        }
+        else if (choice == 2)
+        {
+            if (signup_flow(session))
+            {
+                return 1;
+            }
+        }
+        else if (choice == 3)
+        {
+            return 0;
+        }
+        else
+        {
+            (void)printf("Please choose 1, 2, or 3.\n");
+            app_pause(NULL);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#include "vcs.h"
+
+#include <stdio.h>
+
+#define BLAME_SHORT_ID 8
+
+void annotate(const RepoRecord *repo)
+{
+    Arena arena;
+    CommitHistory history;
+    BlameLine *lines;
+    size_t count;
+    size_t i;
+
+    app_clear_screen();
+    (void)printf("Annotate %s\n\n", repo->tracked_file);
+
+    arena_init(&arena, 0U);
+    if (!load_commits_for_repo(repo, &arena, &history))
+    {
+        arena_free(&arena);
+        (void)printf("Failed to load commits.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    if (history.count == 0U)
+    {
+        arena_free(&arena);
+        (void)printf("No commits yet.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    if (!blame_tracked_file(repo, &history, &arena, &lines, &count))
+    {
+        arena_free(&arena);
+        (void)printf("Failed to annotate the tracked file.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    for (i = 0U; i < count; i++)
+    {
+        const CommitEntry *entry = lines[i].origin;
+        char id[VELOCE_ID_LEN];
+        char timestamp[VELOCE_TIMESTAMP_LEN];
+
+        if (entry != NULL)
+        {
+            id_key_to_text(&entry->id, id);
+            format_timestamp(entry->timestamp, timestamp);
+            (void)printf("%.*s %.10s %5zu| %.*s\n", BLAME_SHORT_ID, id, timestamp, i + 1U, (int)lines[i].len,
+                         lines[i].text);
+        }
+        else
+        {
+            (void)printf("%-*s %-10s %5zu| %.*s\n", BLAME_SHORT_ID, "--------", "working", i + 1U, (int)lines[i].len,
+                         lines[i].text);
+        }
+    }
+
+    arena_free(&arena);
+    app_pause(NULL);
+}
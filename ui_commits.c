@@ -0,0 +1,300 @@
+#include "vcs.h"
+
+#include <stdio.h>
+
+static int init_repo(RepoRecord *repo)
+{
+    int choice;
+    char path[VELOCE_PATH_LEN + 1];
+    char id[VELOCE_ID_LEN];
+    IdKey commit_id;
+
+    while (1)
+    {
+        app_clear_screen();
+        (void)printf("Repository: %s\n", repo->name);
+        (void)printf("This repository is not initialized yet.\n\n");
+        (void)printf("1) Track an existing file\n");
+        (void)printf("2) Create a new tracked file\n");
+        (void)printf("3) Back\n");
+
+        if (!read_int("Choice: ", &choice))
+        {
+            (void)printf("Please enter a valid number.\n");
+            app_pause(NULL);
+            continue;
+        }
+
+        if (choice == 1)
+        {
+            if (!read_line("Path to file: ", path, sizeof(path)))
+            {
+                return 0;
+            }
+            sanitize_field(path);
+            if (!file_exists(path))
+            {
+                (void)printf("File not found.\n");
+                app_pause(NULL);
+                continue;
+            }
+
+            if (!repo_track_file(repo, path))
+            {
+                (void)printf("Failed to save repository state.\n");
+                app_pause(NULL);
+                return 0;
+            }
+            break;
+        }
+
+        if (choice == 2)
+        {
+            if (!repo_track_file(repo, NULL))
+            {
+                (void)printf("Failed to create a tracked file in the repository workspace.\n");
+                app_pause(NULL);
+                return 0;
+            }
+            break;
+        }
+
+        if (choice == 3)
+        {
+            return 0;
+        }
+
+        (void)printf("Please choose 1, 2, or 3.\n");
+        app_pause(NULL);
+    }
+
+    if (!create_commit_with_message(repo, "Initial commit", &commit_id))
+    {
+        (void)printf("Repository initialized, but initial commit failed.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    id_key_to_text(&commit_id, id);
+    (void)printf("Commit created: %s\n", id);
+
+    (void)printf("Repository initialized successfully.\n");
+    app_pause(NULL);
+    return 1;
+}
+
+static int create_commit(RepoRecord *repo)
+{
+    char message[VELOCE_MSG_LEN + 1];
+    char id[VELOCE_ID_LEN];
+    IdKey commit_id;
+
+    app_clear_screen();
+    (void)printf("Create commit\n\n");
+
+    if (!read_line("Commit message: ", message, sizeof(message)))
+    {
+        return 0;
+    }
+    sanitize_field(message);
+
+    if (message[0] == '\0')
+    {
+        (void)printf("Commit message cannot be empty.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    if (!create_commit_with_message(repo, message, &commit_id))
+    {
+        (void)printf("Commit failed.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    id_key_to_text(&commit_id, id);
+    (void)printf("Commit created: %s\n", id);
+    app_pause(NULL);
+    return 1;
+}
+
+static void view_commits(const RepoRecord *repo)
+{
+    Arena arena;
+    CommitHistory history;
+    size_t i;
+    int loaded;
+    uint64_t start;
+
+    app_clear_screen();
+    (void)printf("Commits for %s\n\n", repo->name);
+
+    arena_init(&arena, 0U);
+    start = stats_op_begin();
+    loaded = load_commits_for_repo(repo, &arena, &history);
+    stats_op_end(STAT_OP_LOG, start);
+
+    if (!loaded)
+    {
+        arena_free(&arena);
+        (void)printf("Failed to load commits.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    if (history.count == 0U)
+    {
+        (void)printf("No commits yet.\n");
+        arena_free(&arena);
+        app_pause(NULL);
+        return;
+    }
+
+    for (i = 0U; i < history.count; i++)
+    {
+        const CommitEntry *entry = &history.items[i];
+        char id[VELOCE_ID_LEN];
+        char timestamp[VELOCE_TIMESTAMP_LEN];
+
+        id_key_to_text(&entry->id, id);
+        format_timestamp(entry->timestamp, timestamp);
+        (void)printf("%zu) %s  %s\n", i + 1U, id, timestamp);
+        (void)printf("    %s\n", entry->message);
+    }
+
+    arena_free(&arena);
+    app_pause(NULL);
+}
+
+static int revert_commit(RepoRecord *repo)
+{
+    Arena arena;
+    CommitHistory history;
+    IdKey target;
+    IdKey commit_id;
+    size_t i;
+    int choice;
+    char id[VELOCE_ID_LEN];
+
+    app_clear_screen();
+    (void)printf("Revert commit\n\n");
+
+    arena_init(&arena, 0U);
+    if (!load_commits_for_repo(repo, &arena, &history))
+    {
+        arena_free(&arena);
+        (void)printf("Failed to load commits.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    if (history.count == 0U)
+    {
+        (void)printf("No commits available.\n");
+        arena_free(&arena);
+        app_pause(NULL);
+        return 0;
+    }
+
+    for (i = 0U; i < history.count; i++)
+    {
+        id_key_to_text(&history.items[i].id, id);
+        (void)printf("%zu) %s  %s\n", i + 1U, id, history.items[i].message);
+    }
+
+    if (!read_int("Select commit number: ", &choice))
+    {
+        arena_free(&arena);
+        (void)printf("Invalid selection.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    if (choice < 1 || (size_t)choice > history.count)
+    {
+        arena_free(&arena);
+        (void)printf("Invalid selection.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    target = history.items[(size_t)choice - 1U].id;
+    arena_free(&arena);
+
+    if (!revert_to_commit(repo, &target, &commit_id))
+    {
+        (void)printf("Failed to revert to that commit.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    id_key_to_text(&commit_id, id);
+    (void)printf("Commit created: %s\n", id);
+
+    (void)printf("Repository reverted successfully.\n");
+    app_pause(NULL);
+    return 1;
+}
+
+void comm(RepoRecord *repo)
+{
+    int choice;
+
+    if (!repo->initialized)
+    {
+        if (!init_repo(repo))
+        {
+            return;
+        }
+    }
+
+    while (1)
+    {
+        app_clear_screen();
+        (void)printf("Repository #%d: %s\n", repo->rid, repo->name);
+        (void)printf("Tracked file: %s\n\n", repo->tracked_file);
+        (void)printf("1) Create commit\n");
+        (void)printf("2) View commits\n");
+        (void)printf("3) Revert to commit\n");
+        (void)printf("4) Search file history\n");
+        (void)printf("5) Annotate tracked file\n");
+        (void)printf("6) Back\n");
+
+        if (!read_int("Choice: ", &choice))
+        {
+            (void)printf("Please enter a valid number.\n");
+            app_pause(NULL);
+            continue;
+        }
+
+        if (choice == 1)
+        {
+            (void)create_commit(repo);
+        }
+        else if (choice == 2)
+        {
+            view_commits(repo);
+        }
+        else if (choice == 3)
+        {
+            (void)revert_commit(repo);
+        }
+        else if (choice == 4)
+        {
+            history_grep(repo);
+        }
+        else if (choice == 5)
+        {
+            annotate(repo);
+        }
+        else if (choice == 6)
+        {
+            return;
+        }
+        else
+        {
+            (void)printf("Please choose 1 to 6.\n");
+            app_pause(NULL);
+        }
+    }
+}
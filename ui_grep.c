@@ -0,0 +1,84 @@
+#include "vcs.h"
+
+#include <stdio.h>
+
+#define GREP_PATTERN_LEN 255U
+
+static void print_change(const CommitEntry *entry, const char *what)
+{
+    char id[VELOCE_ID_LEN];
+    char timestamp[VELOCE_TIMESTAMP_LEN];
+
+    id_key_to_text(&entry->id, id);
+    format_timestamp(entry->timestamp, timestamp);
+    (void)printf("%-10s %s  %s  %s\n", what, id, timestamp, entry->message);
+}
+
+void history_grep(const RepoRecord *repo)
+{
+    char pattern[GREP_PATTERN_LEN + 1];
+    Arena arena;
+    CommitHistory history;
+    signed char *present;
+    size_t read;
+    size_t i;
+    int was_present = 0;
+
+    app_clear_screen();
+    (void)printf("Search file history\n\n");
+
+    if (!read_line("Text to find: ", pattern, sizeof(pattern)) || pattern[0] == '\0')
+    {
+        return;
+    }
+
+    arena_init(&arena, 0U);
+    if (!load_commits_for_repo(repo, &arena, &history))
+    {
+        arena_free(&arena);
+        (void)printf("Failed to load commits.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    if (!history_grep_scan(repo, &history, pattern, &arena, &present, &read))
+    {
+        arena_free(&arena);
+        (void)printf("Failed to load the trigram index.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    (void)printf("\nRead %zu of %zu snapshot(s); the trigram index ruled out the rest.\n\n", read, history.count);
+
+    for (i = 0U; i < history.count; i++)
+    {
+        if (present[i] < 0)
+        {
+            print_change(&history.items[i], "unreadable");
+            continue;
+        }
+
+        if (present[i] && !was_present)
+        {
+            print_change(&history.items[i], "added");
+        }
+        else if (!present[i] && was_present)
+        {
+            print_change(&history.items[i], "removed");
+        }
+        was_present = present[i];
+    }
+
+    if (history.count > 0U)
+    {
+        (void)printf("\nThe text is %s in the latest commit.\n", was_present ? "present" : "not present");
+    }
+    else
+    {
+        (void)printf("No commits yet.\n");
+    }
+
+    arena_free(&arena);
+    app_pause(NULL);
+}
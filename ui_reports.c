@@ -0,0 +1,198 @@
+#include "vcs.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define REPORT_DAYS 14U
+#define REPORT_TOP_USERS 5U
+
+static void print_repo_counts(const Session *session, const CommitTable *table, const uint64_t *counts)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    DbScan scan;
+    FieldSpan fields[VELOCE_REPO_FIELDS];
+    int shown = 0;
+
+    (void)printf("Commits per repository\n");
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_REPOS_DB) != 0 || !db_scan_open(&scan, path))
+    {
+        (void)printf("  (no repositories)\n\n");
+        return;
+    }
+
+    while (db_scan_next(&scan, fields, VELOCE_REPO_FIELDS))
+    {
+        RepoRecord repo;
+        uint32_t index;
+
+        if (!span_key_equals(&fields[1], &session->uid) || !repo_from_fields(fields, &repo))
+        {
+            continue;
+        }
+
+        index = commit_table_find_repo(table, &repo.id);
+        (void)printf("  #%-4d %-32s %8llu\n", repo.rid, repo.name,
+                     (unsigned long long)(index != UINT32_MAX ? counts[index] : 0U));
+        shown++;
+    }
+    db_scan_close(&scan);
+
+    if (shown == 0)
+    {
+        (void)printf("  (no repositories)\n");
+    }
+    (void)printf("\n");
+}
+
+static void print_daily_activity(const CommitTable *table, const uint8_t *selected)
+{
+    const int64_t day_ns = 86400 * VELOCE_NS_PER_SEC;
+    uint64_t counts[REPORT_DAYS];
+    int64_t first;
+    size_t i;
+
+    first = local_day_start(now_timestamp()) - (int64_t)(REPORT_DAYS - 1U) * day_ns;
+    commit_table_count_by_day(table, selected, first, REPORT_DAYS, counts);
+
+    (void)printf("Your activity, last %u days\n", REPORT_DAYS);
+    for (i = 0U; i < REPORT_DAYS; i++)
+    {
+        char day[VELOCE_TIMESTAMP_LEN];
+
+        /* Labelled from midday so a DST shift cannot move the label to a neighbouring date. */
+        format_timestamp(first + (int64_t)i * day_ns + day_ns / 2, day);
+        day[10] = '\0';
+        (void)printf("  %s %8llu\n", day, (unsigned long long)counts[i]);
+    }
+    (void)printf("\n");
+}
+
+static void print_top_users(const CommitTable *table, const uint64_t *counts)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    char names[REPORT_TOP_USERS][VELOCE_USERNAME_LEN + 1];
+    uint32_t top[REPORT_TOP_USERS];
+    size_t top_count = 0U;
+    size_t i;
+    DbScan scan;
+    FieldSpan fields[VELOCE_USER_FIELDS];
+
+    /* Insertion into a short sorted list: the report only ever shows a handful of owners. */
+    for (i = 0U; i < table->owner_count; i++)
+    {
+        size_t pos;
+
+        if (counts[i] == 0U)
+        {
+            continue;
+        }
+
+        if (top_count < REPORT_TOP_USERS)
+        {
+            pos = top_count++;
+        }
+        else if (counts[i] > counts[top[REPORT_TOP_USERS - 1U]])
+        {
+            pos = REPORT_TOP_USERS - 1U;
+        }
+        else
+        {
+            continue;
+        }
+
+        while (pos > 0U && counts[top[pos - 1U]] < counts[i])
+        {
+            top[pos] = top[pos - 1U];
+            pos--;
+        }
+        top[pos] = (uint32_t)i;
+    }
+
+    for (i = 0U; i < top_count; i++)
+    {
+        id_key_to_text(&table->owner_keys[top[i]], names[i]);
+    }
+
+    if (top_count > 0U && path_join(path, sizeof(path), storage_root(), VELOCE_USERS_DB) == 0 && db_scan_open(&scan, path))
+    {
+        while (db_scan_next(&scan, fields, VELOCE_USER_FIELDS))
+        {
+            IdKey uid;
+
+            if (!id_key_from_span(&fields[0], &uid))
+            {
+                continue;
+            }
+            for (i = 0U; i < top_count; i++)
+            {
+                if (id_key_equals(&uid, &table->owner_keys[top[i]]))
+                {
+                    span_copy(names[i], sizeof(names[i]), &fields[1]);
+                }
+            }
+        }
+        db_scan_close(&scan);
+    }
+
+    (void)printf("Most active users\n");
+    for (i = 0U; i < top_count; i++)
+    {
+        (void)printf("  %-32s %8llu\n", names[i], (unsigned long long)counts[top[i]]);
+    }
+    if (top_count == 0U)
+    {
+        (void)printf("  (no commits yet)\n");
+    }
+}
+
+void reports(const Session *session)
+{
+    Arena arena;
+    CommitTable table;
+    uint64_t *repo_counts;
+    uint64_t *owner_counts;
+    uint8_t *selected;
+    uint32_t owner;
+
+    app_clear_screen();
+    (void)printf("Reports\n\n");
+
+    arena_init(&arena, 0U);
+    if (!commit_table_load(&arena, &table))
+    {
+        arena_free(&arena);
+        (void)printf("Failed to load commits.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    repo_counts = (uint64_t *)arena_alloc(&arena, (table.repo_count + 1U) * sizeof(uint64_t));
+    owner_counts = (uint64_t *)arena_alloc(&arena, (table.owner_count + 1U) * sizeof(uint64_t));
+    selected = (uint8_t *)arena_alloc(&arena, table.count + 1U);
+    if (repo_counts == NULL || owner_counts == NULL || selected == NULL)
+    {
+        arena_free(&arena);
+        (void)printf("Out of memory.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    (void)printf("%zu commits across %zu repositories\n\n", table.count, table.repo_count);
+
+    commit_table_count_by_repo(&table, NULL, repo_counts);
+    print_repo_counts(session, &table, repo_counts);
+
+    owner = commit_table_find_owner(&table, &session->uid);
+    memset(selected, owner != UINT32_MAX, table.count);
+    if (owner != UINT32_MAX)
+    {
+        (void)commit_table_select_owner(&table, owner, selected);
+    }
+    print_daily_activity(&table, selected);
+
+    commit_table_count_by_owner(&table, NULL, owner_counts);
+    print_top_users(&table, owner_counts);
+
+    arena_free(&arena);
+    app_pause(NULL);
+}
@@ -0,0 +1,186 @@
+#include "vcs.h"
+
+#include <stdio.h>
+
+static void create_repo(const Session *session)
+{
+    char name[VELOCE_NAME_LEN + 1];
+    RepoRecord repo;
+
+    app_clear_screen();
+    (void)printf("Create repository\n\n");
+
+    if (!read_line("Repository name: ", name, sizeof(name)))
+    {
+        return;
+    }
+    sanitize_field(name);
+
+    if (name[0] == '\0')
+    {
+        (void)printf("Repository name cannot be empty.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    if (!repo_create(&session->uid, name, &repo))
+    {
+        (void)printf("Failed to create repository.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    (void)printf("Repository created as #%d (%s).\n", repo.rid, repo.name);
+    app_pause(NULL);
+}
+
+static void view_repos(const Session *session)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    DbScan scan;
+    FieldSpan fields[VELOCE_REPO_FIELDS];
+    int count = 0;
+    uint64_t span;
+
+    app_clear_screen();
+    (void)printf("Your repositories\n\n");
+
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_REPOS_DB) != 0)
+    {
+        (void)printf("Failed to access repository database.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    span = trace_begin();
+    if (!db_scan_open(&scan, path))
+    {
+        (void)printf("Failed to access repository database.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    while (db_scan_next(&scan, fields, VELOCE_REPO_FIELDS))
+    {
+        RepoRecord repo;
+
+        if (!span_key_equals(&fields[1], &session->uid))
+        {
+            continue;
+        }
+
+        (void)repo_from_fields(fields, &repo);
+        count++;
+        (void)printf("%d) #%d  %s", count, repo.rid, repo.name);
+        if (repo.initialized)
+        {
+            (void)printf("  [initialized]");
+        }
+        (void)printf("\n");
+    }
+
+    db_scan_close(&scan);
+    trace_end("scan repos.db", span, 0U);
+
+    if (count == 0)
+    {
+        (void)printf("No repositories yet.\n");
+    }
+
+    app_pause(NULL);
+}
+
+static int open_repo(const Session *session, RepoRecord *opened)
+{
+    int rid;
+    int found;
+    uint64_t start;
+
+    app_clear_screen();
+    (void)printf("Open repository\n\n");
+
+    if (!read_int("Repository id (#): ", &rid))
+    {
+        (void)printf("Please provide a valid repository id.\n");
+        app_pause(NULL);
+        return 0;
+    }
+
+    start = stats_op_begin();
+    found = load_repo_for_owner(&session->uid, rid, opened);
+    stats_op_end(STAT_OP_REPO_OPEN, start);
+
+    if (!found)
+    {
+        (void)printf("Repository #%d was not found.\n", rid);
+        app_pause(NULL);
+        return 0;
+    }
+
+    (void)printf("Opening repository #%d (%s).\n", opened->rid, opened->name);
+    app_pause(NULL);
+    return 1;
+}
+
+int repo(const Session *session, RepoRecord *opened_repo)
+{
+    int choice;
+
+    while (1)
+    {
+        app_clear_screen();
+        (void)printf("Welcome %s (%s)\n\n", session->name, session->username);
+        (void)printf("1) Create repository\n");
+        (void)printf("2) View repositories\n");
+        (void)printf("3) Open repository\n");
+        (void)printf("4) Search commit messages\n");
+        (void)printf("5) Reports\n");
+        (void)printf("6) Logout\n");
+        (void)printf("7) Exit\n");
+
+        if (!read_int("Choice: ", &choice))
+        {
+            (void)printf("Please enter a valid number.\n");
+            app_pause(NULL);
+            continue;
+        }
+
+        if (choice == 1)
+        {
+            create_repo(session);
+        }
+        else if (choice == 2)
+        {
+            view_repos(session);
+        }
+        else if (choice == 3)
+        {
+            if (open_repo(session, opened_repo))
+            {
+                comm(opened_repo);
+            }
+        }
+        else if (choice == 4)
+        {
+            search_messages(session);
+        }
+        else if (choice == 5)
+        {
+            reports(session);
+        }
+        else if (choice == 6)
+        {
+            return 1;
+        }
+        else if (choice == 7)
+        {
+            return 0;
+        }
+        else
+        {
+            (void)printf("Please choose 1 to 7.\n");
+            app_pause(NULL);
+        }
+    }
+}
+
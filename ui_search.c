@@ -0,0 +1,124 @@
+#include "vcs.h"
+
+#include <stdio.h>
+
+#define SEARCH_MAX_SHOWN 50U
+#define SEARCH_MAX_REPOS 4096U
+
+typedef struct
+{
+    IdKey id;
+    int rid;
+    char name[VELOCE_NAME_LEN + 1];
+} SearchRepo;
+
+static size_t load_user_repos(const Session *session, SearchRepo *repos, IdKey *keys, size_t max)
+{
+    char path[VELOCE_PATH_LEN + 1];
+    DbScan scan;
+    FieldSpan fields[VELOCE_REPO_FIELDS];
+    size_t count = 0U;
+
+    if (path_join(path, sizeof(path), storage_root(), VELOCE_REPOS_DB) != 0 || !db_scan_open(&scan, path))
+    {
+        return 0U;
+    }
+
+    while (count < max && db_scan_next(&scan, fields, VELOCE_REPO_FIELDS))
+    {
+        RepoRecord repo;
+
+        if (!span_key_equals(&fields[1], &session->uid) || !repo_from_fields(fields, &repo))
+        {
+            continue;
+        }
+
+        repos[count].id = repo.id;
+        repos[count].rid = repo.rid;
+        (void)snprintf(repos[count].name, sizeof(repos[count].name), "%s", repo.name);
+        keys[count] = repo.id;
+        count++;
+    }
+
+    db_scan_close(&scan);
+    return count;
+}
+
+static void print_hit(const MessageHit *hit, const SearchRepo *repos, size_t repo_count)
+{
+    CommitRecord commit;
+    char id[VELOCE_ID_LEN];
+    char timestamp[VELOCE_TIMESTAMP_LEN];
+    size_t i;
+
+    id_key_to_text(&hit->commit, id);
+    if (!message_hit_commit(hit, &commit))
+    {
+        (void)printf("%s  (commit record moved; index will be rebuilt)\n", id);
+        return;
+    }
+
+    format_timestamp(commit.timestamp, timestamp);
+    for (i = 0U; i < repo_count; i++)
+    {
+        if (id_key_equals(&repos[i].id, &hit->repo))
+        {
+            (void)printf("#%d %s  %s  %s\n", repos[i].rid, repos[i].name, id, timestamp);
+            break;
+        }
+    }
+    (void)printf("    %s\n", commit.message);
+}
+
+void search_messages(const Session *session)
+{
+    char query[VELOCE_MSG_LEN + 1];
+    SearchRepo *repos;
+    IdKey *keys;
+    size_t repo_count;
+    MessageHit *hits;
+    size_t hit_count;
+    size_t i;
+    Arena arena;
+    int ok;
+
+    app_clear_screen();
+    (void)printf("Search commit messages\n\n");
+
+    if (!read_line("Words to find: ", query, sizeof(query)))
+    {
+        return;
+    }
+
+    arena_init(&arena, 0U);
+    repos = (SearchRepo *)arena_alloc(&arena, SEARCH_MAX_REPOS * sizeof(SearchRepo));
+    keys = (IdKey *)arena_alloc(&arena, SEARCH_MAX_REPOS * sizeof(IdKey));
+    if (repos == NULL || keys == NULL)
+    {
+        arena_free(&arena);
+        return;
+    }
+
+    repo_count = load_user_repos(session, repos, keys, SEARCH_MAX_REPOS);
+    ok = message_index_search(query, keys, repo_count, &arena, &hits, &hit_count);
+    if (!ok)
+    {
+        arena_free(&arena);
+        (void)printf("Failed to search commit messages.\n");
+        app_pause(NULL);
+        return;
+    }
+
+    (void)printf("\n%zu matching commit(s)\n\n", hit_count);
+    for (i = 0U; i < hit_count && i < SEARCH_MAX_SHOWN; i++)
+    {
+        print_hit(&hits[hit_count - 1U - i], repos, repo_count);
+    }
+    if (hit_count > SEARCH_MAX_SHOWN)
+    {
+        (void)printf("... %zu older match(es) not shown\n", hit_count - SEARCH_MAX_SHOWN);
+    }
+
+    arena_free(&arena);
+    app_pause(NULL);
+}
@@ -2,6 +2,8 @@
 #define VCS_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #define VELOCE_ID_LEN 17
 #define VELOCE_USERNAME_LEN 31
@@ -11,18 +13,67 @@
 #define VELOCE_ANSWER_LEN 127
 #define VELOCE_PATH_LEN 511
 #define VELOCE_MSG_LEN 159
+/* Stamps are stored as int64 nanoseconds since 1970 UTC; this sizes their display form. */
 #define VELOCE_TIMESTAMP_LEN 20
+#define VELOCE_NS_PER_SEC 1000000000LL
 #define VELOCE_HASH_HEX_LEN 65
+/* A recorded content hash: 64 hex digits for SHA-256, or "blake3:" and 64 hex digits. */
+#define VELOCE_CONTENT_HASH_LEN 72
+
+#define VELOCE_USER_FIELDS 9U
+#define VELOCE_REPO_FIELDS 7U
+#define VELOCE_COMMIT_FIELDS 6U
+#define VELOCE_COMMIT_REQUIRED_FIELDS 5U
+#define VELOCE_MAX_FIELDS 16U
 
 #define VELOCE_USERS_DB "users.db"
 #define VELOCE_REPOS_DB "repos.db"
+/* Commit logs live in VELOCE_COMMITS_DIR, one per repository; commits.db is the pre-shard layout. */
 #define VELOCE_COMMITS_DB "commits.db"
+#define VELOCE_MESSAGE_INDEX "messages.idx"
+#define VELOCE_CHANGE_LOG "changes.log"
+#define VELOCE_REPLICA_STATE "replica.state"
+/* Names the algorithm new commits hash snapshots with; a root without it uses SHA-256. */
+#define VELOCE_HASH_CONFIG "content.hash"
+
+/* Entry kinds in changes.log. */
+#define CHANGE_APPEND 'a'
+#define CHANGE_WRITE 'w'
+#define CHANGE_SNAPSHOT 's'
 #define VELOCE_SNAPSHOTS_DIR "snapshots"
+#define VELOCE_COMMITS_DIR "commits"
+#define VELOCE_COUNTERS_DIR "counters"
+#define VELOCE_TRIGRAMS_DIR "trigrams"
+#define VELOCE_BLAME_DIR "blame"
 #define VELOCE_WORKSPACE_DIR "workspace"
 
+#ifdef _WIN32
+#define VELOCE_PATH_SEP '\\'
+#else
+#define VELOCE_PATH_SEP '/'
+#endif
+
+/* A view of one '|'-separated field inside a line buffer; not NUL-terminated. */
+typedef struct
+{
+    const char *ptr;
+    size_t len;
+} FieldSpan;
+
+/*
+ * A user, repository or commit id packed six bits per character. Records carry ids in this
+ * form and compare them as integers; the 16-character text only exists in the .db files,
+ * file names and on screen.
+ */
 typedef struct
 {
-    char uid[VELOCE_ID_LEN];
+    uint64_t hi;
+    uint64_t lo;
+} IdKey;
+
+typedef struct
+{
+    IdKey uid;
     char username[VELOCE_USERNAME_LEN + 1];
     char name[VELOCE_NAME_LEN + 1];
     char password_salt[VELOCE_ID_LEN];
@@ -30,65 +81,454 @@ typedef struct
     char security_question[VELOCE_QUESTION_LEN + 1];
     char answer_salt[VELOCE_ID_LEN];
     char answer_hash[VELOCE_HASH_HEX_LEN];
-    char created_at[VELOCE_TIMESTAMP_LEN];
+    int64_t created_at;
 } UserRecord;
 
 typedef struct
 {
-    char id[VELOCE_ID_LEN];
-    char owner_uid[VELOCE_ID_LEN];
+    IdKey id;
+    IdKey owner_uid;
     int rid;
     char name[VELOCE_NAME_LEN + 1];
     int initialized;
     char tracked_file[VELOCE_PATH_LEN + 1];
-    char created_at[VELOCE_TIMESTAMP_LEN];
+    int64_t created_at;
 } RepoRecord;
 
 typedef struct
 {
-    char id[VELOCE_ID_LEN];
-    char repo_id[VELOCE_ID_LEN];
-    char timestamp[VELOCE_TIMESTAMP_LEN];
+    IdKey id;
+    IdKey repo_id;
+    int64_t timestamp;
     char message[VELOCE_MSG_LEN + 1];
-    char snapshot_path[VELOCE_PATH_LEN + 1];
+    /* Commit whose snapshot holds the content; stored as an empty field when it is `id` itself. */
+    IdKey snapshot_id;
+    /* Snapshot hash (see VELOCE_CONTENT_HASH_LEN); empty on lines written before hashes were recorded. */
+    char content_hash[VELOCE_CONTENT_HASH_LEN];
 } CommitRecord;
 
+typedef struct ArenaBlock ArenaBlock;
+
+/* Bump allocator for the transient allocations of one operation, released in one call. */
 typedef struct
 {
-    char uid[VELOCE_ID_LEN];
+    ArenaBlock *head;
+    size_t block_size;
+    size_t used;
+} Arena;
+
+/*
+ * One commit as held in memory by history loads: `snapshot` names the commit whose snapshot
+ * holds the content (the commit itself, or an earlier one for a revert), the repository is
+ * an index into CommitHistory.repos and the message lives in the arena the history was
+ * loaded into.
+ */
+typedef struct
+{
+    IdKey id;
+    IdKey snapshot;
+    int64_t timestamp;
+    const char *message;
+    uint32_t repo;
+    uint32_t message_len;
+} CommitEntry;
+
+typedef struct
+{
+    Arena *arena;
+    CommitEntry *items;
+    size_t count;
+    size_t cap;
+    IdKey *repos;
+    size_t repo_count;
+    size_t repo_cap;
+} CommitHistory;
+
+/*
+ * Every commit as parallel columns, for reports that aggregate over the whole log. Row i is
+ * (repo[i], timestamp[i], message[i]); repo is dictionary-encoded against repo_keys, each
+ * repo maps to an index into owner_keys (or UINT32_MAX) and messages are offsets into
+ * strings. All memory belongs to `arena`.
+ */
+typedef struct
+{
+    Arena *arena;
+    size_t count;
+    size_t cap;
+    uint32_t *repo;
+    int64_t *timestamp;
+    uint32_t *message;
+    char *strings;
+    size_t strings_len;
+    size_t strings_cap;
+    IdKey *repo_keys;
+    uint32_t *repo_owner;
+    size_t repo_count;
+    size_t repo_cap;
+    uint32_t *repo_slots;
+    size_t repo_slot_mask;
+    IdKey *owner_keys;
+    size_t owner_count;
+    size_t owner_cap;
+} CommitTable;
+
+typedef struct
+{
+    IdKey uid;
     char username[VELOCE_USERNAME_LEN + 1];
     char name[VELOCE_NAME_LEN + 1];
 } Session;
 
-void load(void);
+/* A commit found through messages.idx; offset is where its line starts in the repo's commit log. */
+typedef struct
+{
+    IdKey commit;
+    IdKey repo;
+    uint64_t offset;
+} MessageHit;
 
-int verify_auth(Session *session);
-int repo(const Session *session, RepoRecord *opened_repo);
-void comm(RepoRecord *repo);
+/* One line of the tracked file and the commit that last changed it; NULL if not committed yet. */
+typedef struct
+{
+    const char *text;
+    size_t len;
+    const CommitEntry *origin;
+} BlameLine;
+
+/* Where fsck_storage sends what it finds; either callback may be NULL. Calls never overlap. */
+typedef struct
+{
+    void (*problem)(void *ctx, const char *where, const char *what);
+    /* `done` is set on the last call, once every snapshot has been checked. */
+    void (*progress)(void *ctx, uint64_t checked, uint64_t total, int done);
+    void *ctx;
+} FsckReporter;
+
+typedef struct
+{
+    size_t commits;
+    unsigned int threads;
+    /* Snapshots of commits written before hashes were recorded; only checked for presence. */
+    uint64_t unhashed;
+} FsckSummary;
+
+typedef enum
+{
+    BUNDLE_OK,
+    BUNDLE_CANNOT_WRITE,
+    BUNDLE_SNAPSHOT_UNREADABLE,
+    BUNDLE_CANNOT_OPEN,
+    BUNDLE_NOT_A_BUNDLE,
+    BUNDLE_REPO_EXISTS,
+    BUNDLE_NO_OWNER,
+    BUNDLE_CANNOT_STAGE,
+    BUNDLE_HASH_MISMATCH,
+    BUNDLE_CORRUPT
+} BundleStatus;
+
+/* How a bundle export or import went; `commit` is the one a snapshot status is about. */
+typedef struct
+{
+    BundleStatus status;
+    RepoRecord repo;
+    size_t commits;
+    IdKey commit;
+} BundleResult;
+
+typedef enum
+{
+    REPLICATE_OK,
+    REPLICATE_BAD_DEST,
+    REPLICATE_NO_LOG,
+    REPLICATE_STOPPED
+} ReplicateStatus;
+
+typedef struct
+{
+    ReplicateStatus status;
+    /* Set when the run copied the whole root because `dest` had never synced from it. */
+    int seeded;
+    uint64_t changes;
+    uint64_t snapshots;
+    uint64_t bytes;
+} ReplicateResult;
+
+typedef struct
+{
+    uint8_t data[64];
+    uint32_t datalen;
+    uint32_t state[8];
+    uint64_t bitlen;
+} Sha256Ctx;
+
+typedef enum
+{
+    CONTENT_HASH_SHA256,
+    CONTENT_HASH_BLAKE3
+} ContentHash;
+
+/* An incremental BLAKE3 hash: the open chunk plus the chaining values of finished subtrees. */
+typedef struct
+{
+    uint32_t cv[8];
+    uint8_t block[64];
+    uint32_t block_len;
+    uint32_t blocks;
+    uint64_t chunks;
+    uint64_t chunk_base;
+    uint32_t stack[54][8];
+    uint8_t depth;
+} Blake3Ctx;
+
+typedef struct
+{
+    ContentHash algorithm;
+    Sha256Ctx sha;
+    Blake3Ctx blake3;
+} ContentHasher;
+
+typedef struct DbMap DbMap;
+
+/* Iterates the records of one database file, either through stdio or a shared mapping. */
+typedef struct
+{
+    FILE *fp;
+    DbMap *map;
+    const char *cursor;
+    const char *end;
+    char line[2048];
+} DbScan;
+
+typedef enum
+{
+    STAT_OP_LOGIN,
+    STAT_OP_REPO_OPEN,
+    STAT_OP_COMMIT,
+    STAT_OP_LOG,
+    STAT_OP_REVERT,
+    STAT_OP_FILE_READ,
+    STAT_OP_FILE_WRITE,
+    STAT_OP_DB_APPEND,
+    STAT_OP_COUNT
+} StatOp;
+
+typedef enum
+{
+    STAT_RECORDS_SCANNED,
+    STAT_BYTES_READ,
+    STAT_BYTES_WRITTEN,
+    STAT_FSYNCS,
+    STAT_SNAPSHOT_CACHE_HITS,
+    STAT_SNAPSHOT_CACHE_MISSES,
+    STAT_SNAPSHOT_CACHE_EVICTIONS,
+    STAT_COUNTER_COUNT
+} StatCounter;
+
+typedef void (*WorkerFn)(void *arg, unsigned int index);
+typedef void (*BulkReadFn)(void *arg, size_t index, const char *data, size_t len);
+typedef struct BulkReader BulkReader;
+
+typedef struct
+{
+    const char *path;
+    const char *data;
+    size_t len;
+} BulkWrite;
+
+int find_user_by_username(const char *username, UserRecord *result);
+int username_is_valid(const char *username);
+int password_is_valid(const char *password);
+int user_create(UserRecord *user, const char *password, const char *answer);
+int user_authenticate(const char *username, const char *password, UserRecord *user);
+int user_check_answer(const UserRecord *user, const char *answer);
+int user_set_password(const IdKey *uid, const char *password);
+int repo_create(const IdKey *owner_uid, const char *name, RepoRecord *repo);
+int append_repo(const RepoRecord *repo);
+int next_repo_id_for_owner(const IdKey *owner_uid);
+int repo_counter_name(const IdKey *owner_uid, char out[VELOCE_PATH_LEN + 1]);
+int repo_counter_raise(const IdKey *owner_uid, int rid);
+int repo_counters_prepare(void);
+int load_repo_for_owner(const IdKey *owner_uid, int rid, RepoRecord *result);
+int repo_track_file(RepoRecord *repo, const char *path);
+int create_commit_with_message(const RepoRecord *repo, const char *message, IdKey *commit_id);
+int find_commit(const RepoRecord *repo, const IdKey *commit_id, CommitRecord *commit);
+int revert_to_commit(const RepoRecord *repo, const IdKey *target, IdKey *commit_id);
+int snapshot_path_in(const char *root, const IdKey *commit_id, char out[VELOCE_PATH_LEN + 1]);
+int snapshot_path_create(const char *root, const IdKey *commit_id, char out[VELOCE_PATH_LEN + 1]);
+int build_snapshot_path(const IdKey *commit_id, char out[VELOCE_PATH_LEN + 1]);
+int snapshot_store_migrate(void);
+int commit_shard_name(const IdKey *repo_id, char out[VELOCE_PATH_LEN + 1]);
+int commit_shard_path_in(const char *root, const IdKey *repo_id, char out[VELOCE_PATH_LEN + 1]);
+int commit_shard_path(const IdKey *repo_id, char out[VELOCE_PATH_LEN + 1]);
+int commit_shards_migrate(void);
+int load_commits_for_repo(const RepoRecord *repo, Arena *arena, CommitHistory *history);
+int load_commits_between(const RepoRecord *repo, int64_t since, int64_t until, Arena *arena, CommitHistory *history);
+int commit_entry_snapshot_path(const CommitEntry *entry, char out[VELOCE_PATH_LEN + 1]);
+const char *snapshot_cache_acquire(const IdKey *snapshot, size_t *len);
+void snapshot_cache_release(const char *content);
+void snapshot_cache_set_budget(size_t bytes);
+int message_index_append(const CommitRecord *commit, uint64_t db_offset);
+int message_hit_commit(const MessageHit *hit, CommitRecord *commit);
+int history_grep_scan(const RepoRecord *repo, const CommitHistory *history, const char *pattern, Arena *arena,
+                      signed char **present, size_t *read);
+int blame_commit(const CommitHistory *history, size_t target, Arena *arena, IdKey **origins, size_t *count);
+int blame_tracked_file(const RepoRecord *repo, const CommitHistory *history, Arena *arena, BlameLine **lines,
+                       size_t *count);
+int snapshot_trigrams_append(const IdKey *repo, const IdKey *commit, const char *content, size_t len);
+const char *find_substring(const char *hay, size_t hay_len, const char *needle, size_t needle_len);
+long fsck_storage(unsigned int threads, const FsckReporter *reporter, FsckSummary *summary);
+int change_log_record(char kind, const char *name, uint64_t offset);
+int change_log_append(FILE *fp, const char *name);
+int change_log_snapshot(const IdKey *commit_id);
+int replicate_storage(const char *dest, ReplicateResult *result);
+int bundle_export(const RepoRecord *repo, const char *path, int compress, BundleResult *result);
+int bundle_import(const char *path, const IdKey *owner, BundleResult *result);
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+int lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t raw_len);
+int message_index_search(const char *query, const IdKey *repos, size_t repo_count, Arena *arena,
+                         MessageHit **hits, size_t *count);
+
+int commit_table_load(Arena *arena, CommitTable *table);
+uint32_t commit_table_find_repo(const CommitTable *table, const IdKey *repo);
+uint32_t commit_table_find_owner(const CommitTable *table, const IdKey *owner);
+const char *commit_table_message(const CommitTable *table, size_t row);
+size_t commit_table_select_range(const CommitTable *table, int64_t from, int64_t until, uint8_t *selected);
+size_t commit_table_select_owner(const CommitTable *table, uint32_t owner, uint8_t *selected);
+void commit_table_count_by_repo(const CommitTable *table, const uint8_t *selected, uint64_t *counts);
+void commit_table_count_by_owner(const CommitTable *table, const uint8_t *selected, uint64_t *counts);
+void commit_table_count_by_day(const CommitTable *table, const uint8_t *selected, int64_t first_day, size_t days,
+                               uint64_t *counts);
+
+int db_next_line(FILE *fp, char *line, size_t size, size_t *out_len);
+int split_field_spans(const char *line, size_t len, FieldSpan fields[], size_t expected);
+int split_field_spans_optional(const char *line, size_t len, FieldSpan fields[], size_t required, size_t expected);
+int span_equals(const FieldSpan *field, const char *text);
+void span_copy(char *dst, size_t dst_size, const FieldSpan *field);
+int span_to_int(const FieldSpan *field);
+int id_key_from_span(const FieldSpan *field, IdKey *key);
+int id_key_from_text(const char *text, IdKey *key);
+void id_key_to_text(const IdKey *key, char out[VELOCE_ID_LEN]);
+int id_key_equals(const IdKey *a, const IdKey *b);
+uint64_t id_key_hash(const IdKey *key);
+int span_key_equals(const FieldSpan *field, const IdKey *key);
+int user_from_fields(const FieldSpan fields[VELOCE_USER_FIELDS], UserRecord *user);
+int repo_from_fields(const FieldSpan fields[VELOCE_REPO_FIELDS], RepoRecord *repo);
+int commit_from_fields(const FieldSpan fields[VELOCE_COMMIT_FIELDS], CommitRecord *commit);
+int snapshot_id_from_span(const FieldSpan *field, const IdKey *commit_id, IdKey *snapshot_id);
+int db_mmap_enabled(void);
+void db_mmap_set(int enabled);
+int db_scan_open(DbScan *scan, const char *path);
+int db_scan_next(DbScan *scan, FieldSpan fields[], size_t expected);
+int db_scan_next_optional(DbScan *scan, FieldSpan fields[], size_t required, size_t expected);
+int64_t db_scan_size(DbScan *scan);
+int db_scan_seek(DbScan *scan, int64_t offset);
+void db_scan_close(DbScan *scan);
+
+int parse_user_line(const char *line, UserRecord *user);
+int write_user_line(FILE *fp, const UserRecord *user);
+int parse_repo_line(const char *line, RepoRecord *repo);
+int write_repo_line(FILE *fp, const RepoRecord *repo);
+int parse_commit_line(const char *line, CommitRecord *commit);
+int write_commit_line(FILE *fp, const CommitRecord *commit);
 
 int ensure_storage_ready(void);
 const char *storage_root(void);
+void storage_set_root(const char *root);
 
-void app_clear_screen(void);
-void app_pause(const char *prompt);
-void app_sleep_ms(unsigned int ms);
-int app_getch(void);
-
-int read_line(const char *prompt, char *buffer, size_t size);
-int read_password(const char *prompt, char *buffer, size_t size);
-int read_int(const char *prompt, int *value);
 void sanitize_field(char *value);
 void trim_whitespace(char *value);
 
 void generate_id(char out[VELOCE_ID_LEN]);
-void now_timestamp(char out[VELOCE_TIMESTAMP_LEN]);
+void generate_key(IdKey *key);
+uint64_t monotonic_ns(void);
+int64_t now_timestamp(void);
+int64_t parse_timestamp(const char *text, size_t len);
+int parse_time_arg(const char *text, int64_t now, int64_t *out);
+int64_t local_day_start(int64_t ns);
+void format_timestamp(int64_t ns, char out[VELOCE_TIMESTAMP_LEN]);
 void hash_secret(const char *secret, const char *salt, char out[VELOCE_HASH_HEX_LEN]);
+int content_hash_load(void);
+int content_hash_select(ContentHash algorithm);
+ContentHash content_hash_algorithm(void);
+const char *content_hash_name(ContentHash algorithm);
+int content_hash_from_name(const char *name, ContentHash *algorithm);
+ContentHash content_hash_of(const char *recorded);
+int content_hash_is_valid(const char *recorded);
+void content_hasher_init(ContentHasher *hasher, ContentHash algorithm);
+void content_hasher_update(ContentHasher *hasher, const void *data, size_t len);
+void content_hasher_final(ContentHasher *hasher, char out[VELOCE_CONTENT_HASH_LEN]);
+void hash_content(const char *content, size_t len, char out[VELOCE_CONTENT_HASH_LEN]);
+int content_hash_matches(const char *content, size_t len, const char *recorded);
+void digest_to_hex(const uint8_t digest[32], char out[VELOCE_HASH_HEX_LEN]);
 
 int path_join(char *out, size_t out_size, const char *left, const char *right);
 int ensure_dir(const char *path);
+int dir_for_each(const char *path, int (*visit)(const char *name, void *ctx), void *ctx);
 int file_exists(const char *path);
 int read_text_file(const char *path, char **content, size_t *len);
+int read_text_file_arena(Arena *arena, const char *path, char **content, size_t *len);
+int read_text_file_reserve(const char *path, size_t reserve, char **content, size_t *len);
 int write_text_file(const char *path, const char *content, size_t len);
-int copy_text_file(const char *src, const char *dst);
+int file_sync(FILE *fp);
+
+void sha256_init(Sha256Ctx *ctx);
+void sha256_update(Sha256Ctx *ctx, const uint8_t data[], size_t len);
+void sha256_final(Sha256Ctx *ctx, uint8_t hash[]);
+void blake3_init(Blake3Ctx *ctx);
+void blake3_update(Blake3Ctx *ctx, const uint8_t data[], size_t len);
+void blake3_final(Blake3Ctx *ctx, uint8_t digest[32]);
+void blake3_hash_parallel(const uint8_t data[], size_t len, uint8_t digest[32]);
+
+void arena_init(Arena *arena, size_t block_size);
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+char *arena_strndup(Arena *arena, const char *text, size_t len);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+
+void stats_init(void);
+uint64_t stats_op_begin(void);
+void stats_op_end(StatOp op, uint64_t start_ns);
+void stats_record(StatOp op, uint64_t ns);
+void stats_add(StatCounter counter, uint64_t amount);
+uint64_t stats_counter(StatCounter counter);
+void stats_write(FILE *fp);
+
+void trace_init(void);
+uint64_t trace_begin(void);
+/* `name` must outlive the process (a string literal); events are written at exit. */
+void trace_end(const char *name, uint64_t start_ns, uint64_t bytes);
+
+int worker_spin_trylock(int *lock);
+void worker_spin_unlock(int *lock);
+void worker_yield(void);
+unsigned int worker_default_count(void);
+int run_workers(unsigned int count, WorkerFn fn, void *arg);
+
+int bulk_io_uring_enabled(void);
+void bulk_io_uring_set(int enabled);
+BulkReader *bulk_reader_open(void);
+void bulk_reader_close(BulkReader *reader);
+int bulk_reader_read(BulkReader *reader, const char *const *paths, size_t count, BulkReadFn fn, void *arg);
+int bulk_read_files(const char *const *paths, size_t count, BulkReadFn fn, void *arg);
+int bulk_write_files(const BulkWrite *files, size_t count);
+int bulk_copy_file(const char *src, const char *dst);
+
+/* The interactive client: tui.c and the ui_*.c screens, linked into vcs but not libveloce. */
+void load(void);
+void app_clear_screen(void);
+void app_pause(const char *prompt);
+void app_sleep_ms(unsigned int ms);
+int app_getch(void);
+int read_line(const char *prompt, char *buffer, size_t size);
+int read_password(const char *prompt, char *buffer, size_t size);
+int read_int(const char *prompt, int *value);
+int verify_auth(Session *session);
+int repo(const Session *session, RepoRecord *opened_repo);
+void comm(RepoRecord *repo);
+void reports(const Session *session);
+void search_messages(const Session *session);
+void history_grep(const RepoRecord *repo);
+void annotate(const RepoRecord *repo);
 
 #endif
@@ -0,0 +1,334 @@
+#include "veloce.h"
+#include "vcs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The embedding API over the same storage code vcs uses. The storage root is process-wide
+ * (storage_root()), which is why only one store can be open at a time.
+ */
+struct VeloceStore
+{
+    char root[VELOCE_PATH_LEN + 1];
+};
+
+struct VeloceSession
+{
+    VeloceStore *store;
+    Session session;
+};
+
+struct VeloceRepo
+{
+    RepoRecord record;
+};
+
+struct VeloceLog
+{
+    Arena arena;
+    CommitHistory history;
+};
+
+static VeloceStore *g_open_store;
+
+VeloceStore *veloce_open(const char *root)
+{
+    VeloceStore *store;
+
+    if (g_open_store != NULL)
+    {
+        return NULL;
+    }
+
+    store = (VeloceStore *)calloc(1U, sizeof(VeloceStore));
+    if (store == NULL)
+    {
+        return NULL;
+    }
+
+    storage_set_root(root);
+    if (ensure_storage_ready() != 0)
+    {
+        free(store);
+        return NULL;
+    }
+
+    (void)snprintf(store->root, sizeof(store->root), "%s", storage_root());
+    stats_init();
+    trace_init();
+    g_open_store = store;
+    return store;
+}
+
+void veloce_close(VeloceStore *store)
+{
+    if (store == NULL)
+    {
+        return;
+    }
+
+    if (store == g_open_store)
+    {
+        g_open_store = NULL;
+    }
+    free(store);
+}
+
+int veloce_signup(VeloceStore *store, const char *username, const char *password, const char *name,
+                  const char *question, const char *answer)
+{
+    UserRecord user;
+
+    if (store == NULL || username == NULL || password == NULL || name == NULL || question == NULL ||
+        answer == NULL || strlen(username) > VELOCE_USERNAME_LEN)
+    {
+        return 0;
+    }
+
+    memset(&user, 0, sizeof(user));
+    (void)snprintf(user.username, sizeof(user.username), "%s", username);
+    (void)snprintf(user.name, sizeof(user.name), "%s", name);
+    (void)snprintf(user.security_question, sizeof(user.security_question), "%s", question);
+    return user_create(&user, password, answer);
+}
+
+VeloceSession *veloce_login(VeloceStore *store, const char *username, const char *password)
+{
+    VeloceSession *session;
+    UserRecord user;
+
+    if (store == NULL || username == NULL || password == NULL || !user_authenticate(username, password, &user))
+    {
+        return NULL;
+    }
+
+    session = (VeloceSession *)calloc(1U, sizeof(VeloceSession));
+    if (session == NULL)
+    {
+        return NULL;
+    }
+
+    session->store = store;
+    session->session.uid = user.uid;
+    (void)snprintf(session->session.username, sizeof(session->session.username), "%s", user.username);
+    (void)snprintf(session->session.name, sizeof(session->session.name), "%s", user.name);
+    return session;
+}
+
+void veloce_logout(VeloceSession *session)
+{
+    free(session);
+}
+
+int veloce_reset_password(VeloceStore *store, const char *username, const char *answer, const char *new_password)
+{
+    UserRecord user;
+
+    return store != NULL && username != NULL && answer != NULL && new_password != NULL &&
+           find_user_by_username(username, &user) && user_check_answer(&user, answer) &&
+           user_set_password(&user.uid, new_password);
+}
+
+static VeloceRepo *repo_handle(const RepoRecord *record)
+{
+    VeloceRepo *repo = (VeloceRepo *)malloc(sizeof(VeloceRepo));
+
+    if (repo != NULL)
+    {
+        repo->record = *record;
+    }
+    return repo;
+}
+
+VeloceRepo *veloce_repo_create(VeloceSession *session, const char *name)
+{
+    RepoRecord record;
+
+    if (session == NULL || name == NULL || !repo_create(&session->session.uid, name, &record))
+    {
+        return NULL;
+    }
+
+    return repo_handle(&record);
+}
+
+VeloceRepo *veloce_repo_open(VeloceSession *session, int number)
+{
+    RepoRecord record;
+    uint64_t start;
+    int found;
+
+    if (session == NULL)
+    {
+        return NULL;
+    }
+
+    start = stats_op_begin();
+    found = load_repo_for_owner(&session->session.uid, number, &record);
+    stats_op_end(STAT_OP_REPO_OPEN, start);
+
+    return found ? repo_handle(&record) : NULL;
+}
+
+void veloce_repo_close(VeloceRepo *repo)
+{
+    free(repo);
+}
+
+int veloce_repo_number(const VeloceRepo *repo)
+{
+    return repo != NULL ? repo->record.rid : 0;
+}
+
+const char *veloce_repo_tracked_file(const VeloceRepo *repo)
+{
+    return repo != NULL ? repo->record.tracked_file : "";
+}
+
+int veloce_repo_track(VeloceRepo *repo, const char *path)
+{
+    return repo != NULL && !repo->record.initialized && repo_track_file(&repo->record, path) &&
+           create_commit_with_message(&repo->record, "Initial commit", NULL);
+}
+
+int veloce_commit(VeloceRepo *repo, const char *message, char id[VELOCE_ID_TEXT_LEN])
+{
+    char clean[VELOCE_MSG_LEN + 1];
+    IdKey commit_id;
+
+    if (repo == NULL || message == NULL || !repo->record.initialized)
+    {
+        return 0;
+    }
+
+    (void)snprintf(clean, sizeof(clean), "%s", message);
+    sanitize_field(clean);
+    if (clean[0] == '\0' || !create_commit_with_message(&repo->record, clean, &commit_id))
+    {
+        return 0;
+    }
+
+    if (id != NULL)
+    {
+        id_key_to_text(&commit_id, id);
+    }
+    return 1;
+}
+
+int veloce_revert(VeloceRepo *repo, const char *target, char id[VELOCE_ID_TEXT_LEN])
+{
+    IdKey target_id;
+    IdKey commit_id;
+
+    if (repo == NULL || target == NULL || !repo->record.initialized || !id_key_from_text(target, &target_id) ||
+        !revert_to_commit(&repo->record, &target_id, &commit_id))
+    {
+        return 0;
+    }
+
+    if (id != NULL)
+    {
+        id_key_to_text(&commit_id, id);
+    }
+    return 1;
+}
+
+VeloceLog *veloce_log(VeloceRepo *repo, int64_t since, int64_t until)
+{
+    VeloceLog *log;
+    uint64_t start;
+    int loaded;
+
+    if (repo == NULL)
+    {
+        return NULL;
+    }
+
+    log = (VeloceLog *)malloc(sizeof(VeloceLog));
+    if (log == NULL)
+    {
+        return NULL;
+    }
+
+    arena_init(&log->arena, 0U);
+    start = stats_op_begin();
+    loaded = load_commits_between(&repo->record, since, until, &log->arena, &log->history);
+    stats_op_end(STAT_OP_LOG, start);
+
+    if (!loaded)
+    {
+        veloce_log_free(log);
+        return NULL;
+    }
+    return log;
+}
+
+size_t veloce_log_count(const VeloceLog *log)
+{
+    return log != NULL ? log->history.count : 0U;
+}
+
+int veloce_log_get(const VeloceLog *log, size_t index, VeloceCommitInfo *info)
+{
+    const CommitEntry *entry;
+
+    if (log == NULL || info == NULL || index >= log->history.count)
+    {
+        return 0;
+    }
+
+    entry = &log->history.items[index];
+    id_key_to_text(&entry->id, info->id);
+    info->timestamp = entry->timestamp;
+    info->message = entry->message;
+    return 1;
+}
+
+void veloce_log_free(VeloceLog *log)
+{
+    if (log == NULL)
+    {
+        return;
+    }
+
+    arena_free(&log->arena);
+    free(log);
+}
+
+int veloce_snapshot_read(VeloceRepo *repo, const char *id, char **content, size_t *len)
+{
+    CommitRecord commit;
+    IdKey commit_id;
+    const char *cached;
+    size_t size;
+
+    if (repo == NULL || id == NULL || content == NULL || len == NULL || !id_key_from_text(id, &commit_id) ||
+        !find_commit(&repo->record, &commit_id, &commit))
+    {
+        return 0;
+    }
+
+    cached = snapshot_cache_acquire(&commit.snapshot_id, &size);
+    if (cached == NULL)
+    {
+        return 0;
+    }
+
+    *content = (char *)malloc(size + 1U);
+    if (*content != NULL)
+    {
+        memcpy(*content, cached, size);
+        (*content)[size] = '\0';
+        *len = size;
+    }
+    snapshot_cache_release(cached);
+
+    return *content != NULL;
+}
+
+void veloce_free(void *ptr)
+{
+    free(ptr);
+}
@@ -0,0 +1,73 @@
+#ifndef VELOCE_H
+#define VELOCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * libveloce: accounts, repositories, commits and snapshots of one storage root, for programs
+ * that embed Veloce instead of running vcs. Nothing here reads the terminal or prints.
+ *
+ * Functions returning int return 1 on success and 0 on failure; those returning a handle
+ * return NULL on failure. Every handle is released by its matching close or free call, and
+ * handles must not outlive the store they came from. One store can be open per process, and
+ * calls on it must not run concurrently.
+ *
+ * Ids are 16 characters and are passed as NUL-terminated text. Timestamps are nanoseconds
+ * since 1970 UTC.
+ */
+
+#define VELOCE_ID_TEXT_LEN 17
+
+typedef struct VeloceStore VeloceStore;
+typedef struct VeloceSession VeloceSession;
+typedef struct VeloceRepo VeloceRepo;
+typedef struct VeloceLog VeloceLog;
+
+typedef struct
+{
+    char id[VELOCE_ID_TEXT_LEN];
+    int64_t timestamp;
+    /* Owned by the log it came from. */
+    const char *message;
+} VeloceCommitInfo;
+
+/* Opens the storage root `root`, creating it if needed; NULL uses VELOCE_HOME or .veloce. */
+VeloceStore *veloce_open(const char *root);
+void veloce_close(VeloceStore *store);
+
+int veloce_signup(VeloceStore *store, const char *username, const char *password, const char *name,
+                  const char *question, const char *answer);
+VeloceSession *veloce_login(VeloceStore *store, const char *username, const char *password);
+void veloce_logout(VeloceSession *session);
+int veloce_reset_password(VeloceStore *store, const char *username, const char *answer, const char *new_password);
+
+/* Repositories are numbered per owner from 1, in order of creation. */
+VeloceRepo *veloce_repo_create(VeloceSession *session, const char *name);
+VeloceRepo *veloce_repo_open(VeloceSession *session, int number);
+void veloce_repo_close(VeloceRepo *repo);
+int veloce_repo_number(const VeloceRepo *repo);
+/* Empty until the repository tracks a file. */
+const char *veloce_repo_tracked_file(const VeloceRepo *repo);
+/*
+ * Starts tracking `path`, or a new empty file in the storage root's workspace when `path` is
+ * NULL, and records the initial commit. A repository tracks one file for its whole life.
+ */
+int veloce_repo_track(VeloceRepo *repo, const char *path);
+
+/* Snapshots the tracked file; `id`, when not NULL, receives the new commit's id. */
+int veloce_commit(VeloceRepo *repo, const char *message, char id[VELOCE_ID_TEXT_LEN]);
+/* Restores the tracked file to commit `target` and records that as a new commit. */
+int veloce_revert(VeloceRepo *repo, const char *target, char id[VELOCE_ID_TEXT_LEN]);
+
+/* Commits made in [since, until), oldest first; INT64_MIN and INT64_MAX leave a side open. */
+VeloceLog *veloce_log(VeloceRepo *repo, int64_t since, int64_t until);
+size_t veloce_log_count(const VeloceLog *log);
+int veloce_log_get(const VeloceLog *log, size_t index, VeloceCommitInfo *info);
+void veloce_log_free(VeloceLog *log);
+
+/* Copies the snapshot of commit `id` into a buffer the caller releases with veloce_free. */
+int veloce_snapshot_read(VeloceRepo *repo, const char *id, char **content, size_t *len);
+void veloce_free(void *ptr);
+
+#endif
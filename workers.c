@@ -0,0 +1,156 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "vcs.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+typedef struct
+{
+    WorkerFn fn;
+    void *arg;
+    unsigned int index;
+} WorkerSlot;
+
+#ifdef _WIN32
+static DWORD WINAPI worker_entry(LPVOID param)
+{
+    WorkerSlot *slot = (WorkerSlot *)param;
+    slot->fn(slot->arg, slot->index);
+    return 0;
+}
+#else
+static void *worker_entry(void *param)
+{
+    WorkerSlot *slot = (WorkerSlot *)param;
+    slot->fn(slot->arg, slot->index);
+    return NULL;
+}
+#endif
+
+int worker_spin_trylock(int *lock)
+{
+#ifdef _MSC_VER
+    return InterlockedExchange((volatile LONG *)lock, 1) == 0;
+#else
+    return __atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE) == 0;
+#endif
+}
+
+void worker_spin_unlock(int *lock)
+{
+#ifdef _MSC_VER
+    (void)InterlockedExchange((volatile LONG *)lock, 0);
+#else
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+/* Gives up the processor while waiting on a lock another thread holds for a slow operation. */
+void worker_yield(void)
+{
+#ifdef _WIN32
+    (void)SwitchToThread();
+#else
+    (void)sched_yield();
+#endif
+}
+
+unsigned int worker_default_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (unsigned int)info.dwNumberOfProcessors : 1U;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? (unsigned int)n : 1U;
+#endif
+}
+
+int run_workers(unsigned int count, WorkerFn fn, void *arg)
+{
+    WorkerSlot *slots;
+    unsigned int started = 0U;
+    unsigned int i;
+#ifdef _WIN32
+    HANDLE *threads;
+#else
+    pthread_t *threads;
+#endif
+
+    if (fn == NULL)
+    {
+        return 0;
+    }
+
+    if (count == 0U)
+    {
+        count = 1U;
+    }
+
+    slots = count > 1U ? (WorkerSlot *)calloc(count, sizeof(*slots)) : NULL;
+    threads = count > 1U ? calloc(count, sizeof(*threads)) : NULL;
+    if (slots == NULL || threads == NULL)
+    {
+        free(slots);
+        free(threads);
+        for (i = 0U; i < count; i++)
+        {
+            fn(arg, i);
+        }
+        return 1;
+    }
+
+    /* Slot 0 runs on the calling thread, so a failed spawn only loses parallelism for that slot. */
+    for (i = 1U; i < count; i++)
+    {
+        slots[i].fn = fn;
+        slots[i].arg = arg;
+        slots[i].index = i;
+#ifdef _WIN32
+        threads[i] = CreateThread(NULL, 0, worker_entry, &slots[i], 0, NULL);
+        if (threads[i] == NULL)
+        {
+            break;
+        }
+#else
+        if (pthread_create(&threads[i], NULL, worker_entry, &slots[i]) != 0)
+        {
+            break;
+        }
+#endif
+        started = i;
+    }
+
+    fn(arg, 0U);
+
+    for (i = 1U; i <= started; i++)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        (void)pthread_join(threads[i], NULL);
+#endif
+    }
+
+    /* Run whatever could not be spawned inline so every index is processed exactly once. */
+    for (i = started + 1U; i < count; i++)
+    {
+        fn(arg, i);
+    }
+
+    free(slots);
+    free(threads);
+    return 1;
+}